@@ -0,0 +1,626 @@
+// Benchmark driver for the student database engine, built and run by
+// `make bench`.  It links the engine itself (sdbsc.c is compiled with
+// SDBSC_NO_MAIN) and times the same functions main() calls, one operation
+// at a time, so the numbers are those of the hot paths and not of process
+// start up.
+//
+// Workloads, run in this order on a scratch database:
+//   add_seq      add ids 1..n in order, into an empty database
+//   add_rand     add n distinct random ids up to MAX_STD_ID, into an empty
+//                database; the later workloads use this population
+//   add_rand64   add n random ids above MAX_STD_ID (the id map), into an
+//                empty database
+//   get_uniform  n get_student() calls, ids picked uniformly
+//   get_zipf     n get_student() calls, ids picked with a Zipf distribution
+//   get_packed   n dbpack_get() calls on a packed copy of the population
+//                (see dbpack.h), ids picked uniformly
+//   scan         print_db() of the whole table, -r times
+//   delete       del_student() of half of the population
+//   compact      compress_db() after the deletes
+//   get_miss64   n get_student() calls of random ids above MAX_STD_ID that
+//                are not there, against the add_rand64 population
+//
+// Every workload prints one JSON object per line to stdout:
+//   {"workload":"get_zipf","backend":"fd","ops":50000,"secs":0.052,
+//    "ops_per_sec":961538,"p50_us":0.9,"p99_us":2.1,"p999_us":9.8,
+//    "max_us":41.0}
+//
+// The storage backend comes from the environment like for sdbsc, for
+// example:  SDB_BACKEND=mmap make bench BENCH_ARGS="-n 20000 -w get_zipf"
+//
+// -g seq|rand|rand64 prints the synthetic data set as bulk input for
+// ./sdbsc -b instead of running anything.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbio.h"
+#include "dbfmt.h"
+#include "dbmap.h"
+#include "dbbloom.h"
+#include "dbpack.h"
+#include "wal.h"
+#include "nameidx.h"
+#include "gpaidx.h"
+#include "trieidx.h"
+
+#define BENCH_DEFAULT_OPS 50000
+#define BENCH_DEFAULT_SCANS 20
+#define BENCH_DEFAULT_THETA 0.99
+
+typedef struct bench
+{
+    char *path;       // scratch database file
+    int flags;        // DB_OPEN_* from db_open_flags()
+    const char *name; // backend name for the report
+    int fd;
+    int ops;          // -n
+    int scans;        // -r
+    double theta;     // -z, Zipf skew
+    uint64_t rng;     // splitmix64 state, -s
+    FILE *out;        // the real stdout, sdbsc output goes to /dev/null
+    long long *ids;   // current population, in random order
+    int count;
+    bool deleted;     // delete ran since the last load
+    uint64_t *lat;    // latency of every operation of a workload, in ns
+    double *cdf;      // Zipf cumulative distribution over ranks
+} bench_t;
+
+typedef struct workload
+{
+    const char *name;
+    void (*run)(bench_t *b);
+} workload_t;
+
+static uint64_t next_rand(bench_t *b)
+{
+    uint64_t z = (b->rng += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// uniform in [0, n)
+static uint64_t rand_below(bench_t *b, uint64_t n)
+{
+    return next_rand(b) % n;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// a pronounceable random name of 4 to 10 letters
+static void random_name(bench_t *b, char *buf, size_t size)
+{
+    static const char cons[] = "bcdfghjklmnprstvwz";
+    static const char vow[] = "aeiou";
+    size_t len = 4 + rand_below(b, 7);
+
+    if (len >= size)
+        len = size - 1;
+    for (size_t i = 0; i < len; i++)
+        buf[i] = i % 2 ? vow[rand_below(b, 5)] : cons[rand_below(b, 18)];
+    buf[len] = '\0';
+}
+
+static void shuffle(bench_t *b, long long *ids, int count)
+{
+    for (int i = count - 1; i > 0; i--)
+    {
+        int j = rand_below(b, i + 1);
+        long long t = ids[i];
+        ids[i] = ids[j];
+        ids[j] = t;
+    }
+}
+
+/*
+ *  make_ids
+ *      kind:  "seq", "rand" or "rand64"
+ *
+ *  Fills b->ids with b->ops distinct ids of that kind, seq in ascending
+ *  order, the others in random order.
+ *
+ *  returns:  number of ids, -1 for an unknown kind
+ */
+static int make_ids(bench_t *b, const char *kind)
+{
+    int n = b->ops;
+
+    if (strcmp(kind, "seq") == 0 || strcmp(kind, "rand") == 0)
+    {
+        if (n > MAX_STD_ID)
+            n = MAX_STD_ID;
+        if (kind[0] == 's')
+        {
+            for (int i = 0; i < n; i++)
+                b->ids[i] = i + 1;
+            return n;
+        }
+
+        // the first n of a shuffled 1..MAX_STD_ID
+        long long *all = malloc(MAX_STD_ID * sizeof(long long));
+        if (all == NULL)
+            return -1;
+        for (int i = 0; i < MAX_STD_ID; i++)
+            all[i] = i + 1;
+        shuffle(b, all, MAX_STD_ID);
+        memcpy(b->ids, all, n * sizeof(long long));
+        free(all);
+        return n;
+    }
+
+    if (strcmp(kind, "rand64") == 0)
+    {
+        // 63 random bits never repeat in practice, the adds would report it
+        for (int i = 0; i < n; i++)
+            b->ids[i] = MAX_STD_ID + 1 + (long long)rand_below(b, MAX_STD_ID_64 - MAX_STD_ID);
+        return n;
+    }
+    return -1;
+}
+
+static void fresh_db(bench_t *b)
+{
+    if (b->fd >= 0)
+        close_db(b->fd);
+    b->fd = open_db(b->path, true, b->flags);
+    if (b->fd < 0)
+    {
+        fprintf(stderr, "sdbbench: can not open %s\n", b->path);
+        exit(EXIT_FAIL_DB);
+    }
+    b->count = 0;
+    b->deleted = false;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// nearest rank percentile of the sorted latencies, in microseconds
+static double pct_us(const uint64_t *lat, int n, double p)
+{
+    int i = (int)ceil(p * n) - 1;
+
+    if (i < 0)
+        i = 0;
+    return lat[i] / 1000.0;
+}
+
+static void report(bench_t *b, const char *workload, int n, uint64_t total_ns)
+{
+    double secs = total_ns / 1e9;
+
+    if (n == 0)
+        return;
+    qsort(b->lat, n, sizeof(uint64_t), cmp_u64);
+    fprintf(b->out,
+            "{\"workload\":\"%s\",\"backend\":\"%s\",\"ops\":%d,\"secs\":%.6f,"
+            "\"ops_per_sec\":%.0f,\"p50_us\":%.2f,\"p99_us\":%.2f,\"p999_us\":%.2f,"
+            "\"max_us\":%.2f}\n",
+            workload, b->name, n, secs, secs > 0 ? n / secs : 0.0, pct_us(b->lat, n, 0.50),
+            pct_us(b->lat, n, 0.99), pct_us(b->lat, n, 0.999), b->lat[n - 1] / 1000.0);
+    fflush(b->out);
+}
+
+// adds b->ids[0..n) to an empty database, timing every add_student()
+static void timed_adds(bench_t *b, const char *workload, const char *kind)
+{
+    char fname[16], lname[16];
+    uint64_t start, t;
+    int n;
+
+    fresh_db(b);
+    n = make_ids(b, kind);
+    start = now_ns();
+    for (int i = 0; i < n; i++)
+    {
+        random_name(b, fname, sizeof(fname));
+        random_name(b, lname, sizeof(lname));
+        int gpa = rand_below(b, MAX_STD_GPA + 1);
+
+        t = now_ns();
+        if (add_student(b->fd, b->ids[i], fname, lname, gpa) != NO_ERROR)
+        {
+            fprintf(stderr, "sdbbench: adding %lld failed\n", b->ids[i]);
+            exit(EXIT_FAIL_DB);
+        }
+        b->lat[i] = now_ns() - t;
+    }
+    report(b, workload, n, now_ns() - start);
+    if (kind[0] == 's')
+        shuffle(b, b->ids, n);
+    b->count = n;
+}
+
+static void run_add_seq(bench_t *b)
+{
+    timed_adds(b, "add_seq", "seq");
+}
+
+static void run_add_rand(bench_t *b)
+{
+    timed_adds(b, "add_rand", "rand");
+}
+
+static void run_add_rand64(bench_t *b)
+{
+    timed_adds(b, "add_rand64", "rand64");
+}
+
+// the later workloads need a population, load one without timing it
+static void need_population(bench_t *b)
+{
+    student_t s = EMPTY_STUDENT_RECORD;
+
+    if (b->count > 0)
+        return;
+    fresh_db(b);
+    b->count = make_ids(b, "rand");
+    for (int i = 0; i < b->count; i++)
+    {
+        s.id = b->ids[i];
+        random_name(b, s.fname, sizeof(s.fname));
+        random_name(b, s.lname, sizeof(s.lname));
+        s.gpa = rand_below(b, MAX_STD_GPA + 1);
+        if (db_insert(b->fd, &s) != NO_ERROR)
+            exit(EXIT_FAIL_DB);
+    }
+}
+
+static void timed_gets(bench_t *b, const char *workload, bool zipf)
+{
+    student_t s;
+    uint64_t start, t;
+
+    need_population(b);
+    if (zipf)
+    {
+        // P(rank k) ~ 1 / (k + 1)^theta over the population, the ids are
+        // in random order so the hot ids are spread over the file
+        double sum = 0;
+        for (int k = 0; k < b->count; k++)
+            b->cdf[k] = (sum += 1.0 / pow(k + 1, b->theta));
+        for (int k = 0; k < b->count; k++)
+            b->cdf[k] /= sum;
+    }
+
+    start = now_ns();
+    for (int i = 0; i < b->ops; i++)
+    {
+        int k;
+        if (zipf)
+        {
+            double u = (next_rand(b) >> 11) * (1.0 / 9007199254740992.0);
+            int lo = 0, hi = b->count - 1;
+            while (lo < hi)
+            {
+                int mid = (lo + hi) / 2;
+                if (b->cdf[mid] < u)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            k = lo;
+        }
+        else
+            k = rand_below(b, b->count);
+
+        t = now_ns();
+        if (get_student(b->fd, b->ids[k], &s) != NO_ERROR)
+        {
+            fprintf(stderr, "sdbbench: student %lld not found\n", b->ids[k]);
+            exit(EXIT_FAIL_DB);
+        }
+        b->lat[i] = now_ns() - t;
+    }
+    report(b, workload, b->ops, now_ns() - start);
+}
+
+static void run_get_uniform(bench_t *b)
+{
+    timed_gets(b, "get_uniform", false);
+}
+
+static void run_get_zipf(bench_t *b)
+{
+    timed_gets(b, "get_zipf", true);
+}
+
+// where get_packed writes the packed copy, next to the scratch database
+#define BENCH_PACK_SUFFIX ".pack"
+
+static void run_get_packed(bench_t *b)
+{
+    char pack[4200];
+    dbpack_hdr_t hdr;
+    dbpack_t *p;
+    student_t s;
+    uint64_t start, t;
+
+    need_population(b);
+    snprintf(pack, sizeof(pack), "%s%s", b->path, BENCH_PACK_SUFFIX);
+    int out = open(pack, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (out == -1 || dbpack_write(b->fd, out, &hdr) != NO_ERROR)
+        exit(EXIT_FAIL_DB);
+    close(out);
+    if ((p = dbpack_open(pack)) == NULL)
+        exit(EXIT_FAIL_DB);
+
+    start = now_ns();
+    for (int i = 0; i < b->ops; i++)
+    {
+        int k = rand_below(b, b->count);
+
+        t = now_ns();
+        if (dbpack_get(p, b->ids[k], &s) != NO_ERROR)
+        {
+            fprintf(stderr, "sdbbench: student %lld not in the packed copy\n", b->ids[k]);
+            exit(EXIT_FAIL_DB);
+        }
+        b->lat[i] = now_ns() - t;
+    }
+    report(b, "get_packed", b->ops, now_ns() - start);
+    dbpack_close(p);
+}
+
+static void run_get_miss64(bench_t *b)
+{
+    student_t s;
+    uint64_t start, t;
+
+    // the misses only go through the id map with ids in it
+    if (b->count == 0 || b->ids[0] <= MAX_STD_ID)
+    {
+        fresh_db(b);
+        b->count = make_ids(b, "rand64");
+        for (int i = 0; i < b->count; i++)
+            if (add_student(b->fd, b->ids[i], "miss", "miss", 0) != NO_ERROR)
+                exit(EXIT_FAIL_DB);
+    }
+
+    start = now_ns();
+    for (int i = 0; i < b->ops; i++)
+    {
+        long long id = MAX_STD_ID + 1 + (long long)rand_below(b, MAX_STD_ID_64 - MAX_STD_ID);
+
+        t = now_ns();
+        if (get_student(b->fd, id, &s) == ERR_DB_FILE)
+            exit(EXIT_FAIL_DB);
+        b->lat[i] = now_ns() - t;
+    }
+    report(b, "get_miss64", b->ops, now_ns() - start);
+}
+
+static void run_scan(bench_t *b)
+{
+    uint64_t start, t;
+
+    need_population(b);
+    start = now_ns();
+    for (int i = 0; i < b->scans; i++)
+    {
+        t = now_ns();
+        if (print_db(b->fd, FMT_TABLE) != NO_ERROR)
+            exit(EXIT_FAIL_DB);
+        b->lat[i] = now_ns() - t;
+    }
+    report(b, "scan", b->scans, now_ns() - start);
+}
+
+static void run_delete(bench_t *b)
+{
+    uint64_t start, t;
+    int keep;
+
+    need_population(b);
+    keep = b->count / 2;
+    start = now_ns();
+    for (int i = keep; i < b->count; i++)
+    {
+        t = now_ns();
+        if (del_student(b->fd, b->ids[i]) != NO_ERROR)
+            exit(EXIT_FAIL_DB);
+        b->lat[i - keep] = now_ns() - t;
+    }
+    report(b, "delete", b->count - keep, now_ns() - start);
+    b->count = keep;
+    b->deleted = true;
+}
+
+static void run_compact(bench_t *b)
+{
+    uint64_t t;
+
+    if (!b->deleted)
+        run_delete(b);
+    t = now_ns();
+    if (compress_db(b->fd) < 0)
+        exit(EXIT_FAIL_DB);
+    b->lat[0] = now_ns() - t;
+    report(b, "compact", 1, b->lat[0]);
+}
+
+static const workload_t workloads[] = {
+    {"add_seq", run_add_seq},
+    {"add_rand", run_add_rand},
+    {"add_rand64", run_add_rand64},
+    {"get_uniform", run_get_uniform},
+    {"get_zipf", run_get_zipf},
+    {"get_packed", run_get_packed},
+    {"scan", run_scan},
+    {"delete", run_delete},
+    {"compact", run_compact},
+    {"get_miss64", run_get_miss64},
+};
+#define NWORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+// add_rand64 replaces the population the reads and deletes run against,
+// so it goes last in the default run, only get_miss64 needs it
+static const char *default_order[] = {"add_seq", "add_rand", "get_uniform", "get_zipf", "get_packed",
+                                      "scan", "delete", "compact", "add_rand64", "get_miss64"};
+
+static const workload_t *find_workload(const char *name)
+{
+    for (size_t i = 0; i < NWORKLOADS; i++)
+        if (strcmp(workloads[i].name, name) == 0)
+            return &workloads[i];
+    return NULL;
+}
+
+// prints the data set as bulk input, see bulk.h
+static int generate(bench_t *b, const char *kind)
+{
+    char fname[16], lname[16];
+    int n = make_ids(b, kind);
+
+    if (n < 0)
+        return EXIT_FAIL_ARGS;
+    for (int i = 0; i < n; i++)
+    {
+        random_name(b, fname, sizeof(fname));
+        random_name(b, lname, sizeof(lname));
+        printf("a %lld %s %s %d\n", b->ids[i], fname, lname, (int)rand_below(b, MAX_STD_GPA + 1));
+    }
+    return EXIT_OK;
+}
+
+static void bench_usage(char *exename)
+{
+    printf("usage: %s [-n ops] [-r scans] [-s seed] [-z theta] [-d dir] [-w a,b,...] [-g kind]\n",
+           exename);
+    printf("\t-n ops:     operations per workload (default %d)\n", BENCH_DEFAULT_OPS);
+    printf("\t-r scans:   full table scans of the scan workload (default %d)\n", BENCH_DEFAULT_SCANS);
+    printf("\t-s seed:    seed of the data set and the access pattern\n");
+    printf("\t-z theta:   Zipf skew of get_zipf (default %.2f)\n", BENCH_DEFAULT_THETA);
+    printf("\t-d dir:     directory for the scratch database (default /tmp)\n");
+    printf("\t-w list:    workloads to run, comma separated, of:\n\t           ");
+    for (size_t i = 0; i < NWORKLOADS; i++)
+        printf(" %s", workloads[i].name);
+    printf("\n\t-g kind:    print a data set of seq, rand or rand64 ids as bulk input and exit\n");
+}
+
+int main(int argc, char *argv[])
+{
+    bench_t b = {.fd = -1, .ops = BENCH_DEFAULT_OPS, .scans = BENCH_DEFAULT_SCANS,
+                 .theta = BENCH_DEFAULT_THETA, .rng = 1};
+    char *dir = "/tmp", *list = NULL, *gen = NULL;
+    char path[4096];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:s:z:d:w:g:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            b.ops = atoi(optarg);
+            break;
+        case 'r':
+            b.scans = atoi(optarg);
+            break;
+        case 's':
+            b.rng = strtoull(optarg, NULL, 10);
+            break;
+        case 'z':
+            b.theta = atof(optarg);
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        case 'w':
+            list = optarg;
+            break;
+        case 'g':
+            gen = optarg;
+            break;
+        default:
+            bench_usage(argv[0]);
+            exit(opt == 'h' ? EXIT_OK : EXIT_FAIL_ARGS);
+        }
+    }
+    if (b.ops < 1 || b.scans < 1 || b.theta <= 0)
+    {
+        bench_usage(argv[0]);
+        exit(EXIT_FAIL_ARGS);
+    }
+
+    int nlat = b.ops > b.scans ? b.ops : b.scans;
+    b.ids = malloc((size_t)b.ops * sizeof(long long));
+    b.lat = malloc((size_t)nlat * sizeof(uint64_t));
+    b.cdf = malloc((size_t)b.ops * sizeof(double));
+    if (b.ids == NULL || b.lat == NULL || b.cdf == NULL)
+        exit(EXIT_FAIL_DB);
+
+    if (gen != NULL)
+    {
+        int rc = generate(&b, gen);
+        if (rc != EXIT_OK)
+            bench_usage(argv[0]);
+        exit(rc);
+    }
+
+    // check the whole list before anything runs
+    const workload_t *run[2 * NWORKLOADS];
+    int nrun = 0;
+    if (list == NULL)
+        for (size_t i = 0; i < NWORKLOADS; i++)
+            run[nrun++] = find_workload(default_order[i]);
+    else
+        for (char *w = strtok(list, ","); w != NULL && nrun < (int)(2 * NWORKLOADS); w = strtok(NULL, ","))
+            if ((run[nrun++] = find_workload(w)) == NULL)
+            {
+                fprintf(stderr, "sdbbench: unknown workload %s\n", w);
+                bench_usage(argv[0]);
+                exit(EXIT_FAIL_ARGS);
+            }
+
+    b.flags = db_open_flags();
+    b.name = getenv(DB_BACKEND_ENV) != NULL ? getenv(DB_BACKEND_ENV) : "fd";
+    snprintf(path, sizeof(path), "%s/sdbbench.%d.db", dir, (int)getpid());
+    b.path = path;
+
+    // the report keeps the real stdout, everything sdbsc prints is dropped
+    b.out = fdopen(dup(STDOUT_FILENO), "w");
+    int null = open("/dev/null", O_WRONLY);
+    if (b.out == NULL || null == -1 || dup2(null, STDOUT_FILENO) == -1)
+        exit(EXIT_FAIL_DB);
+    close(null);
+
+    for (int i = 0; i < nrun; i++)
+        run[i]->run(&b);
+
+    if (b.fd >= 0)
+        close_db(b.fd);
+    fflush(stdout);
+
+    // the database and everything that lives next to it
+    static const char *suffixes[] = {"", DBMAP_SUFFIX, WAL_SUFFIX, NAMEIDX_SUFFIX, GPAIDX_SUFFIX,
+                                     TRIEIDX_SUFFIX, DBBLOOM_SUFFIX, BENCH_PACK_SUFFIX};
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++)
+    {
+        char side[4200];
+        snprintf(side, sizeof(side), "%s%s", path, suffixes[i]);
+        unlink(side);
+    }
+    fclose(b.out);
+    return EXIT_OK;
+}
@@ -0,0 +1,903 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbio.h"
+#include "dbindex.h"
+#include "dbmap.h"
+#include "wal.h"
+#include "bulk.h"
+
+// One parsed line of bulk input
+typedef struct bulk_op
+{
+    char op;      // 'a', 'd' or 'f'
+    long long id; // student id the operation works on
+    int gpa;      // add only
+    int line;     // input line number, for error messages
+    char fname[sizeof(((student_t *)0)->fname)];
+    char lname[sizeof(((student_t *)0)->lname)];
+} bulk_op_t;
+
+// In memory copy of a database slot touched by the current batch, only
+// ids up to MAX_STD_ID are staged
+typedef struct bulk_slot
+{
+    int id;
+    bool want;  // a find or delete needs the current contents of this slot
+    bool live;  // set in the occupancy bitmap when staged, kept up to date
+                // by scripts
+    bool dirty;
+    student_t rec;
+} bulk_slot_t;
+
+// Running totals reported when the load finishes
+typedef struct bulk_stats
+{
+    int ops;
+    int added;
+    int deleted;
+    int found;
+    int failed;
+} bulk_stats_t;
+
+static int cmp_int(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_slot(const void *key, const void *elem)
+{
+    long long id = *(const long long *)key;
+    int other = ((const bulk_slot_t *)elem)->id;
+    return (id > other) - (id < other);
+}
+
+/*
+ *  parse_op
+ *      line:  one line of bulk input
+ *      *op:   filled in with the parsed operation
+ *
+ *  Bulk input uses the same arguments as the command line, one operation
+ *  per line, the leading dash is optional:
+ *
+ *      -a 1 john doe 345
+ *      d 64
+ *      -f 3
+ *
+ *  Blank lines and lines starting with # are ignored.  Every field runs up
+ *  to the next blank, names that do not fit a record are refused like -a
+ *  refuses them (see validate_names()).
+ *
+ *  returns:  1 operation parsed, 0 line should be skipped, -1 malformed,
+ *            -2 a name is too long
+ */
+static int parse_op(char *line, bulk_op_t *op)
+{
+    char *p = line + strspn(line, " \t");
+
+    if (*p == '\0' || *p == '\n' || *p == '#')
+        return 0;
+    if (*p == '-')
+        p++;
+
+    op->op = *p++;
+    switch (op->op)
+    {
+    case 'a':
+    {
+        char *save;
+        char *id = strtok_r(p, " \t\r\n", &save);
+        char *fname = strtok_r(NULL, " \t\r\n", &save);
+        char *lname = strtok_r(NULL, " \t\r\n", &save);
+        char *gpa = strtok_r(NULL, " \t\r\n", &save);
+
+        if (gpa == NULL || sscanf(id, "%lld", &op->id) != 1 || sscanf(gpa, "%d", &op->gpa) != 1)
+            return -1;
+        if (validate_names(fname, lname) != NO_ERROR)
+            return -2;
+        strcpy(op->fname, fname);
+        strcpy(op->lname, lname);
+        return 1;
+    }
+    case 'd':
+    case 'f':
+        if (sscanf(p, "%lld", &op->id) != 1)
+            return -1;
+        return 1;
+    default:
+        return -1;
+    }
+}
+
+// unlocks every slot of the batch, a single call covers the whole span.
+// Returns what dbio_unlock_records() does
+static int unlock_slots(int fd, bulk_slot_t *slots, int nslots)
+{
+    if (nslots == 0)
+        return NO_ERROR;
+    return dbio_unlock_records(fd, slots[0].id, slots[nslots - 1].id - slots[0].id + 1);
+}
+
+/*
+ *  lock_slots
+ *      fd:      linux file descriptor
+ *      slots:   staged slots sorted by id
+ *      nslots:  number of staged slots
+ *
+ *  Takes the record locks of every slot the batch touches, one lock per run
+ *  of adjacent ids.  Runs are locked in ascending order like every other
+ *  multi record locker, so two bulk loads can not deadlock.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int lock_slots(int fd, bulk_slot_t *slots, int nslots)
+{
+    int i = 0;
+
+    while (i < nslots)
+    {
+        int n = 1;
+        while (i + n < nslots && slots[i + n].id == slots[i].id + n)
+            n++;
+        if (dbio_lock_records(fd, slots[i].id, n) != NO_ERROR)
+        {
+            unlock_slots(fd, slots, i);
+            return ERR_DB_FILE;
+        }
+        i += n;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  stage_batch
+ *      fd:       linux file descriptor
+ *      ops:      operations of this batch
+ *      nops:     number of operations
+ *      slots:    room for nops slots, one per distinct id the batch
+ *                touches, sorted by id
+ *
+ *  Duplicate and existence checks are answered by the occupancy bitmap in
+ *  the file header, so the only slots that are read are live ones a find
+ *  asks for or a delete removes (the indexes need the old record).  They
+ *  are read up front in id order, that is file offset order, and ids that
+ *  are close together share a single dbio_read_scatter() call (one
+ *  preadv() straight into the staged slots) instead of one read per
+ *  record.
+ *
+ *  returns:  number of staged slots, or ERR_DB_FILE
+ */
+static int stage_batch(int fd, bulk_op_t *ops, int nops, bulk_slot_t *slots)
+{
+    int *ids = malloc(sizeof(int) * (nops ? nops : 1));
+    int nids = 0;
+
+    if (ids == NULL)
+        return ERR_DB_FILE;
+
+    for (int i = 0; i < nops; i++)
+        if (ops[i].id >= MIN_STD_ID && ops[i].id <= MAX_STD_ID)
+            ids[nids++] = (int)ops[i].id;
+
+    qsort(ids, nids, sizeof(int), cmp_int);
+
+    int nslots = 0;
+    for (int i = 0; i < nids; i++)
+        if (nslots == 0 || slots[nslots - 1].id != ids[i])
+        {
+            slots[nslots].id = ids[i];
+            slots[nslots].want = false;
+            slots[nslots].live = false;
+            slots[nslots].dirty = false;
+            slots[nslots].rec = EMPTY_STUDENT_RECORD;
+            nslots++;
+        }
+    free(ids);
+
+    // nobody else may change these ids until the batch is flushed
+    if (lock_slots(fd, slots, nslots) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    for (int i = 0; i < nslots; i++)
+        slots[i].live = dbio_live(fd, slots[i].id);
+    for (int i = 0; i < nops; i++)
+    {
+        bulk_slot_t *slot = bsearch(&ops[i].id, slots, nslots, sizeof(bulk_slot_t), cmp_slot);
+        if ((ops[i].op == 'f' || ops[i].op == 'd') && slot != NULL)
+            slot->want = slot->live;
+    }
+
+    int i = 0;
+    while (i < nslots)
+    {
+        if (!slots[i].want)
+        {
+            i++;
+            continue;
+        }
+
+        int j = i;
+        for (int k = i + 1; k < nslots && slots[k].id - slots[j].id <= BULK_READ_GAP; k++)
+            if (slots[k].want)
+                j = k;
+
+        int first = slots[i].id;
+        int count = slots[j].id - first + 1;
+        student_t **run = calloc(count, sizeof(student_t *));
+
+        for (int k = i; run != NULL && k <= j; k++)
+            if (slots[k].want)
+                run[slots[k].id - first] = &slots[k].rec;
+        if (run == NULL || dbio_read_scatter(fd, first, count, run) != NO_ERROR)
+        {
+            free(run);
+            unlock_slots(fd, slots, nslots);
+            return ERR_DB_FILE;
+        }
+        free(run);
+        i = j + 1;
+    }
+
+    return nslots;
+}
+
+/*
+ *  flush_batch
+ *      fd:      linux file descriptor
+ *      slots:   staged slots sorted by id
+ *      nslots:  number of staged slots
+ *
+ *  Writes every dirty slot back.  Dirty slots with adjacent ids are handed
+ *  to dbio_write_gather() together so they go out in one pwritev().
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int flush_batch(int fd, bulk_slot_t *slots, int nslots)
+{
+    const student_t **recs = malloc(sizeof(student_t *) * (nslots ? nslots : 1));
+
+    if (recs == NULL)
+        return ERR_DB_FILE;
+
+    int i = 0;
+    while (i < nslots)
+    {
+        if (!slots[i].dirty)
+        {
+            i++;
+            continue;
+        }
+
+        int n = 0;
+        recs[n++] = &slots[i].rec;
+        while (i + n < nslots && slots[i + n].dirty &&
+               slots[i + n].id == slots[i].id + n)
+        {
+            recs[n] = &slots[i + n].rec;
+            n++;
+        }
+
+        if (dbio_write_gather(fd, slots[i].id, n, recs) != NO_ERROR)
+        {
+            free(recs);
+            return ERR_DB_FILE;
+        }
+        i += n;
+    }
+
+    free(recs);
+    return NO_ERROR;
+}
+
+/*
+ *  apply_mapped
+ *      fd:   linux file descriptor
+ *      *op:  operation on an id above MAX_STD_ID
+ *      *st:  running totals
+ *
+ *  Ids above MAX_STD_ID live in the id map (see dbmap.h) and are not
+ *  staged, the operation goes to the id map right away.  The caller holds
+ *  wal_begin().
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int apply_mapped(int fd, bulk_op_t *op, bulk_stats_t *st)
+{
+    student_t rec = EMPTY_STUDENT_RECORD;
+    int rc;
+
+    switch (op->op)
+    {
+    case 'a':
+        if (validate_range(op->id, op->gpa) != NO_ERROR)
+        {
+            printf(M_ERR_STD_RNG);
+            st->failed++;
+            return NO_ERROR;
+        }
+        rec.id = op->id;
+        memcpy(rec.fname, op->fname, sizeof(rec.fname));
+        memcpy(rec.lname, op->lname, sizeof(rec.lname));
+        rec.gpa = op->gpa;
+        rc = dbmap_insert(fd, &rec);
+        if (rc == ERR_DB_OP)
+        {
+            printf(M_ERR_DB_ADD_DUP, op->id);
+            st->failed++;
+            return NO_ERROR;
+        }
+        if (rc != NO_ERROR || db_indexes_insert(fd, &rec) != NO_ERROR)
+            return ERR_DB_FILE;
+        st->added++;
+        return NO_ERROR;
+
+    case 'd':
+        rc = dbmap_remove(fd, op->id, &rec);
+        if (rc == SRCH_NOT_FOUND)
+        {
+            printf(M_STD_NOT_FND_MSG, op->id);
+            st->failed++;
+            return NO_ERROR;
+        }
+        if (rc != NO_ERROR || db_indexes_remove(fd, &rec) != NO_ERROR)
+            return ERR_DB_FILE;
+        st->deleted++;
+        return NO_ERROR;
+
+    default:
+        rc = dbmap_read(fd, op->id, &rec);
+        if (rc == SRCH_NOT_FOUND)
+        {
+            printf(M_STD_NOT_FND_MSG, op->id);
+            st->failed++;
+            return NO_ERROR;
+        }
+        if (rc != NO_ERROR)
+            return ERR_DB_FILE;
+        print_student(&rec);
+        st->found++;
+        return NO_ERROR;
+    }
+}
+
+/*
+ *  apply_batch
+ *      fd:     linux file descriptor
+ *      ops:    operations of this batch, in input order
+ *      nops:   number of operations
+ *      slots:  scratch space for nops staged slots
+ *      *st:    running totals
+ *
+ *  Applies the batch in input order against the staged slots, so an add
+ *  followed by a find of the same id in one batch behaves exactly like two
+ *  separate runs of the program.  Adds and deletes claim and release their
+ *  ids in the header bitmap, log and update the indexes right away, the
+ *  records follow at flush time after one commit of the log.
+ *  Only failures and find results are printed, successful adds and deletes
+ *  are summarized at the end.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int apply_batch(int fd, bulk_op_t *ops, int nops, bulk_slot_t *slots,
+                       bulk_stats_t *st)
+{
+    int nslots;
+    int io_rc = NO_ERROR;
+    int rc;
+
+    if (wal_begin(fd) != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+    if ((nslots = stage_batch(fd, ops, nops, slots)) < 0)
+    {
+        wal_end(fd);
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    for (int i = 0; i < nops; i++)
+    {
+        bulk_op_t *op = &ops[i];
+        bulk_slot_t *slot = bsearch(&op->id, slots, nslots, sizeof(bulk_slot_t), cmp_slot);
+        bool live = slot != NULL &&
+                    memcmp(&slot->rec, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) != 0;
+
+        st->ops++;
+        if (op->id > MAX_STD_ID)
+        {
+            if (apply_mapped(fd, op, st) != NO_ERROR)
+                io_rc = ERR_DB_FILE;
+            continue;
+        }
+        switch (op->op)
+        {
+        case 'a':
+            if (validate_range(op->id, op->gpa) != NO_ERROR || slot == NULL)
+            {
+                printf(M_ERR_STD_RNG);
+                st->failed++;
+            }
+            else if ((rc = dbio_claim(fd, op->id)) != NO_ERROR)
+            {
+                if (rc == ERR_DB_OP)
+                    printf(M_ERR_DB_ADD_DUP, op->id);
+                else
+                    printf(M_ERR_DB_WRITE);
+                st->failed++;
+            }
+            else
+            {
+                slot->rec = EMPTY_STUDENT_RECORD;
+                slot->rec.id = op->id;
+                memcpy(slot->rec.fname, op->fname, sizeof(slot->rec.fname));
+                memcpy(slot->rec.lname, op->lname, sizeof(slot->rec.lname));
+                slot->rec.gpa = op->gpa;
+                slot->dirty = true;
+                if (wal_log(fd, WAL_OP_ADD, slot->id, &slot->rec) != NO_ERROR ||
+                    db_indexes_insert(fd, &slot->rec) != NO_ERROR)
+                    io_rc = ERR_DB_FILE;
+                st->added++;
+            }
+            break;
+
+        case 'd':
+            if (slot == NULL || dbio_release(fd, op->id) != NO_ERROR)
+            {
+                printf(M_STD_NOT_FND_MSG, op->id);
+                st->failed++;
+            }
+            else
+            {
+                if (wal_log(fd, WAL_OP_DEL, slot->id, &slot->rec) != NO_ERROR ||
+                    db_indexes_remove(fd, &slot->rec) != NO_ERROR)
+                    io_rc = ERR_DB_FILE;
+                slot->rec = EMPTY_STUDENT_RECORD;
+                slot->dirty = true;
+                st->deleted++;
+            }
+            break;
+
+        case 'f':
+            if (!live)
+            {
+                printf(M_STD_NOT_FND_MSG, op->id);
+                st->failed++;
+            }
+            else
+            {
+                print_student(&slot->rec);
+                st->found++;
+            }
+            break;
+        }
+    }
+
+    // one commit of the write-ahead log covers the whole batch.  The records
+    // still go out when logging or an index update failed, so the file stays
+    // consistent with the header bitmap
+    if (wal_sync(fd) != NO_ERROR)
+        io_rc = ERR_DB_FILE;
+    if (flush_batch(fd, slots, nslots) != NO_ERROR)
+        io_rc = ERR_DB_FILE;
+    if (unlock_slots(fd, slots, nslots) != NO_ERROR)
+        io_rc = ERR_DB_FILE;
+    wal_end(fd);
+
+    if (io_rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  bulk_load
+ *      fd:   linux file descriptor of the open database
+ *      *in:  stream of operations, see parse_op() for the format
+ *
+ *  Runs a whole stream of add, delete and find operations in this process
+ *  with the database opened once.  Input is consumed BULK_BATCH_OPS lines at
+ *  a time, each batch is staged with coalesced reads, applied in memory and
+ *  written back with one pwritev() per run of adjacent ids.
+ *
+ *  returns:  NO_ERROR       every operation succeeded
+ *            ERR_DB_OP      at least one operation failed (duplicate add,
+ *                           unknown id, bad input line)
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  one line per failed operation, find results, and M_BULK_DONE
+ *            with the achieved records/sec at the end
+ */
+int bulk_load(int fd, FILE *in)
+{
+    bulk_op_t *ops = malloc(sizeof(bulk_op_t) * BULK_BATCH_OPS);
+    bulk_slot_t *slots = malloc(sizeof(bulk_slot_t) * BULK_BATCH_OPS);
+    bulk_stats_t st = {0};
+    struct timespec start, end;
+    char line[256];
+    int nops = 0;
+    int lineno = 0;
+    int rc = NO_ERROR;
+
+    if (ops == NULL || slots == NULL)
+    {
+        free(ops);
+        free(slots);
+        return ERR_DB_FILE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    wal_defer(fd, true);
+
+    while (rc == NO_ERROR && fgets(line, sizeof(line), in) != NULL)
+    {
+        lineno++;
+        memset(&ops[nops], 0, sizeof(bulk_op_t));
+
+        int parsed = parse_op(line, &ops[nops]);
+        if (parsed < 0)
+        {
+            if (parsed == -2)
+                printf(M_ERR_STD_NAME, STD_FNAME_MAX, STD_LNAME_MAX);
+            else
+                printf(M_ERR_BULK_LINE, lineno);
+            st.failed++;
+            continue;
+        }
+        if (parsed == 0)
+            continue;
+
+        ops[nops].line = lineno;
+        if (++nops == BULK_BATCH_OPS)
+        {
+            rc = apply_batch(fd, ops, nops, slots, &st);
+            nops = 0;
+        }
+    }
+    if (rc == NO_ERROR && nops > 0)
+        rc = apply_batch(fd, ops, nops, slots, &st);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    wal_defer(fd, false);
+    free(ops);
+    free(slots);
+
+    if (rc != NO_ERROR)
+        return rc;
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf(M_BULK_DONE, st.ops, st.added, st.deleted, st.found, st.failed, secs,
+           secs > 0 ? st.ops / secs : 0.0);
+
+    return st.failed ? ERR_DB_OP : NO_ERROR;
+}
+
+/*
+ *  read_script
+ *      *in:     the script
+ *      *nops:   set to the number of operations
+ *      *bad:    set to the line that stopped the read, 0 if none did
+ *
+ *  Reads a whole script into memory, it is checked as a unit before
+ *  anything is changed.  A malformed line, or an add or delete of an id
+ *  above MAX_STD_ID, stops the read.
+ *
+ *  returns:  the operations (NULL with *bad 0 if out of memory)
+ */
+static bulk_op_t *read_script(FILE *in, int *nops, int *bad)
+{
+    bulk_op_t *ops = NULL;
+    char line[256];
+    int cap = 0;
+    int lineno = 0;
+
+    *nops = 0;
+    *bad = 0;
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+        lineno++;
+        if (*nops == cap)
+        {
+            cap = cap ? cap * 2 : BULK_BATCH_OPS;
+            bulk_op_t *more = realloc(ops, sizeof(bulk_op_t) * cap);
+            if (more == NULL)
+            {
+                free(ops);
+                return NULL;
+            }
+            ops = more;
+        }
+
+        bulk_op_t *op = &ops[*nops];
+        memset(op, 0, sizeof(bulk_op_t));
+        int parsed = parse_op(line, op);
+        if (parsed == -2)
+            printf(M_ERR_STD_NAME, STD_FNAME_MAX, STD_LNAME_MAX);
+        else if (parsed < 0)
+            printf(M_ERR_TXN_LINE, lineno);
+        else if (parsed > 0 && op->op != 'f' && op->id > MAX_STD_ID)
+            printf(M_ERR_TXN_MAPPED, op->id, MAX_STD_ID);
+        else
+        {
+            if (parsed > 0)
+            {
+                op->line = lineno;
+                (*nops)++;
+            }
+            continue;
+        }
+        *bad = lineno;
+        break;
+    }
+    if (ops == NULL)
+        ops = malloc(sizeof(bulk_op_t));
+    return ops;
+}
+
+/*
+ *  check_script
+ *      fd:     linux file descriptor
+ *      ops:    the whole script
+ *      nops:   number of operations
+ *      slots:  the staged slots
+ *      nslots: number of staged slots
+ *      *imgs:  room for nops records, receives the new record of an add,
+ *              the removed record of a delete and the student a find got
+ *      *rcs:   room for nops results, what a find returned
+ *
+ *  Runs the script against the staged slots only, nothing is logged or
+ *  written.  Ids above MAX_STD_ID are only ever looked up.
+ *
+ *  returns:  NO_ERROR, the line of the first add or delete that would fail
+ *            (its message is printed), or ERR_DB_FILE
+ */
+static int check_script(int fd, bulk_op_t *ops, int nops, bulk_slot_t *slots, int nslots,
+                        student_t *imgs, int *rcs)
+{
+    for (int i = 0; i < nops; i++)
+    {
+        bulk_op_t *op = &ops[i];
+        bulk_slot_t *slot = bsearch(&op->id, slots, nslots, sizeof(bulk_slot_t), cmp_slot);
+
+        imgs[i] = EMPTY_STUDENT_RECORD;
+        rcs[i] = NO_ERROR;
+        if (op->id > MAX_STD_ID)
+        {
+            rcs[i] = dbmap_read(fd, op->id, &imgs[i]);
+            if (rcs[i] == ERR_DB_FILE)
+                return ERR_DB_FILE;
+            continue;
+        }
+
+        switch (op->op)
+        {
+        case 'a':
+            if (validate_range(op->id, op->gpa) != NO_ERROR || slot == NULL)
+            {
+                printf(M_ERR_STD_RNG);
+                return op->line;
+            }
+            if (slot->live)
+            {
+                printf(M_ERR_DB_ADD_DUP, op->id);
+                return op->line;
+            }
+            slot->rec = EMPTY_STUDENT_RECORD;
+            slot->rec.id = op->id;
+            memcpy(slot->rec.fname, op->fname, sizeof(slot->rec.fname));
+            memcpy(slot->rec.lname, op->lname, sizeof(slot->rec.lname));
+            slot->rec.gpa = op->gpa;
+            slot->live = true;
+            slot->dirty = true;
+            imgs[i] = slot->rec;
+            break;
+
+        case 'd':
+            if (slot == NULL || !slot->live)
+            {
+                printf(M_STD_NOT_FND_MSG, op->id);
+                return op->line;
+            }
+            imgs[i] = slot->rec;
+            slot->rec = EMPTY_STUDENT_RECORD;
+            slot->live = false;
+            slot->dirty = true;
+            break;
+
+        case 'f':
+            if (slot == NULL || !slot->live)
+                rcs[i] = SRCH_NOT_FOUND;
+            else
+                imgs[i] = slot->rec;
+            break;
+        }
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  commit_script
+ *      fd:     linux file descriptor, the caller holds wal_begin()
+ *      ops:    the whole script, checked by check_script()
+ *      nops:   number of operations
+ *      slots:  the staged slots with their final contents
+ *      nslots: number of staged slots
+ *      imgs:   the records check_script() handed back
+ *
+ *  Logs the final image of every slot the script changed under one
+ *  transaction and commits it.  Only then are the header bitmap, the
+ *  indexes and the records themselves updated.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE.  If the commit failed nothing was
+ *            changed, if a later write failed replaying the log finishes
+ *            the script.
+ */
+static int commit_script(int fd, bulk_op_t *ops, int nops, bulk_slot_t *slots, int nslots,
+                         const student_t *imgs)
+{
+    int rc = NO_ERROR;
+
+    wal_txn_begin(fd);
+    for (int i = 0; i < nslots && rc == NO_ERROR; i++)
+    {
+        student_t gone = EMPTY_STUDENT_RECORD;
+
+        gone.id = slots[i].id;
+        if (slots[i].dirty)
+            rc = slots[i].live ? wal_log(fd, WAL_OP_ADD, slots[i].id, &slots[i].rec)
+                               : wal_log(fd, WAL_OP_DEL, slots[i].id, &gone);
+    }
+    if (rc != NO_ERROR || wal_txn_commit(fd) != NO_ERROR)
+    {
+        wal_txn_abort(fd);
+        return ERR_DB_FILE;
+    }
+
+    for (int i = 0; i < nslots; i++)
+    {
+        if (!slots[i].dirty || slots[i].live == dbio_live(fd, slots[i].id))
+            continue;
+        if ((slots[i].live ? dbio_claim(fd, slots[i].id) : dbio_release(fd, slots[i].id)) != NO_ERROR)
+            rc = ERR_DB_FILE;
+    }
+    for (int i = 0; i < nops; i++)
+    {
+        if (ops[i].op == 'a' && db_indexes_insert(fd, &imgs[i]) != NO_ERROR)
+            rc = ERR_DB_FILE;
+        else if (ops[i].op == 'd' && db_indexes_remove(fd, &imgs[i]) != NO_ERROR)
+            rc = ERR_DB_FILE;
+    }
+    if (flush_batch(fd, slots, nslots) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    return rc;
+}
+
+/*
+ *  bulk_script
+ *      fd:   linux file descriptor of the open database, opened with
+ *            DB_OPEN_WAL
+ *      *in:  the script, same format as bulk input (see parse_op())
+ *
+ *  Runs a whole script as one transaction.  Every id it touches is locked
+ *  and staged first (see stage_batch()), so lookups cost one preadv() per
+ *  run of nearby ids however many there are.  Then the operations are
+ *  checked in order against the staged slots, and if an add or a delete
+ *  would fail, or a line is malformed, the script is aborted without any
+ *  change to the database.  Otherwise its changes are committed as one
+ *  transaction of the write-ahead log before a single page is written, so
+ *  a crash can not leave half a script behind either (see wal.h).
+ *
+ *  Finds see the changes of the lines before them.  A find of a missing
+ *  student is reported like -f does and does not abort the script.  Ids
+ *  above MAX_STD_ID can only be looked up: the id map writes its pages as
+ *  it goes (bucket splits), so its changes could not be held back until
+ *  the commit.
+ *
+ *  returns:  NO_ERROR       committed, every find succeeded
+ *            ERR_DB_OP      aborted, or committed with a find that failed
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  why the script was aborted and M_TXN_ABORTED, or the results
+ *            of the finds and M_TXN_DONE
+ */
+int bulk_script(int fd, FILE *in)
+{
+    int nops, bad, nslots;
+    int found = 0, added = 0, deleted = 0, missing = 0;
+    int rc = NO_ERROR;
+
+    bulk_op_t *ops = read_script(in, &nops, &bad);
+    if (ops == NULL)
+        return ERR_DB_FILE;
+    if (bad)
+    {
+        printf(M_TXN_ABORTED, bad);
+        free(ops);
+        return ERR_DB_OP;
+    }
+
+    bulk_slot_t *slots = malloc(sizeof(bulk_slot_t) * (nops ? nops : 1));
+    student_t *imgs = malloc(sizeof(student_t) * (nops ? nops : 1));
+    int *rcs = malloc(sizeof(int) * (nops ? nops : 1));
+    if (slots == NULL || imgs == NULL || rcs == NULL)
+    {
+        free(ops);
+        free(slots);
+        free(imgs);
+        free(rcs);
+        return ERR_DB_FILE;
+    }
+
+    if (wal_begin(fd) != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+        rc = ERR_DB_FILE;
+    }
+    else if ((nslots = stage_batch(fd, ops, nops, slots)) < 0)
+    {
+        wal_end(fd);
+        printf(M_ERR_DB_READ);
+        rc = ERR_DB_FILE;
+    }
+    else
+    {
+        if ((bad = check_script(fd, ops, nops, slots, nslots, imgs, rcs)) > 0)
+        {
+            printf(M_TXN_ABORTED, bad);
+            rc = ERR_DB_OP;
+        }
+        else if (bad != NO_ERROR)
+        {
+            printf(M_ERR_DB_READ);
+            rc = ERR_DB_FILE;
+        }
+        else if (commit_script(fd, ops, nops, slots, nslots, imgs) != NO_ERROR)
+            rc = ERR_DB_FILE;
+
+        if (unlock_slots(fd, slots, nslots) != NO_ERROR)
+            rc = ERR_DB_FILE;
+        if (rc == ERR_DB_FILE && bad == NO_ERROR)
+            printf(M_ERR_DB_WRITE);
+        wal_end(fd);
+    }
+
+    if (rc == NO_ERROR)
+    {
+        for (int i = 0; i < nops; i++)
+        {
+            if (ops[i].op == 'a')
+                added++;
+            else if (ops[i].op == 'd')
+                deleted++;
+            else if (rcs[i] == NO_ERROR)
+            {
+                print_student(&imgs[i]);
+                found++;
+            }
+            else
+            {
+                printf(M_STD_NOT_FND_MSG, ops[i].id);
+                missing++;
+            }
+        }
+        printf(M_TXN_DONE, nops, added, deleted, found, missing);
+        if (missing)
+            rc = ERR_DB_OP;
+    }
+
+    free(ops);
+    free(slots);
+    free(imgs);
+    free(rcs);
+    return rc;
+}
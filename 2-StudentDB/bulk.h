@@ -0,0 +1,21 @@
+#ifndef __BULK_H__
+#define __BULK_H__
+
+#include <stdio.h>
+
+// Number of input operations that are staged, checked and written back
+// together.  Every batch costs a handful of coalesced preads plus one
+// pwritev per run of adjacent dirty ids.
+#define BULK_BATCH_OPS 4096
+
+// Two ids whose slots are at most this many records apart are fetched with
+// the same pread() when a batch is staged.  64 records is one 4K page.
+#define BULK_READ_GAP 64
+
+// Scripts (-T) take the bulk input format too but run as one transaction,
+// all their adds and deletes happen or none does, see bulk_script().
+
+int bulk_load(int fd, FILE *in);
+int bulk_script(int fd, FILE *in);
+
+#endif
@@ -3,25 +3,38 @@
 
 // Basic student database record.  Note:
 //  1. id must be > 0.  A student id==0 means the record has been deleted
-//  2. gpa is an int, should be between 0<=gpa<=500, real gpa is gpa/100.0 this
-//     simplifies dealing with floating point types
+//  2. gpa is a short, should be between 0<=gpa<=500, real gpa is gpa/100.0
+//     this simplifies dealing with floating point types
 //  3. Notice that the student struct was engineered to have a size of
 //     64 bytes.  There are reasons for using such a number
+//  4. ids are 64 bit, the first name gave up two bytes and the gpa is kept
+//     in a short to keep the record at 64 bytes (record format 2, see
+//     dbhdr.h, older files are converted when they are opened).  Names are
+//     kept NUL terminated, a first name has at most 21 characters and a
+//     last name at most 31, longer ones are refused (see validate_names())
 typedef struct student
 {
-    int id;
-    char fname[24];
+    long long id;
+    char fname[22];
     char lname[32];
-    int gpa;
+    short gpa;
 } student_t;
 
 // Define limits for sudent ids and allowable GPA ranges.  Note GPA values will
 // be stored as integers but printed as floats.  For example a GPA of 450 is really
 // that value divided by 100.0 or 4.50.
+//
+// Every id from MIN_STD_ID to MAX_STD_ID_64 is valid.  Ids up to MAX_STD_ID
+// have a fixed slot in the file (see db_record_offset() in dbio.h), larger
+// ones are placed through the id map (see dbmap.h), so the file does not
+// grow with the largest id seen.
 #define MIN_STD_ID 1
 #define MAX_STD_ID 100000
+#define MAX_STD_ID_64 0x7fffffffffffffffLL
 #define MIN_STD_GPA 0
 #define MAX_STD_GPA 500
+#define STD_FNAME_MAX ((int)sizeof(((student_t *)0)->fname) - 1)
+#define STD_LNAME_MAX ((int)sizeof(((student_t *)0)->lname) - 1)
 
 // some useful constants you should consider using versus hard coding
 // in your program.
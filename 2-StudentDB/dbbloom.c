@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbio.h"
+#include "dbbloom.h"
+
+#define BLOCK_WORDS (DBBLOOM_BLOCK_BITS / 64)
+
+// the filter of one database fd
+typedef struct bloom
+{
+    char path[4096];
+    dbbloom_hdr_t *hdr; // shared mapping of the filter file, NULL for none
+    uint64_t *bits;     // the blocks, behind the header
+    uint64_t mask;      // number of blocks - 1
+    size_t len;         // length of the mapping
+} bloom_t;
+
+static bloom_t *dbbloom_table[DBIO_MAX_FD];
+
+static bloom_t *bloom_of(int fd)
+{
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return NULL;
+    return dbbloom_table[fd];
+}
+
+// splitmix64 finalizer, the seeds keep it apart from the hash of dbmap.c
+static uint64_t mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// the block of id and the DBBLOOM_K bits in it, 9 bits of h for each
+static uint64_t *probe(const bloom_t *b, long long id, uint64_t *h)
+{
+    uint64_t h1 = mix((uint64_t)id + 0x9e3779b97f4a7c15ULL);
+
+    *h = mix(h1 ^ 0xd6e8feb86659fd93ULL);
+    return b->bits + (h1 & b->mask) * BLOCK_WORDS;
+}
+
+static size_t file_len(uint32_t lg_blocks)
+{
+    return DBBLOOM_BITS_OFFSET + ((size_t)1 << lg_blocks) * (DBBLOOM_BLOCK_BITS / 8);
+}
+
+static void unmap(bloom_t *b)
+{
+    if (b->hdr != NULL)
+        munmap(b->hdr, b->len);
+    b->hdr = NULL;
+    b->bits = NULL;
+}
+
+/*
+ *  map_filter
+ *      *b:  filter state, b->path names the file
+ *
+ *  Maps the filter file if it is a complete filter of this version that
+ *  was not retired.
+ *
+ *  returns:  NO_ERROR, ERR_DB_OP if there is no usable file, or ERR_DB_FILE
+ */
+static int map_filter(bloom_t *b)
+{
+    dbbloom_hdr_t hdr;
+    struct stat st;
+    int rc = ERR_DB_OP;
+
+    unmap(b);
+    int xfd = open(b->path, O_RDWR);
+    if (xfd == -1)
+        return ERR_DB_OP;
+
+    if (pread(xfd, &hdr, sizeof(hdr), 0) == sizeof(hdr) && fstat(xfd, &st) == 0 &&
+        memcmp(hdr.magic, DBBLOOM_MAGIC, sizeof(hdr.magic)) == 0 && hdr.version == DBBLOOM_VERSION &&
+        hdr.lg_blocks < 40 && hdr.retired == 0 && (size_t)st.st_size >= file_len(hdr.lg_blocks))
+    {
+        void *map = mmap(NULL, file_len(hdr.lg_blocks), PROT_READ | PROT_WRITE, MAP_SHARED, xfd, 0);
+        if (map == MAP_FAILED)
+            rc = ERR_DB_FILE;
+        else
+        {
+            b->hdr = map;
+            b->bits = (uint64_t *)((char *)map + DBBLOOM_BITS_OFFSET);
+            b->mask = (1ULL << hdr.lg_blocks) - 1;
+            b->len = file_len(hdr.lg_blocks);
+            rc = NO_ERROR;
+        }
+    }
+    close(xfd);
+    return rc;
+}
+
+// maps the file that replaced a retired filter, false if there is none
+static bool refresh(bloom_t *b)
+{
+    if (b->hdr != NULL && __atomic_load_n(&b->hdr->retired, __ATOMIC_ACQUIRE) == 0)
+        return true;
+    return map_filter(b) == NO_ERROR;
+}
+
+/*
+ *  dbbloom_open
+ *      fd:               database file descriptor
+ *      dbFile:           path of the database, the filter is dbFile
+ *                        followed by DBBLOOM_SUFFIX
+ *      should_truncate:  the database was just emptied
+ *      pages:            bucket pages of the id map
+ *
+ *  Maps the filter of the database.  The caller holds the directory lock of
+ *  the id map exclusively, if the filter has to be rebuilt it is the
+ *  caller's job, see dbbloom_rebuild().
+ *
+ *  returns:  NO_ERROR       the filter is mapped
+ *            ERR_DB_OP      the filter is missing, was written by another
+ *                           version or does not match the id map
+ *            ERR_DB_FILE    out of memory, or the file can not be mapped
+ */
+int dbbloom_open(int fd, char *dbFile, bool should_truncate, uint32_t pages)
+{
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return ERR_DB_FILE;
+
+    dbbloom_close(fd);
+    bloom_t *b = calloc(1, sizeof(bloom_t));
+    if (b == NULL)
+        return ERR_DB_FILE;
+    snprintf(b->path, sizeof(b->path), "%s%s", dbFile, DBBLOOM_SUFFIX);
+    dbbloom_table[fd] = b;
+
+    if (should_truncate)
+        return ERR_DB_OP;
+    int rc = map_filter(b);
+    if (rc == NO_ERROR && b->hdr->pages != pages)
+        rc = ERR_DB_OP;
+    return rc;
+}
+
+void dbbloom_close(int fd)
+{
+    bloom_t *b = bloom_of(fd);
+
+    if (b == NULL)
+        return;
+    unmap(b);
+    free(b);
+    dbbloom_table[fd] = NULL;
+}
+
+/*
+ *  dbbloom_rebuild
+ *      fd:     database file descriptor
+ *      *ids:   every id of the id map
+ *      count:  number of ids
+ *      pages:  bucket pages of the id map
+ *
+ *  Writes a new filter sized for twice the ids (at least DBBLOOM_MIN_IDS)
+ *  and renames it over the old one, which is marked retired.  The caller
+ *  holds the directory lock of the id map exclusively.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbbloom_rebuild(int fd, const long long *ids, int count, uint32_t pages)
+{
+    bloom_t *b = bloom_of(fd);
+    char tmp[4096 + 8];
+    uint64_t capacity = (uint64_t)count * 2 < DBBLOOM_MIN_IDS ? DBBLOOM_MIN_IDS : (uint64_t)count * 2;
+    uint32_t lg = 0;
+    int rc = NO_ERROR;
+
+    if (b == NULL)
+        return ERR_DB_FILE;
+    while (((uint64_t)DBBLOOM_BLOCK_BITS << lg) < capacity * DBBLOOM_BITS_PER_ID)
+        lg++;
+
+    // build the filter in memory, then the file in one go
+    size_t len = file_len(lg);
+    char *image = calloc(1, len);
+    if (image == NULL)
+        return ERR_DB_FILE;
+
+    dbbloom_hdr_t *hdr = (dbbloom_hdr_t *)image;
+    memcpy(hdr->magic, DBBLOOM_MAGIC, sizeof(hdr->magic));
+    hdr->version = DBBLOOM_VERSION;
+    hdr->lg_blocks = lg;
+    hdr->pages = pages;
+    hdr->capacity = capacity;
+    hdr->added = count;
+
+    bloom_t build = {.bits = (uint64_t *)(image + DBBLOOM_BITS_OFFSET), .mask = (1ULL << lg) - 1};
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t h;
+        uint64_t *block = probe(&build, ids[i], &h);
+
+        for (int k = 0; k < DBBLOOM_K; k++, h >>= 9)
+            block[(h & 511) / 64] |= 1ULL << (h & 63);
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", b->path);
+    int old = open(b->path, O_RDWR);
+    int xfd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (xfd == -1 || pwrite(xfd, image, len, 0) != (ssize_t)len || rename(tmp, b->path) == -1)
+    {
+        unlink(tmp);
+        rc = ERR_DB_FILE;
+    }
+    free(image);
+    if (xfd != -1)
+        close(xfd);
+
+    // whoever still maps the old file moves over to the new one
+    if (old != -1)
+    {
+        uint32_t retired = 1;
+        if (rc == NO_ERROR &&
+            pwrite(old, &retired, sizeof(retired), offsetof(dbbloom_hdr_t, retired)) != sizeof(retired))
+            rc = ERR_DB_FILE;
+        close(old);
+    }
+    if (rc == NO_ERROR)
+        rc = map_filter(b);
+    return rc == ERR_DB_OP ? ERR_DB_FILE : rc;
+}
+
+/*
+ *  dbbloom_may_contain
+ *      fd:  database file descriptor
+ *      id:  student id above MAX_STD_ID
+ *
+ *  Costs no system call unless the filter was rebuilt by another process
+ *  since it was last used.
+ *
+ *  returns:  false if id is surely not in the id map, true if it may be
+ *            (always true without a filter)
+ */
+bool dbbloom_may_contain(int fd, long long id)
+{
+    bloom_t *b = bloom_of(fd);
+
+    while (b != NULL && refresh(b))
+    {
+        uint64_t h;
+        uint64_t *block = probe(b, id, &h);
+        bool hit = true;
+
+        for (int k = 0; k < DBBLOOM_K && hit; k++, h >>= 9)
+            hit = __atomic_load_n(&block[(h & 511) / 64], __ATOMIC_ACQUIRE) >> (h & 63) & 1;
+        if (hit)
+            return true;
+
+        // a miss only counts if the filter was still the current one, an
+        // id added after a rebuild is only in the new file
+        if (__atomic_load_n(&b->hdr->retired, __ATOMIC_ACQUIRE) == 0)
+            return false;
+    }
+    return true;
+}
+
+/*
+ *  dbbloom_add
+ *      fd:  database file descriptor
+ *      id:  student id above MAX_STD_ID, not written yet
+ *
+ *  Sets the bits of id.  The caller holds the directory lock of the id map
+ *  exclusively and only writes the record after this succeeded.
+ *
+ *  returns:  NO_ERROR       id is in the filter
+ *            ERR_DB_OP      there is no filter, or it is full, rebuild it
+ */
+int dbbloom_add(int fd, long long id)
+{
+    bloom_t *b = bloom_of(fd);
+
+    if (b == NULL || !refresh(b) || b->hdr->added >= b->hdr->capacity)
+        return ERR_DB_OP;
+
+    uint64_t h;
+    uint64_t *block = probe(b, id, &h);
+
+    for (int k = 0; k < DBBLOOM_K; k++, h >>= 9)
+        __atomic_or_fetch(&block[(h & 511) / 64], 1ULL << (h & 63), __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&b->hdr->added, 1, __ATOMIC_RELAXED);
+    return NO_ERROR;
+}
+
+/*
+ *  dbbloom_set_pages
+ *      fd:     database file descriptor
+ *      pages:  bucket pages of the id map after a split
+ *
+ *  Keeps the filter matching the directory, see dbbloom_open().  The caller
+ *  holds the directory lock exclusively.
+ */
+void dbbloom_set_pages(int fd, uint32_t pages)
+{
+    bloom_t *b = bloom_of(fd);
+
+    if (b != NULL && refresh(b))
+        __atomic_store_n(&b->hdr->pages, pages, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,55 @@
+#ifndef __DBBLOOM_H__
+#define __DBBLOOM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "db.h" //get student record type
+
+// Bloom filter over the ids of the id map (the ids above MAX_STD_ID, see
+// dbmap.h), so a lookup of an id that is not there usually ends without
+// taking the directory lock or reading a bucket page.  The fixed slots do
+// not need one, the occupancy bitmap in the file header is exact.
+//
+// The filter lives in a file next to the database (DB_FILE followed by
+// DBBLOOM_SUFFIX) that every process maps shared: a dbbloom_hdr_t in the
+// first DBBLOOM_BITS_OFFSET bytes, then 1 << lg_blocks blocks of 512 bits.
+// The DBBLOOM_K bits of an id are all in the same block, one cache line,
+// so a probe touches a single page of the mapping.
+//
+// Bits are set before the record is written and never cleared, so the
+// filter never misses a student that is there; a deleted id only leaves
+// bits behind that may let some other missing id through.  Once more ids
+// went in than the filter was sized for it is rebuilt from the bucket
+// pages, at twice the size of the live ids, which also drops the bits of
+// the deleted ones.  A rebuild writes a new file and renames it over the
+// old one, then marks the old one retired; processes still mapping it see
+// that and map the new file.
+#define DBBLOOM_SUFFIX ".bloom"
+#define DBBLOOM_MAGIC "SDBBLM\0"
+#define DBBLOOM_VERSION 1
+#define DBBLOOM_BITS_OFFSET 4096
+#define DBBLOOM_BLOCK_BITS 512
+#define DBBLOOM_K 7
+#define DBBLOOM_BITS_PER_ID 12
+#define DBBLOOM_MIN_IDS 4096
+
+typedef struct dbbloom_hdr
+{
+    char magic[8];     // DBBLOOM_MAGIC
+    uint32_t version;  // DBBLOOM_VERSION
+    uint32_t lg_blocks;// the filter has 1 << lg_blocks blocks
+    uint32_t retired;  // a rebuilt filter replaced this file
+    uint32_t pages;    // bucket pages of the id map the filter knows of
+    uint64_t capacity; // ids the filter was sized for
+    uint64_t added;    // ids that went in since it was built
+} dbbloom_hdr_t;
+
+int dbbloom_open(int fd, char *dbFile, bool should_truncate, uint32_t pages);
+void dbbloom_close(int fd);
+int dbbloom_rebuild(int fd, const long long *ids, int count, uint32_t pages);
+bool dbbloom_may_contain(int fd, long long id);
+int dbbloom_add(int fd, long long id);
+void dbbloom_set_pages(int fd, uint32_t pages);
+
+#endif
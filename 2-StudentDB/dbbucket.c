@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbio.h"
+#include "dbbucket.h"
+
+static int idx_fd(const dbbucket_t *b, int fd)
+{
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return -1;
+    return b->fds[fd] - 1;
+}
+
+static uint32_t per_page(const dbbucket_t *b)
+{
+    return sizeof(((dbbucket_page_t *)0)->e) / b->entry_size;
+}
+
+static void *entry_at(const dbbucket_t *b, dbbucket_page_t *page, uint32_t i)
+{
+    return page->e + (size_t)i * b->entry_size;
+}
+
+static int read_page(int xfd, uint32_t pno, dbbucket_page_t *page)
+{
+    ssize_t n = pread(xfd, page, DBBUCKET_PAGE, (off_t)pno * DBBUCKET_PAGE);
+
+    if (n == -1)
+        return ERR_DB_FILE;
+    if (n < DBBUCKET_PAGE)
+        memset((char *)page + n, 0, DBBUCKET_PAGE - n);
+    return NO_ERROR;
+}
+
+static int write_page(int xfd, uint32_t pno, const dbbucket_page_t *page)
+{
+    if (pwrite(xfd, page, DBBUCKET_PAGE, (off_t)pno * DBBUCKET_PAGE) != DBBUCKET_PAGE)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+static int read_hdr(const dbbucket_t *b, int xfd, void *hdr)
+{
+    if (pread(xfd, hdr, b->hdr_size, 0) != (ssize_t)b->hdr_size)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+static int write_hdr(const dbbucket_t *b, int xfd, const void *hdr)
+{
+    if (pwrite(xfd, hdr, b->hdr_size, 0) != (ssize_t)b->hdr_size)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+// one entry of a rebuild with the bucket it goes to
+typedef struct rebuild_item
+{
+    uint32_t bucket;
+    uint32_t pad;
+    int64_t e[DBBUCKET_MAX_ENTRY / sizeof(int64_t)];
+} rebuild_item_t;
+
+// dbio_scan() callback collecting the entries for a rebuild
+typedef struct rebuild_buf
+{
+    const dbbucket_t *b;
+    rebuild_item_t *items;
+    size_t n;
+    size_t cap;
+} rebuild_buf_t;
+
+static int collect_entry(const student_t *s, void *arg)
+{
+    rebuild_buf_t *rb = arg;
+
+    if (rb->n == rb->cap)
+    {
+        size_t cap = rb->cap ? rb->cap * 2 : 1024;
+        rebuild_item_t *items = realloc(rb->items, cap * sizeof(*items));
+        if (items == NULL)
+            return ERR_DB_FILE;
+        rb->items = items;
+        rb->cap = cap;
+    }
+    rebuild_item_t *it = &rb->items[rb->n++];
+    memset(it, 0, sizeof(*it));
+    it->bucket = rb->b->key(s, it->e);
+    return 0;
+}
+
+static int cmp_bucket(const void *a, const void *b)
+{
+    uint32_t x = ((const rebuild_item_t *)a)->bucket;
+    uint32_t y = ((const rebuild_item_t *)b)->bucket;
+    return (x > y) - (x < y);
+}
+
+/*
+ *  rebuild
+ *      *b:   the index
+ *      fd:   database file descriptor
+ *      xfd:  index file descriptor, locked exclusively by the caller
+ *
+ *  Builds the index from scratch with one scan of the database.  The
+ *  entries are grouped by bucket in memory and every page is written
+ *  exactly once.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int rebuild(const dbbucket_t *b, int fd, int xfd)
+{
+    rebuild_buf_t rb = {.b = b};
+    dbbucket_hdr_t *hdr = calloc(1, b->hdr_size);
+    dbbucket_page_t *page = calloc(1, DBBUCKET_PAGE);
+    uint32_t per = per_page(b);
+    int rc = NO_ERROR;
+
+    if (hdr == NULL || page == NULL)
+        rc = ERR_DB_FILE;
+    else if (dbio_scan(fd, collect_entry, &rb) != NO_ERROR || ftruncate(xfd, 0) == -1)
+        rc = ERR_DB_FILE;
+    else
+    {
+        qsort(rb.items, rb.n, sizeof(rebuild_item_t), cmp_bucket);
+        memcpy(hdr->magic, b->magic, sizeof(hdr->magic));
+        hdr->version = b->version;
+        hdr->buckets = b->buckets;
+        hdr->next_page = 1 + b->buckets;
+    }
+
+    size_t i = 0;
+    while (i < rb.n && rc == NO_ERROR)
+    {
+        uint32_t bucket = rb.items[i].bucket;
+        uint32_t pno = 1 + bucket;
+
+        // fill the primary page, then as many overflow pages as needed
+        for (;;)
+        {
+            memset(page, 0, DBBUCKET_PAGE);
+            while (i < rb.n && rb.items[i].bucket == bucket && page->count < per)
+            {
+                memcpy(entry_at(b, page, page->count++), rb.items[i++].e, b->entry_size);
+                if (b->count != NULL)
+                    b->count(hdr, bucket, 1);
+            }
+
+            bool more = i < rb.n && rb.items[i].bucket == bucket;
+            if (more)
+                page->next = hdr->next_page++;
+            if ((rc = write_page(xfd, pno, page)) != NO_ERROR || !more)
+                break;
+            pno = page->next;
+        }
+    }
+
+    if (rc == NO_ERROR)
+    {
+        hdr->entries = rb.n;
+        if (ftruncate(xfd, (off_t)hdr->next_page * DBBUCKET_PAGE) == -1 ||
+            write_hdr(b, xfd, hdr) != NO_ERROR)
+            rc = ERR_DB_FILE;
+    }
+
+    free(rb.items);
+    free(hdr);
+    free(page);
+    return rc;
+}
+
+/*
+ *  dbbucket_open
+ *      *b:               the index
+ *      fd:               database file descriptor
+ *      dbFile:           path of the database, the index is dbFile followed
+ *                        by suffix
+ *      suffix:           file name suffix of the index
+ *      should_truncate:  the database was just emptied
+ *
+ *  Opens the index of the database.  If the index is missing, was written
+ *  by another version, or its entry count does not match the live count in
+ *  the database header (for example after a crash between the two writes)
+ *  it is rebuilt from the records.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbbucket_open(dbbucket_t *b, int fd, char *dbFile, const char *suffix, bool should_truncate)
+{
+    char path[4096];
+    dbbucket_hdr_t hdr;
+    int rc = NO_ERROR;
+
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return ERR_DB_FILE;
+
+    snprintf(path, sizeof(path), "%s%s", dbFile, suffix);
+    int xfd = open(path, O_RDWR | O_CREAT | (should_truncate ? O_TRUNC : 0),
+                   S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (xfd == -1)
+        return ERR_DB_FILE;
+
+    if (flock(xfd, LOCK_EX) == -1)
+        rc = ERR_DB_FILE;
+    else if (pread(xfd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+             memcmp(hdr.magic, b->magic, sizeof(hdr.magic)) != 0 ||
+             hdr.version != b->version || hdr.buckets != b->buckets ||
+             hdr.entries != dbio_count(fd))
+        rc = rebuild(b, fd, xfd);
+    flock(xfd, LOCK_UN);
+
+    if (rc != NO_ERROR)
+    {
+        close(xfd);
+        return rc;
+    }
+    b->fds[fd] = xfd + 1;
+    return NO_ERROR;
+}
+
+void dbbucket_close(dbbucket_t *b, int fd)
+{
+    int xfd = idx_fd(b, fd);
+
+    if (xfd >= 0)
+    {
+        close(xfd);
+        b->fds[fd] = 0;
+    }
+}
+
+/*
+ *  dbbucket_insert
+ *      *b:  the index
+ *      fd:  database file descriptor
+ *      *s:  student that was just added
+ *
+ *  Appends the entry of the student to the primary page of its bucket.
+ *  When that page is full its entries move to a new overflow page linked
+ *  right behind it, so an insert never walks the chain.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbbucket_insert(dbbucket_t *b, int fd, const student_t *s)
+{
+    int xfd = idx_fd(b, fd);
+    uint32_t hdr[DBBUCKET_PAGE / sizeof(uint32_t)];
+    int64_t entry[DBBUCKET_MAX_ENTRY / sizeof(int64_t)] = {0};
+    dbbucket_page_t page;
+    int rc = NO_ERROR;
+
+    if (xfd < 0)
+        return NO_ERROR;
+
+    uint32_t bucket = b->key(s, entry);
+    uint32_t pno = 1 + bucket;
+    dbbucket_hdr_t *h = (dbbucket_hdr_t *)hdr;
+
+    if (flock(xfd, LOCK_EX) == -1)
+        return ERR_DB_FILE;
+
+    if (read_hdr(b, xfd, hdr) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    else if ((rc = read_page(xfd, pno, &page)) == NO_ERROR)
+    {
+        if (page.count == per_page(b))
+        {
+            uint32_t moved = h->next_page++;
+            if ((rc = write_page(xfd, moved, &page)) == NO_ERROR)
+            {
+                memset(&page, 0, sizeof(page));
+                page.next = moved;
+            }
+        }
+        if (rc == NO_ERROR)
+        {
+            memcpy(entry_at(b, &page, page.count++), entry, b->entry_size);
+            rc = write_page(xfd, pno, &page);
+        }
+    }
+
+    if (rc == NO_ERROR)
+    {
+        h->entries++;
+        if (b->count != NULL)
+            b->count(hdr, bucket, 1);
+        rc = write_hdr(b, xfd, hdr);
+    }
+    flock(xfd, LOCK_UN);
+    return rc;
+}
+
+/*
+ *  dbbucket_remove
+ *      *b:  the index
+ *      fd:  database file descriptor
+ *      *s:  record of the student that was just deleted
+ *
+ *  Removes the entry of the student from its bucket chain.  The last entry
+ *  of the page takes the place of the removed one so pages stay dense.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbbucket_remove(dbbucket_t *b, int fd, const student_t *s)
+{
+    int xfd = idx_fd(b, fd);
+    uint32_t hdr[DBBUCKET_PAGE / sizeof(uint32_t)];
+    int64_t entry[DBBUCKET_MAX_ENTRY / sizeof(int64_t)] = {0};
+    dbbucket_page_t page;
+    int rc = NO_ERROR;
+
+    if (xfd < 0)
+        return NO_ERROR;
+
+    uint32_t bucket = b->key(s, entry);
+    uint32_t pno = 1 + bucket;
+
+    if (flock(xfd, LOCK_EX) == -1)
+        return ERR_DB_FILE;
+
+    if (read_hdr(b, xfd, hdr) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    while (rc == NO_ERROR && pno != 0)
+    {
+        if ((rc = read_page(xfd, pno, &page)) != NO_ERROR)
+            break;
+
+        uint32_t i;
+        for (i = 0; i < page.count; i++)
+            if (memcmp(entry_at(b, &page, i), entry, b->entry_size) == 0)
+                break;
+        if (i < page.count)
+        {
+            memcpy(entry_at(b, &page, i), entry_at(b, &page, --page.count), b->entry_size);
+            if ((rc = write_page(xfd, pno, &page)) == NO_ERROR)
+            {
+                ((dbbucket_hdr_t *)hdr)->entries--;
+                if (b->count != NULL)
+                    b->count(hdr, bucket, -1);
+                rc = write_hdr(b, xfd, hdr);
+            }
+            break;
+        }
+        pno = page.next;
+    }
+    flock(xfd, LOCK_UN);
+    return rc;
+}
+
+/*
+ *  dbbucket_lock
+ *      *b:  the index
+ *      fd:  database file descriptor
+ *      op:  LOCK_SH before a lookup, LOCK_UN after it
+ *
+ *  dbbucket_read_hdr() and dbbucket_walk() expect the caller to hold the
+ *  shared lock, so a lookup sees the header and the pages of one state.
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE if the index is not open
+ */
+int dbbucket_lock(dbbucket_t *b, int fd, int op)
+{
+    int xfd = idx_fd(b, fd);
+
+    if (xfd < 0 || flock(xfd, op) == -1)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+// reads the whole header of the index, see dbbucket_lock()
+int dbbucket_read_hdr(dbbucket_t *b, int fd, void *hdr)
+{
+    int xfd = idx_fd(b, fd);
+
+    if (xfd < 0)
+        return ERR_DB_FILE;
+    return read_hdr(b, xfd, hdr);
+}
+
+/*
+ *  dbbucket_walk
+ *      *b:      the index
+ *      fd:      database file descriptor
+ *      bucket:  bucket to read
+ *      fn:      called for every entry of the bucket
+ *      arg:     passed through to fn
+ *
+ *  Reads the chain of one bucket, see dbbucket_lock().
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE, or the first non zero return of fn
+ */
+int dbbucket_walk(dbbucket_t *b, int fd, uint32_t bucket, dbbucket_fn fn, void *arg)
+{
+    int xfd = idx_fd(b, fd);
+    dbbucket_page_t page;
+    uint32_t pno = 1 + bucket;
+    int rc = NO_ERROR;
+
+    if (xfd < 0)
+        return ERR_DB_FILE;
+
+    while (rc == NO_ERROR && pno != 0)
+    {
+        if ((rc = read_page(xfd, pno, &page)) != NO_ERROR)
+            break;
+        for (uint32_t i = 0; i < page.count && rc == NO_ERROR; i++)
+            rc = fn(entry_at(b, &page, i), arg);
+        pno = page.next;
+    }
+    return rc;
+}
+
+// appends an id to the result of a lookup, returns NO_ERROR or ERR_DB_FILE
+int dbbucket_add_id(dbbucket_ids_t *out, long long id)
+{
+    if (out->n == out->cap)
+    {
+        int cap = out->cap ? out->cap * 2 : 16;
+        long long *grown = realloc(out->ids, cap * sizeof(long long));
+        if (grown == NULL)
+            return ERR_DB_FILE;
+        out->ids = grown;
+        out->cap = cap;
+    }
+    out->ids[out->n++] = id;
+    return NO_ERROR;
+}
+
+static int cmp_id(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ *  dbbucket_sort_ids
+ *      *out:   ids collected by a lookup
+ *      **ids:  set to the sorted ids, the caller frees them
+ *
+ *  Sorts the ids and drops the duplicates a concurrent rebuild may have
+ *  left behind.  An empty result is still an allocated array.
+ *
+ *  returns:  number of ids, or ERR_DB_FILE
+ */
+int dbbucket_sort_ids(dbbucket_ids_t *out, long long **ids)
+{
+    int uniq = 0;
+
+    *ids = NULL;
+    if (out->ids == NULL && (out->ids = malloc(sizeof(long long))) == NULL)
+        return ERR_DB_FILE;
+
+    qsort(out->ids, out->n, sizeof(long long), cmp_id);
+    for (int i = 0; i < out->n; i++)
+        if (uniq == 0 || out->ids[uniq - 1] != out->ids[i])
+            out->ids[uniq++] = out->ids[i];
+    *ids = out->ids;
+    return uniq;
+}
@@ -0,0 +1,80 @@
+#ifndef __DBBUCKET_H__
+#define __DBBUCKET_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "db.h"   //get student record type
+#include "dbio.h" //get DBIO_MAX_FD
+
+// Bucket file shared by the secondary indexes on the last name (nameidx.h)
+// and on the gpa (gpaidx.h).  An index only says which bucket a student
+// goes to and what its entry looks like, the paging, the rebuild from the
+// records and the locking live here.
+//
+// The file is made of DBBUCKET_PAGE sized pages.  Page 0 is the header,
+// which starts with dbbucket_hdr_t and may carry more fields of the index
+// behind it.  Pages 1..buckets are the primary bucket pages, overflow pages
+// are appended behind them when a bucket fills up.  Writers take an
+// exclusive flock() of the file, readers a shared one.
+#define DBBUCKET_PAGE 4096
+
+// largest entry an index may store
+#define DBBUCKET_MAX_ENTRY 16
+
+typedef struct dbbucket_hdr
+{
+    char magic[8];      // magic of the index
+    uint32_t version;   // version of the index
+    uint32_t buckets;   // number of primary bucket pages
+    uint32_t next_page; // first page that is not in use yet
+    int32_t entries;    // number of indexed students
+} dbbucket_hdr_t;
+
+typedef struct dbbucket_page
+{
+    uint32_t count; // entries in use on this page
+    uint32_t next;  // next overflow page of the bucket, 0 for none
+    uint32_t pad[2];
+    unsigned char e[DBBUCKET_PAGE - 16];
+} dbbucket_page_t;
+
+// Description of one index.  key() fills in the entry of a student and
+// returns its bucket, count() (may be NULL) keeps fields of the header
+// behind dbbucket_hdr_t up to date, it gets +1 or -1 for every entry added
+// or removed.  An index keeps one static dbbucket_t.
+typedef struct dbbucket
+{
+    const char *magic;
+    uint32_t version;
+    uint32_t buckets;
+    size_t hdr_size;   // sizeof the header of the index
+    size_t entry_size; // at most DBBUCKET_MAX_ENTRY
+    uint32_t (*key)(const student_t *s, void *entry);
+    void (*count)(void *hdr, uint32_t bucket, int delta);
+    int fds[DBIO_MAX_FD]; // index file descriptor + 1 per database fd
+} dbbucket_t;
+
+// callback of dbbucket_walk(), a non zero return stops the walk and is
+// passed back
+typedef int (*dbbucket_fn)(const void *entry, void *arg);
+
+// ids collected by a lookup, see dbbucket_add_id()
+typedef struct dbbucket_ids
+{
+    long long *ids;
+    int n;
+    int cap;
+} dbbucket_ids_t;
+
+int dbbucket_open(dbbucket_t *b, int fd, char *dbFile, const char *suffix, bool should_truncate);
+void dbbucket_close(dbbucket_t *b, int fd);
+int dbbucket_insert(dbbucket_t *b, int fd, const student_t *s);
+int dbbucket_remove(dbbucket_t *b, int fd, const student_t *s);
+int dbbucket_lock(dbbucket_t *b, int fd, int op);
+int dbbucket_read_hdr(dbbucket_t *b, int fd, void *hdr);
+int dbbucket_walk(dbbucket_t *b, int fd, uint32_t bucket, dbbucket_fn fn, void *arg);
+int dbbucket_add_id(dbbucket_ids_t *out, long long id);
+int dbbucket_sort_ids(dbbucket_ids_t *out, long long **ids);
+
+#endif
@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbfmt.h"
+
+/*
+ *  dbfmt_mode
+ *      opt:  command line option after -p, NULL for none
+ *
+ *  returns:  FMT_* for "--csv", "--jsonl", "--raw" or no option, -1 for
+ *            anything else
+ */
+int dbfmt_mode(const char *opt)
+{
+    if (opt == NULL)
+        return FMT_TABLE;
+    if (strcmp(opt, "--csv") == 0)
+        return FMT_CSV;
+    if (strcmp(opt, "--jsonl") == 0)
+        return FMT_JSONL;
+    if (strcmp(opt, "--raw") == 0)
+        return FMT_RAW;
+    return -1;
+}
+
+// writes out everything that is buffered, a failed write() is remembered
+// and the rest of the output is dropped
+static void flush_buf(dbfmt_t *f)
+{
+    size_t done = 0;
+
+    while (done < f->len && !f->err)
+    {
+        ssize_t n = write(f->out, f->buf + done, f->len - done);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            f->err = 1;
+        else
+            done += n;
+    }
+    f->len = 0;
+}
+
+// makes room for at least FMT_MAX_ROW more bytes
+static void make_room(dbfmt_t *f)
+{
+    if (f->cap - f->len >= FMT_MAX_ROW)
+        return;
+    if (f->out >= 0)
+    {
+        flush_buf(f);
+        return;
+    }
+
+    char *grown = realloc(f->buf, f->cap * 2);
+    if (grown == NULL)
+    {
+        // the rows of this part are lost, dbfmt_close() reports it
+        f->err = 1;
+        f->len = 0;
+        return;
+    }
+    f->buf = grown;
+    f->cap *= 2;
+}
+
+static void put_bytes(dbfmt_t *f, const char *p, size_t n)
+{
+    memcpy(f->buf + f->len, p, n);
+    f->len += n;
+}
+
+static void put_char(dbfmt_t *f, char c)
+{
+    f->buf[f->len++] = c;
+}
+
+// like "%-*s", pads with blanks
+static void put_padded(dbfmt_t *f, const char *p, size_t n, size_t width)
+{
+    put_bytes(f, p, n);
+    if (n < width)
+    {
+        memset(f->buf + f->len, ' ', width - n);
+        f->len += width - n;
+    }
+}
+
+// decimal digits of v, written backwards into the end of tmp
+static size_t fmt_uint(char *tmp, size_t size, unsigned long long v)
+{
+    size_t i = size;
+
+    do
+    {
+        tmp[--i] = '0' + v % 10;
+        v /= 10;
+    } while (v != 0);
+    return i;
+}
+
+static void put_id(dbfmt_t *f, long long id, size_t width)
+{
+    char tmp[24];
+    size_t i;
+
+    if (id < 0)
+    {
+        i = fmt_uint(tmp, sizeof(tmp), -(unsigned long long)id);
+        tmp[--i] = '-';
+    }
+    else
+        i = fmt_uint(tmp, sizeof(tmp), id);
+    put_padded(f, tmp + i, sizeof(tmp) - i, width);
+}
+
+// gpa / 100.0 with two decimals, the same text "%.2f" prints
+static void put_gpa(dbfmt_t *f, int gpa)
+{
+    char tmp[16];
+    size_t i;
+    unsigned v = gpa < 0 ? -gpa : gpa;
+
+    tmp[15] = '0' + v % 10;
+    tmp[14] = '0' + v / 10 % 10;
+    tmp[13] = '.';
+    i = fmt_uint(tmp, 13, v / 100);
+    if (gpa < 0)
+        tmp[--i] = '-';
+    put_bytes(f, tmp + i, sizeof(tmp) - i);
+}
+
+static void put_csv(dbfmt_t *f, const char *p, size_t n)
+{
+    bool quote = false;
+
+    for (size_t i = 0; i < n && !quote; i++)
+        quote = p[i] == ',' || p[i] == '"' || p[i] == '\r' || p[i] == '\n';
+    if (!quote)
+    {
+        put_bytes(f, p, n);
+        return;
+    }
+    put_char(f, '"');
+    for (size_t i = 0; i < n; i++)
+    {
+        if (p[i] == '"')
+            put_char(f, '"');
+        put_char(f, p[i]);
+    }
+    put_char(f, '"');
+}
+
+static void put_json(dbfmt_t *f, const char *p, size_t n)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    put_char(f, '"');
+    for (size_t i = 0; i < n; i++)
+    {
+        unsigned char c = p[i];
+        if (c == '"' || c == '\\')
+        {
+            put_char(f, '\\');
+            put_char(f, c);
+        }
+        else if (c < 0x20)
+        {
+            put_bytes(f, "\\u00", 4);
+            put_char(f, hex[c >> 4]);
+            put_char(f, hex[c & 15]);
+        }
+        else
+            put_char(f, c);
+    }
+    put_char(f, '"');
+}
+
+/*
+ *  dbfmt_open
+ *      *f:    formatter to set up
+ *      mode:  FMT_*
+ *      out:   file descriptor to write to, usually STDOUT_FILENO, or -1
+ *             to keep the output in memory
+ *
+ *  Anything stdio still holds is flushed first, so output printed with
+ *  printf() before stays in front of the rows.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE (out of memory)
+ */
+int dbfmt_open(dbfmt_t *f, int mode, int out)
+{
+    memset(f, 0, sizeof(*f));
+    f->mode = mode;
+    f->out = out;
+    f->cap = out >= 0 ? FMT_BUF_SIZE : FMT_MEM_SIZE;
+    f->buf = malloc(f->cap);
+    if (f->buf == NULL)
+        return ERR_DB_FILE;
+    if (out >= 0)
+        fflush(stdout);
+    return NO_ERROR;
+}
+
+/*
+ *  dbfmt_header
+ *      *f:  formatter
+ *
+ *  Adds the header line of the table or of the CSV output, the other
+ *  modes have none.
+ */
+void dbfmt_header(dbfmt_t *f)
+{
+    make_room(f);
+    if (f->mode == FMT_TABLE)
+        f->len += snprintf(f->buf + f->len, FMT_MAX_ROW, STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME",
+                           "LAST_NAME", "GPA");
+    else if (f->mode == FMT_CSV)
+        put_bytes(f, "id,fname,lname,gpa\n", 19);
+}
+
+/*
+ *  dbfmt_row
+ *      *f:  formatter
+ *      *s:  student to add
+ *
+ *  Renders one student in the mode of f.  The name fields are not
+ *  necessarily terminated, at most their size is used.
+ */
+void dbfmt_row(dbfmt_t *f, const student_t *s)
+{
+    size_t fn = strnlen(s->fname, sizeof(s->fname));
+    size_t ln = strnlen(s->lname, sizeof(s->lname));
+
+    make_room(f);
+
+    switch (f->mode)
+    {
+    case FMT_TABLE:
+        // STUDENT_PRINT_FMT_STRING, the names are shorter than their columns
+        put_id(f, s->id, 6);
+        put_char(f, ' ');
+        put_padded(f, s->fname, fn, 24);
+        put_char(f, ' ');
+        put_padded(f, s->lname, ln, 32);
+        put_char(f, ' ');
+        put_gpa(f, s->gpa);
+        put_char(f, '\n');
+        break;
+
+    case FMT_CSV:
+        put_id(f, s->id, 0);
+        put_char(f, ',');
+        put_csv(f, s->fname, fn);
+        put_char(f, ',');
+        put_csv(f, s->lname, ln);
+        put_char(f, ',');
+        put_gpa(f, s->gpa);
+        put_char(f, '\n');
+        break;
+
+    case FMT_JSONL:
+        put_bytes(f, "{\"id\":", 6);
+        put_id(f, s->id, 0);
+        put_bytes(f, ",\"fname\":", 9);
+        put_json(f, s->fname, fn);
+        put_bytes(f, ",\"lname\":", 9);
+        put_json(f, s->lname, ln);
+        put_bytes(f, ",\"gpa\":", 7);
+        put_gpa(f, s->gpa);
+        put_bytes(f, "}\n", 2);
+        break;
+
+    case FMT_RAW:
+        put_bytes(f, (const char *)s, STUDENT_RECORD_SIZE);
+        break;
+    }
+}
+
+/*
+ *  dbfmt_append
+ *      *f:     formatter that writes to a file descriptor
+ *      *part:  memory formatter, emptied
+ *
+ *  Adds everything part holds to the output of f.  A part that does not
+ *  fit into the buffer of f goes out with its own write() calls.
+ */
+void dbfmt_append(dbfmt_t *f, dbfmt_t *part)
+{
+    if (part->err)
+        f->err = 1;
+    if (f->cap - f->len >= part->len)
+        put_bytes(f, part->buf, part->len);
+    else
+    {
+        flush_buf(f);
+        char *buf = f->buf;
+        f->buf = part->buf;
+        f->len = part->len;
+        flush_buf(f);
+        f->buf = buf;
+    }
+    part->len = 0;
+}
+
+/*
+ *  dbfmt_close
+ *      *f:  formatter
+ *
+ *  Writes out what is left in the buffer and releases it.
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE if any write() failed
+ */
+int dbfmt_close(dbfmt_t *f)
+{
+    flush_buf(f);
+    free(f->buf);
+    f->buf = NULL;
+    return f->err ? ERR_DB_FILE : NO_ERROR;
+}
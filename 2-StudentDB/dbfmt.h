@@ -0,0 +1,51 @@
+#ifndef __DBFMT_H__
+#define __DBFMT_H__
+
+#include <stddef.h>
+
+#include "db.h" //get student record type
+
+// Output formatter used by print_db().  Rows are rendered straight into one
+// large buffer, the gpa with integer arithmetic only, and the buffer goes
+// out with a single write() whenever it fills up.  The table rows are byte
+// for byte what STUDENT_PRINT_FMT_STRING produces.
+//
+// Besides the table, -p can print the records in formats that are meant
+// for other programs:
+//   ./sdbsc -p --csv    id,fname,lname,gpa header, then one row per student
+//   ./sdbsc -p --jsonl  one JSON object per student and line
+//   ./sdbsc -p --raw    the 64 byte student records as stored (see db.h)
+#define FMT_TABLE 0
+#define FMT_CSV 1
+#define FMT_JSONL 2
+#define FMT_RAW 3
+
+// A formatter opened with out < 0 keeps everything in memory instead, its
+// buffer grows as needed.  The parallel scan renders every range into one
+// of those and appends it to the real output in range order.
+//
+// Size of the output buffer (and the first size of a memory buffer), and
+// the most one row can ever take (a JSON row whose names consist of
+// characters that all need \u escapes)
+#define FMT_BUF_SIZE (256 * 1024)
+#define FMT_MEM_SIZE (64 * 1024)
+#define FMT_MAX_ROW 512
+
+typedef struct dbfmt
+{
+    int mode;  // FMT_*
+    int out;   // file descriptor the buffer is written to, -1 for memory
+    int err;   // set once a write() or an allocation failed
+    size_t len;
+    size_t cap;
+    char *buf;
+} dbfmt_t;
+
+int dbfmt_mode(const char *opt);
+int dbfmt_open(dbfmt_t *f, int mode, int out);
+void dbfmt_header(dbfmt_t *f);
+void dbfmt_row(dbfmt_t *f, const student_t *s);
+void dbfmt_append(dbfmt_t *f, dbfmt_t *part);
+int dbfmt_close(dbfmt_t *f);
+
+#endif
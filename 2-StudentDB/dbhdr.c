@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbio.h"
+#include "dbhdr.h"
+
+// Chunk size used to read an old database while migrating it
+#define DBHDR_MIGRATE_CHUNK (1024 * 1024)
+
+// Student record of headerless and version 1 files, 32 bit id
+typedef struct student_v1
+{
+    int id;
+    char fname[24];
+    char lname[32];
+    int gpa;
+} student_v1_t;
+
+// converts an old record, a first name longer than the new field is cut
+static void record_from_v1(const student_v1_t *old, student_t *s)
+{
+    *s = EMPTY_STUDENT_RECORD;
+    s->id = old->id;
+    memcpy(s->fname, old->fname, sizeof(s->fname) - 1);
+    memcpy(s->lname, old->lname, sizeof(s->lname));
+    s->lname[sizeof(s->lname) - 1] = '\0';
+    s->gpa = old->gpa;
+}
+
+static void header_fill(db_header_t *hdr)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, DB_HEADER_MAGIC, sizeof(hdr->magic));
+    hdr->version = DB_HEADER_VERSION;
+    hdr->header_size = DB_HEADER_SIZE;
+    hdr->record_size = sizeof(student_t);
+    hdr->max_id = MAX_STD_ID;
+}
+
+/*
+ *  header_create
+ *      fd:  linux file descriptor of an empty database file
+ *
+ *  Writes a fresh header.  Only the first 64 bytes are written, the bitmap
+ *  starts out as a hole and pages of it are allocated as ids are added.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int header_create(int fd)
+{
+    db_header_t hdr;
+
+    header_fill(&hdr);
+    if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        return ERR_DB_FILE;
+    if (ftruncate(fd, DB_HEADER_SIZE) == -1)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+/*
+ *  tmp_path_for
+ *      path:  path of the database file
+ *      *buf:  receives TMP_DB_FILE placed in the same directory as path
+ *      len:   size of buf
+ */
+static void tmp_path_for(const char *path, char *buf, size_t len)
+{
+    const char *slash = strrchr(path, '/');
+
+    if (slash == NULL)
+        snprintf(buf, len, "%s", TMP_DB_FILE);
+    else
+        snprintf(buf, len, "%.*s/%s", (int)(slash - path), path, TMP_DB_FILE);
+}
+
+/*
+ *  header_migrate
+ *      path:  path of the database file
+ *      fd:    linux file descriptor of an old database
+ *      base:  offset of the slot for id 0 in the old file, 0 for headerless
+ *             files and DB_HEADER_SIZE for version 1 files
+ *
+ *  The live records are converted to the current record format and copied
+ *  into TMP_DB_FILE behind a new header (holes stay holes), the bitmap and
+ *  count are built on the way, and the temporary file is then renamed over
+ *  the old one.  The old fd is closed.
+ *
+ *  A first name longer than STD_FNAME_MAX or a record in a slot outside
+ *  MIN_STD_ID..MAX_STD_ID can not be carried over as it is.  By default
+ *  the scan still runs to the end so every such record is reported, and
+ *  then the migration is given up and the old file is left as it was.
+ *  With DBHDR_MIGRATE_ENV=1 those names are cut and those records dropped,
+ *  each one reported as well.
+ *
+ *  returns:  fd of the migrated database, or ERR_DB_FILE
+ *  console:  M_ERR_MIGRATE_FNAME or M_ERR_MIGRATE_ID for each record that
+ *            can not be migrated, then M_ERR_MIGRATE_LOSSY.  When allowed,
+ *            M_MIGRATE_FNAME_CUT or M_MIGRATE_ID_DROP instead
+ */
+static int header_migrate(char *path, int fd, off_t base)
+{
+    char tmp_path[4096];
+    struct stat st;
+    db_header_t hdr;
+    uint8_t *bitmap = calloc(1, DB_HEADER_BITMAP_BYTES);
+    char *buf = malloc(DBHDR_MIGRATE_CHUNK);
+    off_t data, hole;
+    int rc = NO_ERROR;
+    int more;
+    bool lossy = false;
+    char *env = getenv(DBHDR_MIGRATE_ENV);
+    bool allow = env != NULL && strcmp(env, "1") == 0;
+
+    tmp_path_for(path, tmp_path, sizeof(tmp_path));
+    int tfd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+
+    if (tfd == -1 || bitmap == NULL || buf == NULL || fstat(fd, &st) == -1)
+        rc = ERR_DB_FILE;
+
+    header_fill(&hdr);
+    for (hole = base; rc == NO_ERROR; )
+    {
+        more = dbio_next_extent(fd, hole, st.st_size, STUDENT_RECORD_SIZE, &data, &hole);
+        if (more <= 0)
+        {
+            rc = more;
+            break;
+        }
+
+        for (off_t off = data; off < hole && rc == NO_ERROR; off += DBHDR_MIGRATE_CHUNK)
+        {
+            size_t want = hole - off < DBHDR_MIGRATE_CHUNK ? (size_t)(hole - off) : DBHDR_MIGRATE_CHUNK;
+            ssize_t got = pread(fd, buf, want, off);
+            if (got == -1)
+            {
+                rc = ERR_DB_FILE;
+                break;
+            }
+
+            for (ssize_t r = 0; r + STUDENT_RECORD_SIZE <= got; r += STUDENT_RECORD_SIZE)
+            {
+                student_v1_t *old = (student_v1_t *)(buf + r);
+                long long slot = (off + r - base) / STUDENT_RECORD_SIZE;
+                student_t s;
+
+                if (memcmp(old, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) == 0)
+                    continue;
+                if (slot < MIN_STD_ID || slot > MAX_STD_ID)
+                {
+                    printf(allow ? M_MIGRATE_ID_DROP : M_ERR_MIGRATE_ID, slot);
+                    lossy = true;
+                    continue;
+                }
+                int id = (int)slot;
+                if (strnlen(old->fname, sizeof(old->fname)) > STD_FNAME_MAX)
+                {
+                    printf(allow ? M_MIGRATE_FNAME_CUT : M_ERR_MIGRATE_FNAME, id, STD_FNAME_MAX);
+                    lossy = true;
+                }
+                if (lossy && !allow)
+                    continue;
+                record_from_v1(old, &s);
+                if (pwrite(tfd, &s, STUDENT_RECORD_SIZE, db_record_offset(id)) != STUDENT_RECORD_SIZE)
+                {
+                    rc = ERR_DB_FILE;
+                    break;
+                }
+                bitmap[id >> 3] |= 1 << (id & 7);
+                hdr.live_count++;
+            }
+            if (got < (ssize_t)want)
+                break;
+        }
+    }
+
+    if (rc == NO_ERROR && lossy && !allow)
+    {
+        printf(M_ERR_MIGRATE_LOSSY, DBHDR_MIGRATE_ENV);
+        rc = ERR_DB_FILE;
+    }
+
+    // the header goes in last, a migration that dies half way leaves an
+    // unusable temp file behind but never a header that lies
+    if (rc == NO_ERROR &&
+        (ftruncate(tfd, DB_HEADER_SIZE + st.st_size - base) == -1 ||
+         pwrite(tfd, bitmap, DB_HEADER_BITMAP_BYTES, DB_HEADER_BITMAP_OFF) != DB_HEADER_BITMAP_BYTES ||
+         pwrite(tfd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+         fsync(tfd) == -1 || rename(tmp_path, path) == -1))
+        rc = ERR_DB_FILE;
+
+    free(bitmap);
+    free(buf);
+    close(fd);
+    if (rc != NO_ERROR)
+    {
+        if (tfd != -1)
+        {
+            close(tfd);
+            unlink(tmp_path);
+        }
+        return ERR_DB_FILE;
+    }
+    return tfd;
+}
+
+/*
+ *  dbhdr_open
+ *      path:  path of the database file
+ *      fd:    linux file descriptor just opened on path
+ *
+ *  Makes sure the database behind fd carries a current header.  An empty
+ *  file (new database, or one truncated by -z) gets a fresh header, a
+ *  database from before the header existed or with 32 bit ids (version 1)
+ *  is migrated.  The work is done
+ *  under flock() so two processes opening the same new or old file at the
+ *  same time do not both format it.  If another process migrated the file
+ *  while we waited for the lock, our fd points to the replaced file and
+ *  the path is opened again.
+ *
+ *  returns:  fd to use from now on (may differ from the fd passed in), or
+ *            ERR_DB_FILE.  On error fd has been closed.
+ */
+int dbhdr_open(char *path, int fd)
+{
+    for (;;)
+    {
+        struct stat st;
+        db_header_t hdr;
+        int rc = NO_ERROR;
+
+        if (flock(fd, LOCK_EX) == -1 || fstat(fd, &st) == -1)
+        {
+            close(fd);
+            return ERR_DB_FILE;
+        }
+
+        if (st.st_nlink == 0)
+        {
+            close(fd);
+            fd = open(path, O_RDWR);
+            if (fd == -1)
+                return ERR_DB_FILE;
+            continue;
+        }
+
+        if (st.st_size == 0)
+            rc = header_create(fd);
+        else if (st.st_size >= (off_t)sizeof(hdr) &&
+                 pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+                 memcmp(hdr.magic, DB_HEADER_MAGIC, sizeof(hdr.magic)) == 0)
+        {
+            if (hdr.version == 1 && hdr.header_size == DB_HEADER_SIZE &&
+                hdr.record_size == sizeof(student_v1_t) && hdr.max_id == MAX_STD_ID)
+                return header_migrate(path, fd, DB_HEADER_SIZE);
+            if (hdr.version != DB_HEADER_VERSION || hdr.header_size != DB_HEADER_SIZE ||
+                hdr.record_size != sizeof(student_t) || hdr.max_id != MAX_STD_ID)
+                rc = ERR_DB_FILE;
+            else if (st.st_size < DB_HEADER_SIZE && ftruncate(fd, DB_HEADER_SIZE) == -1)
+                rc = ERR_DB_FILE;
+        }
+        else
+            return header_migrate(path, fd, 0);
+
+        flock(fd, LOCK_UN);
+        if (rc != NO_ERROR)
+        {
+            close(fd);
+            return ERR_DB_FILE;
+        }
+        return fd;
+    }
+}
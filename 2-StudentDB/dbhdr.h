@@ -0,0 +1,59 @@
+#ifndef __DBHDR_H__
+#define __DBHDR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "db.h" //get student record type
+
+// Every database file starts with a header of DB_HEADER_SIZE bytes, the
+// student slots follow it, see db_record_offset() in dbio.h.  The header
+// holds the number of live records and an occupancy bitmap with one bit per
+// id in 0..MAX_STD_ID, so counting the records or checking whether an id is
+// taken never has to touch the record pages.
+//
+//     offset 0                     db_header_t
+//     offset DB_HEADER_BITMAP_OFF  occupancy bitmap, bit id%8 of byte id/8
+//     offset DB_HEADER_SIZE        slot for id 0, 1, 2 ...
+//
+// The header is kept mapped (MAP_SHARED) by every process that has the
+// database open and is updated with atomic instructions, so concurrent
+// adds and deletes from different processes can never lose an update.
+#define DB_HEADER_MAGIC "SDBHDR\0"
+// Version 2 is the 64 bit id record format, see db.h.  Version 1 files and
+// files from before the header existed are converted by dbhdr_open().
+#define DB_HEADER_VERSION 2
+// A migration that would have to cut a first name or drop a record is
+// refused, DBHDR_MIGRATE_ENV=1 lets it go ahead and report each one:
+//   SDB_MIGRATE_LOSSY=1 ./sdbsc -c
+#define DBHDR_MIGRATE_ENV "SDB_MIGRATE_LOSSY"
+#define DB_HEADER_SIZE 16384
+#define DB_HEADER_BITMAP_OFF 64
+#define DB_HEADER_BITMAP_BYTES ((MAX_STD_ID + 8) / 8)
+
+typedef struct db_header
+{
+    char magic[8];        // DB_HEADER_MAGIC
+    uint32_t version;     // DB_HEADER_VERSION
+    uint32_t header_size; // DB_HEADER_SIZE
+    uint32_t record_size; // sizeof(student_t)
+    uint32_t max_id;      // highest id covered by the bitmap
+    int32_t live_count;   // number of live student records
+    uint32_t write_gen;   // bumped by every write of a fixed slot, see dbpool.h
+    uint32_t reserved[8]; // zero, pads the header to 64 bytes
+} db_header_t;
+
+static inline uint8_t *dbhdr_bitmap(db_header_t *hdr)
+{
+    return (uint8_t *)hdr + DB_HEADER_BITMAP_OFF;
+}
+
+static inline bool dbhdr_test(db_header_t *hdr, int id)
+{
+    uint8_t byte = __atomic_load_n(&dbhdr_bitmap(hdr)[id >> 3], __ATOMIC_ACQUIRE);
+    return (byte >> (id & 7)) & 1;
+}
+
+int dbhdr_open(char *path, int fd);
+
+#endif
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbindex.h"
+#include "nameidx.h"
+#include "gpaidx.h"
+#include "trieidx.h"
+
+/*
+ *  db_indexes_open
+ *      fd:               database file descriptor
+ *      dbFile:           path of the database, index files live next to it
+ *      should_truncate:  the database was just emptied, empty the indexes
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int db_indexes_open(int fd, char *dbFile, bool should_truncate)
+{
+    if (nameidx_open(fd, dbFile, should_truncate) != NO_ERROR)
+        return ERR_DB_FILE;
+    if (gpaidx_open(fd, dbFile, should_truncate) != NO_ERROR)
+    {
+        nameidx_close(fd);
+        return ERR_DB_FILE;
+    }
+    if (trieidx_open(fd, dbFile, should_truncate) != NO_ERROR)
+    {
+        nameidx_close(fd);
+        gpaidx_close(fd);
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+void db_indexes_close(int fd)
+{
+    nameidx_close(fd);
+    gpaidx_close(fd);
+    trieidx_close(fd);
+}
+
+/*
+ *  db_indexes_insert
+ *      fd:  database file descriptor
+ *      *s:  student that was just added
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int db_indexes_insert(int fd, const student_t *s)
+{
+    int rc = nameidx_insert(fd, s);
+
+    if (gpaidx_insert(fd, s) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    if (trieidx_insert(fd, s) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    return rc;
+}
+
+/*
+ *  db_indexes_remove
+ *      fd:  database file descriptor
+ *      *s:  the record of the student that was just deleted
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int db_indexes_remove(int fd, const student_t *s)
+{
+    int rc = nameidx_remove(fd, s);
+
+    if (gpaidx_remove(fd, s) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    if (trieidx_remove(fd, s) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    return rc;
+}
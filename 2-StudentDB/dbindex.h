@@ -0,0 +1,16 @@
+#ifndef __DBINDEX_H__
+#define __DBINDEX_H__
+
+#include <stdbool.h>
+
+#include "db.h" //get student record type
+
+// Secondary indexes of the database.  open_db()/close_db() attach and
+// release them, and every code path that adds or deletes a student reports
+// the change here so all indexes stay in sync with the records.
+int db_indexes_open(int fd, char *dbFile, bool should_truncate);
+void db_indexes_close(int fd);
+int db_indexes_insert(int fd, const student_t *s);
+int db_indexes_remove(int fd, const student_t *s);
+
+#endif
@@ -0,0 +1,1522 @@
+#define _GNU_SOURCE // fallocate(), SEEK_DATA, SEEK_HOLE and F_OFD_SETLKW
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbio.h"
+#include "dbhdr.h"
+#include "dbscan.h"
+#include "dburing.h"
+#include "dbpool.h"
+
+// Per file descriptor state for the storage layer.  The program only ever
+// has a handful of database descriptors open so a small table indexed by the
+// fd itself (see DBIO_MAX_FD) is plenty.
+
+// Largest iovec array handed to pwritev(), Linux accepts up to 1024
+#define DBIO_MAX_IOV 1024
+
+// Scans and compaction read allocated extents in chunks of this size.  It
+// is a multiple of both STUDENT_RECORD_SIZE and DB_PAGE_SIZE.
+#define DBIO_CHUNK (1024 * 1024)
+
+// Blocks of the uncached scans (see DBIO_SCAN_IO_ENV), smaller so that a
+// range of the parallel scan still has a few of them to overlap
+#define DBIO_COLD_CHUNK (128 * 1024)
+
+typedef struct dbio_ctx
+{
+    int flags;         // DB_OPEN_* flags the fd was attached with
+    db_header_t *hdr;  // shared mapping of the file header, all backends
+    char *map;         // base of the mapping (DB_OPEN_MMAP only)
+    size_t map_cap;    // bytes reserved for the mapping, covers MAX_STD_ID
+    off_t file_size;   // cached size of the file, the valid part of map
+} dbio_ctx_t;
+
+static dbio_ctx_t dbio_table[DBIO_MAX_FD];
+
+// mapping state of fd, NULL unless it uses the mmap backend
+static dbio_ctx_t *dbio_ctx(int fd)
+{
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return NULL;
+    if (!(dbio_table[fd].flags & DB_OPEN_MMAP))
+        return NULL;
+    return &dbio_table[fd];
+}
+
+// header of fd, NULL if fd was never attached
+static db_header_t *dbio_hdr(int fd)
+{
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return NULL;
+    return dbio_table[fd].hdr;
+}
+
+// true if [offset, offset + len) is inside the mapping of the mmap backend.
+// The mapping covers the header and the fixed slots of ids up to
+// MAX_STD_ID, the pages of the id map behind them (see dbmap.h) are
+// always accessed with pread()/pwrite()
+static bool in_map(const dbio_ctx_t *ctx, off_t offset, size_t len)
+{
+    return ctx != NULL && (size_t)offset + len <= ctx->map_cap;
+}
+
+static bool is_empty_record(const student_t *s)
+{
+    return memcmp(s, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) == 0;
+}
+
+// tells the buffer pools of other processes that a fixed slot changed, see
+// dbpool.h.  Called once the write is done
+static void note_write(int fd, int last_id)
+{
+    db_header_t *hdr = dbio_hdr(fd);
+
+    if (hdr != NULL && last_id >= 0 && last_id <= MAX_STD_ID)
+        __atomic_add_fetch(&hdr->write_gen, 1, __ATOMIC_RELEASE);
+}
+
+// OFD byte range lock on [start, start + len) of the database file, waits
+// for conflicting locks of other processes.  F_UNLCK releases the range.
+static int lock_range(int fd, off_t start, off_t len, short type)
+{
+    struct flock fl = {0};
+
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = start;
+    fl.l_len = len;
+    while (fcntl(fd, F_OFD_SETLKW, &fl) == -1)
+        if (errno != EINTR)
+            return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+// one record sized read or write of the fd backend, through the ring when
+// fd has one.  Returns the bytes transferred or -1 like pread()/pwrite()
+static ssize_t fd_rw(int fd, int op, void *buf, off_t offset)
+{
+    if (dburing_active(fd))
+    {
+        dburing_req_t req = {op, buf, STUDENT_RECORD_SIZE, offset, 0};
+
+        if (dburing_run(fd, &req, 1) == NO_ERROR)
+        {
+            if (req.res < 0)
+            {
+                errno = -req.res;
+                return -1;
+            }
+            return req.res;
+        }
+    }
+    if (op == DBURING_WRITE)
+        return pwrite(fd, buf, STUDENT_RECORD_SIZE, offset);
+    return pread(fd, buf, STUDENT_RECORD_SIZE, offset);
+}
+
+/*
+ *  map_refresh_size
+ *      ctx:  mapping state for the database fd
+ *      fd:   linux file descriptor
+ *
+ *  Another process (or the fd backend in this process) may have grown the
+ *  file behind our back.  Re-read the size so the valid window of the
+ *  mapping follows the file.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int map_refresh_size(dbio_ctx_t *ctx, int fd)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) == -1)
+        return ERR_DB_FILE;
+    ctx->file_size = st.st_size;
+    return NO_ERROR;
+}
+
+/*
+ *  grow_file
+ *      fd:    linux file descriptor
+ *      size:  the file has to be at least this large
+ *
+ *  Several processes may grow the mapped file at once.  An ftruncate() to
+ *  a size read a moment earlier can shrink the file behind another process
+ *  that already grew it and wrote through its mapping, which loses its
+ *  records and makes its next access fault.  fallocate() of the last slot
+ *  only ever extends the file.  File systems without fallocate() re-read
+ *  the size and extend under a write lock on the first byte of the file.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int grow_file(int fd, off_t size)
+{
+    struct stat st;
+    int rc = NO_ERROR;
+
+    if (fallocate(fd, 0, size - STUDENT_RECORD_SIZE, STUDENT_RECORD_SIZE) == 0)
+        return NO_ERROR;
+    if (errno != EOPNOTSUPP || lock_range(fd, 0, 1, F_WRLCK) != NO_ERROR)
+        return ERR_DB_FILE;
+    if (fstat(fd, &st) == -1 || (st.st_size < size && ftruncate(fd, size) == -1))
+        rc = ERR_DB_FILE;
+    lock_range(fd, 0, 1, F_UNLCK);
+    return rc;
+}
+
+/*
+ *  dbio_attach
+ *      fd:     linux file descriptor returned from open()
+ *      flags:  DB_OPEN_* backend selection
+ *
+ *  Sets up the storage backend for fd.  For DB_OPEN_MMAP the whole id range
+ *  (0..MAX_STD_ID) is reserved up front with a single shared mapping.  Only
+ *  the part of the mapping that is backed by the file may be touched, so the
+ *  usable window grows with the file as new ids are added (see dbio_write()).
+ *  Reserving the address space once means the mapping never has to move.
+ *  DB_OPEN_URING sets up an io_uring for the fd backend (see dburing.h), if
+ *  the kernel cannot provide one the flag is dropped and fd works as usual.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbio_attach(int fd, int flags)
+{
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return ERR_DB_FILE;
+
+    dbio_ctx_t *ctx = &dbio_table[fd];
+    memset(ctx, 0, sizeof(*ctx));
+
+    if (flags & DB_OPEN_MMAP)
+    {
+        long page = sysconf(_SC_PAGESIZE);
+        size_t cap = (size_t)db_record_offset(MAX_STD_ID + 1);
+        cap = (cap + page - 1) / page * page;
+
+        if (map_refresh_size(ctx, fd) != NO_ERROR)
+            return ERR_DB_FILE;
+
+        void *map = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+            return ERR_DB_FILE;
+
+        ctx->map = map;
+        ctx->map_cap = cap;
+        ctx->hdr = map;
+    }
+    else
+    {
+        // the fd backend still keeps the header mapped, the bitmap and the
+        // counter are updated in place with atomic instructions
+        void *hdr = mmap(NULL, DB_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (hdr == MAP_FAILED)
+            return ERR_DB_FILE;
+        ctx->hdr = hdr;
+
+        // without io_uring the fd backend simply keeps using pread()
+        if ((flags & DB_OPEN_URING) && dburing_open(fd) != NO_ERROR)
+            flags &= ~DB_OPEN_URING;
+    }
+
+    ctx->flags = flags;
+    return NO_ERROR;
+}
+
+/*
+ *  dbio_detach
+ *      fd:  linux file descriptor
+ *
+ *  Releases any backend state for fd, the caller still closes the fd.
+ */
+void dbio_detach(int fd)
+{
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return;
+
+    dbio_ctx_t *ctx = &dbio_table[fd];
+
+    dbpool_close(fd);
+    dburing_close(fd);
+    if (ctx->map != NULL)
+        munmap(ctx->map, ctx->map_cap);
+    else if (ctx->hdr != NULL)
+        munmap(ctx->hdr, DB_HEADER_SIZE);
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+/*
+ *  dbio_attach_pool
+ *      fd:      linux file descriptor, already attached
+ *      budget:  bytes of memory for the pool, see dbpool_budget()
+ *
+ *  Puts a buffer pool (see dbpool.h) in front of the fixed slots of fd.
+ *  Only the fd backend gets one, with the mmap backend or a budget of 0
+ *  this does nothing and the reads and writes go to the file as usual.
+ *
+ *  returns:  true if fd has a pool now
+ */
+bool dbio_attach_pool(int fd, size_t budget)
+{
+    db_header_t *hdr = dbio_hdr(fd);
+
+    if (hdr == NULL || dbio_ctx(fd) != NULL || budget == 0)
+        return false;
+    return dbpool_open(fd, hdr, budget) == NO_ERROR;
+}
+
+/*
+ *  dbio_read
+ *      fd:  linux file descriptor
+ *      id:  slot to read
+ *      *s:  where the slot contents are copied
+ *
+ *  Reads the raw slot for id.  Reading past the end of the file is not an
+ *  error, the slot simply does not exist yet.  Ids whose bit is clear in the
+ *  occupancy bitmap are reported missing without touching the record.
+ *  Slots past MAX_STD_ID belong to the id map (see dbmap.h), they have no
+ *  bit and are always read.
+ *
+ *  returns:  NO_ERROR       slot holds a student
+ *            SRCH_NOT_FOUND slot is empty or past the end of the file
+ *            ERR_DB_FILE    database file I/O issue
+ */
+int dbio_read(int fd, int id, student_t *s)
+{
+    if (id < 0)
+        return ERR_DB_FILE;
+
+    off_t offset = db_record_offset(id);
+    dbio_ctx_t *ctx = dbio_ctx(fd);
+    db_header_t *hdr = dbio_hdr(fd);
+
+    if (hdr != NULL && id <= MAX_STD_ID && !dbhdr_test(hdr, id))
+    {
+        *s = EMPTY_STUDENT_RECORD;
+        return SRCH_NOT_FOUND;
+    }
+
+    if (in_map(ctx, offset, STUDENT_RECORD_SIZE))
+    {
+        if (offset + STUDENT_RECORD_SIZE > ctx->file_size &&
+            map_refresh_size(ctx, fd) != NO_ERROR)
+            return ERR_DB_FILE;
+        if (offset + STUDENT_RECORD_SIZE > ctx->file_size)
+            return SRCH_NOT_FOUND;
+
+        memcpy(s, ctx->map + offset, STUDENT_RECORD_SIZE);
+    }
+    else if (id <= MAX_STD_ID && dbpool_active(fd))
+    {
+        if (dbpool_read(fd, id, s) != NO_ERROR)
+            return ERR_DB_FILE;
+    }
+    else
+    {
+        ssize_t bytesReturned = fd_rw(fd, DBURING_READ, s, offset);
+        if (bytesReturned == -1)
+            return ERR_DB_FILE;
+        if (bytesReturned == 0)
+            return SRCH_NOT_FOUND;
+        if (bytesReturned < STUDENT_RECORD_SIZE)
+            memset((char *)s + bytesReturned, 0, STUDENT_RECORD_SIZE - bytesReturned);
+    }
+
+    if (is_empty_record(s))
+        return SRCH_NOT_FOUND;
+    return NO_ERROR;
+}
+
+/*
+ *  dbio_read_many
+ *      fd:     linux file descriptor
+ *      count:  number of ids
+ *      *ids:   slots to read, in any order, duplicates are fine
+ *      *out:   room for count records, out[i] receives the slot of ids[i]
+ *      *rcs:   room for count results, rcs[i] is what dbio_read() would
+ *              have returned for ids[i]
+ *
+ *  Reads a set of unrelated slots.  Ids that are clear in the occupancy
+ *  bitmap cost nothing.  With an io_uring (DB_OPEN_URING) the reads of all
+ *  the remaining ids are submitted together and complete in any order, so
+ *  a cold lookup of n ids waits for roughly n / queue depth disk latencies
+ *  instead of n.  Otherwise the ids are read one after the other.
+ *
+ *  returns:  NO_ERROR       every slot was looked at, see rcs
+ *            ERR_DB_FILE    out of memory
+ */
+int dbio_read_many(int fd, int count, const int *ids, student_t *out, int *rcs)
+{
+    db_header_t *hdr = dbio_hdr(fd);
+    dburing_req_t *reqs;
+    int *slot_of;
+    int nreqs = 0;
+
+    if (count <= 0)
+        return NO_ERROR;
+
+    if (!dburing_active(fd) || hdr == NULL || dbpool_active(fd))
+    {
+        for (int i = 0; i < count; i++)
+            rcs[i] = dbio_read(fd, ids[i], &out[i]);
+        return NO_ERROR;
+    }
+
+    reqs = malloc(sizeof(dburing_req_t) * count);
+    slot_of = malloc(sizeof(int) * count);
+    if (reqs == NULL || slot_of == NULL)
+    {
+        free(reqs);
+        free(slot_of);
+        return ERR_DB_FILE;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = EMPTY_STUDENT_RECORD;
+        if (ids[i] < 0)
+            rcs[i] = ERR_DB_FILE;
+        else if (ids[i] <= MAX_STD_ID && !dbhdr_test(hdr, ids[i]))
+            rcs[i] = SRCH_NOT_FOUND;
+        else
+        {
+            dburing_req_t req = {DBURING_READ, &out[i], STUDENT_RECORD_SIZE,
+                                 db_record_offset(ids[i]), 0};
+            reqs[nreqs] = req;
+            slot_of[nreqs++] = i;
+        }
+    }
+
+    if (dburing_run(fd, reqs, nreqs) != NO_ERROR)
+    {
+        // the ring is gone, finish with plain reads
+        for (int r = 0; r < nreqs; r++)
+            rcs[slot_of[r]] = dbio_read(fd, ids[slot_of[r]], &out[slot_of[r]]);
+    }
+    else
+    {
+        for (int r = 0; r < nreqs; r++)
+        {
+            int i = slot_of[r];
+            if (reqs[r].res < 0)
+            {
+                rcs[i] = ERR_DB_FILE;
+                continue;
+            }
+            // a short read at the end of the file, like in dbio_read()
+            if (reqs[r].res < STUDENT_RECORD_SIZE)
+                memset((char *)&out[i] + reqs[r].res, 0, STUDENT_RECORD_SIZE - reqs[r].res);
+            rcs[i] = is_empty_record(&out[i]) ? SRCH_NOT_FOUND : NO_ERROR;
+        }
+    }
+
+    free(reqs);
+    free(slot_of);
+    return NO_ERROR;
+}
+
+/*
+ *  dbio_write
+ *      fd:  linux file descriptor
+ *      id:  slot to write
+ *      *s:  record to store, EMPTY_STUDENT_RECORD clears the slot
+ *
+ *  With the mmap backend the file is extended (see grow_file()) when a slot
+ *  past the current end is written, which makes that part of the mapping
+ *  valid.  The file ends up exactly as large as with the fd backend.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbio_write(int fd, int id, const student_t *s)
+{
+    if (id < 0)
+        return ERR_DB_FILE;
+
+    off_t offset = db_record_offset(id);
+    dbio_ctx_t *ctx = dbio_ctx(fd);
+
+    if (in_map(ctx, offset, STUDENT_RECORD_SIZE))
+    {
+        if (offset + STUDENT_RECORD_SIZE > ctx->file_size &&
+            map_refresh_size(ctx, fd) != NO_ERROR)
+            return ERR_DB_FILE;
+        if (offset + STUDENT_RECORD_SIZE > ctx->file_size)
+        {
+            if (grow_file(fd, offset + STUDENT_RECORD_SIZE) != NO_ERROR)
+                return ERR_DB_FILE;
+            ctx->file_size = offset + STUDENT_RECORD_SIZE;
+        }
+
+        memcpy(ctx->map + offset, s, STUDENT_RECORD_SIZE);
+        note_write(fd, id);
+        return NO_ERROR;
+    }
+
+    if (id <= MAX_STD_ID && dbpool_active(fd))
+        return dbpool_write(fd, id, s);
+
+    if (fd_rw(fd, DBURING_WRITE, (void *)s, offset) != STUDENT_RECORD_SIZE)
+        return ERR_DB_FILE;
+    note_write(fd, id);
+    return NO_ERROR;
+}
+
+/*
+ *  dbio_write_field
+ *      fd:   linux file descriptor
+ *      id:   slot of a live record
+ *      *s:   the whole record after the change
+ *      off:  offset of the changed field in student_t
+ *      len:  size of the field
+ *
+ *  Stores just the bytes [off, off + len) of *s with a single pwrite() (a
+ *  single copy into the mapping for the mmap backend), the rest of the slot
+ *  is not touched, so the record is never missing for a reader.  Readers
+ *  do not take the record lock, one that reads the slot while a name is
+ *  being written may see part of the old and part of the new name.  A
+ *  buffer pool that may hold the page takes the whole record instead.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbio_write_field(int fd, int id, const student_t *s, size_t off, size_t len)
+{
+    if (id < 0 || off + len > (size_t)STUDENT_RECORD_SIZE)
+        return ERR_DB_FILE;
+
+    off_t offset = db_record_offset(id);
+    dbio_ctx_t *ctx = dbio_ctx(fd);
+
+    if (in_map(ctx, offset, STUDENT_RECORD_SIZE))
+    {
+        // the record is live, so only our view of the size can be short
+        if (offset + STUDENT_RECORD_SIZE > ctx->file_size &&
+            (map_refresh_size(ctx, fd) != NO_ERROR || offset + STUDENT_RECORD_SIZE > ctx->file_size))
+            return ERR_DB_FILE;
+
+        memcpy(ctx->map + offset + off, (const char *)s + off, len);
+        note_write(fd, id);
+        return NO_ERROR;
+    }
+
+    if (id <= MAX_STD_ID && dbpool_active(fd))
+        return dbpool_write(fd, id, s);
+
+    if (pwrite(fd, (const char *)s + off, len, offset + off) != (ssize_t)len)
+        return ERR_DB_FILE;
+    note_write(fd, id);
+    return NO_ERROR;
+}
+
+/*
+ *  dbio_next_extent
+ *      fd:     linux file descriptor
+ *      from:   offset to start looking at
+ *      end:    size of the file
+ *      align:  the extent is widened to a multiple of this many bytes
+ *      *data:  set to the start of the next allocated extent
+ *      *hole:  set to the end of that extent
+ *
+ *  The database is a sparse file, most of a large id range is usually
+ *  holes.  lseek(SEEK_DATA/SEEK_HOLE) lets scans jump straight from one
+ *  allocated extent to the next without reading the holes.  On file
+ *  systems that do not support it the whole file is reported as a single
+ *  extent, which degrades to a plain sequential scan.
+ *
+ *  returns:  1 extent found, 0 no more data, ERR_DB_FILE on error
+ */
+int dbio_next_extent(int fd, off_t from, off_t end, off_t align,
+                     off_t *data, off_t *hole)
+{
+    if (from >= end)
+        return 0;
+
+    *data = lseek(fd, from, SEEK_DATA);
+    if (*data == -1)
+    {
+        if (errno == ENXIO) // no data past this point
+            return 0;
+        if (errno != EINVAL)
+            return ERR_DB_FILE;
+        *data = from;
+        *hole = end;
+    }
+    else
+    {
+        *hole = lseek(fd, *data, SEEK_HOLE);
+        if (*hole == -1)
+            return ERR_DB_FILE;
+    }
+
+    *data -= *data % align;
+    if (*data < from)
+        *data = from;
+    if (*hole % align)
+        *hole += align - *hole % align;
+    if (*hole > end)
+        *hole = end;
+    return *data < *hole;
+}
+
+/*
+ *  dbio_scan
+ *      fd:   linux file descriptor
+ *      fn:   callback invoked for every live record
+ *      arg:  passed through to fn
+ *
+ *  Walks the whole database.  Only the allocated extents of the sparse file
+ *  are visited (see dbio_next_extent()), so the cost follows the live data
+ *  and not the id range.  The mmap backend filters each extent in place,
+ *  the fd backend reads it in page aligned DBIO_CHUNK sized blocks.  Each
+ *  block is classified by a vectorized kernel (see dbscan.h) into a list of
+ *  live slots, fn only ever sees those.  Ids up to MAX_STD_ID come in id
+ *  order, the larger ones follow in the order of the id map pages.
+ *
+ *  returns:  NO_ERROR       the whole file was scanned
+ *            ERR_DB_FILE    database file I/O issue
+ *            <other>        the non-zero value returned by fn
+ */
+int dbio_scan(int fd, dbio_scan_fn fn, void *arg)
+{
+    off_t end = dbio_scan_end(fd);
+
+    if (end < 0)
+        return ERR_DB_FILE;
+    return dbio_scan_range(fd, DB_HEADER_SIZE, end, fn, arg);
+}
+
+/*
+ *  dbio_scan_end
+ *      fd:  linux file descriptor
+ *
+ *  returns:  offset behind the last whole slot of the file, DB_HEADER_SIZE
+ *            for a file without records, or ERR_DB_FILE
+ */
+off_t dbio_scan_end(int fd)
+{
+    dbio_ctx_t *ctx = dbio_ctx(fd);
+    struct stat st;
+
+    // scans read the file, it has to hold what the pool still has dirty
+    if (dbpool_flush_all(fd) != NO_ERROR || fstat(fd, &st) == -1)
+        return ERR_DB_FILE;
+    if (st.st_size < DB_HEADER_SIZE)
+        return DB_HEADER_SIZE;
+    if (ctx != NULL)
+        ctx->file_size = st.st_size;
+    return st.st_size - (st.st_size - DB_HEADER_SIZE) % STUDENT_RECORD_SIZE;
+}
+
+/*
+ *  dbio_scan_io
+ *
+ *  returns:  how full scans read the file, DBIO_SCAN_DIRECT or
+ *            DBIO_SCAN_NOCACHE if DBIO_SCAN_IO_ENV asks for it, else
+ *            DBIO_SCAN_CACHED
+ */
+int dbio_scan_io(void)
+{
+    char *env = getenv(DBIO_SCAN_IO_ENV);
+
+    if (env != NULL && strcmp(env, "direct") == 0)
+        return DBIO_SCAN_DIRECT;
+    if (env != NULL && strcmp(env, "nocache") == 0)
+        return DBIO_SCAN_NOCACHE;
+    return DBIO_SCAN_CACHED;
+}
+
+// One of the two buffers of an uncached scan
+typedef struct cold_buf
+{
+    char *mem;          // DB_PAGE_SIZE aligned, a block plus two pages
+    const char *block;  // first slot of the block inside mem
+    off_t off;          // file offset of the block
+    ssize_t got;        // bytes of the block read, -1 on error
+    bool cached;        // read through the page cache, drop it afterwards
+    off_t first;        // page aligned offset resident[0] describes
+    size_t pages;       // pages of the block, 0 if their residency is unknown
+    unsigned char resident[DBIO_COLD_CHUNK / DB_PAGE_SIZE + 2]; // before the read
+    bool full;          // filled by the reader, not yet filtered
+    bool last;          // no more blocks follow
+} cold_buf_t;
+
+// State shared by the reader thread and the filtering caller of
+// scan_cold()
+typedef struct cold_scan
+{
+    int fd;
+    int rfd;            // private descriptor of the file the blocks are read from
+    bool direct;        // rfd was opened with O_DIRECT
+    off_t from, end;
+    cold_buf_t bufs[2];
+    bool stop;          // the caller is done, read no further
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} cold_scan_t;
+
+/*
+ *  open_cold
+ *      *c:      the scan
+ *      direct:  try O_DIRECT
+ *
+ *  Opens the file a second time through /proc, so the advice given to it
+ *  does not change how the lookups on fd read.  Some file systems accept
+ *  O_DIRECT at open() and only refuse the reads, so one page is read as a
+ *  probe and the scan goes through the cache if that fails.  This is
+ *  settled here, before the reader thread starts, and never changes while
+ *  it runs.  Without O_DIRECT the file is marked POSIX_FADV_RANDOM:
+ *  readahead would pull in pages past each block (and the holes between
+ *  extents) that nobody drops again.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int open_cold(cold_scan_t *c, bool direct)
+{
+    char path[64];
+
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", c->fd);
+    c->rfd = direct ? open(path, O_RDONLY | O_DIRECT) : -1;
+    if (c->rfd != -1 &&
+        pread(c->rfd, c->bufs[0].mem, DB_PAGE_SIZE, c->from / DB_PAGE_SIZE * DB_PAGE_SIZE) == -1 &&
+        errno == EINVAL)
+    {
+        close(c->rfd);
+        c->rfd = -1;
+    }
+    c->direct = c->rfd != -1;
+    if (c->rfd == -1)
+    {
+        c->rfd = open(path, O_RDONLY);
+        if (c->rfd == -1)
+            return ERR_DB_FILE;
+        posix_fadvise(c->rfd, 0, 0, POSIX_FADV_RANDOM);
+        posix_fadvise(c->rfd, c->from, c->end - c->from, POSIX_FADV_NOREUSE);
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  read_cold
+ *      *c:    the scan
+ *      *b:    buffer to fill
+ *      off:   slot aligned offset of the block
+ *      want:  bytes of the block, at most DBIO_COLD_CHUNK
+ *
+ *  O_DIRECT wants the offset, the length and the buffer aligned, so the
+ *  pages around the block are read and b->block points into them.  Through
+ *  the cache, mincore() on a mapping of the block first records which of
+ *  its pages were cached already, see drop_cold().
+ */
+static void read_cold(cold_scan_t *c, cold_buf_t *b, off_t off, size_t want)
+{
+    b->off = off;
+    if (c->direct)
+    {
+        off_t first = off / DB_PAGE_SIZE * DB_PAGE_SIZE;
+        off_t last = (off + want + DB_PAGE_SIZE - 1) / DB_PAGE_SIZE * DB_PAGE_SIZE;
+        ssize_t got = pread(c->rfd, b->mem, last - first, first);
+        ssize_t skip = off - first;
+
+        b->block = b->mem + skip;
+        b->cached = false;
+        if (got == -1)
+            b->got = -1;
+        else if (got <= skip)
+            b->got = 0;
+        else
+            b->got = got - skip < (ssize_t)want ? got - skip : (ssize_t)want;
+        return;
+    }
+
+    b->first = off / DB_PAGE_SIZE * DB_PAGE_SIZE;
+    b->pages = (off + want - b->first + DB_PAGE_SIZE - 1) / DB_PAGE_SIZE;
+    size_t len = b->pages * DB_PAGE_SIZE;
+    void *map = mmap(NULL, len, PROT_READ, MAP_SHARED, c->rfd, b->first);
+    if (map == MAP_FAILED || mincore(map, len, b->resident) == -1)
+        b->pages = 0;
+    if (map != MAP_FAILED)
+        munmap(map, len);
+    b->block = b->mem;
+    b->cached = true;
+    b->got = pread(c->rfd, b->mem, want, off);
+}
+
+// drops the pages of a block read through the cache that were not cached
+// before it was read.  When their residency is unknown nothing is dropped,
+// a scan must not evict the pages the lookups live on.
+static void drop_cold(cold_scan_t *c, const cold_buf_t *b)
+{
+    size_t run = 0;
+
+    for (size_t p = 0; p <= b->pages; p++)
+    {
+        if (p < b->pages && !(b->resident[p] & 1))
+        {
+            run++;
+            continue;
+        }
+        if (run > 0)
+            posix_fadvise(c->rfd, b->first + (off_t)(p - run) * DB_PAGE_SIZE,
+                          (off_t)run * DB_PAGE_SIZE, POSIX_FADV_DONTNEED);
+        run = 0;
+    }
+}
+
+// reader thread, walks the allocated extents block by block and hands the
+// buffers over in turn
+static void *cold_reader(void *arg)
+{
+    cold_scan_t *c = arg;
+    off_t data, hole = c->from, off = c->from;
+    int more = 1;
+
+    for (int i = 0;; i++)
+    {
+        cold_buf_t *b = &c->bufs[i % 2];
+
+        pthread_mutex_lock(&c->lock);
+        while (b->full && !c->stop)
+            pthread_cond_wait(&c->cond, &c->lock);
+        bool stop = c->stop;
+        pthread_mutex_unlock(&c->lock);
+        if (stop)
+            break;
+
+        if (off >= hole)
+        {
+            more = dbio_next_extent(c->fd, hole, c->end, STUDENT_RECORD_SIZE, &data, &hole);
+            off = data;
+        }
+        if (more <= 0)
+            b->got = more; // the end of the file, or ERR_DB_FILE
+        else
+        {
+            size_t want = hole - off < DBIO_COLD_CHUNK ? (size_t)(hole - off) : DBIO_COLD_CHUNK;
+            read_cold(c, b, off, want);
+            // a short read ends the extent
+            off = b->got < (ssize_t)want ? hole : off + (off_t)want;
+        }
+
+        pthread_mutex_lock(&c->lock);
+        b->last = more <= 0 || b->got < 0;
+        b->full = true;
+        pthread_cond_broadcast(&c->cond);
+        pthread_mutex_unlock(&c->lock);
+        if (b->last)
+            break;
+    }
+    return NULL;
+}
+
+/*
+ *  scan_cold
+ *      fd:    linux file descriptor, fd backend
+ *      mode:  DBIO_SCAN_DIRECT or DBIO_SCAN_NOCACHE
+ *      from:  slot aligned offset to start at
+ *      end:   slot aligned offset to stop at
+ *      fn:    callback invoked for every live record
+ *      arg:   passed through to fn
+ *
+ *  dbio_scan_range() without leaving the records in the page cache.  A
+ *  reader thread fills one buffer while this thread classifies and filters
+ *  the other.  Pages that a block read through the cache brought in are
+ *  dropped from it again once fn has seen them.
+ *
+ *  returns:  see dbio_scan()
+ */
+static int scan_cold(int fd, int mode, off_t from, off_t end, dbio_scan_fn fn, void *arg)
+{
+    cold_scan_t c = {.fd = fd, .rfd = -1, .from = from, .end = end};
+    uint32_t *live = malloc(DBIO_COLD_CHUNK / STUDENT_RECORD_SIZE * sizeof(uint32_t));
+    pthread_t reader;
+    int rc = NO_ERROR;
+
+    for (int i = 0; i < 2; i++)
+        c.bufs[i].mem = aligned_alloc(DB_PAGE_SIZE, DBIO_COLD_CHUNK + 2 * DB_PAGE_SIZE);
+    if (live == NULL || c.bufs[0].mem == NULL || c.bufs[1].mem == NULL ||
+        open_cold(&c, mode == DBIO_SCAN_DIRECT) != NO_ERROR)
+    {
+        rc = ERR_DB_FILE;
+        goto out;
+    }
+
+    pthread_mutex_init(&c.lock, NULL);
+    pthread_cond_init(&c.cond, NULL);
+    if (pthread_create(&reader, NULL, cold_reader, &c) != 0)
+    {
+        rc = ERR_DB_FILE;
+        goto done;
+    }
+
+    for (int i = 0;; i++)
+    {
+        cold_buf_t *b = &c.bufs[i % 2];
+
+        pthread_mutex_lock(&c.lock);
+        while (!b->full)
+            pthread_cond_wait(&c.cond, &c.lock);
+        pthread_mutex_unlock(&c.lock);
+
+        if (b->got < 0)
+            rc = ERR_DB_FILE;
+        const student_t *slots = (const student_t *)b->block;
+        size_t nlive = rc == NO_ERROR && b->got > 0 ? dbscan_live(slots, b->got / STUDENT_RECORD_SIZE, live) : 0;
+        for (size_t k = 0; k < nlive && rc == NO_ERROR; k++)
+            if (slots[live[k]].id != DELETED_STUDENT_ID)
+                rc = fn(&slots[live[k]], arg);
+        if (b->cached && b->got > 0)
+            drop_cold(&c, b);
+
+        bool last = b->last;
+        pthread_mutex_lock(&c.lock);
+        b->full = false;
+        c.stop = rc != NO_ERROR;
+        pthread_cond_broadcast(&c.cond);
+        pthread_mutex_unlock(&c.lock);
+        if (last || rc != NO_ERROR)
+            break;
+    }
+    pthread_join(reader, NULL);
+
+
+done:
+    pthread_cond_destroy(&c.cond);
+    pthread_mutex_destroy(&c.lock);
+out:
+    if (c.rfd != -1)
+        close(c.rfd);
+    free(c.bufs[0].mem);
+    free(c.bufs[1].mem);
+    free(live);
+    return rc;
+}
+
+/*
+ *  dbio_scan_range
+ *      fd:    linux file descriptor
+ *      from:  slot aligned offset to start at
+ *      end:   slot aligned offset to stop at, see dbio_scan_end()
+ *      fn:    callback invoked for every live record
+ *      arg:   passed through to fn
+ *
+ *  dbio_scan() of the slots in [from, end) only.  Nothing is shared
+ *  between calls, several threads can scan different ranges of the same
+ *  fd at once (see dbpscan.h).
+ *
+ *  returns:  see dbio_scan()
+ */
+int dbio_scan_range(int fd, off_t from, off_t end, dbio_scan_fn fn, void *arg)
+{
+    dbio_ctx_t *ctx = dbio_ctx(fd);
+    off_t data, hole;
+    size_t want;
+    char *buf;
+    uint32_t *live;
+    int rc = NO_ERROR;
+    int more;
+
+    if (end <= from)
+        return NO_ERROR;
+
+    // the fd backend can keep the scan out of the page cache
+    int mode = dbio_scan_io();
+    if (mode != DBIO_SCAN_CACHED && ctx == NULL)
+        return scan_cold(fd, mode, from, end, fn, arg);
+
+    // blocks are at most DBIO_CHUNK bytes, less for a short range
+    size_t chunk = end - from < DBIO_CHUNK ? (size_t)(end - from) : DBIO_CHUNK;
+    chunk = (chunk + DB_PAGE_SIZE - 1) / DB_PAGE_SIZE * DB_PAGE_SIZE;
+
+    live = malloc(chunk / STUDENT_RECORD_SIZE * sizeof(uint32_t));
+    buf = aligned_alloc(DB_PAGE_SIZE, chunk);
+    if (live == NULL || buf == NULL)
+    {
+        free(live);
+        free(buf);
+        return ERR_DB_FILE;
+    }
+
+    for (hole = from; rc == NO_ERROR; )
+    {
+        more = dbio_next_extent(fd, hole, end, STUDENT_RECORD_SIZE, &data, &hole);
+        if (more <= 0)
+        {
+            rc = more;
+            break;
+        }
+
+        for (off_t off = data; off < hole && rc == NO_ERROR; off += want)
+        {
+            want = hole - off < (off_t)chunk ? (size_t)(hole - off) : chunk;
+            const char *block;
+            ssize_t got;
+
+            // blocks never straddle the end of the mapping
+            if (ctx != NULL && (size_t)off < ctx->map_cap && (size_t)off + want > ctx->map_cap)
+                want = ctx->map_cap - off;
+
+            // the mapping is scanned in place, the fd backend (and the id
+            // map behind the mapping) reads each block with one pread()
+            if (in_map(ctx, off, want))
+            {
+                block = ctx->map + off;
+                got = want;
+            }
+            else
+            {
+                got = pread(fd, buf, want, off);
+                if (got == -1)
+                {
+                    rc = ERR_DB_FILE;
+                    break;
+                }
+                block = buf;
+            }
+
+            // classify the whole block first, then visit only live slots.
+            // The bucket headers of the id map keep the id field zero
+            const student_t *slots = (const student_t *)block;
+            size_t nlive = dbscan_live(slots, got / STUDENT_RECORD_SIZE, live);
+            for (size_t k = 0; k < nlive && rc == NO_ERROR; k++)
+                if (slots[live[k]].id != DELETED_STUDENT_ID)
+                    rc = fn(&slots[live[k]], arg);
+            if (got < (ssize_t)want)
+                break;
+        }
+    }
+
+    free(buf);
+    free(live);
+    return rc;
+}
+
+/*
+ *  dbio_read_range
+ *      fd:        linux file descriptor
+ *      first_id:  first slot to read
+ *      count:     number of consecutive slots
+ *      *out:      room for count records
+ *
+ *  Reads a run of adjacent slots with a single pread() (or one memcpy() from
+ *  the mapping).  Slots past the end of the file come back as
+ *  EMPTY_STUDENT_RECORD.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbio_read_range(int fd, int first_id, int count, student_t *out)
+{
+    if (first_id < 0 || count < 0)
+        return ERR_DB_FILE;
+
+    off_t offset = db_record_offset(first_id);
+    size_t want = (size_t)count * STUDENT_RECORD_SIZE;
+    size_t got = 0;
+    dbio_ctx_t *ctx = dbio_ctx(fd);
+
+    memset(out, 0, want);
+
+    // slots the pool holds come from there, it may have newer contents
+    if (dbpool_active(fd) && first_id + count - 1 <= MAX_STD_ID)
+    {
+        for (int i = 0; i < count; i++)
+            if (dbpool_read(fd, first_id + i, &out[i]) != NO_ERROR)
+                return ERR_DB_FILE;
+        return NO_ERROR;
+    }
+    if (dbpool_flush(fd, first_id, count) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    if (in_map(ctx, offset, want))
+    {
+        if (map_refresh_size(ctx, fd) != NO_ERROR)
+            return ERR_DB_FILE;
+        off_t end = ctx->file_size;
+        if (offset < end)
+        {
+            got = end - offset < (off_t)want ? (size_t)(end - offset) : want;
+            memcpy(out, ctx->map + offset, got);
+        }
+        return NO_ERROR;
+    }
+
+    while (got < want)
+    {
+        ssize_t n = pread(fd, (char *)out + got, want - got, offset + got);
+        if (n == -1)
+            return ERR_DB_FILE;
+        if (n == 0)
+            break;
+        got += n;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  dbio_read_scatter
+ *      fd:        linux file descriptor
+ *      first_id:  first slot to read
+ *      count:     number of consecutive slots
+ *      **recs:    one record pointer per slot, NULL for a slot that is not
+ *                 needed
+ *
+ *  The read side of dbio_write_gather(): a run of adjacent slots goes
+ *  straight into separate buffers with one preadv() (split at
+ *  DBIO_MAX_IOV), the slots nobody asked for land in a scratch record.
+ *  Slots past the end of the file come back as EMPTY_STUDENT_RECORD.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbio_read_scatter(int fd, int first_id, int count, student_t *const *recs)
+{
+    static student_t skip;
+
+    if (first_id < 0 || count < 0)
+        return ERR_DB_FILE;
+
+    if (dbio_ctx(fd) != NULL || (dbpool_active(fd) && first_id + count - 1 <= MAX_STD_ID))
+    {
+        for (int i = 0; i < count; i++)
+            if (recs[i] != NULL && dbio_read_range(fd, first_id + i, 1, recs[i]) != NO_ERROR)
+                return ERR_DB_FILE;
+        return NO_ERROR;
+    }
+    if (dbpool_flush(fd, first_id, count) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    struct iovec iov[DBIO_MAX_IOV];
+
+    for (int done = 0; done < count;)
+    {
+        int n = count - done < DBIO_MAX_IOV ? count - done : DBIO_MAX_IOV;
+        for (int i = 0; i < n; i++)
+        {
+            student_t *rec = recs[done + i];
+            if (rec != NULL)
+                memset(rec, 0, STUDENT_RECORD_SIZE);
+            iov[i].iov_base = rec != NULL ? rec : &skip;
+            iov[i].iov_len = STUDENT_RECORD_SIZE;
+        }
+
+        ssize_t want = (ssize_t)n * STUDENT_RECORD_SIZE;
+        ssize_t got = preadv(fd, iov, n, db_record_offset(first_id + done));
+        if (got == -1)
+            return ERR_DB_FILE;
+        // the end of the file, whatever was not read stays empty
+        if (got < want)
+            break;
+        done += n;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  dbio_write_gather
+ *      fd:        linux file descriptor
+ *      first_id:  slot the first record goes to
+ *      count:     number of consecutive slots to write
+ *      **recs:    one record pointer per slot
+ *
+ *  Writes a run of adjacent slots whose records live in separate buffers.
+ *  The fd backend hands the whole run to pwritev() (split at DBIO_MAX_IOV), so
+ *  writing n adjacent ids costs one syscall instead of n.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbio_write_gather(int fd, int first_id, int count, const student_t *const *recs)
+{
+    if (first_id < 0 || count < 0)
+        return ERR_DB_FILE;
+
+    if (dbio_ctx(fd) != NULL || (dbpool_active(fd) && first_id + count - 1 <= MAX_STD_ID))
+    {
+        for (int i = 0; i < count; i++)
+            if (dbio_write(fd, first_id + i, recs[i]) != NO_ERROR)
+                return ERR_DB_FILE;
+        return NO_ERROR;
+    }
+
+    struct iovec iov[DBIO_MAX_IOV];
+    int max_iov = DBIO_MAX_IOV;
+
+    for (int done = 0; done < count;)
+    {
+        int n = count - done < max_iov ? count - done : max_iov;
+        for (int i = 0; i < n; i++)
+        {
+            iov[i].iov_base = (void *)recs[done + i];
+            iov[i].iov_len = STUDENT_RECORD_SIZE;
+        }
+
+        ssize_t want = (ssize_t)n * STUDENT_RECORD_SIZE;
+        if (pwritev(fd, iov, n, db_record_offset(first_id + done)) != want)
+            return ERR_DB_FILE;
+        done += n;
+    }
+    note_write(fd, first_id);
+    return NO_ERROR;
+}
+
+/*
+ *  punch_run
+ *      fd:   linux file descriptor
+ *      at:   start of a run of pages that were empty when scanned
+ *      len:  length of the run, a multiple of DB_PAGE_SIZE
+ *      buf:  DBIO_CHUNK bytes of scratch space
+ *
+ *  Writers hold the record lock of a slot while they change it (see
+ *  dbio_lock_records()), so the run is locked and checked again before
+ *  it is punched.  A run that got a record since the scan is left alone.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int punch_run(int fd, off_t at, off_t len, char *buf)
+{
+    static const char zero_chunk[DBIO_CHUNK];
+    int rc = NO_ERROR;
+    bool empty = true;
+
+    if (lock_range(fd, at, len, F_WRLCK) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    for (off_t off = at; off < at + len && empty; off += DBIO_CHUNK)
+    {
+        size_t want = at + len - off < DBIO_CHUNK ? (size_t)(at + len - off) : DBIO_CHUNK;
+        ssize_t got = pread(fd, buf, want, off);
+        if (got == -1)
+        {
+            rc = ERR_DB_FILE;
+            break;
+        }
+        empty = memcmp(buf, zero_chunk, got) == 0;
+    }
+
+    if (rc == NO_ERROR && empty &&
+        fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, at, len) == -1)
+        rc = ERR_DB_FILE;
+
+    lock_range(fd, at, len, F_UNLCK);
+    return rc;
+}
+
+/*
+ *  dbio_punch_empty_pages
+ *      fd:          linux file descriptor
+ *      *reclaimed:  set to the number of bytes of storage given back
+ *
+ *  Records live at fixed offsets, so compaction never has to move one.
+ *  Instead every DB_PAGE_SIZE page that holds only deleted (all zero)
+ *  slots is turned back into a hole with fallocate(FALLOC_FL_PUNCH_HOLE).
+ *  The file keeps its size and every offset stays valid.  Only the
+ *  allocated extents of the file are visited (SEEK_DATA/SEEK_HOLE), holes
+ *  are skipped without being read, and runs of adjacent empty pages are
+ *  freed with a single fallocate() call (see punch_run()).  The scan
+ *  starts behind the header: its bitmap pages are changed through the
+ *  shared mapping without the record locks, so punching one could wipe
+ *  out a bit that dbio_claim() sets at the same time.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbio_punch_empty_pages(int fd, off_t *reclaimed)
+{
+    static const char zero_page[DB_PAGE_SIZE];
+    struct stat st;
+    char *buf;
+    off_t data, hole, end;
+    off_t punch_at = -1, punch_len = 0;
+    blkcnt_t blocks_before;
+    int rc = NO_ERROR;
+
+    *reclaimed = 0;
+    if (dbpool_flush_all(fd) != NO_ERROR || fstat(fd, &st) == -1)
+        return ERR_DB_FILE;
+    end = st.st_size;
+    blocks_before = st.st_blocks;
+
+    // the second half is scratch space for punch_run()
+    buf = malloc(2 * DBIO_CHUNK);
+    if (buf == NULL)
+        return ERR_DB_FILE;
+
+    for (hole = DB_HEADER_SIZE; rc == NO_ERROR; )
+    {
+        int more = dbio_next_extent(fd, hole, end, DB_PAGE_SIZE, &data, &hole);
+        if (more <= 0)
+        {
+            rc = more;
+            break;
+        }
+
+        for (off_t off = data; off < hole && rc == NO_ERROR; off += DBIO_CHUNK)
+        {
+            size_t want = hole - off < DBIO_CHUNK ? (size_t)(hole - off) : DBIO_CHUNK;
+            ssize_t got = pread(fd, buf, want, off);
+            if (got <= 0)
+            {
+                rc = got == 0 ? NO_ERROR : ERR_DB_FILE;
+                break;
+            }
+
+            for (ssize_t p = 0; p < got; p += DB_PAGE_SIZE)
+            {
+                size_t len = got - p < DB_PAGE_SIZE ? (size_t)(got - p) : DB_PAGE_SIZE;
+                if (memcmp(buf + p, zero_page, len) != 0)
+                    continue;
+
+                // extend the pending run, or flush it and start a new one.
+                // Runs always cover whole pages, a partial last page is
+                // punched up to the page boundary past the end of the file
+                // so its block is released too
+                if (punch_at + punch_len == off + p)
+                {
+                    punch_len += DB_PAGE_SIZE;
+                    continue;
+                }
+                if (punch_len > 0 && punch_run(fd, punch_at, punch_len, buf + DBIO_CHUNK) != NO_ERROR)
+                {
+                    rc = ERR_DB_FILE;
+                    break;
+                }
+                punch_at = off + p;
+                punch_len = DB_PAGE_SIZE;
+            }
+        }
+    }
+
+    if (rc == NO_ERROR && punch_len > 0)
+        rc = punch_run(fd, punch_at, punch_len, buf + DBIO_CHUNK);
+    free(buf);
+
+    if (rc == NO_ERROR && fstat(fd, &st) == 0 && st.st_blocks < blocks_before)
+        *reclaimed = (off_t)(blocks_before - st.st_blocks) * 512;
+    return rc;
+}
+
+/*
+ *  dbio_claim
+ *      fd:  linux file descriptor
+ *      id:  student id about to be added
+ *
+ *  Atomically marks id as taken in the occupancy bitmap and bumps the live
+ *  count.  Of several processes racing to add the same id exactly one gets
+ *  NO_ERROR, so the duplicate check is both free of I/O and race free.
+ *  The caller writes the record afterwards.
+ *
+ *  returns:  NO_ERROR       id was free and is now taken
+ *            ERR_DB_OP      id is already taken
+ *            ERR_DB_FILE    fd has no header or id is out of range
+ */
+int dbio_claim(int fd, int id)
+{
+    db_header_t *hdr = dbio_hdr(fd);
+
+    if (hdr == NULL || id < 0 || id > MAX_STD_ID)
+        return ERR_DB_FILE;
+
+    uint8_t bit = 1 << (id & 7);
+    uint8_t old = __atomic_fetch_or(&dbhdr_bitmap(hdr)[id >> 3], bit, __ATOMIC_ACQ_REL);
+    if (old & bit)
+        return ERR_DB_OP;
+
+    __atomic_add_fetch(&hdr->live_count, 1, __ATOMIC_ACQ_REL);
+    return NO_ERROR;
+}
+
+/*
+ *  dbio_release
+ *      fd:  linux file descriptor
+ *      id:  student id about to be deleted
+ *
+ *  The counterpart of dbio_claim(), atomically clears the bit of id and
+ *  drops the live count.
+ *
+ *  returns:  NO_ERROR       id was taken and is now free
+ *            SRCH_NOT_FOUND id was not taken
+ *            ERR_DB_FILE    fd has no header
+ */
+int dbio_release(int fd, int id)
+{
+    db_header_t *hdr = dbio_hdr(fd);
+
+    if (hdr == NULL || id < 0)
+        return ERR_DB_FILE;
+    if (id > MAX_STD_ID)
+        return SRCH_NOT_FOUND;
+
+    uint8_t bit = 1 << (id & 7);
+    uint8_t old = __atomic_fetch_and(&dbhdr_bitmap(hdr)[id >> 3], (uint8_t)~bit, __ATOMIC_ACQ_REL);
+    if (!(old & bit))
+        return SRCH_NOT_FOUND;
+
+    __atomic_sub_fetch(&hdr->live_count, 1, __ATOMIC_ACQ_REL);
+    return NO_ERROR;
+}
+
+/*
+ *  dbio_live
+ *      fd:  linux file descriptor
+ *      id:  student id
+ *
+ *  returns:  true if the occupancy bitmap says id holds a student
+ */
+bool dbio_live(int fd, int id)
+{
+    db_header_t *hdr = dbio_hdr(fd);
+
+    if (hdr == NULL || id < 0 || id > MAX_STD_ID)
+        return false;
+    return dbhdr_test(hdr, id);
+}
+
+/*
+ *  dbio_count
+ *      fd:  linux file descriptor
+ *
+ *  returns:  number of live records kept in the header, or ERR_DB_FILE
+ */
+int dbio_count(int fd)
+{
+    db_header_t *hdr = dbio_hdr(fd);
+
+    if (hdr == NULL)
+        return ERR_DB_FILE;
+    return __atomic_load_n(&hdr->live_count, __ATOMIC_ACQUIRE);
+}
+
+/*
+ *  dbio_add_count
+ *      fd:     linux file descriptor
+ *      delta:  change of the number of live records
+ *
+ *  Records placed through the id map have no bitmap bit, dbmap.c keeps the
+ *  live count in the header right with this call.
+ */
+void dbio_add_count(int fd, int delta)
+{
+    db_header_t *hdr = dbio_hdr(fd);
+
+    if (hdr != NULL)
+        __atomic_add_fetch(&hdr->live_count, delta, __ATOMIC_ACQ_REL);
+}
+
+static int count_record(const student_t *s, void *arg)
+{
+    (void)s;
+    (*(int *)arg)++;
+    return 0;
+}
+
+/*
+ *  dbio_recount
+ *      fd:  linux file descriptor, nobody else may be changing records
+ *
+ *  Sets the live count in the header to the number of records a full scan
+ *  finds.  Used by the log replay after it rewrote slots of the id map.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbio_recount(int fd)
+{
+    db_header_t *hdr = dbio_hdr(fd);
+    int n = 0;
+
+    if (hdr == NULL || dbio_scan(fd, count_record, &n) != NO_ERROR)
+        return ERR_DB_FILE;
+    __atomic_store_n(&hdr->live_count, n, __ATOMIC_RELEASE);
+    return NO_ERROR;
+}
+
+/*
+ *  dbio_sync
+ *      fd:  linux file descriptor
+ *
+ *  Forces the records and the header of fd to stable storage, after
+ *  writing back what the buffer pool still holds.  The header
+ *  mapping and the mmap backend are MAP_SHARED mappings of the page cache,
+ *  so fdatasync() of the file covers them as well.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbio_sync(int fd)
+{
+    if (dbpool_flush_all(fd) != NO_ERROR || fdatasync(fd) == -1)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+/*
+ *  dbio_lock_records
+ *      fd:        linux file descriptor
+ *      first_id:  first slot to lock
+ *      count:     number of adjacent slots
+ *
+ *  Takes an exclusive OFD lock (fcntl(F_OFD_SETLKW)) on the bytes of the
+ *  slots, waiting for other processes that hold any of them.  Adds and
+ *  deletes hold the lock of their slot from the bitmap update until the
+ *  record and the indexes are written, so two processes can never
+ *  interleave changes of the same id, while changes of different ids never
+ *  wait for each other.  Callers that lock several ranges must lock them
+ *  in ascending id order.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbio_lock_records(int fd, int first_id, int count)
+{
+    if (first_id < 0 || count <= 0)
+        return ERR_DB_FILE;
+    return lock_range(fd, db_record_offset(first_id), (off_t)count * STUDENT_RECORD_SIZE, F_WRLCK);
+}
+
+/*
+ *  dbio_unlock_records
+ *      fd:        linux file descriptor
+ *      first_id:  first slot to unlock
+ *      count:     number of adjacent slots
+ *
+ *  Releases what dbio_lock_records() took.  Records of the slots that are
+ *  still dirty in the buffer pool are written back first, so other
+ *  processes see them as soon as they can lock the slots.
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE if writing back failed (the lock is
+ *            released anyway)
+ */
+int dbio_unlock_records(int fd, int first_id, int count)
+{
+    if (first_id < 0 || count <= 0)
+        return NO_ERROR;
+
+    int rc = dbpool_flush(fd, first_id, count);
+    lock_range(fd, db_record_offset(first_id), (off_t)count * STUDENT_RECORD_SIZE, F_UNLCK);
+    return rc;
+}
+
+/*
+ *  dbio_freeze
+ *      fd:  linux file descriptor
+ *
+ *  Takes a shared OFD lock on every slot of the file, waiting for the adds
+ *  and deletes that hold the lock of a slot (see dbio_lock_records()).
+ *  Until dbio_thaw() no change of a slot up to MAX_STD_ID can start, while
+ *  readers are not held up at all.  Used to take snapshots, see dbsnap.h.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbio_freeze(int fd)
+{
+    return lock_range(fd, DB_HEADER_SIZE, 0, F_RDLCK);
+}
+
+void dbio_thaw(int fd)
+{
+    lock_range(fd, DB_HEADER_SIZE, 0, F_UNLCK);
+}
@@ -0,0 +1,94 @@
+#ifndef __DBIO_H__
+#define __DBIO_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "db.h" //get student record type
+#include "dbhdr.h"
+
+// Storage backends that can be selected when the database is opened via
+// open_db().  DB_OPEN_FD is the classic lseek()/read()/write() access path,
+// DB_OPEN_MMAP maps the database file into memory so lookups and updates
+// become plain memory accesses.  DB_OPEN_WAL can be or'ed into either one
+// to send every change through the write-ahead log first, see wal.h.
+// DB_OPEN_URING or'ed into DB_OPEN_FD does the record reads and writes
+// through an io_uring, see dburing.h.
+#define DB_OPEN_FD 0x00
+#define DB_OPEN_MMAP 0x01
+#define DB_OPEN_WAL 0x02
+#define DB_OPEN_URING 0x04
+
+// Database descriptors are tracked in small tables indexed by the fd, by
+// the storage layer and by the index modules.  Descriptors must be below
+// this limit.
+#define DBIO_MAX_FD 256
+
+// Environment variable used by main() to pick the storage backend, for
+// example:  SDB_BACKEND=mmap ./sdbsc -f 3
+// SDB_BACKEND=uring selects DB_OPEN_FD | DB_OPEN_URING.
+#define DB_BACKEND_ENV "SDB_BACKEND"
+
+// Environment variable that keeps full scans out of the page cache, so a
+// nightly -p does not evict the pages the -f lookups live on:
+//   SDB_SCAN_IO=direct ./sdbsc -p   reads with O_DIRECT into aligned buffers
+//   SDB_SCAN_IO=nocache ./sdbsc -p  reads through the cache without readahead
+//                                   and drops the pages it brought in again
+//                                   with posix_fadvise(), pages that were
+//                                   cached before (see mincore()) stay
+// direct falls back to nocache on file systems without O_DIRECT.  Either
+// way a reader thread fills one buffer while the records of the other are
+// filtered.  Only the fd backend scans this way, the mmap backend scans its
+// mapping in place; point lookups always go through the cache.
+#define DBIO_SCAN_IO_ENV "SDB_SCAN_IO"
+#define DBIO_SCAN_CACHED 0
+#define DBIO_SCAN_DIRECT 1
+#define DBIO_SCAN_NOCACHE 2
+
+// Storage is managed in pages of this many bytes (64 student records).
+// Compaction frees whole pages, see dbio_punch_empty_pages().
+#define DB_PAGE_SIZE 4096
+
+// Callback used by dbio_scan(), it is handed every live record, see there
+// for the order.
+// Returning a non-zero value stops the scan and is passed back to the caller
+// of dbio_scan().
+typedef int (*dbio_scan_fn)(const student_t *s, void *arg);
+
+// Byte offset of a student slot in the database file, the slots follow the
+// file header.  Offsets are computed with off_t so large ids can never
+// overflow an int.
+static inline off_t db_record_offset(int id)
+{
+    return DB_HEADER_SIZE + (off_t)id * (off_t)sizeof(student_t);
+}
+
+int dbio_attach(int fd, int flags);
+void dbio_detach(int fd);
+bool dbio_attach_pool(int fd, size_t budget);
+int dbio_read(int fd, int id, student_t *s);
+int dbio_read_many(int fd, int count, const int *ids, student_t *out, int *rcs);
+int dbio_write(int fd, int id, const student_t *s);
+int dbio_write_field(int fd, int id, const student_t *s, size_t off, size_t len);
+int dbio_scan(int fd, dbio_scan_fn fn, void *arg);
+off_t dbio_scan_end(int fd);
+int dbio_scan_range(int fd, off_t from, off_t end, dbio_scan_fn fn, void *arg);
+int dbio_scan_io(void);
+int dbio_read_range(int fd, int first_id, int count, student_t *out);
+int dbio_read_scatter(int fd, int first_id, int count, student_t *const *recs);
+int dbio_write_gather(int fd, int first_id, int count, const student_t *const *recs);
+int dbio_punch_empty_pages(int fd, off_t *reclaimed);
+int dbio_next_extent(int fd, off_t from, off_t end, off_t align, off_t *data, off_t *hole);
+int dbio_claim(int fd, int id);
+int dbio_release(int fd, int id);
+bool dbio_live(int fd, int id);
+int dbio_count(int fd);
+void dbio_add_count(int fd, int delta);
+int dbio_recount(int fd);
+int dbio_sync(int fd);
+int dbio_lock_records(int fd, int first_id, int count);
+int dbio_unlock_records(int fd, int first_id, int count);
+int dbio_freeze(int fd);
+void dbio_thaw(int fd);
+
+#endif
@@ -0,0 +1,883 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbio.h"
+#include "wal.h"
+#include "dbmap.h"
+#include "dbbloom.h"
+
+// directory file descriptor for each database fd, -1 (stored as 0) when none
+static int dbmap_fds[DBIO_MAX_FD];
+
+// what a bucket page that was never written reads back as
+static const student_t empty_page[DBMAP_PAGE_SLOTS];
+
+static int dir_fd(int fd)
+{
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return -1;
+    return dbmap_fds[fd] - 1;
+}
+
+// splitmix64 finalizer.  It is a bijection, so two ids never share all 64
+// bits of their hash and a bucket can always be split apart eventually
+static uint64_t id_hash(long long id)
+{
+    uint64_t z = (uint64_t)id;
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t low_bits(uint64_t h, uint32_t depth)
+{
+    return h & ((1ULL << depth) - 1);
+}
+
+// dbio slot number of the header of bucket page pno
+static int page_slot(uint32_t pno)
+{
+    return DBMAP_FIRST_SLOT + (int)pno * DBMAP_PAGE_SLOTS;
+}
+
+static int read_hdr(int xfd, dbmap_hdr_t *hdr)
+{
+    if (pread(xfd, hdr, sizeof(*hdr), 0) != sizeof(*hdr))
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+static int write_hdr(int xfd, const dbmap_hdr_t *hdr)
+{
+    if (pwrite(xfd, hdr, sizeof(*hdr), 0) != sizeof(*hdr))
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+static bool hdr_valid(const dbmap_hdr_t *hdr)
+{
+    return memcmp(hdr->magic, DBMAP_MAGIC, sizeof(hdr->magic)) == 0 &&
+           hdr->version == DBMAP_VERSION && hdr->depth <= DBMAP_MAX_DEPTH;
+}
+
+static int read_entry(int xfd, uint64_t i, uint32_t *pno)
+{
+    off_t off = DBMAP_DIR_OFFSET + (off_t)i * sizeof(uint32_t);
+
+    if (pread(xfd, pno, sizeof(*pno), off) != sizeof(*pno))
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+static int write_entries(int xfd, uint64_t first, uint64_t count, const uint32_t *pnos)
+{
+    off_t off = DBMAP_DIR_OFFSET + (off_t)first * sizeof(uint32_t);
+    size_t len = count * sizeof(uint32_t);
+
+    if (pwrite(xfd, pnos, len, off) != (ssize_t)len)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+static int read_page(int fd, uint32_t pno, student_t *page)
+{
+    return dbio_read_range(fd, page_slot(pno), DBMAP_PAGE_SLOTS, page);
+}
+
+static void get_bucket(const student_t *page, dbmap_bucket_t *b)
+{
+    memcpy(b, &page[0], sizeof(*b));
+}
+
+static void set_bucket(student_t *page, uint32_t depth, uint64_t prefix)
+{
+    dbmap_bucket_t b = {0};
+
+    memcpy(b.magic, DBMAP_BUCKET_MAGIC, sizeof(b.magic));
+    b.depth = depth;
+    b.prefix = prefix;
+    memcpy(&page[0], &b, sizeof(b));
+}
+
+static bool bucket_valid(const dbmap_bucket_t *b)
+{
+    return b->zero == DELETED_STUDENT_ID && memcmp(b->magic, DBMAP_BUCKET_MAGIC, sizeof(b->magic)) == 0 &&
+           b->depth <= DBMAP_MAX_DEPTH && b->prefix == low_bits(b->prefix, b->depth);
+}
+
+// slot of id in a bucket page, 0 if the page does not have it
+static int find_in_page(const student_t *page, long long id)
+{
+    for (int j = 1; j < DBMAP_PAGE_SLOTS; j++)
+        if (page[j].id == id)
+            return j;
+    return 0;
+}
+
+// number of bucket pages the database file has room for
+static int file_pages(int fd, uint32_t *pages)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) == -1)
+        return ERR_DB_FILE;
+    *pages = st.st_size <= DBMAP_BASE ? 0 : (st.st_size - DBMAP_BASE + DB_PAGE_SIZE - 1) / DB_PAGE_SIZE;
+    return NO_ERROR;
+}
+
+/*
+ *  store_page
+ *      fd:      database file descriptor
+ *      pno:     bucket page to write
+ *      *before: current contents of the page
+ *      *after:  new contents of the page
+ *
+ *  Logs every slot that changes (the bucket header as an add of its image)
+ *  and writes the whole page with one dbio_write_gather() call.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int store_page(int fd, uint32_t pno, const student_t *before, const student_t *after)
+{
+    const student_t *recs[DBMAP_PAGE_SLOTS];
+    int slot = page_slot(pno);
+    int rc = NO_ERROR;
+
+    for (int j = 0; j < DBMAP_PAGE_SLOTS && rc == NO_ERROR; j++)
+    {
+        recs[j] = &after[j];
+        if (memcmp(&before[j], &after[j], STUDENT_RECORD_SIZE) == 0)
+            continue;
+        if (j == 0 || after[j].id != DELETED_STUDENT_ID)
+            rc = wal_log(fd, WAL_OP_ADD, slot + j, &after[j]);
+        else
+            rc = wal_log(fd, WAL_OP_DEL, slot + j, &before[j]);
+    }
+    if (rc == NO_ERROR)
+        rc = dbio_write_gather(fd, slot, DBMAP_PAGE_SLOTS, recs);
+    return rc;
+}
+
+/*
+ *  drop_stale
+ *      fd:    database file descriptor
+ *      dir:   the directory that was just rebuilt
+ *      depth: global depth of dir
+ *      pno:   bucket page to check
+ *
+ *  A split that did not finish can leave records in the page they were
+ *  moving out of.  Such a record is dropped if the page the directory
+ *  sends its id to has it as well.
+ *
+ *  returns:  number of records dropped, or ERR_DB_FILE
+ */
+static int drop_stale(int fd, const uint32_t *dir, uint32_t depth, uint32_t pno)
+{
+    student_t page[DBMAP_PAGE_SLOTS], fixed[DBMAP_PAGE_SLOTS], other[DBMAP_PAGE_SLOTS];
+    int dropped = 0;
+
+    if (read_page(fd, pno, page) != NO_ERROR)
+        return ERR_DB_FILE;
+    memcpy(fixed, page, sizeof(page));
+
+    for (int j = 1; j < DBMAP_PAGE_SLOTS; j++)
+    {
+        uint32_t home;
+
+        if (page[j].id == DELETED_STUDENT_ID)
+            continue;
+        home = dir[low_bits(id_hash(page[j].id), depth)];
+        if (home == pno)
+            continue;
+        if (read_page(fd, home, other) != NO_ERROR)
+            return ERR_DB_FILE;
+        if (find_in_page(other, page[j].id) != 0)
+        {
+            fixed[j] = EMPTY_STUDENT_RECORD;
+            dropped++;
+        }
+    }
+    if (dropped > 0 && store_page(fd, pno, page, fixed) != NO_ERROR)
+        return ERR_DB_FILE;
+    return dropped;
+}
+
+/*
+ *  rebuild_filter
+ *      fd:     database file descriptor
+ *      pages:  bucket pages of the id map
+ *
+ *  Collects the ids of every bucket page and rebuilds the Bloom filter from
+ *  them, see dbbloom.h.  The caller holds the directory lock exclusively.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int rebuild_filter(int fd, uint32_t pages)
+{
+    student_t page[DBMAP_PAGE_SLOTS];
+    dbmap_bucket_t b;
+    long long *ids = NULL;
+    int n = 0, cap = 0, rc = NO_ERROR;
+
+    for (uint32_t p = 0; p < pages && rc == NO_ERROR; p++)
+    {
+        if (read_page(fd, p, page) != NO_ERROR)
+        {
+            rc = ERR_DB_FILE;
+            break;
+        }
+        get_bucket(page, &b);
+        if (!bucket_valid(&b))
+            continue;
+        for (int j = 1; j < DBMAP_PAGE_SLOTS; j++)
+        {
+            if (page[j].id == DELETED_STUDENT_ID)
+                continue;
+            if (n == cap)
+            {
+                long long *more = realloc(ids, sizeof(long long) * (cap ? cap * 2 : 1024));
+                if (more == NULL)
+                {
+                    rc = ERR_DB_FILE;
+                    break;
+                }
+                ids = more;
+                cap = cap ? cap * 2 : 1024;
+            }
+            ids[n++] = page[j].id;
+        }
+    }
+    if (rc == NO_ERROR)
+        rc = dbbloom_rebuild(fd, ids, n, pages);
+    free(ids);
+    return rc;
+}
+
+// puts id in the Bloom filter before its record is written, rebuilding a
+// filter that is full
+static int filter_add(int fd, uint32_t pages, long long id)
+{
+    if (dbbloom_add(fd, id) == NO_ERROR)
+        return NO_ERROR;
+    if (rebuild_filter(fd, pages) != NO_ERROR || dbbloom_add(fd, id) != NO_ERROR)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+/*
+ *  rebuild
+ *      fd:       database file descriptor
+ *      xfd:      directory file descriptor, locked exclusively by the caller
+ *      *hdr:     receives the new directory header
+ *      recount:  the live count came from a scan and has to be recomputed
+ *                if stale records are dropped
+ *
+ *  Builds the directory from the bucket headers.  Buckets are entered from
+ *  the lowest local depth up, so a bucket that was split wins over the
+ *  header of the page it was split from if that one was never updated.
+ *  Directory entries nobody claims get a new, empty bucket page.  The
+ *  Bloom filter is rebuilt along.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int rebuild(int fd, int xfd, dbmap_hdr_t *hdr, bool recount)
+{
+    dbmap_bucket_t *b = NULL;
+    uint32_t *dir = NULL;
+    uint32_t pages, depth = 0, valid = 0;
+    student_t page[DBMAP_PAGE_SLOTS];
+    int rc = NO_ERROR, dropped = 0;
+
+    if (file_pages(fd, &pages) != NO_ERROR)
+        return ERR_DB_FILE;
+    if (pages > 0 && (b = malloc(pages * sizeof(*b))) == NULL)
+        return ERR_DB_FILE;
+
+    for (uint32_t p = 0; p < pages && rc == NO_ERROR; p++)
+    {
+        if (dbio_read_range(fd, page_slot(p), 1, page) != NO_ERROR)
+            rc = ERR_DB_FILE;
+        get_bucket(page, &b[p]);
+        if (!bucket_valid(&b[p]))
+            b[p].depth = UINT32_MAX;
+        else
+        {
+            valid++;
+            if (b[p].depth > depth)
+                depth = b[p].depth;
+        }
+    }
+
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, DBMAP_MAGIC, sizeof(hdr->magic));
+    hdr->version = DBMAP_VERSION;
+    hdr->depth = depth;
+    hdr->pages = pages;
+
+    uint64_t size = 1ULL << depth;
+    if (rc == NO_ERROR && pages > 0 && (dir = malloc(size * sizeof(*dir))) == NULL)
+        rc = ERR_DB_FILE;
+
+    if (rc == NO_ERROR && pages > 0)
+    {
+        memset(dir, 0xff, size * sizeof(*dir));
+        for (uint32_t d = 0; d <= depth; d++)
+            for (uint32_t p = 0; p < pages; p++)
+                if (b[p].depth == d)
+                    for (uint64_t i = b[p].prefix; i < size; i += 1ULL << d)
+                        dir[i] = p;
+
+        for (uint64_t i = 0; i < size && rc == NO_ERROR; i++)
+        {
+            if (dir[i] != UINT32_MAX)
+                continue;
+            memset(page, 0, sizeof(page));
+            set_bucket(page, depth, i);
+            dir[i] = hdr->pages++;
+            rc = store_page(fd, dir[i], empty_page, page);
+        }
+
+        for (uint32_t p = 0; p < pages && rc == NO_ERROR && valid > 0; p++)
+        {
+            int n = b[p].depth == UINT32_MAX ? 0 : drop_stale(fd, dir, depth, p);
+            if (n < 0)
+                rc = ERR_DB_FILE;
+            else
+                dropped += n;
+        }
+        if (rc == NO_ERROR)
+            rc = write_entries(xfd, 0, size, dir);
+    }
+
+    if (rc == NO_ERROR && dropped > 0 && recount)
+        rc = dbio_recount(fd);
+    if (rc == NO_ERROR &&
+        (ftruncate(xfd, DBMAP_DIR_OFFSET + (pages > 0 ? size * sizeof(*dir) : 0)) == -1 ||
+         write_hdr(xfd, hdr) != NO_ERROR))
+        rc = ERR_DB_FILE;
+    if (rc == NO_ERROR)
+        rc = rebuild_filter(fd, hdr->pages);
+
+    free(dir);
+    free(b);
+    return rc;
+}
+
+/*
+ *  find
+ *      fd:     database file descriptor
+ *      xfd:    directory file descriptor, locked by the caller
+ *      *hdr:   current directory header
+ *      id:     student id, above MAX_STD_ID
+ *      *pno:   receives the bucket page of id
+ *      *page:  receives the contents of that page
+ *
+ *  returns:  slot of id in the page (1 and up), 0 if id is not there,
+ *            ERR_DB_OP if the directory does not match the bucket header,
+ *            or ERR_DB_FILE
+ */
+static int find(int fd, int xfd, const dbmap_hdr_t *hdr, long long id, uint32_t *pno, student_t *page)
+{
+    uint64_t h = id_hash(id);
+    dbmap_bucket_t b;
+
+    if (hdr->pages == 0)
+    {
+        *pno = UINT32_MAX;
+        return 0;
+    }
+    if (read_entry(xfd, low_bits(h, hdr->depth), pno) != NO_ERROR)
+        return ERR_DB_OP;
+    if (*pno >= hdr->pages)
+        return ERR_DB_OP;
+    if (read_page(fd, *pno, page) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    get_bucket(page, &b);
+    if (!bucket_valid(&b) || b.depth > hdr->depth || b.prefix != low_bits(h, b.depth))
+        return ERR_DB_OP;
+    return find_in_page(page, id);
+}
+
+/*
+ *  locked_find
+ *      op:  LOCK_SH for a lookup, LOCK_EX for a change
+ *
+ *  find() under an flock() of the directory file.  A directory that does
+ *  not match the bucket pages, for example because a process died in the
+ *  middle of a split, is rebuilt and the lookup is repeated.  The caller
+ *  releases the lock, which is exclusive after a rebuild.
+ *
+ *  returns:  see find(), except that ERR_DB_OP is never returned
+ */
+static int locked_find(int fd, int xfd, int op, dbmap_hdr_t *hdr, long long id, uint32_t *pno,
+                       student_t *page)
+{
+    int rc;
+
+    if (flock(xfd, op) == -1)
+        return ERR_DB_FILE;
+    if (read_hdr(xfd, hdr) != NO_ERROR || !hdr_valid(hdr))
+        rc = ERR_DB_OP;
+    else
+        rc = find(fd, xfd, hdr, id, pno, page);
+
+    if (rc == ERR_DB_OP)
+    {
+        if (op != LOCK_EX && flock(xfd, LOCK_EX) == -1)
+            return ERR_DB_FILE;
+        rc = rebuild(fd, xfd, hdr, false);
+        if (rc == NO_ERROR)
+            rc = find(fd, xfd, hdr, id, pno, page);
+        if (rc == ERR_DB_OP)
+            rc = ERR_DB_FILE;
+    }
+    return rc;
+}
+
+/*
+ *  first_page
+ *      fd:    database file descriptor
+ *      xfd:   directory file descriptor, locked exclusively
+ *      *hdr:  directory header, updated
+ *
+ *  Creates bucket page 0 with local depth 0, the whole directory points
+ *  to it.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int first_page(int fd, int xfd, dbmap_hdr_t *hdr)
+{
+    student_t page[DBMAP_PAGE_SLOTS] = {0};
+    uint32_t pno = 0;
+
+    set_bucket(page, 0, 0);
+    if (store_page(fd, pno, empty_page, page) != NO_ERROR ||
+        write_entries(xfd, 0, 1, &pno) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    hdr->depth = 0;
+    hdr->pages = 1;
+    if (write_hdr(xfd, hdr) != NO_ERROR)
+        return ERR_DB_FILE;
+    dbbloom_set_pages(fd, hdr->pages);
+    return NO_ERROR;
+}
+
+/*
+ *  split
+ *      fd:     database file descriptor
+ *      xfd:    directory file descriptor, locked exclusively
+ *      *hdr:   directory header, updated
+ *      pno:    the full bucket page
+ *      *page:  its contents
+ *
+ *  Splits a full bucket of local depth d into two buckets of depth d + 1.
+ *  The records whose hash has bit d set move to a new page at the end of
+ *  the file, into the same slots they had.  If the bucket was as deep as
+ *  the directory, the directory is doubled first.  The new page is written
+ *  before the old one and the directory last, so a crash never loses a
+ *  record, it can only leave a directory that rebuild() has to fix.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE (also when DBMAP_MAX_DEPTH is reached)
+ */
+static int split(int fd, int xfd, dbmap_hdr_t *hdr, uint32_t pno, const student_t *page)
+{
+    student_t old[DBMAP_PAGE_SLOTS], moved[DBMAP_PAGE_SLOTS] = {0};
+    dbmap_bucket_t b;
+    uint32_t newp = hdr->pages;
+    int rc = NO_ERROR;
+
+    get_bucket(page, &b);
+    if (b.depth == hdr->depth)
+    {
+        uint64_t size = 1ULL << hdr->depth;
+        uint32_t *dir;
+
+        if (hdr->depth == DBMAP_MAX_DEPTH || (dir = malloc(size * sizeof(*dir))) == NULL)
+            return ERR_DB_FILE;
+
+        // the upper half of the doubled directory repeats the lower half
+        if (pread(xfd, dir, size * sizeof(*dir), DBMAP_DIR_OFFSET) != (ssize_t)(size * sizeof(*dir)) ||
+            write_entries(xfd, size, size, dir) != NO_ERROR)
+            rc = ERR_DB_FILE;
+        free(dir);
+        if (rc != NO_ERROR)
+            return rc;
+        hdr->depth++;
+    }
+
+    memcpy(old, page, sizeof(old));
+    set_bucket(old, b.depth + 1, b.prefix);
+    set_bucket(moved, b.depth + 1, b.prefix | 1ULL << b.depth);
+    for (int j = 1; j < DBMAP_PAGE_SLOTS; j++)
+        if (page[j].id != DELETED_STUDENT_ID && (id_hash(page[j].id) >> b.depth & 1))
+        {
+            moved[j] = page[j];
+            old[j] = EMPTY_STUDENT_RECORD;
+        }
+
+    if (store_page(fd, newp, empty_page, moved) != NO_ERROR ||
+        store_page(fd, pno, page, old) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    uint64_t step = 1ULL << (b.depth + 1);
+    for (uint64_t i = b.prefix | 1ULL << b.depth; i < 1ULL << hdr->depth && rc == NO_ERROR; i += step)
+        rc = write_entries(xfd, i, 1, &newp);
+
+    hdr->pages++;
+    if (rc == NO_ERROR)
+        rc = write_hdr(xfd, hdr);
+    if (rc == NO_ERROR)
+        dbbloom_set_pages(fd, hdr->pages);
+    return rc;
+}
+
+/*
+ *  dbmap_open
+ *      fd:               database file descriptor
+ *      dbFile:           path of the database, the directory is dbFile
+ *                        followed by DBMAP_SUFFIX
+ *      should_truncate:  the database was just emptied
+ *      rebuild_dir:      the log replay rewrote records, always rebuild
+ *
+ *  Opens the directory of the id map and its Bloom filter.  If the
+ *  directory is missing, was written by another version, or does not cover
+ *  every bucket page of the file it is rebuilt from the bucket headers, so
+ *  is a filter that does not match it.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbmap_open(int fd, char *dbFile, bool should_truncate, bool rebuild_dir)
+{
+    char path[4096];
+    dbmap_hdr_t hdr;
+    uint32_t pages;
+    int rc = NO_ERROR;
+
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return ERR_DB_FILE;
+
+    snprintf(path, sizeof(path), "%s%s", dbFile, DBMAP_SUFFIX);
+    int xfd = open(path, O_RDWR | O_CREAT | (should_truncate ? O_TRUNC : 0),
+                   S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (xfd == -1)
+        return ERR_DB_FILE;
+
+    if (flock(xfd, LOCK_EX) == -1 || file_pages(fd, &pages) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    else
+    {
+        bool stale = rebuild_dir || read_hdr(xfd, &hdr) != NO_ERROR || !hdr_valid(&hdr) ||
+                     hdr.pages != pages;
+
+        rc = dbbloom_open(fd, dbFile, should_truncate || stale, stale ? 0 : hdr.pages);
+        if (stale && rc != ERR_DB_FILE)
+            rc = rebuild(fd, xfd, &hdr, rebuild_dir);
+        else if (rc == ERR_DB_OP)
+            rc = rebuild_filter(fd, hdr.pages);
+    }
+    flock(xfd, LOCK_UN);
+
+    if (rc != NO_ERROR)
+    {
+        dbbloom_close(fd);
+        close(xfd);
+        return rc;
+    }
+    dbmap_fds[fd] = xfd + 1;
+    return NO_ERROR;
+}
+
+void dbmap_close(int fd)
+{
+    int xfd = dir_fd(fd);
+
+    dbbloom_close(fd);
+    if (xfd >= 0)
+    {
+        close(xfd);
+        dbmap_fds[fd] = 0;
+    }
+}
+
+/*
+ *  dbmap_freeze
+ *      fd:  database file descriptor
+ *
+ *  Takes a shared flock() of the directory file, which keeps every change
+ *  of the id map out (they all hold it exclusively) until dbmap_thaw().
+ *  Lookups go on as usual.
+ *
+ *  returns:  the directory file descriptor, or ERR_DB_FILE
+ */
+int dbmap_freeze(int fd)
+{
+    int xfd = dir_fd(fd);
+
+    if (xfd < 0 || flock(xfd, LOCK_SH) == -1)
+        return ERR_DB_FILE;
+    return xfd;
+}
+
+void dbmap_thaw(int fd)
+{
+    int xfd = dir_fd(fd);
+
+    if (xfd >= 0)
+        flock(xfd, LOCK_UN);
+}
+
+/*
+ *  dbmap_read
+ *      fd:  database file descriptor
+ *      id:  student id
+ *      *s:  receives the student
+ *
+ *  Looks up a student by id, ids up to MAX_STD_ID are simply read from
+ *  their slot.
+ *
+ *  returns:  NO_ERROR       student located and copied into *s
+ *            ERR_DB_FILE    database file I/O issue
+ *            SRCH_NOT_FOUND student was not located in the database
+ */
+int dbmap_read(int fd, long long id, student_t *s)
+{
+    student_t page[DBMAP_PAGE_SLOTS];
+    dbmap_hdr_t hdr;
+    uint32_t pno;
+    int xfd = dir_fd(fd);
+
+    if (id <= MAX_STD_ID)
+        return dbio_read(fd, (int)id, s);
+    if (xfd < 0)
+        return ERR_DB_FILE;
+    if (!dbbloom_may_contain(fd, id))
+        return SRCH_NOT_FOUND;
+
+    int rc = locked_find(fd, xfd, LOCK_SH, &hdr, id, &pno, page);
+    flock(xfd, LOCK_UN);
+    if (rc < 0)
+        return rc;
+    if (rc == 0)
+        return SRCH_NOT_FOUND;
+    *s = page[rc];
+    return NO_ERROR;
+}
+
+/*
+ *  dbmap_may_exist
+ *      fd:  database file descriptor
+ *      id:  student id
+ *
+ *  Answers from memory alone: the occupancy bitmap for ids up to
+ *  MAX_STD_ID, the Bloom filter for the others.
+ *
+ *  returns:  false if there is surely no student id, true if there may be
+ */
+bool dbmap_may_exist(int fd, long long id)
+{
+    if (id <= MAX_STD_ID)
+        return dbio_live(fd, (int)id);
+    return dbbloom_may_contain(fd, id);
+}
+
+/*
+ *  dbmap_read_many
+ *      fd:     database file descriptor
+ *      count:  number of ids
+ *      *ids:   student ids
+ *      *out:   room for count students, out[i] receives student ids[i]
+ *      *rcs:   room for count results, rcs[i] is what dbmap_read() would
+ *              return for ids[i]
+ *
+ *  The ids up to MAX_STD_ID go to dbio_read_many() together, so they still
+ *  share one batch of I/O, the others are looked up one by one.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE (out of memory)
+ */
+int dbmap_read_many(int fd, int count, const long long *ids, student_t *out, int *rcs)
+{
+    int *direct = malloc(sizeof(int) * (count ? count : 1));
+    int *at = malloc(sizeof(int) * (count ? count : 1));
+    student_t *found = malloc(sizeof(student_t) * (count ? count : 1));
+    int *found_rcs = malloc(sizeof(int) * (count ? count : 1));
+    int n = 0, rc = NO_ERROR;
+
+    if (direct == NULL || at == NULL || found == NULL || found_rcs == NULL)
+        rc = ERR_DB_FILE;
+
+    for (int i = 0; rc == NO_ERROR && i < count; i++)
+    {
+        if (ids[i] > MAX_STD_ID)
+        {
+            rcs[i] = dbmap_read(fd, ids[i], &out[i]);
+            continue;
+        }
+        direct[n] = (int)ids[i];
+        at[n++] = i;
+    }
+    if (rc == NO_ERROR && n > 0)
+        rc = dbio_read_many(fd, n, direct, found, found_rcs);
+    for (int k = 0; rc == NO_ERROR && k < n; k++)
+    {
+        out[at[k]] = found[k];
+        rcs[at[k]] = found_rcs[k];
+    }
+
+    free(direct);
+    free(at);
+    free(found);
+    free(found_rcs);
+    return rc;
+}
+
+/*
+ *  dbmap_insert
+ *      fd:  database file descriptor
+ *      *s:  fully built student record, s->id above MAX_STD_ID
+ *
+ *  Stores the student in a free slot of its bucket, splitting the bucket
+ *  as often as needed to make room.  All changes are made under an
+ *  exclusive flock() of the directory file and go through the write-ahead
+ *  log, the caller holds wal_begin().
+ *
+ *  returns:  NO_ERROR       student added
+ *            ERR_DB_FILE    database file I/O issue
+ *            ERR_DB_OP      student already exists
+ */
+int dbmap_insert(int fd, const student_t *s)
+{
+    student_t page[DBMAP_PAGE_SLOTS];
+    dbmap_hdr_t hdr;
+    uint32_t pno;
+    int xfd = dir_fd(fd);
+    int rc;
+
+    if (xfd < 0 || s->id <= MAX_STD_ID)
+        return ERR_DB_FILE;
+
+    rc = locked_find(fd, xfd, LOCK_EX, &hdr, s->id, &pno, page);
+    if (rc == 0 && hdr.pages == 0 && (rc = first_page(fd, xfd, &hdr)) == NO_ERROR)
+        rc = find(fd, xfd, &hdr, s->id, &pno, page);
+    if (rc == 0)
+        rc = filter_add(fd, hdr.pages, s->id);
+
+    while (rc == 0)
+    {
+        int j = find_in_page(page, DELETED_STUDENT_ID);
+        if (j > 0)
+        {
+            int slot = page_slot(pno) + j;
+            if ((rc = wal_log(fd, WAL_OP_ADD, slot, s)) == NO_ERROR &&
+                (rc = dbio_write(fd, slot, s)) == NO_ERROR)
+                dbio_add_count(fd, 1);
+            break;
+        }
+        if ((rc = split(fd, xfd, &hdr, pno, page)) == NO_ERROR)
+            rc = find(fd, xfd, &hdr, s->id, &pno, page);
+    }
+    if (rc > 0)
+        rc = ERR_DB_OP;
+    else if (rc == ERR_DB_OP)
+        rc = ERR_DB_FILE;
+
+    flock(xfd, LOCK_UN);
+    return rc;
+}
+
+/*
+ *  dbmap_update
+ *      fd:    database file descriptor
+ *      *s:    s->id above MAX_STD_ID, and the new value of the field
+ *      off:   offset of the field in student_t
+ *      len:   size of the field
+ *      *old:  receives the record before the change
+ *
+ *  Rewrites one field of the student in place, under an exclusive flock()
+ *  of the directory file.  The log gets the whole new record, it replays
+ *  like an add.  The caller holds wal_begin().
+ *
+ *  returns:  NO_ERROR       field written
+ *            ERR_DB_FILE    database file I/O issue
+ *            SRCH_NOT_FOUND student not in database
+ */
+int dbmap_update(int fd, const student_t *s, size_t off, size_t len, student_t *old)
+{
+    student_t page[DBMAP_PAGE_SLOTS];
+    student_t rec;
+    dbmap_hdr_t hdr;
+    uint32_t pno;
+    int xfd = dir_fd(fd);
+    int rc;
+
+    if (xfd < 0 || s->id <= MAX_STD_ID || off + len > (size_t)STUDENT_RECORD_SIZE)
+        return ERR_DB_FILE;
+
+    rc = locked_find(fd, xfd, LOCK_EX, &hdr, s->id, &pno, page);
+    if (rc > 0)
+    {
+        int slot = page_slot(pno) + rc;
+
+        *old = rec = page[rc];
+        memcpy((char *)&rec + off, (const char *)s + off, len);
+        if ((rc = wal_log(fd, WAL_OP_ADD, slot, &rec)) == NO_ERROR)
+            rc = dbio_write_field(fd, slot, &rec, off, len);
+    }
+    else if (rc == 0)
+        rc = SRCH_NOT_FOUND;
+
+    flock(xfd, LOCK_UN);
+    return rc;
+}
+
+/*
+ *  dbmap_remove
+ *      fd:    database file descriptor
+ *      id:    student id above MAX_STD_ID
+ *      *old:  receives the record that was deleted
+ *
+ *  Clears the slot of the student in its bucket, under an exclusive
+ *  flock() of the directory file.  The caller holds wal_begin().
+ *
+ *  returns:  NO_ERROR       student deleted
+ *            ERR_DB_FILE    database file I/O issue
+ *            SRCH_NOT_FOUND student not in database
+ */
+int dbmap_remove(int fd, long long id, student_t *old)
+{
+    student_t page[DBMAP_PAGE_SLOTS];
+    dbmap_hdr_t hdr;
+    uint32_t pno;
+    int xfd = dir_fd(fd);
+    int rc;
+
+    if (xfd < 0 || id <= MAX_STD_ID)
+        return ERR_DB_FILE;
+
+    rc = locked_find(fd, xfd, LOCK_EX, &hdr, id, &pno, page);
+    if (rc > 0)
+    {
+        int slot = page_slot(pno) + rc;
+
+        *old = page[rc];
+        if ((rc = wal_log(fd, WAL_OP_DEL, slot, old)) == NO_ERROR &&
+            (rc = dbio_write(fd, slot, &EMPTY_STUDENT_RECORD)) == NO_ERROR)
+            dbio_add_count(fd, -1);
+    }
+    else if (rc == 0)
+        rc = SRCH_NOT_FOUND;
+
+    flock(xfd, LOCK_UN);
+    return rc;
+}
@@ -0,0 +1,83 @@
+#ifndef __DBMAP_H__
+#define __DBMAP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "db.h" //get student record type
+#include "dbio.h"
+
+// Id map for students with an id above MAX_STD_ID.  Those ids can be
+// anywhere up to MAX_STD_ID_64, so they can not have a fixed slot, instead
+// they are placed with extendible hashing:
+//
+//  - Bucket pages of DB_PAGE_SIZE bytes live in the database file behind
+//    the fixed slots, starting at DBMAP_BASE.  Slot 0 of a bucket page is a
+//    dbmap_bucket_t header (its id field stays zero, so scans skip it), the
+//    other slots hold ordinary student records.
+//  - The directory is kept in a sidecar file (DB_FILE followed by
+//    DBMAP_SUFFIX): a dbmap_hdr_t in the first DBMAP_DIR_OFFSET bytes and
+//    then 1 << depth page numbers.  Entry i points to the bucket that holds
+//    the ids whose hash ends in the low depth bits of i.
+//
+// A lookup hashes the id, reads one directory entry and one bucket page,
+// whatever the number of students and the size of the ids.  A full bucket
+// is split in two, doubling the directory when needed, so the file grows
+// with the number of students and never with the largest id.  Bucket pages
+// are not merged again when students are deleted.
+//
+// The directory can always be rebuilt from the bucket headers, which is
+// done when it is missing or does not match the database, for example
+// after a crash in the middle of a split.
+//
+// A Bloom filter of the ids (see dbbloom.h) answers most lookups of ids
+// that are not there without touching the directory.
+#define DBMAP_SUFFIX ".dir"
+#define DBMAP_MAGIC "SDBDIR\0"
+#define DBMAP_BUCKET_MAGIC "SDBBKT\0"
+#define DBMAP_VERSION 1
+#define DBMAP_DIR_OFFSET 4096
+#define DBMAP_MAX_DEPTH 24
+
+// Slots per bucket page, slot 0 is the bucket header
+#define DBMAP_PAGE_SLOTS (DB_PAGE_SIZE / 64)
+
+// The first bucket page starts on the first page boundary behind the slot
+// of MAX_STD_ID, which is also where the mapping of the mmap backend ends.
+// DBMAP_FIRST_SLOT is the slot number of its header in dbio terms.
+#define DBMAP_BASE \
+    ((DB_HEADER_SIZE + (MAX_STD_ID + 1) * 64 + DB_PAGE_SIZE - 1) / DB_PAGE_SIZE * DB_PAGE_SIZE)
+#define DBMAP_FIRST_SLOT ((DBMAP_BASE - DB_HEADER_SIZE) / 64)
+
+typedef struct dbmap_hdr
+{
+    char magic[8];     // DBMAP_MAGIC
+    uint32_t version;  // DBMAP_VERSION
+    uint32_t depth;    // global depth, the directory has 1 << depth entries
+    uint32_t pages;    // bucket pages in the database file
+    uint32_t reserved;
+} dbmap_hdr_t;
+
+// Header of a bucket page, exactly one student record in size
+typedef struct dbmap_bucket
+{
+    int64_t zero;      // id field of the slot, always DELETED_STUDENT_ID
+    char magic[8];     // DBMAP_BUCKET_MAGIC
+    uint32_t depth;    // local depth
+    uint32_t reserved;
+    uint64_t prefix;   // low depth bits shared by the hashes of the bucket
+    char pad[32];
+} dbmap_bucket_t;
+
+int dbmap_open(int fd, char *dbFile, bool should_truncate, bool rebuild_dir);
+void dbmap_close(int fd);
+int dbmap_freeze(int fd);
+void dbmap_thaw(int fd);
+bool dbmap_may_exist(int fd, long long id);
+int dbmap_read(int fd, long long id, student_t *s);
+int dbmap_read_many(int fd, int count, const long long *ids, student_t *out, int *rcs);
+int dbmap_insert(int fd, const student_t *s);
+int dbmap_update(int fd, const student_t *s, size_t off, size_t len, student_t *old);
+int dbmap_remove(int fd, long long id, student_t *old);
+
+#endif
@@ -0,0 +1,484 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbio.h"
+#include "dbpack.h"
+
+#define FNAME_SIZE sizeof(((student_t *)0)->fname)
+
+// the most a record takes: id delta, gpa and dictionary position as
+// varints, the fname length byte and the longest fname
+#define MAX_REC (10 + 3 + 5 + 1 + FNAME_SIZE)
+
+// one distinct last name while the dictionary is built
+typedef struct dict_entry
+{
+    char name[DBPACK_LNAME];
+    uint32_t uses;
+    uint32_t pos;  // position in the written dictionary
+} dict_entry_t;
+
+// everything dbpack_write() collects from the scan
+typedef struct pack_build
+{
+    student_t *recs;
+    size_t count;
+    size_t cap;
+} pack_build_t;
+
+static int collect_record(const student_t *s, void *arg)
+{
+    pack_build_t *pb = arg;
+
+    if (pb->count == pb->cap)
+    {
+        size_t cap = pb->cap ? pb->cap * 2 : 4096;
+        student_t *more = realloc(pb->recs, cap * sizeof(student_t));
+        if (more == NULL)
+            return ERR_DB_FILE;
+        pb->recs = more;
+        pb->cap = cap;
+    }
+    pb->recs[pb->count++] = *s;
+    return 0;
+}
+
+static int cmp_id(const void *a, const void *b)
+{
+    long long x = ((const student_t *)a)->id, y = ((const student_t *)b)->id;
+    return (x > y) - (x < y);
+}
+
+// most used first, so the common last names get the one byte positions
+static int cmp_uses(const void *a, const void *b)
+{
+    const dict_entry_t *x = *(dict_entry_t *const *)a, *y = *(dict_entry_t *const *)b;
+
+    if (x->uses != y->uses)
+        return x->uses > y->uses ? -1 : 1;
+    return memcmp(x->name, y->name, DBPACK_LNAME);
+}
+
+// FNV-1a of a zero padded last name
+static uint32_t name_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < DBPACK_LNAME && name[i] != '\0'; i++)
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    return h;
+}
+
+static size_t put_varint(unsigned char *out, uint64_t v)
+{
+    size_t n = 0;
+
+    while (v >= 0x80)
+    {
+        out[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (unsigned char)v;
+    return n;
+}
+
+// reads a varint out of [*at, end), false if it runs past end
+static bool get_varint(const unsigned char **at, const unsigned char *end, uint64_t *v)
+{
+    *v = 0;
+    for (int shift = 0; *at < end && shift < 64; shift += 7)
+    {
+        unsigned char c = *(*at)++;
+        *v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static size_t encode(unsigned char *out, const student_t *s, int64_t first_id, uint32_t lname_pos)
+{
+    size_t n = put_varint(out, (uint64_t)(s->id - first_id));
+    size_t flen = strnlen(s->fname, FNAME_SIZE);
+
+    n += put_varint(out + n, (uint64_t)(uint16_t)s->gpa);
+    n += put_varint(out + n, lname_pos);
+    out[n++] = (unsigned char)flen;
+    memcpy(out + n, s->fname, flen);
+    return n + flen;
+}
+
+/*
+ *  build_dict
+ *      *pb:    the collected students
+ *      *pos:   receives the dictionary position of the lname of every student
+ *      **out:  receives the encoded dictionary, the caller frees it
+ *      *len:   receives its length
+ *      *hdr:   dict_entries is filled in
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE (out of memory)
+ */
+static int build_dict(const pack_build_t *pb, uint32_t *pos, unsigned char **out, size_t *len,
+                      dbpack_hdr_t *hdr)
+{
+    size_t size = 64;
+    while (size < pb->count * 2)
+        size <<= 1;
+
+    dict_entry_t *table = calloc(size, sizeof(dict_entry_t));
+    dict_entry_t **order = malloc(size * sizeof(dict_entry_t *));
+    size_t *slot_of = malloc((pb->count ? pb->count : 1) * sizeof(size_t));
+    uint32_t n = 0;
+
+    if (table == NULL || order == NULL || slot_of == NULL)
+    {
+        free(table);
+        free(order);
+        free(slot_of);
+        return ERR_DB_FILE;
+    }
+
+    // uses == 0 marks a free slot, every entry in use has one at least
+    for (size_t i = 0; i < pb->count; i++)
+    {
+        const char *name = pb->recs[i].lname;
+        size_t k = name_hash(name) & (size - 1);
+
+        while (table[k].uses != 0 && strncmp(table[k].name, name, DBPACK_LNAME) != 0)
+            k = (k + 1) & (size - 1);
+        if (table[k].uses++ == 0)
+        {
+            memcpy(table[k].name, name, DBPACK_LNAME);
+            order[n++] = &table[k];
+        }
+        slot_of[i] = k;
+    }
+
+    qsort(order, n, sizeof(dict_entry_t *), cmp_uses);
+    *out = malloc((size_t)n * (DBPACK_LNAME + 1) + 1);
+    *len = 0;
+    if (*out != NULL)
+    {
+        for (uint32_t i = 0; i < n; i++)
+        {
+            size_t l = strnlen(order[i]->name, DBPACK_LNAME);
+            order[i]->pos = i;
+            (*out)[(*len)++] = (unsigned char)l;
+            memcpy(*out + *len, order[i]->name, l);
+            *len += l;
+        }
+        for (size_t i = 0; i < pb->count; i++)
+            pos[i] = table[slot_of[i]].pos;
+    }
+    hdr->dict_entries = n;
+
+    free(table);
+    free(order);
+    free(slot_of);
+    return *out != NULL ? NO_ERROR : ERR_DB_FILE;
+}
+
+// writes the page in buf as data page pno and starts a new one
+static int flush_page(int out, unsigned char *buf, uint32_t pno)
+{
+    if (pwrite(out, buf, DBPACK_PAGE, (off_t)(pno + 1) * DBPACK_PAGE) != DBPACK_PAGE)
+        return ERR_DB_FILE;
+    memset(buf, 0, DBPACK_PAGE);
+    return NO_ERROR;
+}
+
+/*
+ *  dbpack_write
+ *      fd:     database file descriptor
+ *      out:    file descriptor of the packed file, empty
+ *      *hdr:   receives the header that was written
+ *
+ *  Writes every student of the database to out in the packed format.  The
+ *  caller keeps the writers out for a consistent copy, see dbio_freeze().
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbpack_write(int fd, int out, dbpack_hdr_t *hdr)
+{
+    pack_build_t pb = {0};
+    unsigned char *dict = NULL;
+    unsigned char page[DBPACK_PAGE] = {0};
+    int64_t *index = NULL;
+    uint32_t *pos = NULL;
+    size_t dict_len = 0, nindex = 0;
+    int rc = dbio_scan(fd, collect_record, &pb);
+
+    memset(hdr, 0, sizeof(*hdr));
+    if (rc != NO_ERROR)
+        goto out;
+
+    // id order, a split of the id map that did not finish may have left a
+    // second copy of a record behind
+    qsort(pb.recs, pb.count, sizeof(student_t), cmp_id);
+    size_t n = 0;
+    for (size_t i = 0; i < pb.count; i++)
+        if (n == 0 || pb.recs[n - 1].id != pb.recs[i].id)
+            pb.recs[n++] = pb.recs[i];
+    pb.count = n;
+
+    pos = malloc((pb.count ? pb.count : 1) * sizeof(uint32_t));
+    index = malloc((pb.count ? pb.count : 1) * sizeof(int64_t));
+    if (pos == NULL || index == NULL || build_dict(&pb, pos, &dict, &dict_len, hdr) != NO_ERROR)
+    {
+        rc = ERR_DB_FILE;
+        goto out;
+    }
+
+    dbpack_page_t *ph = (dbpack_page_t *)page;
+    uint16_t *dir = (uint16_t *)(page + sizeof(dbpack_page_t));
+    unsigned char rec[MAX_REC];
+
+    for (size_t i = 0; i < pb.count && rc == NO_ERROR; i++)
+    {
+        size_t len = encode(rec, &pb.recs[i], ph->count ? ph->first_id : pb.recs[i].id, pos[i]);
+
+        if (ph->count > 0 &&
+            sizeof(dbpack_page_t) + (ph->count + 1) * sizeof(uint16_t) + len > ph->heap)
+        {
+            if ((rc = flush_page(out, page, nindex - 1)) != NO_ERROR)
+                break;
+            len = encode(rec, &pb.recs[i], pb.recs[i].id, pos[i]);
+        }
+        if (ph->count == 0)
+        {
+            ph->first_id = pb.recs[i].id;
+            ph->heap = DBPACK_PAGE;
+            index[nindex++] = ph->first_id;
+        }
+        ph->heap -= len;
+        memcpy(page + ph->heap, rec, len);
+        dir[ph->count++] = ph->heap;
+    }
+    if (rc == NO_ERROR && ph->count > 0)
+        rc = flush_page(out, page, nindex - 1);
+
+    // the dictionary and the index behind the pages, the header last
+    memcpy(hdr->magic, DBPACK_MAGIC, sizeof(hdr->magic));
+    hdr->version = DBPACK_VERSION;
+    hdr->page_size = DBPACK_PAGE;
+    hdr->records = pb.count;
+    hdr->pages = nindex;
+    hdr->dict_offset = (uint64_t)(nindex + 1) * DBPACK_PAGE;
+    hdr->dict_len = dict_len;
+    hdr->index_offset = (hdr->dict_offset + dict_len + 7) / 8 * 8;
+
+    size_t index_len = nindex * sizeof(int64_t);
+    if (rc == NO_ERROR &&
+        (pwrite(out, dict, dict_len, hdr->dict_offset) != (ssize_t)dict_len ||
+         pwrite(out, index, index_len, hdr->index_offset) != (ssize_t)index_len ||
+         pwrite(out, hdr, sizeof(*hdr), 0) != sizeof(*hdr)))
+        rc = ERR_DB_FILE;
+
+out:
+    free(pb.recs);
+    free(pos);
+    free(index);
+    free(dict);
+    return rc < 0 ? rc : NO_ERROR;
+}
+
+/*
+ *  dbpack_open
+ *      *path:  the packed file
+ *
+ *  Reads the header, the dictionary and the page index into memory.
+ *
+ *  returns:  the open packed file, NULL if it can not be read or is not a
+ *            packed file of this version
+ */
+dbpack_t *dbpack_open(const char *path)
+{
+    dbpack_t *p = calloc(1, sizeof(dbpack_t));
+    unsigned char *dict = NULL;
+
+    if (p == NULL)
+        return NULL;
+    p->cached = -1;
+    p->fd = open(path, O_RDONLY);
+    if (p->fd == -1 || pread(p->fd, &p->hdr, sizeof(p->hdr), 0) != sizeof(p->hdr) ||
+        memcmp(p->hdr.magic, DBPACK_MAGIC, sizeof(p->hdr.magic)) != 0 ||
+        p->hdr.version != DBPACK_VERSION || p->hdr.page_size != DBPACK_PAGE)
+        goto fail;
+
+    size_t index_len = (size_t)p->hdr.pages * sizeof(int64_t);
+    p->dict = calloc(p->hdr.dict_entries ? p->hdr.dict_entries : 1, DBPACK_LNAME);
+    p->index = malloc(index_len ? index_len : 1);
+    p->page = malloc(DBPACK_PAGE);
+    dict = malloc(p->hdr.dict_len ? p->hdr.dict_len : 1);
+    if (p->dict == NULL || p->index == NULL || p->page == NULL || dict == NULL ||
+        pread(p->fd, dict, p->hdr.dict_len, p->hdr.dict_offset) != (ssize_t)p->hdr.dict_len ||
+        pread(p->fd, p->index, index_len, p->hdr.index_offset) != (ssize_t)index_len)
+        goto fail;
+
+    size_t at = 0;
+    for (uint32_t i = 0; i < p->hdr.dict_entries; i++)
+    {
+        if (at >= p->hdr.dict_len || dict[at] > DBPACK_LNAME || at + 1 + dict[at] > p->hdr.dict_len)
+            goto fail;
+        memcpy(p->dict[i], dict + at + 1, dict[at]);
+        at += 1 + dict[at];
+    }
+    free(dict);
+    return p;
+
+fail:
+    free(dict);
+    dbpack_close(p);
+    return NULL;
+}
+
+void dbpack_close(dbpack_t *p)
+{
+    if (p == NULL)
+        return;
+    if (p->fd != -1)
+        close(p->fd);
+    free(p->dict);
+    free(p->index);
+    free(p->page);
+    free(p);
+}
+
+static int load_page(dbpack_t *p, uint32_t pno)
+{
+    if (p->cached == pno)
+        return NO_ERROR;
+    p->cached = -1;
+    if (pread(p->fd, p->page, DBPACK_PAGE, (off_t)(pno + 1) * DBPACK_PAGE) != DBPACK_PAGE)
+        return ERR_DB_FILE;
+
+    const dbpack_page_t *ph = (const dbpack_page_t *)p->page;
+    if (ph->count == 0 || sizeof(dbpack_page_t) + ph->count * sizeof(uint16_t) > ph->heap ||
+        ph->heap > DBPACK_PAGE)
+        return ERR_DB_FILE;
+    p->cached = pno;
+    return NO_ERROR;
+}
+
+// id of record i of the loaded page, -1 if the page is damaged
+static long long record_id(const dbpack_t *p, int i)
+{
+    const dbpack_page_t *ph = (const dbpack_page_t *)p->page;
+    const uint16_t *dir = (const uint16_t *)(p->page + sizeof(dbpack_page_t));
+    const unsigned char *at = p->page + dir[i];
+    uint64_t delta;
+
+    if (dir[i] < ph->heap || dir[i] >= DBPACK_PAGE ||
+        !get_varint(&at, p->page + DBPACK_PAGE, &delta))
+        return -1;
+    return ph->first_id + (long long)delta;
+}
+
+// decodes record i of the loaded page into *s
+static int decode(const dbpack_t *p, int i, student_t *s)
+{
+    const dbpack_page_t *ph = (const dbpack_page_t *)p->page;
+    const uint16_t *dir = (const uint16_t *)(p->page + sizeof(dbpack_page_t));
+    const unsigned char *at = p->page + dir[i], *end = p->page + DBPACK_PAGE;
+    uint64_t delta, gpa, lname;
+
+    if (dir[i] < ph->heap || dir[i] >= DBPACK_PAGE || !get_varint(&at, end, &delta) ||
+        !get_varint(&at, end, &gpa) || !get_varint(&at, end, &lname) ||
+        lname >= p->hdr.dict_entries || at >= end || *at > FNAME_SIZE || at + 1 + *at > end)
+        return ERR_DB_FILE;
+
+    *s = EMPTY_STUDENT_RECORD;
+    s->id = ph->first_id + (long long)delta;
+    s->gpa = (short)gpa;
+    memcpy(s->lname, p->dict[lname], DBPACK_LNAME);
+    memcpy(s->fname, at + 1, *at);
+    return NO_ERROR;
+}
+
+/*
+ *  dbpack_get
+ *      *p:  open packed file
+ *      id:  student id
+ *      *s:  receives the student
+ *
+ *  One pread() of a data page at most, none if the page is the one read
+ *  last.
+ *
+ *  returns:  NO_ERROR       student located and copied into *s
+ *            ERR_DB_FILE    the file can not be read or is damaged
+ *            SRCH_NOT_FOUND student is not in the packed file
+ */
+int dbpack_get(dbpack_t *p, long long id, student_t *s)
+{
+    // the last page that starts at or below id
+    int lo = 0, hi = (int)p->hdr.pages - 1;
+
+    if (hi < 0 || id < p->index[0])
+        return SRCH_NOT_FOUND;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (p->index[mid] <= id)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    if (load_page(p, lo) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    const dbpack_page_t *ph = (const dbpack_page_t *)p->page;
+    lo = 0;
+    hi = ph->count - 1;
+    while (lo <= hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        long long at = record_id(p, mid);
+
+        if (at < 0)
+            return ERR_DB_FILE;
+        if (at == id)
+            return decode(p, mid, s);
+        if (at < id)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return SRCH_NOT_FOUND;
+}
+
+/*
+ *  dbpack_scan
+ *      *p:    open packed file
+ *      fn:    called for every student, in id order
+ *      *arg:  handed to fn
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE, or the first non-zero value of fn
+ */
+int dbpack_scan(dbpack_t *p, dbio_scan_fn fn, void *arg)
+{
+    student_t s;
+
+    for (uint32_t pno = 0; pno < p->hdr.pages; pno++)
+    {
+        if (load_page(p, pno) != NO_ERROR)
+            return ERR_DB_FILE;
+
+        int count = ((const dbpack_page_t *)p->page)->count;
+        for (int i = 0; i < count; i++)
+        {
+            int rc = decode(p, i, &s);
+            if (rc == NO_ERROR)
+                rc = fn(&s, arg);
+            if (rc != 0)
+                return rc;
+        }
+    }
+    return NO_ERROR;
+}
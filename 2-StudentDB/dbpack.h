@@ -0,0 +1,76 @@
+#ifndef __DBPACK_H__
+#define __DBPACK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "db.h" //get student record type
+#include "dbio.h"
+
+// Compact copy of a database ("packed" file), written by -pack and turned
+// back into students with -unpack.  It can be read in place with -packed,
+// which needs a fraction of the memory and page cache the 64 byte records
+// of the live file take.  The live database keeps its fixed format.
+//
+// The file is made of DBPACK_PAGE sized pages:
+//  - page 0 is the dbpack_hdr_t
+//  - then hdr.pages data pages with the students in id order
+//  - then the last name dictionary at hdr.dict_offset, every distinct last
+//    name as a length byte and its characters, most used first
+//  - then the page index at hdr.index_offset, the first id of every data
+//    page as an int64_t
+//
+// A data page is a slotted page: a dbpack_page_t header, then a directory
+// of count uint16_t record offsets in id order, the records themselves are
+// packed from the end of the page down.  A record is
+//    varint   id - page first id
+//    varint   gpa
+//    varint   position of lname in the dictionary
+//    uint8_t  length of fname, then its characters
+// so a student with short names takes about 16 bytes instead of 64.  A
+// lookup binary searches the page index, which readers keep in memory
+// with the dictionary, and then the slot directory of a single page.
+#define DBPACK_MAGIC "SDBPACK"
+#define DBPACK_VERSION 1
+#define DBPACK_PAGE 4096
+#define DBPACK_LNAME sizeof(((student_t *)0)->lname)
+
+typedef struct dbpack_hdr
+{
+    char magic[8];          // DBPACK_MAGIC
+    uint32_t version;       // DBPACK_VERSION
+    uint32_t page_size;     // DBPACK_PAGE
+    uint64_t records;       // students in the file
+    uint32_t pages;         // data pages, they start at page 1
+    uint32_t dict_entries;  // distinct last names
+    uint64_t dict_offset;   // file offset of the dictionary
+    uint64_t dict_len;      // its length in bytes
+    uint64_t index_offset;  // file offset of the page index
+} dbpack_hdr_t;
+
+typedef struct dbpack_page
+{
+    uint16_t count;     // records on the page
+    uint16_t heap;      // offset of the lowest record
+    uint32_t reserved;
+    int64_t first_id;   // id of the first record
+} dbpack_page_t;
+
+// a packed file opened for reading
+typedef struct dbpack
+{
+    int fd;
+    dbpack_hdr_t hdr;
+    char (*dict)[DBPACK_LNAME]; // the last names, zero padded as in student_t
+    int64_t *index;     // first id of every data page
+    unsigned char *page;// the page read last
+    int64_t cached;     // which one, -1 for none
+} dbpack_t;
+
+int dbpack_write(int fd, int out, dbpack_hdr_t *hdr);
+dbpack_t *dbpack_open(const char *path);
+void dbpack_close(dbpack_t *p);
+int dbpack_get(dbpack_t *p, long long id, student_t *s);
+int dbpack_scan(dbpack_t *p, dbio_scan_fn fn, void *arg);
+
+#endif
@@ -0,0 +1,478 @@
+#define _GNU_SOURCE // qsort_r()
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbio.h"
+#include "dbpool.h"
+
+// Largest iovec array handed to pwritev()
+#define DBPOOL_MAX_IOV 1024
+
+// pages that hold fixed slots, the pool never needs more frames
+#define DBPOOL_MAX_PAGES ((MAX_STD_ID + DBPOOL_RECS) / DBPOOL_RECS)
+
+typedef struct frame
+{
+    int32_t page;   // id / DBPOOL_RECS of the records held, -1 when free
+    int32_t next;   // next frame in the same hash bucket, -1 at the end
+    uint64_t valid; // bit i: record i holds the file contents (or newer)
+    uint64_t dirty; // bit i: record i was written and not written back
+    bool ref;       // CLOCK reference bit
+} frame_t;
+
+typedef struct pool
+{
+    db_header_t *hdr;  // shared file header, for write_gen
+    uint32_t gen;      // write_gen the valid records are current for
+    int nframes;
+    int hand;          // CLOCK hand
+    int ndirty;        // frames with dirty records
+    uint32_t mask;     // hash buckets - 1
+    int32_t *buckets;  // first frame of every hash bucket, -1 for none
+    frame_t *frames;
+    student_t *data;   // DBPOOL_RECS records per frame, page aligned
+    student_t *tmp;    // one page of scratch space for misses
+    dbpool_stats_t st;
+} pool_t;
+
+// pool of each database fd, NULL when none
+static pool_t *dbpool_table[DBIO_MAX_FD];
+
+static pool_t *pool_of(int fd)
+{
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return NULL;
+    return dbpool_table[fd];
+}
+
+static student_t *frame_data(pool_t *p, int f)
+{
+    return p->data + (size_t)f * DBPOOL_RECS;
+}
+
+static uint32_t bucket_of(pool_t *p, int32_t page)
+{
+    return ((uint32_t)page * 2654435761u) & p->mask;
+}
+
+static int lookup(pool_t *p, int32_t page)
+{
+    for (int f = p->buckets[bucket_of(p, page)]; f != -1; f = p->frames[f].next)
+        if (p->frames[f].page == page)
+            return f;
+    return -1;
+}
+
+static void unlink_frame(pool_t *p, int f)
+{
+    int32_t *link = &p->buckets[bucket_of(p, p->frames[f].page)];
+
+    while (*link != f)
+        link = &p->frames[*link].next;
+    *link = p->frames[f].next;
+}
+
+// forgets every record that is not dirty, they are read again on their next use
+static void invalidate(pool_t *p)
+{
+    for (int f = 0; f < p->nframes; f++)
+        p->frames[f].valid &= p->frames[f].dirty;
+    p->st.invalidations++;
+}
+
+// notices writes of other processes since the pool last looked
+static void check_gen(pool_t *p)
+{
+    uint32_t gen = __atomic_load_n(&p->hdr->write_gen, __ATOMIC_ACQUIRE);
+
+    if (gen != p->gen)
+    {
+        invalidate(p);
+        p->gen = gen;
+    }
+}
+
+static int cmp_frame_page(const void *a, const void *b, void *arg)
+{
+    const frame_t *frames = arg;
+    int32_t x = frames[*(const int *)a].page, y = frames[*(const int *)b].page;
+    return (x > y) - (x < y);
+}
+
+// writes out the iovec array collected by write_back()
+static int submit(pool_t *p, int fd, struct iovec *iov, int *niov, off_t at, off_t end)
+{
+    if (*niov == 0)
+        return NO_ERROR;
+
+    ssize_t done = pwritev(fd, iov, *niov, at);
+    p->st.writes++;
+    *niov = 0;
+    return done == end - at ? NO_ERROR : ERR_DB_FILE;
+}
+
+/*
+ *  write_back
+ *      p:      pool
+ *      fd:     database file descriptor
+ *      list:   dirty frames, sorted by page
+ *      n:      number of frames
+ *
+ *  Writes the dirty records of the frames.  Runs of adjacent dirty records
+ *  are collected into one iovec array, also across frames of adjacent
+ *  pages, and every such run goes out with a single pwritev().
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int write_back(pool_t *p, int fd, const int *list, int n)
+{
+    struct iovec iov[DBPOOL_MAX_IOV];
+    int niov = 0;
+    off_t at = 0, end = 0; // file range covered by iov
+    int rc = NO_ERROR;
+
+    for (int k = 0; k < n && rc == NO_ERROR; k++)
+    {
+        uint64_t dirty = p->frames[list[k]].dirty;
+
+        while (dirty != 0 && rc == NO_ERROR)
+        {
+            // the next run of set bits
+            int first = __builtin_ctzll(dirty);
+            uint64_t rest = ~(dirty >> first);
+            int count = rest == 0 ? DBPOOL_RECS : __builtin_ctzll(rest);
+            dirty = first + count >= DBPOOL_RECS ? 0 : dirty & (~0ULL << (first + count));
+
+            off_t off = db_record_offset(p->frames[list[k]].page * DBPOOL_RECS + first);
+            if (niov > 0 && (off != end || niov == DBPOOL_MAX_IOV))
+                rc = submit(p, fd, iov, &niov, at, end);
+            if (niov == 0)
+                at = end = off;
+            iov[niov].iov_base = frame_data(p, list[k]) + first;
+            iov[niov].iov_len = (size_t)count * STUDENT_RECORD_SIZE;
+            end += iov[niov++].iov_len;
+        }
+    }
+    if (rc == NO_ERROR)
+        rc = submit(p, fd, iov, &niov, at, end);
+    if (rc != NO_ERROR)
+        return rc;
+
+    for (int k = 0; k < n; k++)
+        p->frames[list[k]].dirty = 0;
+    p->st.pages_written += n;
+    p->ndirty -= n;
+
+    // our own write, anything else that happened meanwhile was somebody else's
+    uint32_t gen = __atomic_add_fetch(&p->hdr->write_gen, 1, __ATOMIC_RELEASE);
+    if (gen != p->gen + 1)
+        invalidate(p);
+    p->gen = gen;
+    return NO_ERROR;
+}
+
+// picks a frame for page with the CLOCK algorithm, writing back a dirty
+// victim first.  Returns the frame or -1
+static int take_frame(pool_t *p, int fd, int32_t page)
+{
+    int f;
+
+    for (;;)
+    {
+        f = p->hand;
+        p->hand = (p->hand + 1) % p->nframes;
+        if (!p->frames[f].ref)
+            break;
+        p->frames[f].ref = false;
+    }
+
+    if (p->frames[f].page != -1)
+    {
+        if (p->frames[f].dirty != 0 && write_back(p, fd, &f, 1) != NO_ERROR)
+            return -1;
+        unlink_frame(p, f);
+        p->st.evictions++;
+    }
+
+    uint32_t b = bucket_of(p, page);
+    p->frames[f].page = page;
+    p->frames[f].valid = 0;
+    p->frames[f].dirty = 0;
+    p->frames[f].next = p->buckets[b];
+    p->buckets[b] = f;
+    return f;
+}
+
+static int get_frame(pool_t *p, int fd, int32_t page)
+{
+    int f = lookup(p, page);
+
+    if (f == -1)
+        f = take_frame(p, fd, page);
+    if (f != -1)
+        p->frames[f].ref = true;
+    return f;
+}
+
+// reads the page of frame f and fills in every record that is not valid
+static int fetch(pool_t *p, int fd, int f)
+{
+    frame_t *fr = &p->frames[f];
+    student_t *recs = frame_data(p, f);
+    ssize_t got;
+
+    do
+        got = pread(fd, p->tmp, DB_PAGE_SIZE, db_record_offset(fr->page * DBPOOL_RECS));
+    while (got == -1 && errno == EINTR);
+    if (got == -1)
+        return ERR_DB_FILE;
+
+    // past the end of the file the slots read as empty
+    memset((char *)p->tmp + got, 0, DB_PAGE_SIZE - got);
+    for (int i = 0; i < DBPOOL_RECS; i++)
+        if (!(fr->valid >> i & 1))
+            recs[i] = p->tmp[i];
+    fr->valid = ~0ULL;
+    return NO_ERROR;
+}
+
+/*
+ *  dbpool_budget
+ *
+ *  returns:  bytes of memory the pool may use, from DBPOOL_ENV (in KiB) or
+ *            DBPOOL_DEFAULT_KB, 0 when the pool is turned off
+ */
+size_t dbpool_budget(void)
+{
+    char *env = getenv(DBPOOL_ENV);
+    long kb = env != NULL ? atol(env) : DBPOOL_DEFAULT_KB;
+
+    return kb > 0 ? (size_t)kb * 1024 : 0;
+}
+
+/*
+ *  dbpool_open
+ *      fd:      database file descriptor, attached with the fd backend
+ *      *hdr:    shared mapping of the file header
+ *      budget:  bytes the frames may take, see dbpool_budget()
+ *
+ *  Sets up a pool of budget / DB_PAGE_SIZE frames (no more than there are
+ *  pages of fixed slots) for fd.
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE when the budget is below one page or
+ *            out of memory
+ */
+int dbpool_open(int fd, db_header_t *hdr, size_t budget)
+{
+    size_t pages = budget / DB_PAGE_SIZE;
+    int nframes = pages < (size_t)DBPOOL_MAX_PAGES ? (int)pages : DBPOOL_MAX_PAGES;
+    uint32_t nbuckets = 1;
+
+    if (fd < 0 || fd >= DBIO_MAX_FD || hdr == NULL || nframes < 1)
+        return ERR_DB_FILE;
+    while (nbuckets < (uint32_t)nframes * 2)
+        nbuckets <<= 1;
+
+    pool_t *p = calloc(1, sizeof(pool_t));
+    if (p == NULL)
+        return ERR_DB_FILE;
+    p->hdr = hdr;
+    p->gen = __atomic_load_n(&hdr->write_gen, __ATOMIC_ACQUIRE);
+    p->nframes = nframes;
+    p->mask = nbuckets - 1;
+    p->buckets = malloc(nbuckets * sizeof(int32_t));
+    p->frames = malloc(nframes * sizeof(frame_t));
+    p->data = aligned_alloc(DB_PAGE_SIZE, (size_t)nframes * DB_PAGE_SIZE);
+    p->tmp = aligned_alloc(DB_PAGE_SIZE, DB_PAGE_SIZE);
+    if (p->buckets == NULL || p->frames == NULL || p->data == NULL || p->tmp == NULL)
+    {
+        free(p->buckets);
+        free(p->frames);
+        free(p->data);
+        free(p->tmp);
+        free(p);
+        return ERR_DB_FILE;
+    }
+
+    memset(p->buckets, 0xff, nbuckets * sizeof(int32_t));
+    for (int f = 0; f < nframes; f++)
+    {
+        p->frames[f].page = -1;
+        p->frames[f].next = -1;
+        p->frames[f].valid = p->frames[f].dirty = 0;
+        p->frames[f].ref = false;
+    }
+
+    dbpool_close(fd);
+    dbpool_table[fd] = p;
+    return NO_ERROR;
+}
+
+/*
+ *  dbpool_close
+ *      fd:  database file descriptor
+ *
+ *  Writes back whatever is still dirty and releases the pool of fd.
+ */
+void dbpool_close(int fd)
+{
+    pool_t *p = pool_of(fd);
+
+    if (p == NULL)
+        return;
+    dbpool_flush_all(fd);
+    free(p->buckets);
+    free(p->frames);
+    free(p->data);
+    free(p->tmp);
+    free(p);
+    dbpool_table[fd] = NULL;
+}
+
+bool dbpool_active(int fd)
+{
+    return pool_of(fd) != NULL;
+}
+
+/*
+ *  dbpool_read
+ *      fd:  database file descriptor with a pool
+ *      id:  slot to read, at most MAX_STD_ID
+ *      *s:  receives the slot, EMPTY_STUDENT_RECORD past the end of the file
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbpool_read(int fd, int id, student_t *s)
+{
+    pool_t *p = pool_of(fd);
+
+    if (p == NULL || id < 0 || id > MAX_STD_ID)
+        return ERR_DB_FILE;
+    check_gen(p);
+
+    int f = get_frame(p, fd, id / DBPOOL_RECS);
+    if (f == -1)
+        return ERR_DB_FILE;
+    if (p->frames[f].valid >> (id % DBPOOL_RECS) & 1)
+        p->st.hits++;
+    else
+    {
+        p->st.misses++;
+        if (fetch(p, fd, f) != NO_ERROR)
+            return ERR_DB_FILE;
+    }
+    *s = frame_data(p, f)[id % DBPOOL_RECS];
+    return NO_ERROR;
+}
+
+/*
+ *  dbpool_write
+ *      fd:  database file descriptor with a pool
+ *      id:  slot to write, at most MAX_STD_ID, the caller holds its lock
+ *      *s:  new contents of the slot
+ *
+ *  The record only goes to the file at the latest when its lock is
+ *  released, see dbpool_flush().
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbpool_write(int fd, int id, const student_t *s)
+{
+    pool_t *p = pool_of(fd);
+
+    if (p == NULL || id < 0 || id > MAX_STD_ID)
+        return ERR_DB_FILE;
+    check_gen(p);
+
+    int f = get_frame(p, fd, id / DBPOOL_RECS);
+    if (f == -1)
+        return ERR_DB_FILE;
+
+    frame_t *fr = &p->frames[f];
+    uint64_t bit = 1ULL << (id % DBPOOL_RECS);
+    frame_data(p, f)[id % DBPOOL_RECS] = *s;
+    fr->valid |= bit;
+    if (fr->dirty == 0)
+        p->ndirty++;
+    fr->dirty |= bit;
+    return NO_ERROR;
+}
+
+/*
+ *  dbpool_flush
+ *      fd:        database file descriptor
+ *      first_id:  first slot
+ *      count:     number of adjacent slots
+ *
+ *  Writes back the dirty records of the pages that hold the slots, a fd
+ *  without a pool or without dirty records costs nothing.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int dbpool_flush(int fd, int first_id, int count)
+{
+    pool_t *p = pool_of(fd);
+
+    if (p == NULL || p->ndirty == 0 || count <= 0 || first_id > MAX_STD_ID)
+        return NO_ERROR;
+
+    int32_t first = first_id / DBPOOL_RECS;
+    int32_t last = (first_id + count - 1) / DBPOOL_RECS;
+    int *list = malloc(sizeof(int) * p->ndirty);
+    int n = 0;
+
+    if (list == NULL)
+        return ERR_DB_FILE;
+
+    // few pages are looked up one by one, a long span walks the frames
+    if (last - first < p->nframes)
+    {
+        for (int32_t page = first; page <= last && n < p->ndirty; page++)
+        {
+            int f = lookup(p, page);
+            if (f != -1 && p->frames[f].dirty != 0)
+                list[n++] = f;
+        }
+    }
+    else
+    {
+        for (int f = 0; f < p->nframes; f++)
+            if (p->frames[f].dirty != 0 && p->frames[f].page >= first && p->frames[f].page <= last)
+                list[n++] = f;
+        qsort_r(list, n, sizeof(int), cmp_frame_page, p->frames);
+    }
+
+    int rc = n > 0 ? write_back(p, fd, list, n) : NO_ERROR;
+    free(list);
+    return rc;
+}
+
+int dbpool_flush_all(int fd)
+{
+    return dbpool_flush(fd, 0, MAX_STD_ID + 1);
+}
+
+/*
+ *  dbpool_stats
+ *      fd:   database file descriptor
+ *      *st:  receives the counters of the pool
+ *
+ *  returns:  true if fd has a pool
+ */
+bool dbpool_stats(int fd, dbpool_stats_t *st)
+{
+    pool_t *p = pool_of(fd);
+
+    if (p == NULL)
+        return false;
+    *st = p->st;
+    return true;
+}
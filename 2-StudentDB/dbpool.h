@@ -0,0 +1,62 @@
+#ifndef __DBPOOL_H__
+#define __DBPOOL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "db.h" //get student record type
+#include "dbio.h"
+
+// In process buffer pool for the fixed slots (ids up to MAX_STD_ID) of the
+// fd backend, used by the long running modes (bulk loads and the daemon,
+// see dbio_attach_pool()).  The mmap backend does not need one, the
+// mapping already is the cache.
+//
+// The pool holds DB_PAGE_SIZE pages of DBPOOL_RECS records.  Every frame
+// knows which of its records hold the file contents (valid) and which were
+// written but not yet written back (dirty), so a write never has to read
+// the page first.  A record that is not valid is a miss and reads its
+// whole page with one pread(), a valid one is a hit and costs no system
+// call at all.  Frames are recycled with the CLOCK algorithm, a dirty
+// victim is written back first.
+//
+// Write-back is coalesced: dirty records are sorted by offset and runs of
+// adjacent records, across pages, go out with one pwritev().  Records are
+// only ever dirty while the process holds their record lock, they are
+// written back by dbio_unlock_records() before the lock is dropped, so
+// other processes never see an older record than with plain pwrite().
+//
+// Other processes may write the file directly.  Every write of a fixed
+// slot bumps write_gen in the shared file header (see dbhdr.h); when the
+// pool sees a generation it did not produce, it forgets every clean record
+// it holds and reads them again on their next use.
+//
+// The memory budget comes from DBPOOL_ENV, 0 turns the pool off:
+//   SDB_POOL_KB=2048 ./sdbsc -b load.txt
+#define DBPOOL_ENV "SDB_POOL_KB"
+#define DBPOOL_DEFAULT_KB 8192
+#define DBPOOL_RECS (DB_PAGE_SIZE / STUDENT_RECORD_SIZE)
+
+// counters since the pool was opened
+typedef struct dbpool_stats
+{
+    uint64_t hits;          // record reads served from a frame
+    uint64_t misses;        // record reads that had to read their page
+    uint64_t evictions;     // frames recycled for another page
+    uint64_t invalidations; // times writes of other processes were noticed
+    uint64_t pages_written; // dirty frames written back
+    uint64_t writes;        // pwritev() calls doing that
+} dbpool_stats_t;
+
+size_t dbpool_budget(void);
+int dbpool_open(int fd, db_header_t *hdr, size_t budget);
+void dbpool_close(int fd);
+bool dbpool_active(int fd);
+int dbpool_read(int fd, int id, student_t *s);
+int dbpool_write(int fd, int id, const student_t *s);
+int dbpool_flush(int fd, int first_id, int count);
+int dbpool_flush_all(int fd);
+bool dbpool_stats(int fd, dbpool_stats_t *st);
+
+#endif
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbio.h"
+#include "dbscan.h"
+#include "dbpscan.h"
+
+// State shared by the workers and the merging thread of one dbpscan_run().
+// Range r is scanned into part slot r % nslots, done[] holds the number of
+// the range a slot was last filled with.
+typedef struct pscan
+{
+    int fd;
+    const dbpscan_job_t *job;
+    off_t end;
+    int nranges;
+    int nslots;
+    char *parts;  // nslots parts of job->part_size bytes
+    int *done;    // per slot, range scanned into it, -1 for none yet
+    int *rcs;     // per slot, dbio_scan_range() result of that range
+    int next;     // next range to hand out
+    int merged;   // ranges merged so far
+    bool stop;    // merging failed, hand out no more ranges
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} pscan_t;
+
+static void *part_of(pscan_t *p, int range)
+{
+    return p->parts + (size_t)(range % p->nslots) * p->job->part_size;
+}
+
+static off_t range_start(int range)
+{
+    return DB_HEADER_SIZE + (off_t)range * DBPSCAN_RANGE;
+}
+
+static off_t range_end(pscan_t *p, int range)
+{
+    off_t end = range_start(range) + DBPSCAN_RANGE;
+    return end < p->end ? end : p->end;
+}
+
+static int scan_one(pscan_t *p, int range)
+{
+    void *part = part_of(p, range);
+
+    p->job->reset(part, p->job->arg);
+    return dbio_scan_range(p->fd, range_start(range), range_end(p, range), p->job->row, part);
+}
+
+// takes ranges in file order as long as their part slot is free
+static void *worker(void *arg)
+{
+    pscan_t *p = arg;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;)
+    {
+        while (!p->stop && p->next < p->nranges && p->next - p->merged >= p->nslots)
+            pthread_cond_wait(&p->cond, &p->lock);
+        if (p->stop || p->next >= p->nranges)
+            break;
+
+        int range = p->next++;
+        pthread_mutex_unlock(&p->lock);
+        int rc = scan_one(p, range);
+        pthread_mutex_lock(&p->lock);
+
+        p->rcs[range % p->nslots] = rc;
+        p->done[range % p->nslots] = range;
+        pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+// merges the ranges in file order as the workers finish them
+static int merge_all(pscan_t *p)
+{
+    int rc = NO_ERROR;
+
+    for (int range = 0; range < p->nranges && rc == NO_ERROR; range++)
+    {
+        int slot = range % p->nslots;
+
+        pthread_mutex_lock(&p->lock);
+        while (p->done[slot] != range)
+            pthread_cond_wait(&p->cond, &p->lock);
+        rc = p->rcs[slot];
+        pthread_mutex_unlock(&p->lock);
+
+        if (rc == NO_ERROR)
+            rc = p->job->merge(part_of(p, range), p->job->arg);
+
+        pthread_mutex_lock(&p->lock);
+        p->merged++;
+        if (rc != NO_ERROR)
+            p->stop = true;
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+    }
+    return rc;
+}
+
+/*
+ *  dbpscan_threads
+ *
+ *  returns:  number of scan workers, DBPSCAN_THREADS_ENV if it is set to a
+ *            number, else the number of online CPUs, always between 1 and
+ *            DBPSCAN_MAX_THREADS
+ */
+int dbpscan_threads(void)
+{
+    char *env = getenv(DBPSCAN_THREADS_ENV);
+    long n = env != NULL ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n < 1)
+        n = 1;
+    if (n > DBPSCAN_MAX_THREADS)
+        n = DBPSCAN_MAX_THREADS;
+    return n;
+}
+
+/*
+ *  dbpscan_run
+ *      fd:    linux file descriptor
+ *      *job:  the full table operation, see dbpscan.h
+ *
+ *  Scans the whole database with dbpscan_threads() workers.  job->row sees
+ *  the same records dbio_scan() would hand it, job->merge gets the ranges
+ *  in file order.  With a single worker, or a file of a single range, no
+ *  thread is started.
+ *
+ *  returns:  NO_ERROR       the whole file was scanned and merged
+ *            ERR_DB_FILE    database file I/O issue, or out of memory
+ *            <other>        the first non-zero value of job->row or
+ *                           job->merge, in file order
+ */
+int dbpscan_run(int fd, const dbpscan_job_t *job)
+{
+    pscan_t p = {.fd = fd, .job = job};
+    pthread_t tids[DBPSCAN_MAX_THREADS];
+    int nthreads = dbpscan_threads();
+    int started = 0;
+    int rc = NO_ERROR;
+
+    p.end = dbio_scan_end(fd);
+    if (p.end < 0)
+        return ERR_DB_FILE;
+    p.nranges = (p.end - DB_HEADER_SIZE + DBPSCAN_RANGE - 1) / DBPSCAN_RANGE;
+    if (nthreads > p.nranges)
+        nthreads = p.nranges;
+    p.nslots = nthreads > 1 ? nthreads * DBPSCAN_WINDOW : 1;
+
+    p.parts = calloc(p.nslots, job->part_size);
+    p.done = malloc(p.nslots * sizeof(int));
+    p.rcs = malloc(p.nslots * sizeof(int));
+    if (p.parts == NULL || p.done == NULL || p.rcs == NULL)
+    {
+        rc = ERR_DB_FILE;
+        goto out;
+    }
+    for (int i = 0; i < p.nslots; i++)
+        p.done[i] = -1;
+
+    // one worker: scan and merge range by range on this thread
+    if (nthreads <= 1)
+    {
+        for (int range = 0; range < p.nranges && rc == NO_ERROR; range++)
+        {
+            rc = scan_one(&p, range);
+            if (rc == NO_ERROR)
+                rc = job->merge(part_of(&p, range), job->arg);
+        }
+        goto out;
+    }
+
+    // settle the scan kernel before the workers race to pick it
+    dbscan_kernel_name();
+
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.cond, NULL);
+    for (; started < nthreads; started++)
+        if (pthread_create(&tids[started], NULL, worker, &p) != 0)
+            break;
+
+    if (started == 0)
+        rc = ERR_DB_FILE;
+    else
+        rc = merge_all(&p);
+
+    pthread_mutex_lock(&p.lock);
+    p.stop = true;
+    pthread_cond_broadcast(&p.cond);
+    pthread_mutex_unlock(&p.lock);
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+    pthread_cond_destroy(&p.cond);
+    pthread_mutex_destroy(&p.lock);
+
+out:
+    if (p.parts != NULL && job->release != NULL)
+        for (int i = 0; i < p.nslots; i++)
+            job->release(p.parts + (size_t)i * job->part_size);
+    free(p.parts);
+    free(p.done);
+    free(p.rcs);
+    return rc;
+}
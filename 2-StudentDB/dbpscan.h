@@ -0,0 +1,43 @@
+#ifndef __DBPSCAN_H__
+#define __DBPSCAN_H__
+
+#include <stddef.h>
+
+#include "dbio.h"
+
+// Parallel scan driver for full table operations.
+//
+// The record area of the file is cut into DBPSCAN_RANGE sized ranges.  A
+// pool of worker threads takes the ranges in file order and scans each one
+// with dbio_scan_range() (pread() for the fd backend, the mapping for the
+// mmap backend), filtering and aggregating into a per range part of the
+// job.  The calling thread merges the parts strictly in range order, so
+// the result is the same as that of a single threaded dbio_scan(), record
+// for record.  At most DBPSCAN_WINDOW parts per worker are in flight, a
+// worker that gets that far ahead of the merge waits.
+//
+// The number of workers comes from DBPSCAN_THREADS_ENV, by default one per
+// online CPU.  With one worker the file is scanned on the calling thread.
+//   SDB_SCAN_THREADS=4 ./sdbsc -p
+#define DBPSCAN_THREADS_ENV "SDB_SCAN_THREADS"
+#define DBPSCAN_MAX_THREADS 64
+#define DBPSCAN_RANGE (512 * 1024)
+#define DBPSCAN_WINDOW 4
+
+// A full table operation.  row is called on a worker thread for every live
+// record of a range, with the part of that range as its arg.  merge is
+// called on the calling thread for every range, in file order.
+typedef struct dbpscan_job
+{
+    dbio_scan_fn row;                     // filter and aggregate one record
+    int (*merge)(void *part, void *arg);  // fold one range into the result
+    void (*reset)(void *part, void *arg); // make a part empty, before each range
+    void (*release)(void *part);          // free a part at the end, may be NULL
+    size_t part_size;                     // bytes of one part, zeroed once
+    void *arg;                            // handed to merge and reset
+} dbpscan_job_t;
+
+int dbpscan_threads(void);
+int dbpscan_run(int fd, const dbpscan_job_t *job);
+
+#endif
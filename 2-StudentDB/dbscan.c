@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DBSCAN_X86 1
+#endif
+
+// database include files
+#include "db.h"
+#include "dbscan.h"
+
+typedef size_t (*dbscan_fn)(const student_t *slots, size_t count, uint32_t *live);
+
+typedef struct dbscan_kernel
+{
+    const char *name;
+    dbscan_fn fn;
+} dbscan_kernel_t;
+
+/*
+ *  Every kernel below follows the same pattern: reduce the slot to one
+ *  "any bit set" flag, store the slot index unconditionally and advance
+ *  the output by the flag.  Empty and live slots cost the same, so there
+ *  is nothing for the branch predictor to get wrong on a half empty file.
+ */
+
+static size_t scan_scalar(const student_t *slots, size_t count, uint32_t *live)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t w[8];
+
+        memcpy(w, &slots[i], sizeof(w));
+        uint64_t any = (w[0] | w[1]) | (w[2] | w[3]) | (w[4] | w[5]) | (w[6] | w[7]);
+        live[n] = i;
+        n += any != 0;
+    }
+    return n;
+}
+
+#ifdef DBSCAN_X86
+__attribute__((target("sse2"))) static size_t scan_sse2(const student_t *slots, size_t count,
+                                                        uint32_t *live)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t n = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const __m128i *p = (const __m128i *)&slots[i];
+        __m128i v = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)),
+                                 _mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3)));
+        int empty = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) == 0xFFFF;
+        live[n] = i;
+        n += !empty;
+    }
+    return n;
+}
+
+__attribute__((target("avx2"))) static size_t scan_avx2(const student_t *slots, size_t count,
+                                                        uint32_t *live)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const __m256i *p = (const __m256i *)&slots[i];
+        __m256i v = _mm256_or_si256(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1));
+        live[n] = i;
+        n += !_mm256_testz_si256(v, v);
+    }
+    return n;
+}
+#endif
+
+// widest first, the scalar kernel is always last
+static const dbscan_kernel_t dbscan_kernels[] = {
+#ifdef DBSCAN_X86
+    {"avx2", scan_avx2},
+    {"sse2", scan_sse2},
+#endif
+    {"scalar", scan_scalar},
+};
+
+#define DBSCAN_NKERNELS (sizeof(dbscan_kernels) / sizeof(dbscan_kernels[0]))
+
+static bool kernel_supported(const dbscan_kernel_t *k)
+{
+#ifdef DBSCAN_X86
+    if (k->fn == scan_avx2)
+        return __builtin_cpu_supports("avx2");
+    if (k->fn == scan_sse2)
+        return __builtin_cpu_supports("sse2");
+#endif
+    return k->fn == scan_scalar;
+}
+
+/*
+ *  pick_kernel
+ *
+ *  Runtime CPU dispatch.  Starts at the kernel named in DBSCAN_KERNEL_ENV
+ *  (or the widest one) and takes the first one this CPU can run.
+ *
+ *  returns:  the kernel to use, never NULL
+ */
+static const dbscan_kernel_t *pick_kernel(void)
+{
+    static const dbscan_kernel_t *picked = NULL;
+    size_t first = 0;
+
+    if (picked != NULL)
+        return picked;
+
+    char *want = getenv(DBSCAN_KERNEL_ENV);
+    for (size_t i = 0; want != NULL && i < DBSCAN_NKERNELS; i++)
+        if (strcmp(dbscan_kernels[i].name, want) == 0)
+            first = i;
+
+    for (size_t i = first; i < DBSCAN_NKERNELS && picked == NULL; i++)
+        if (kernel_supported(&dbscan_kernels[i]))
+            picked = &dbscan_kernels[i];
+    return picked;
+}
+
+/*
+ *  dbscan_live
+ *      slots:  block of student slots, no alignment required
+ *      count:  number of slots in the block
+ *      live:   room for count indexes
+ *
+ *  Classifies every slot of the block as live or empty.
+ *
+ *  returns:  number of live slots, their indexes (relative to slots) are in
+ *            live[0..n-1] in ascending order
+ */
+size_t dbscan_live(const student_t *slots, size_t count, uint32_t *live)
+{
+    return pick_kernel()->fn(slots, count, live);
+}
+
+const char *dbscan_kernel_name(void)
+{
+    return pick_kernel()->name;
+}
@@ -0,0 +1,23 @@
+#ifndef __DBSCAN_H__
+#define __DBSCAN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "db.h" //get student record type
+
+// Block classification kernels used by dbio_scan().  A kernel looks at a
+// block of 64 byte slots and writes the indexes of the live (not all zero)
+// slots to a compact array, without a compare or a branch per byte.
+//
+// The widest kernel the CPU supports is picked on first use: AVX2 (one
+// slot per 256 bit OR/test pair), SSE2 (four 128 bit ORs per slot) or a
+// portable scalar kernel (eight 64 bit ORs per slot).  DBSCAN_KERNEL_ENV
+// can force a narrower kernel, for example to compare them in tests:
+//   SDB_SCAN_KERNEL=scalar ./sdbsc -p
+#define DBSCAN_KERNEL_ENV "SDB_SCAN_KERNEL"
+
+size_t dbscan_live(const student_t *slots, size_t count, uint32_t *live);
+const char *dbscan_kernel_name(void);
+
+#endif
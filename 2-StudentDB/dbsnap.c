@@ -0,0 +1,107 @@
+#define _GNU_SOURCE // copy_file_range()
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h> // FICLONE
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbio.h"
+#include "dbsnap.h"
+
+#define DBSNAP_CHUNK (1024 * 1024)
+
+// copies [off, end) with pread()/pwrite(), for when copy_file_range()
+// can not be used between the two files
+static int copy_plain(int src, int dst, off_t off, off_t end)
+{
+    char *buf = malloc(DBSNAP_CHUNK);
+    int rc = NO_ERROR;
+
+    if (buf == NULL)
+        return ERR_DB_FILE;
+    while (off < end && rc == NO_ERROR)
+    {
+        size_t want = end - off < DBSNAP_CHUNK ? (size_t)(end - off) : DBSNAP_CHUNK;
+        ssize_t got = pread(src, buf, want, off);
+        if (got == -1 && errno == EINTR)
+            continue;
+        if (got <= 0 || pwrite(dst, buf, got, off) != got)
+            rc = ERR_DB_FILE;
+        off += got;
+    }
+    free(buf);
+    return rc;
+}
+
+// copies the extent [off, end), in kernel where possible
+static int copy_extent(int src, int dst, off_t off, off_t end, bool *plain)
+{
+    while (off < end && !*plain)
+    {
+        off_t in = off, out = off;
+        ssize_t n = copy_file_range(src, &in, dst, &out, end - off, 0);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1 && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP ||
+                        errno == EINVAL))
+            *plain = true;
+        else if (n <= 0)
+            return ERR_DB_FILE;
+        else
+            off += n;
+    }
+    if (off < end)
+        return copy_plain(src, dst, off, end);
+    return NO_ERROR;
+}
+
+/*
+ *  dbsnap_copy
+ *      src:      file to copy, held still by the caller
+ *      dst:      empty file to copy to
+ *      *copied:  set to the bytes that were copied, 0 for a clone
+ *
+ *  Makes dst a copy of src, a reflink clone if the file system can do it,
+ *  else a copy of the allocated extents of src (see dbsnap.h).  dst is
+ *  synced before returning.
+ *
+ *  returns:  DBSNAP_CLONE   dst shares the extents of src
+ *            DBSNAP_COPY    the data of src was copied
+ *            ERR_DB_FILE    I/O error
+ */
+int dbsnap_copy(int src, int dst, off_t *copied)
+{
+    struct stat st;
+    off_t data, hole;
+    bool plain = false;
+    int more, rc = NO_ERROR;
+
+    *copied = 0;
+    if (ioctl(dst, FICLONE, src) == 0)
+        return fdatasync(dst) == -1 ? ERR_DB_FILE : DBSNAP_CLONE;
+
+    // not supported here (or across file systems), copy the extents
+    if (fstat(src, &st) == -1 || ftruncate(dst, st.st_size) == -1)
+        return ERR_DB_FILE;
+    for (hole = 0; rc == NO_ERROR; )
+    {
+        more = dbio_next_extent(src, hole, st.st_size, DB_PAGE_SIZE, &data, &hole);
+        if (more <= 0)
+        {
+            rc = more;
+            break;
+        }
+        rc = copy_extent(src, dst, data, hole, &plain);
+        *copied += hole - data;
+    }
+
+    if (rc == NO_ERROR && fdatasync(dst) == -1)
+        rc = ERR_DB_FILE;
+    return rc == NO_ERROR ? DBSNAP_COPY : rc;
+}
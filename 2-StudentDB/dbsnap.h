@@ -0,0 +1,29 @@
+#ifndef __DBSNAP_H__
+#define __DBSNAP_H__
+
+#include <sys/types.h>
+
+// Online snapshots of the database file (-snap dest).
+//
+// The copy is made while the writers are held off: dbio_freeze() waits for
+// the adds and deletes that are in flight and keeps new ones out,
+// dbmap_freeze() does the same for the id map.  Readers are never held up.
+// With those locks the file is a consistent point in time, every change is
+// either completely in it or not at all, so the snapshot is a database of
+// its own that needs neither the write-ahead log nor the indexes (they are
+// rebuilt when the snapshot is first opened).
+//
+// Where the file system can share extents (btrfs, XFS, ...) the file is
+// cloned with the FICLONE ioctl, which takes the same few milliseconds
+// whatever its size, and the writers barely notice.  Elsewhere only the
+// allocated extents are copied, found with SEEK_DATA/SEEK_HOLE (see
+// dbio_next_extent()) and moved with copy_file_range(), or pread() and
+// pwrite() where even that is not available.  The holes of the sparse file
+// stay holes in the copy, so the time and the space it takes follow the
+// live data and not the id range.
+#define DBSNAP_CLONE 1
+#define DBSNAP_COPY 2
+
+int dbsnap_copy(int src, int dst, off_t *copied);
+
+#endif
@@ -0,0 +1,205 @@
+#define _GNU_SOURCE // O_CLOEXEC
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/resource.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbstat.h"
+
+static const char *dbstat_names[DBSTAT_OPS] = {
+    "open_db", "get_student", "add_student", "del_student",
+    "print_db", "count_db_records", "compress_db", "update_student"};
+
+static bool dbstat_on = false;
+static int dbstat_io_fd = -1; // /proc/self/io, -1 without I/O accounting
+static dbstat_op_t dbstat_totals[DBSTAT_OPS];
+
+static uint64_t ns_between(const struct timespec *a, const struct timespec *b)
+{
+    return (uint64_t)(b->tv_sec - a->tv_sec) * 1000000000ULL + b->tv_nsec - a->tv_nsec;
+}
+
+/*
+ *  read_io
+ *      io:    receives rchar, wchar, syscr, syscw, read_bytes, write_bytes
+ *
+ *  One pread() of /proc/self/io.  The kernel counts that read after it
+ *  returns, so it shows up in the next snapshot, see dbstat_end().
+ *
+ *  returns:  bytes read, 0 if the numbers are not available
+ */
+static size_t read_io(uint64_t io[6])
+{
+    char buf[512];
+
+    if (dbstat_io_fd == -1)
+        return 0;
+    ssize_t n = pread(dbstat_io_fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+
+    unsigned long long v[6];
+    if (sscanf(buf, "rchar: %llu wchar: %llu syscr: %llu syscw: %llu read_bytes: %llu write_bytes: %llu",
+               &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) != 6)
+        return 0;
+    for (int i = 0; i < 6; i++)
+        io[i] = v[i];
+    return n;
+}
+
+// prints the totals when the program exits
+static void dbstat_report(void)
+{
+    char line[4096];
+
+    if (dbstat_json(line, sizeof(line)) > 0)
+        fprintf(stderr, "%s\n", line);
+}
+
+/*
+ *  dbstat_enable
+ *
+ *  Turns the instrumentation on for the rest of the process and arranges
+ *  for the totals to be printed to stderr at exit.  Calling it again does
+ *  nothing.
+ */
+void dbstat_enable(void)
+{
+    if (dbstat_on)
+        return;
+    dbstat_on = true;
+    dbstat_io_fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+    atexit(dbstat_report);
+}
+
+bool dbstat_enabled(void)
+{
+    return dbstat_on;
+}
+
+/*
+ *  dbstat_begin
+ *      *m:  filled in with the counters as they are now
+ *
+ *  Costs nothing while the instrumentation is off.
+ */
+void dbstat_begin(dbstat_mark_t *m)
+{
+    struct rusage ru;
+
+    m->on = dbstat_on;
+    if (!m->on)
+        return;
+    memset(m->io, 0, sizeof(m->io));
+    m->io_len = read_io(m->io);
+    getrusage(RUSAGE_SELF, &ru);
+    m->faults[0] = ru.ru_minflt;
+    m->faults[1] = ru.ru_majflt;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &m->cpu);
+    clock_gettime(CLOCK_MONOTONIC, &m->wall);
+}
+
+/*
+ *  dbstat_end
+ *      op:  DBSTAT_* operation that ran since dbstat_begin()
+ *      *m:  the mark dbstat_begin() filled in
+ *
+ *  Adds what the operation cost to its totals.  The read of /proc/self/io
+ *  done by dbstat_begin() is taken back out.
+ */
+void dbstat_end(int op, const dbstat_mark_t *m)
+{
+    struct timespec wall, cpu;
+    struct rusage ru;
+    uint64_t io[6] = {0};
+
+    if (!m->on || op < 0 || op >= DBSTAT_OPS)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+    getrusage(RUSAGE_SELF, &ru);
+
+    dbstat_op_t *t = &dbstat_totals[op];
+    t->calls++;
+    t->wall_ns += ns_between(&m->wall, &wall);
+    t->cpu_ns += ns_between(&m->cpu, &cpu);
+    t->minor_faults += ru.ru_minflt - m->faults[0];
+    t->major_faults += ru.ru_majflt - m->faults[1];
+
+    if (m->io_len > 0 && read_io(io) > 0)
+    {
+        t->read_bytes += io[0] - m->io[0] - m->io_len;
+        t->write_bytes += io[1] - m->io[1];
+        t->read_calls += io[2] - m->io[2] - 1;
+        t->write_calls += io[3] - m->io[3];
+        t->disk_read += io[4] - m->io[4];
+        t->disk_write += io[5] - m->io[5];
+    }
+}
+
+// appends to the line being built in buf, false once it does not fit
+static bool append(char *buf, size_t len, size_t *at, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + *at, len - *at, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= len - *at)
+        return false;
+    *at += n;
+    return true;
+}
+
+/*
+ *  dbstat_json
+ *      buf:  room for the line
+ *      len:  size of buf
+ *
+ *  Formats the totals of every operation that ran at least once as one
+ *  JSON object, without a newline.
+ *
+ *  returns:  length of the line, or ERR_DB_OP if buf is too small
+ */
+int dbstat_json(char *buf, size_t len)
+{
+    size_t at = 0;
+    bool ok = append(buf, len, &at, "{\"pid\":%d,\"ops\":{", (int)getpid());
+    bool first = true;
+
+    for (int op = 0; ok && op < DBSTAT_OPS; op++)
+    {
+        const dbstat_op_t *t = &dbstat_totals[op];
+
+        if (t->calls == 0)
+            continue;
+        ok = append(buf, len, &at,
+                    "%s\"%s\":{\"calls\":%llu,\"wall_us\":%.1f,\"cpu_us\":%.1f,"
+                    "\"minor_faults\":%llu,\"major_faults\":%llu",
+                    first ? "" : ",", dbstat_names[op], (unsigned long long)t->calls,
+                    t->wall_ns / 1000.0, t->cpu_ns / 1000.0,
+                    (unsigned long long)t->minor_faults, (unsigned long long)t->major_faults);
+        if (ok && dbstat_io_fd != -1)
+            ok = append(buf, len, &at,
+                        ",\"syscalls\":%llu,\"read_calls\":%llu,\"write_calls\":%llu,"
+                        "\"read_bytes\":%llu,\"write_bytes\":%llu,"
+                        "\"disk_read_bytes\":%llu,\"disk_write_bytes\":%llu",
+                        (unsigned long long)(t->read_calls + t->write_calls),
+                        (unsigned long long)t->read_calls, (unsigned long long)t->write_calls,
+                        (unsigned long long)t->read_bytes, (unsigned long long)t->write_bytes,
+                        (unsigned long long)t->disk_read, (unsigned long long)t->disk_write);
+        ok = ok && append(buf, len, &at, "}");
+        first = false;
+    }
+    if (!ok || !append(buf, len, &at, "}}"))
+        return ERR_DB_OP;
+    return at;
+}
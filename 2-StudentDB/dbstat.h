@@ -0,0 +1,76 @@
+#ifndef __DBSTAT_H__
+#define __DBSTAT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+// Per operation instrumentation, off unless the program runs with -V or
+// with DBSTAT_ENV set to 1:
+//   SDB_STATS=1 ./sdbsc -f 3
+//   ./sdbsc -V -f 3
+//
+// Every instrumented operation adds up how often it ran, its wall and CPU
+// time, the read and write system calls it made with the bytes they moved
+// (read(), pread(), preadv(), write(), ...), the bytes that actually went
+// to or came from the disk, and its page faults (the mmap backend does its
+// I/O through those).  The I/O numbers come from the kernel's accounting
+// in /proc/self/io, so they cover every module and the scan threads
+// without a counter in each call site; other system calls (fsync(), locks)
+// are not counted there.  Without /proc/self/io only the times and faults
+// are reported.
+//
+// When the program exits the totals go to stderr as one JSON line:
+//   {"pid":4242,"ops":{"open_db":{"calls":1,"wall_us":85.2,...},...}}
+// The daemon (-S) keeps adding up for its whole life, a client reads the
+// same line with -C sock -V.
+#define DBSTAT_ENV "SDB_STATS"
+
+// Instrumented operations, the JSON line names them after the functions
+// (open_db, get_student, add_student, del_student, print_db,
+// count_db_records, compress_db, update_student)
+#define DBSTAT_OPEN 0
+#define DBSTAT_GET 1
+#define DBSTAT_ADD 2
+#define DBSTAT_DEL 3
+#define DBSTAT_PRINT 4
+#define DBSTAT_COUNT 5
+#define DBSTAT_COMPRESS 6
+#define DBSTAT_UPDATE 7
+#define DBSTAT_OPS 8
+
+// Totals of one operation
+typedef struct dbstat_op
+{
+    uint64_t calls;
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    uint64_t read_calls;  // read class system calls
+    uint64_t write_calls; // write class system calls
+    uint64_t read_bytes;  // bytes they returned, page cache hits included
+    uint64_t write_bytes; // bytes they were handed
+    uint64_t disk_read;   // bytes read from the disk
+    uint64_t disk_write;  // bytes that will be written to the disk
+    uint64_t minor_faults;
+    uint64_t major_faults;
+} dbstat_op_t;
+
+// Where an operation started, see dbstat_begin()
+typedef struct dbstat_mark
+{
+    bool on;
+    struct timespec wall;
+    struct timespec cpu;
+    uint64_t io[6];  // rchar, wchar, syscr, syscw, read_bytes, write_bytes
+    size_t io_len;   // bytes the read of /proc/self/io itself returned
+    uint64_t faults[2];
+} dbstat_mark_t;
+
+void dbstat_enable(void);
+bool dbstat_enabled(void);
+void dbstat_begin(dbstat_mark_t *m);
+void dbstat_end(int op, const dbstat_mark_t *m);
+int dbstat_json(char *buf, size_t len);
+
+#endif
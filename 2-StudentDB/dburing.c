@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <linux/io_uring.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbio.h"
+#include "dburing.h"
+
+// Ring state of one database descriptor, ring_fd is -1 while there is none
+typedef struct dburing_ctx
+{
+    int ring_fd;
+    unsigned depth;        // submission queue entries
+    void *sq_map;          // submission ring (and completion ring if shared)
+    size_t sq_map_len;
+    void *cq_map;          // completion ring
+    size_t cq_map_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+
+    // pointers into the shared rings
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+} dburing_ctx_t;
+
+static dburing_ctx_t dburing_table[DBIO_MAX_FD];
+
+static dburing_ctx_t *dburing_ctx(int fd)
+{
+    if (fd < 0 || fd >= DBIO_MAX_FD || dburing_table[fd].sqes == NULL)
+        return NULL;
+    return &dburing_table[fd];
+}
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete,
+                              unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static unsigned env_depth(void)
+{
+    char *v = getenv(DBURING_DEPTH_ENV);
+    long n = v != NULL && *v != '\0' ? atol(v) : 0;
+
+    if (n <= 0)
+        return DBURING_DEFAULT_DEPTH;
+    return n > DBURING_MAX_DEPTH ? DBURING_MAX_DEPTH : (unsigned)n;
+}
+
+static void unmap_rings(dburing_ctx_t *ctx)
+{
+    if (ctx->sqes != NULL)
+        munmap(ctx->sqes, ctx->sqes_len);
+    if (ctx->cq_map != NULL && ctx->cq_map != ctx->sq_map)
+        munmap(ctx->cq_map, ctx->cq_map_len);
+    if (ctx->sq_map != NULL)
+        munmap(ctx->sq_map, ctx->sq_map_len);
+    if (ctx->ring_fd >= 0)
+        close(ctx->ring_fd);
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->ring_fd = -1;
+}
+
+/*
+ *  dburing_open
+ *      fd:  database file descriptor
+ *
+ *  Creates the ring for fd with DBURING_DEPTH_ENV submission entries (the
+ *  kernel rounds up to a power of two) and maps its queues.
+ *
+ *  returns:  NO_ERROR     the ring is ready
+ *            ERR_DB_FILE  io_uring is not available, fd keeps using
+ *                         pread()/pwrite()
+ */
+int dburing_open(int fd)
+{
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return ERR_DB_FILE;
+
+    dburing_ctx_t *ctx = &dburing_table[fd];
+    struct io_uring_params p;
+
+    memset(ctx, 0, sizeof(*ctx));
+    memset(&p, 0, sizeof(p));
+    ctx->ring_fd = sys_io_uring_setup(env_depth(), &p);
+    if (ctx->ring_fd < 0)
+    {
+        ctx->ring_fd = -1;
+        return ERR_DB_FILE;
+    }
+
+    ctx->depth = p.sq_entries;
+    ctx->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ctx->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    // newer kernels map both rings with a single mmap() call
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ctx->cq_map_len > ctx->sq_map_len)
+            ctx->sq_map_len = ctx->cq_map_len;
+        ctx->cq_map_len = ctx->sq_map_len;
+    }
+
+    ctx->sq_map = mmap(NULL, ctx->sq_map_len, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ctx->ring_fd, IORING_OFF_SQ_RING);
+    if (ctx->sq_map == MAP_FAILED)
+    {
+        ctx->sq_map = NULL;
+        unmap_rings(ctx);
+        return ERR_DB_FILE;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        ctx->cq_map = ctx->sq_map;
+    else
+    {
+        ctx->cq_map = mmap(NULL, ctx->cq_map_len, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ctx->ring_fd, IORING_OFF_CQ_RING);
+        if (ctx->cq_map == MAP_FAILED)
+        {
+            ctx->cq_map = NULL;
+            unmap_rings(ctx);
+            return ERR_DB_FILE;
+        }
+    }
+
+    ctx->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ctx->sqes = mmap(NULL, ctx->sqes_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ctx->ring_fd, IORING_OFF_SQES);
+    if (ctx->sqes == MAP_FAILED)
+    {
+        ctx->sqes = NULL;
+        unmap_rings(ctx);
+        return ERR_DB_FILE;
+    }
+
+    char *sq = ctx->sq_map;
+    char *cq = ctx->cq_map;
+    ctx->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ctx->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ctx->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ctx->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ctx->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ctx->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ctx->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return NO_ERROR;
+}
+
+/*
+ *  dburing_close
+ *      fd:  database file descriptor
+ *
+ *  Tears down the ring of fd, if it has one.
+ */
+void dburing_close(int fd)
+{
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return;
+    if (dburing_table[fd].sqes != NULL)
+        unmap_rings(&dburing_table[fd]);
+}
+
+bool dburing_active(int fd)
+{
+    return dburing_ctx(fd) != NULL;
+}
+
+int dburing_depth(int fd)
+{
+    dburing_ctx_t *ctx = dburing_ctx(fd);
+
+    return ctx != NULL ? (int)ctx->depth : 0;
+}
+
+// queues reqs[i] in the next submission slot, the caller made sure there
+// is room (at most depth requests are ever in flight)
+static void queue_req(dburing_ctx_t *ctx, int fd, dburing_req_t *req, int i)
+{
+    unsigned tail = *ctx->sq_tail;
+    unsigned idx = tail & *ctx->sq_mask;
+    struct io_uring_sqe *sqe = &ctx->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = req->op == DBURING_WRITE ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)req->buf;
+    sqe->len = req->len;
+    sqe->off = req->off;
+    sqe->user_data = i;
+    ctx->sq_array[idx] = idx;
+
+    // the kernel must see the entry before it sees the new tail
+    __atomic_store_n(ctx->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// moves every completion that is ready into its request, returns how many
+static int reap(dburing_ctx_t *ctx, dburing_req_t *reqs)
+{
+    unsigned head = *ctx->cq_head;
+    unsigned tail = __atomic_load_n(ctx->cq_tail, __ATOMIC_ACQUIRE);
+    int n = 0;
+
+    for (; head != tail; head++, n++)
+    {
+        struct io_uring_cqe *cqe = &ctx->cqes[head & *ctx->cq_mask];
+        reqs[cqe->user_data].res = cqe->res;
+    }
+    __atomic_store_n(ctx->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+/*
+ *  dburing_run
+ *      fd:     database file descriptor with a ring
+ *      reqs:   requests to run, res is filled in for each one
+ *      count:  number of requests
+ *
+ *  Keeps up to the queue depth of requests in flight until all of them
+ *  have completed.  New requests are submitted in the same
+ *  io_uring_enter() call that waits for earlier ones, and completions are
+ *  taken in the order the kernel delivers them.  Requests are independent,
+ *  two that touch the same bytes may run in either order.
+ *
+ *  returns:  NO_ERROR     every request completed, check res of each one
+ *            ERR_DB_FILE  fd has no ring or io_uring_enter() failed
+ */
+int dburing_run(int fd, dburing_req_t *reqs, int count)
+{
+    dburing_ctx_t *ctx = dburing_ctx(fd);
+    unsigned to_submit = 0;
+    int next = 0, inflight = 0, done = 0;
+
+    if (ctx == NULL)
+        return ERR_DB_FILE;
+
+    while (done < count)
+    {
+        while (next < count && inflight < (int)ctx->depth)
+        {
+            queue_req(ctx, fd, &reqs[next], next);
+            next++;
+            inflight++;
+            to_submit++;
+        }
+
+        int rc = sys_io_uring_enter(ctx->ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+        if (rc < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+            {
+                // completions may still be waiting to be reaped
+                int n = reap(ctx, reqs);
+                inflight -= n;
+                done += n;
+                continue;
+            }
+            // entries that were queued but never submitted stay in the
+            // ring, a failed ring is not used again
+            unmap_rings(ctx);
+            return ERR_DB_FILE;
+        }
+        to_submit -= (unsigned)rc < to_submit ? (unsigned)rc : to_submit;
+
+        int n = reap(ctx, reqs);
+        inflight -= n;
+        done += n;
+    }
+    return NO_ERROR;
+}
@@ -0,0 +1,48 @@
+#ifndef __DBURING_H__
+#define __DBURING_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+// Optional io_uring I/O path for the fd backend (DB_OPEN_URING, see dbio.h).
+//
+// A ring is set up per database descriptor when it is attached.  Reads and
+// writes are queued as submission entries and the caller sleeps in a single
+// io_uring_enter() until the first completion arrives, then reaps every
+// completion that is ready, in whatever order the kernel finished them.  A
+// request for many ids keeps up to the queue depth of reads in flight at
+// once instead of waiting out the latency of each pread() in turn, which is
+// what matters when the page cache is cold.
+//
+// The ring is talked to with the raw system calls, there is no dependency
+// on liburing.  When the kernel has no io_uring (or it is disabled, for
+// example by seccomp or kernel.io_uring_disabled) dburing_open() fails and
+// the storage layer quietly keeps using pread()/pwrite().
+//
+// The queue depth comes from DBURING_DEPTH_ENV, for example:
+//   SDB_BACKEND=uring SDB_URING_DEPTH=256 ./sdbsc -f 1 2 3
+#define DBURING_DEPTH_ENV "SDB_URING_DEPTH"
+#define DBURING_DEFAULT_DEPTH 64
+#define DBURING_MAX_DEPTH 4096
+
+// Request types
+#define DBURING_READ 0
+#define DBURING_WRITE 1
+
+// One I/O request handed to dburing_run()
+typedef struct dburing_req
+{
+    int op;       // DBURING_READ or DBURING_WRITE
+    void *buf;    // source or destination
+    size_t len;   // bytes to transfer
+    off_t off;    // file offset
+    ssize_t res;  // set on completion: bytes transferred or -errno
+} dburing_req_t;
+
+int dburing_open(int fd);
+void dburing_close(int fd);
+bool dburing_active(int fd);
+int dburing_depth(int fd);
+int dburing_run(int fd, dburing_req_t *reqs, int count);
+
+#endif
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbbucket.h"
+#include "gpaidx.h"
+
+// bucket of a record, records that predate range checks are clamped
+static uint32_t gpa_key(const student_t *s, void *entry)
+{
+    *(int64_t *)entry = s->id;
+    if (s->gpa < MIN_STD_GPA)
+        return 0;
+    if (s->gpa > MAX_STD_GPA)
+        return GPAIDX_VALUES - 1;
+    return s->gpa - MIN_STD_GPA;
+}
+
+// keeps the per value counts of the header in step with the buckets
+static void gpa_count(void *hdr, uint32_t bucket, int delta)
+{
+    ((gpaidx_hdr_t *)hdr)->counts[bucket] += delta;
+}
+
+static dbbucket_t gpaidx = {
+    .magic = GPAIDX_MAGIC,
+    .version = GPAIDX_VERSION,
+    .buckets = GPAIDX_VALUES,
+    .hdr_size = sizeof(gpaidx_hdr_t),
+    .entry_size = sizeof(int64_t),
+    .key = gpa_key,
+    .count = gpa_count,
+};
+
+/*
+ *  gpaidx_open
+ *      fd:               database file descriptor
+ *      dbFile:           path of the database, the index is dbFile followed
+ *                        by GPAIDX_SUFFIX
+ *      should_truncate:  the database was just emptied
+ *
+ *  Opens the index of the database, rebuilding it from the records when
+ *  needed (see dbbucket_open()).
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int gpaidx_open(int fd, char *dbFile, bool should_truncate)
+{
+    return dbbucket_open(&gpaidx, fd, dbFile, GPAIDX_SUFFIX, should_truncate);
+}
+
+void gpaidx_close(int fd)
+{
+    dbbucket_close(&gpaidx, fd);
+}
+
+// adds the id of a student that was just added and counts its gpa value
+int gpaidx_insert(int fd, const student_t *s)
+{
+    return dbbucket_insert(&gpaidx, fd, s);
+}
+
+// removes the id of a student that was just deleted
+int gpaidx_remove(int fd, const student_t *s)
+{
+    return dbbucket_remove(&gpaidx, fd, s);
+}
+
+// dbbucket_walk() callback of a range query
+static int collect_id(const void *entry, void *arg)
+{
+    return dbbucket_add_id(arg, *(const int64_t *)entry);
+}
+
+/*
+ *  gpaidx_range
+ *      fd:     database file descriptor
+ *      min:    lowest gpa to report, MIN_STD_GPA..MAX_STD_GPA
+ *      max:    highest gpa to report, min..MAX_STD_GPA
+ *      **ids:  set to a malloc()ed array of matching ids, the caller frees
+ *              it
+ *
+ *  Collects the ids of the buckets min..max.  Buckets the header counts as
+ *  empty are not read at all.
+ *
+ *  returns:  number of ids (ascending order), or ERR_DB_FILE
+ */
+int gpaidx_range(int fd, int min, int max, long long **ids)
+{
+    gpaidx_hdr_t hdr;
+    dbbucket_ids_t out = {0};
+    int rc;
+
+    *ids = NULL;
+    if (dbbucket_lock(&gpaidx, fd, LOCK_SH) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    rc = dbbucket_read_hdr(&gpaidx, fd, &hdr);
+    for (int key = min - MIN_STD_GPA; key <= max - MIN_STD_GPA && rc == NO_ERROR; key++)
+        if (hdr.counts[key] != 0)
+            rc = dbbucket_walk(&gpaidx, fd, key, collect_id, &out);
+    dbbucket_lock(&gpaidx, fd, LOCK_UN);
+
+    if (rc != NO_ERROR)
+    {
+        free(out.ids);
+        return ERR_DB_FILE;
+    }
+    return dbbucket_sort_ids(&out, ids);
+}
+
+/*
+ *  gpaidx_counts
+ *      fd:      database file descriptor
+ *      counts:  filled in with the number of students per gpa value,
+ *               counts[0] is MIN_STD_GPA
+ *
+ *  Only the header page of the index is read.
+ *
+ *  returns:  number of students, or ERR_DB_FILE
+ */
+int gpaidx_counts(int fd, uint32_t counts[GPAIDX_VALUES])
+{
+    gpaidx_hdr_t hdr;
+    int rc;
+
+    if (dbbucket_lock(&gpaidx, fd, LOCK_SH) != NO_ERROR)
+        return ERR_DB_FILE;
+    rc = dbbucket_read_hdr(&gpaidx, fd, &hdr);
+    dbbucket_lock(&gpaidx, fd, LOCK_UN);
+
+    if (rc != NO_ERROR)
+        return rc;
+    memcpy(counts, hdr.counts, sizeof(hdr.counts));
+    return hdr.b.entries;
+}
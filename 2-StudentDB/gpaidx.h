@@ -0,0 +1,40 @@
+#ifndef __GPAIDX_H__
+#define __GPAIDX_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "db.h" //get student record type
+#include "dbbucket.h"
+
+// Persistent secondary index on the gpa of a student, kept in a bucket
+// file next to the database (DB_FILE followed by GPAIDX_SUFFIX, see
+// dbbucket.h for the layout).
+//
+// gpa only has GPAIDX_VALUES possible values, so the index has one bucket
+// per value holding the ids of the students with that gpa.  The header
+// page also holds the number of students for every gpa value, which is all
+// the aggregates (-A) need.  A range query (-g) reads only the buckets
+// inside the range.
+#define GPAIDX_SUFFIX ".gpa.idx"
+#define GPAIDX_MAGIC "SDBGPX\0"
+#define GPAIDX_VERSION 3
+#define GPAIDX_VALUES (MAX_STD_GPA - MIN_STD_GPA + 1)
+
+// width of one histogram band printed by -A, 50 is 0.50 of a real gpa
+#define GPAIDX_HIST_BAND 50
+
+typedef struct gpaidx_hdr
+{
+    dbbucket_hdr_t b;               // buckets is GPAIDX_VALUES
+    uint32_t counts[GPAIDX_VALUES]; // students per gpa value
+} gpaidx_hdr_t;
+
+int gpaidx_open(int fd, char *dbFile, bool should_truncate);
+void gpaidx_close(int fd);
+int gpaidx_insert(int fd, const student_t *s);
+int gpaidx_remove(int fd, const student_t *s);
+int gpaidx_range(int fd, int min, int max, long long **ids);
+int gpaidx_counts(int fd, uint32_t counts[GPAIDX_VALUES]);
+
+#endif
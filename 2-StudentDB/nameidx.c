@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbbucket.h"
+#include "nameidx.h"
+
+// FNV-1a over the last name, the field is not necessarily terminated
+static uint32_t name_hash(const char *name, size_t len)
+{
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < len && name[i] != '\0'; i++)
+    {
+        h ^= (uint8_t)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t lname_key(const student_t *s, void *entry)
+{
+    nameidx_entry_t *e = entry;
+
+    e->hash = name_hash(s->lname, sizeof(s->lname));
+    e->id = s->id;
+    return e->hash % NAMEIDX_BUCKETS;
+}
+
+static dbbucket_t nameidx = {
+    .magic = NAMEIDX_MAGIC,
+    .version = NAMEIDX_VERSION,
+    .buckets = NAMEIDX_BUCKETS,
+    .hdr_size = sizeof(dbbucket_hdr_t),
+    .entry_size = sizeof(nameidx_entry_t),
+    .key = lname_key,
+};
+
+/*
+ *  nameidx_open
+ *      fd:               database file descriptor
+ *      dbFile:           path of the database, the index is dbFile followed
+ *                        by NAMEIDX_SUFFIX
+ *      should_truncate:  the database was just emptied
+ *
+ *  Opens the index of the database, rebuilding it from the records when
+ *  needed (see dbbucket_open()).
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int nameidx_open(int fd, char *dbFile, bool should_truncate)
+{
+    return dbbucket_open(&nameidx, fd, dbFile, NAMEIDX_SUFFIX, should_truncate);
+}
+
+void nameidx_close(int fd)
+{
+    dbbucket_close(&nameidx, fd);
+}
+
+// adds (hash, id) of a student that was just added, see dbbucket_insert()
+int nameidx_insert(int fd, const student_t *s)
+{
+    return dbbucket_insert(&nameidx, fd, s);
+}
+
+// removes (hash, id) of a student that was just deleted
+int nameidx_remove(int fd, const student_t *s)
+{
+    return dbbucket_remove(&nameidx, fd, s);
+}
+
+// dbbucket_walk() callback of a lookup
+typedef struct lookup
+{
+    uint32_t hash;
+    dbbucket_ids_t out;
+} lookup_t;
+
+static int collect_hash(const void *entry, void *arg)
+{
+    const nameidx_entry_t *e = entry;
+    lookup_t *l = arg;
+
+    if (e->hash != l->hash)
+        return NO_ERROR;
+    return dbbucket_add_id(&l->out, e->id);
+}
+
+/*
+ *  nameidx_lookup
+ *      fd:     database file descriptor
+ *      lname:  last name to look for (exact match)
+ *      **ids:  set to a malloc()ed array of matching ids, the caller frees
+ *              it
+ *
+ *  Reads the bucket chain of lname and returns every id stored with the
+ *  same hash.  The records are not read here: a hash collision can put a
+ *  student with another last name in the result, the caller drops those
+ *  after it has fetched the candidates in one batch (see print_matches()
+ *  in sdbsc.c).
+ *
+ *  returns:  number of candidates (ids in ascending order), or
+ *            ERR_DB_FILE
+ */
+int nameidx_lookup(int fd, const char *lname, long long **ids)
+{
+    lookup_t l = {.hash = name_hash(lname, strlen(lname))};
+    int rc;
+
+    *ids = NULL;
+    if (dbbucket_lock(&nameidx, fd, LOCK_SH) != NO_ERROR)
+        return ERR_DB_FILE;
+    rc = dbbucket_walk(&nameidx, fd, l.hash % NAMEIDX_BUCKETS, collect_hash, &l);
+    dbbucket_lock(&nameidx, fd, LOCK_UN);
+
+    if (rc != NO_ERROR)
+    {
+        free(l.out.ids);
+        return ERR_DB_FILE;
+    }
+    return dbbucket_sort_ids(&l.out, ids);
+}
@@ -0,0 +1,35 @@
+#ifndef __NAMEIDX_H__
+#define __NAMEIDX_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "db.h" //get student record type
+
+// Persistent secondary index on the last name of a student, kept in a
+// bucket file next to the database (DB_FILE followed by NAMEIDX_SUFFIX,
+// see dbbucket.h for the layout).
+//
+// A bucket page holds (hash, id) pairs, the hash is the FNV-1a hash of
+// lname.  A lookup reads the chain of one bucket, so its cost depends on
+// the number of students sharing the bucket and not on the size of the
+// database.
+#define NAMEIDX_SUFFIX ".lname.idx"
+#define NAMEIDX_MAGIC "SDBLNX\0"
+#define NAMEIDX_VERSION 2
+#define NAMEIDX_BUCKETS 1024
+
+typedef struct nameidx_entry
+{
+    uint32_t hash;
+    uint32_t reserved;
+    int64_t id;
+} nameidx_entry_t;
+
+int nameidx_open(int fd, char *dbFile, bool should_truncate);
+void nameidx_close(int fd);
+int nameidx_insert(int fd, const student_t *s);
+int nameidx_remove(int fd, const student_t *s);
+int nameidx_lookup(int fd, const char *lname, long long **ids);
+
+#endif
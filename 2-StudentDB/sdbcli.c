@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "sdbsrv.h"
+#include "dbstat.h"
+
+static int send_all(int sock, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len > 0)
+    {
+        ssize_t n = send(sock, p, len, MSG_NOSIGNAL);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int recv_all(int sock, void *buf, size_t len)
+{
+    char *p = buf;
+
+    while (len > 0)
+    {
+        ssize_t n = recv(sock, p, len, 0);
+        if (n == 0)
+            return -1;
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ *  client_connect
+ *      sock_path:  unix domain socket the daemon listens on
+ *
+ *  returns:  connected socket, or -1
+ */
+static int client_connect(char *sock_path)
+{
+    struct sockaddr_un addr = {0};
+    int sock;
+
+    if (strlen(sock_path) >= sizeof(addr.sun_path))
+        return -1;
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sock_path);
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1)
+        return -1;
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/*
+ *  client_main
+ *      sock_path:  unix domain socket of a running sdbsc daemon
+ *      argc:       number of arguments left after "-C sock_path"
+ *      argv:       the operation and its arguments, for example
+ *                  {"-f", "3"}
+ *
+ *  Thin client for the daemon started with -S.  Supports the -a, -c, -d,
+ *  -f and -p operations with exactly the same arguments, console output
+ *  and exit codes as running them locally, so scripts can switch between
+ *  the two by adding "-C sock_path" in front of the operation.
+ *
+ *  returns:  EXIT_OK, EXIT_FAIL_DB or EXIT_FAIL_ARGS to hand to exit()
+ *
+ *  console:  same as the local operation, M_ERR_SRV_CONNECT if the daemon
+ *            cannot be reached
+ */
+int client_main(char *sock_path, int argc, char *argv[])
+{
+    sdb_req_t req = {0};
+    sdb_resp_t resp;
+    student_t rec = EMPTY_STUDENT_RECORD;
+    int sock;
+
+    if (argc < 1 || argv[0][0] != '-')
+        return EXIT_FAIL_ARGS;
+
+    req.op = argv[0][1];
+    switch (req.op)
+    {
+    case SDB_OP_ADD:
+        if (argc != 5)
+            return EXIT_FAIL_ARGS;
+        rec.id = atoll(argv[1]);
+        strncpy(rec.fname, argv[2], sizeof(rec.fname) - 1);
+        strncpy(rec.lname, argv[3], sizeof(rec.lname) - 1);
+        rec.gpa = atoi(argv[4]);
+        req.id = rec.id;
+        if (validate_range(rec.id, rec.gpa) != NO_ERROR)
+        {
+            printf(M_ERR_STD_RNG);
+            return EXIT_FAIL_ARGS;
+        }
+        if (validate_names(argv[2], argv[3]) != NO_ERROR)
+        {
+            printf(M_ERR_STD_NAME, STD_FNAME_MAX, STD_LNAME_MAX);
+            return EXIT_FAIL_ARGS;
+        }
+        break;
+    case SDB_OP_DEL:
+    case SDB_OP_GET:
+        if (argc != 2)
+            return EXIT_FAIL_ARGS;
+        req.id = atoll(argv[1]);
+        break;
+    case SDB_OP_COUNT:
+    case SDB_OP_PRINT:
+    case SDB_OP_STATS:
+        if (argc != 1)
+            return EXIT_FAIL_ARGS;
+        break;
+    default:
+        return EXIT_FAIL_ARGS;
+    }
+
+    sock = client_connect(sock_path);
+    if (sock == -1)
+    {
+        printf(M_ERR_SRV_CONNECT);
+        return EXIT_FAIL_DB;
+    }
+
+    // the request is all we send, the daemon answers before it closes
+    if (send_all(sock, &req, sizeof(req)) != 0 ||
+        (req.op == SDB_OP_ADD && send_all(sock, &rec, sizeof(rec)) != 0) ||
+        shutdown(sock, SHUT_WR) == -1 ||
+        recv_all(sock, &resp, sizeof(resp)) != 0)
+    {
+        printf(M_ERR_SRV_CONNECT);
+        close(sock);
+        return EXIT_FAIL_DB;
+    }
+
+    int exit_code = EXIT_OK;
+    switch (req.op)
+    {
+    case SDB_OP_ADD:
+        if (resp.status == NO_ERROR)
+            printf(M_STD_ADDED, (long long)req.id);
+        else if (resp.status == ERR_DB_OP)
+            printf(M_ERR_DB_ADD_DUP, (long long)req.id);
+        else if (resp.status == ERR_DB_ARGS)
+            printf(M_ERR_STD_RNG);
+        else
+            printf(M_ERR_DB_WRITE);
+        break;
+
+    case SDB_OP_DEL:
+        if (resp.status == NO_ERROR)
+            printf(M_STD_DEL_MSG, (long long)req.id);
+        else if (resp.status == SRCH_NOT_FOUND)
+            printf(M_STD_NOT_FND_MSG, (long long)req.id);
+        else
+            printf(M_ERR_DB_WRITE);
+        break;
+
+    case SDB_OP_GET:
+        if (resp.status == NO_ERROR && resp.count == 1 &&
+            recv_all(sock, &rec, sizeof(rec)) == 0)
+            print_student(&rec);
+        else if (resp.status == SRCH_NOT_FOUND)
+            printf(M_STD_NOT_FND_MSG, (long long)req.id);
+        else
+            printf(M_ERR_DB_READ);
+        break;
+
+    case SDB_OP_COUNT:
+        if (resp.status != NO_ERROR)
+            printf(M_ERR_DB_READ);
+        else if (resp.count == 0)
+            printf(M_DB_EMPTY);
+        else
+            printf(M_DB_RECORD_CNT, (int)resp.count);
+        break;
+
+    case SDB_OP_PRINT:
+        if (resp.status != NO_ERROR)
+        {
+            printf(M_ERR_DB_READ);
+            break;
+        }
+        if (resp.count == 0)
+            printf(M_DB_EMPTY);
+        else
+            printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+        for (uint32_t i = 0; i < resp.count; i++)
+        {
+            if (recv_all(sock, &rec, sizeof(rec)) != 0)
+            {
+                printf(M_ERR_SRV_CONNECT);
+                resp.status = ERR_DB_FILE;
+                break;
+            }
+            float calculated_gpa = rec.gpa / 100.0;
+            printf(STUDENT_PRINT_FMT_STRING, rec.id, rec.fname, rec.lname, calculated_gpa);
+        }
+        break;
+
+    case SDB_OP_STATS:
+    {
+        if (resp.status != NO_ERROR)
+        {
+            printf(M_STATS_OFF, DBSTAT_ENV);
+            break;
+        }
+        char *line = malloc(resp.count + 1);
+        if (line == NULL || recv_all(sock, line, resp.count) != 0)
+        {
+            printf(M_ERR_SRV_CONNECT);
+            resp.status = ERR_DB_FILE;
+        }
+        else
+        {
+            line[resp.count] = '\0';
+            printf("%s\n", line);
+        }
+        free(line);
+        break;
+    }
+    }
+
+    if (resp.status != NO_ERROR)
+        exit_code = EXIT_FAIL_DB;
+    close(sock);
+    return exit_code;
+}
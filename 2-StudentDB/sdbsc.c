@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <fcntl.h> //c library for system call file routines
 #include <string.h>
 #include <sys/stat.h>
@@ -9,11 +10,31 @@
 // database include files
 #include "db.h"
 #include "sdbsc.h"
+#include "dbio.h"
+#include "dburing.h"
+#include "dbhdr.h"
+#include "dbindex.h"
+#include "dbmap.h"
+#include "dbbloom.h"
+#include "dbfmt.h"
+#include "dbpscan.h"
+#include "dbpool.h"
+#include "dbsnap.h"
+#include "dbpack.h"
+#include "nameidx.h"
+#include "gpaidx.h"
+#include "trieidx.h"
+#include "wal.h"
+#include "bulk.h"
+#include "dbstat.h"
+#include "sdbsrv.h"
 
 /*
  *  open_db
  *      dbFile:  name of the database file
  *      should_truncate:  indicates if opening the file also empties it
+ *      flags:  DB_OPEN_* storage backend, see dbio.h.  DB_OPEN_FD uses
+ *              plain read()/write() calls, DB_OPEN_MMAP maps the file
  *
  *  returns:  File descriptor on success, or ERR_DB_FILE on failure
  *
@@ -21,7 +42,7 @@
  *            M_ERR_DB_OPEN on error
  *
  */
-int open_db(char *dbFile, bool should_truncate)
+int open_db(char *dbFile, bool should_truncate, int flags)
 {
     // Set permissions: rw-rw----
     // see sys/stat.h for constants
@@ -29,13 +50,13 @@ int open_db(char *dbFile, bool should_truncate)
 
     // open the file if it exists for Read and Write,
     // create it if it does not exist
-    int flags = O_RDWR | O_CREAT;
+    int oflags = O_RDWR | O_CREAT;
 
     if (should_truncate)
-        flags += O_TRUNC;
+        oflags += O_TRUNC;
 
     // Now open file
-    int fd = open(dbFile, flags, mode);
+    int fd = open(dbFile, oflags, mode);
 
     if (fd == -1)
     {
@@ -44,9 +65,103 @@ int open_db(char *dbFile, bool should_truncate)
         return ERR_DB_FILE;
     }
 
+    // Make sure the file has a current header, this formats new files and
+    // migrates databases from before the header existed
+    fd = dbhdr_open(dbFile, fd);
+    if (fd < 0)
+    {
+        printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
+
+    // Hook up the requested storage backend and the secondary indexes
+    if (dbio_attach(fd, flags) != NO_ERROR)
+    {
+        close(fd);
+        printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
+
+    // Replay the write-ahead log before anything looks at the records, if
+    // it had to repair slots the indexes are rebuilt from scratch
+    int repaired = wal_open(fd, dbFile, should_truncate, flags);
+    if (repaired < 0)
+    {
+        dbio_detach(fd);
+        close(fd);
+        printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
+    if (dbmap_open(fd, dbFile, should_truncate, repaired > 0) != NO_ERROR)
+    {
+        wal_close(fd);
+        dbio_detach(fd);
+        close(fd);
+        printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
+    if (db_indexes_open(fd, dbFile, should_truncate || repaired > 0) != NO_ERROR)
+    {
+        dbmap_close(fd);
+        wal_close(fd);
+        dbio_detach(fd);
+        close(fd);
+        printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
+
     return fd;
 }
 
+/*
+ *  close_db
+ *      fd:  linux file descriptor returned by open_db()
+ *
+ *  Releases the write-ahead log, the id map, the secondary indexes and the
+ *  storage backend (for example the mapping of the mmap backend) and closes the
+ *  database file.
+ *
+ *  returns:  nothing, this is a void function
+ *
+ *  console:  Does not produce any console I/O
+ *
+ */
+void close_db(int fd)
+{
+    wal_close(fd);
+    dbmap_close(fd);
+    db_indexes_close(fd);
+    dbio_detach(fd);
+    close(fd);
+}
+
+/*
+ *  db_open_flags
+ *
+ *  Picks the storage backend for main() from the SDB_BACKEND environment
+ *  variable.  "mmap" selects DB_OPEN_MMAP, anything else (or nothing) uses
+ *  the classic fd backend.  SDB_WAL=1 adds DB_OPEN_WAL.
+ *
+ *  returns:  DB_OPEN_* flags to pass to open_db()
+ *
+ *  console:  Does not produce any console I/O
+ *
+ */
+int db_open_flags(void)
+{
+    char *backend = getenv(DB_BACKEND_ENV);
+    char *wal = getenv(WAL_ENV);
+    int flags = DB_OPEN_FD;
+
+    if (backend != NULL && strcmp(backend, "mmap") == 0)
+        flags = DB_OPEN_MMAP;
+    if (backend != NULL && strcmp(backend, "uring") == 0)
+        flags = DB_OPEN_FD | DB_OPEN_URING;
+    if (wal != NULL && strcmp(wal, "1") == 0)
+        flags |= DB_OPEN_WAL;
+    return flags;
+}
+
 /*
  *  get_student
  *      fd:  linux file descriptor
@@ -60,31 +175,36 @@ int open_db(char *dbFile, bool should_truncate)
  *
  *  console:  Does not produce any console I/O used by other functions
  */
-int get_student(int fd, int id, student_t *s)
+int get_student(int fd, long long id, student_t *s)
 {
-    int offset = id * STUDENT_RECORD_SIZE;
-
-    // Seek to correct offset
-    if (lseek(fd, offset, SEEK_SET) == -1)
-    {
-        return ERR_DB_FILE;
-    }
-    ssize_t bytesReturned = read(fd, s, STUDENT_RECORD_SIZE);
-    if (bytesReturned == -1)
-    {
-        return ERR_DB_FILE;
-    }
-    else if (bytesReturned == 0)
-    {
-        return SRCH_NOT_FOUND;
-    }
+    // The storage layer hides whether the slot comes from read() or
+    // straight out of the mapping, the id map where an id above
+    // MAX_STD_ID was placed
+    return dbmap_read(fd, id, s);
+}
 
-    // Check if record is empty
-    if (memcmp(s, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) == 0)
-    {
-        return SRCH_NOT_FOUND;
-    }
-    return NO_ERROR;
+/*
+ *  get_students
+ *      fd:     linux file descriptor
+ *      count:  number of ids
+ *      *ids:   the student ids we are looking for
+ *      *out:   room for count students, out[i] receives student ids[i]
+ *      *rcs:   room for count results, rcs[i] is what get_student() would
+ *              return for ids[i]
+ *
+ *  Looks up many students at once.  With the io_uring backend all of the
+ *  reads of ids up to MAX_STD_ID are in flight together (see
+ *  dbmap_read_many()), so this is the call to use whenever more than one id
+ *  is needed.
+ *
+ *  returns:  NO_ERROR       every id was looked up, see rcs
+ *            ERR_DB_FILE    out of memory
+ *
+ *  console:  Does not produce any console I/O used by other functions
+ */
+int get_students(int fd, int count, const long long *ids, student_t *out, int *rcs)
+{
+    return dbmap_read_many(fd, count, ids, out, rcs);
 }
 
 /*
@@ -95,10 +215,10 @@ int get_student(int fd, int id, student_t *s)
  *      lname:  student last name
  *      gpa:    GPA as an integer (range defined in db.h)
  *
- *  Adds a new student to the database.  After calculating the index for the
- *  student, check if there is another student already at that location.  A good
- *  way is to use something like memcmp() to ensure that the location for this
- *  student contains all zero byes indicating the space is empty.
+ *  Adds a new student to the database through db_insert().  The id is
+ *  claimed in the header bitmap with dbio_claim(), which fails if another
+ *  student already has it, so the record slot is never read first.  Ids
+ *  above MAX_STD_ID have no bit, dbmap_insert() does the check for them.
  *
  *  returns:  NO_ERROR       student added to database
  *            ERR_DB_FILE    database file I/O issue
@@ -112,54 +232,83 @@ int get_student(int fd, int id, student_t *s)
  *            M_ERR_DB_WRITE    error writing to db file (adding student)
  *
  */
-int add_student(int fd, int id, char *fname, char *lname, int gpa)
+int add_student(int fd, long long id, char *fname, char *lname, int gpa)
 {
     // Create student struct
-    student_t new_student;
+    student_t new_student = EMPTY_STUDENT_RECORD;
     new_student.id = id;
-    strcpy(new_student.fname, fname);
-    strcpy(new_student.lname, lname);
+    strncpy(new_student.fname, fname, sizeof(new_student.fname) - 1);
+    strncpy(new_student.lname, lname, sizeof(new_student.lname) - 1);
     new_student.gpa = gpa;
 
-    int offset = id * STUDENT_RECORD_SIZE;
+    int rc = db_insert(fd, &new_student);
 
-    if (lseek(fd, offset, SEEK_SET) == -1)
+    if (rc == ERR_DB_OP)
     {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
+        printf(M_ERR_DB_ADD_DUP, id);
+        return ERR_DB_OP;
     }
-
-    student_t temp;
-    ssize_t bytesReturned = read(fd, &temp, STUDENT_RECORD_SIZE);
-
-    if (bytesReturned == -1)
+    else if (rc != NO_ERROR)
     {
-        printf(M_ERR_DB_READ);
+        printf(M_ERR_DB_WRITE);
         return ERR_DB_FILE;
     }
-    else if (bytesReturned > 0)
-    {
-        if (temp.id != 0 || memcmp(&temp, "\0", STUDENT_RECORD_SIZE) != 0)
-        {
-            printf(M_ERR_DB_ADD_DUP, id);
-            return ERR_DB_OP;
-        }
-    }
 
-    if (lseek(fd, offset, SEEK_SET) == -1)
+    printf(M_STD_ADDED, id);
+    return NO_ERROR;
+}
+
+/*
+ *  db_insert
+ *      fd:  linux file descriptor
+ *      *s:  fully built student record, s->id selects the slot
+ *
+ *  The console free core of add_student(), shared with the bulk loader and
+ *  the server.  The id is claimed in the occupancy bitmap of the file
+ *  header first, which doubles as the duplicate check and never touches
+ *  the record pages, then the record is stored.  Ids above MAX_STD_ID have
+ *  no bit, they are placed through the id map (see dbmap.h).
+ *
+ *  returns:  NO_ERROR       student added to database
+ *            ERR_DB_FILE    database file I/O issue
+ *            ERR_DB_OP      student already exists
+ *
+ *  console:  Does not produce any console I/O
+ */
+int db_insert(int fd, const student_t *s)
+{
+    int rc = wal_begin(fd);
+
+    if (rc != NO_ERROR)
+        return rc;
+    if (s->id > MAX_STD_ID)
     {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
+        if ((rc = dbmap_insert(fd, s)) == NO_ERROR)
+            rc = db_indexes_insert(fd, s);
+        wal_end(fd);
+        return rc;
     }
 
-    if (write(fd, &new_student, STUDENT_RECORD_SIZE) == -1)
+    int id = (int)s->id;
+    if ((rc = dbio_lock_records(fd, id, 1)) != NO_ERROR)
     {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
+        wal_end(fd);
+        return rc;
     }
 
-    printf(M_STD_ADDED, id);
-    return NO_ERROR;
+    // Make sure the slot is free and take it, then log and store the record
+    rc = dbio_claim(fd, id);
+    if (rc == NO_ERROR &&
+        ((rc = wal_log(fd, WAL_OP_ADD, id, s)) != NO_ERROR ||
+         (rc = dbio_write(fd, id, s)) != NO_ERROR))
+        dbio_release(fd, id);
+    if (rc == NO_ERROR)
+        rc = db_indexes_insert(fd, s);
+
+    if (dbio_unlock_records(fd, id, 1) != NO_ERROR && rc == NO_ERROR)
+        rc = ERR_DB_FILE;
+    wal_end(fd);
+    return rc;
 }
 
 /*
@@ -184,57 +333,262 @@ int add_student(int fd, int id, char *fname, char *lname, int gpa)
  *            M_ERR_DB_WRITE     error writing to db file (adding student)
  *
  */
-int del_student(int fd, int id)
+int del_student(int fd, long long id)
 {
-    student_t delete_student;
-    int result = get_student(fd, id, &delete_student);
+    int result = db_remove(fd, id);
 
-    // Handle any get_student errors
-    if (result == ERR_DB_FILE)
+    // Handle any lookup or write errors
+    if (result == SRCH_NOT_FOUND)
     {
-        printf(M_ERR_DB_READ);
+        printf(M_STD_NOT_FND_MSG, id);
+        return ERR_DB_OP;
+    }
+    else if (result != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
         return ERR_DB_FILE;
     }
-    else if (result == SRCH_NOT_FOUND)
+
+    // Success message
+    printf(M_STD_DEL_MSG, id);
+    return NO_ERROR;
+}
+
+/*
+ *  db_remove
+ *      fd:  linux file descriptor
+ *      id:  student id to be deleted
+ *
+ *  The console free core of del_student().  Releases the id in the
+ *  occupancy bitmap, overwrites the slot with EMPTY_STUDENT_RECORD and drops
+ *  the old record from the secondary indexes, all under the record lock of
+ *  the slot.  Ids above MAX_STD_ID are removed from the id map instead.  An
+ *  id the bitmap or the Bloom filter of the id map rules out fails without
+ *  any I/O, see dbmap_may_exist().
+ *
+ *  returns:  NO_ERROR       student deleted from database
+ *            ERR_DB_FILE    database file I/O issue
+ *            SRCH_NOT_FOUND student not in database
+ *
+ *  console:  Does not produce any console I/O
+ */
+int db_remove(int fd, long long id)
+{
+    student_t old;
+    int result;
+
+    // most deletes of missing ids end here, without any locking or I/O
+    if (!dbmap_may_exist(fd, id))
+        return SRCH_NOT_FOUND;
+    if ((result = wal_begin(fd)) != NO_ERROR)
+        return result;
+    if (id > MAX_STD_ID)
     {
-        printf(M_STD_NOT_FND_MSG, id);
-        return ERR_DB_OP;
+        if ((result = dbmap_remove(fd, id, &old)) == NO_ERROR)
+            result = db_indexes_remove(fd, &old);
+        wal_end(fd);
+        return result;
     }
 
-    // Calculate offset to add blank record
-    int offset = id * STUDENT_RECORD_SIZE;
+    if ((result = dbio_lock_records(fd, id, 1)) != NO_ERROR)
+    {
+        wal_end(fd);
+        return result;
+    }
 
-    if (lseek(fd, offset, SEEK_SET) == -1)
+    result = dbio_release(fd, id);
+    if (result == NO_ERROR)
     {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
+        // The indexes need the fields of the record that goes away, then
+        // log the delete and write an empty student record over it
+        if (dbio_read_range(fd, id, 1, &old) != NO_ERROR)
+            result = ERR_DB_FILE;
+        else if ((result = wal_log(fd, WAL_OP_DEL, id, &old)) == NO_ERROR)
+            result = dbio_write(fd, id, &EMPTY_STUDENT_RECORD);
+
+        if (result != NO_ERROR)
+            dbio_claim(fd, id);
+        else
+            result = db_indexes_remove(fd, &old);
     }
 
-    student_t empty_student = EMPTY_STUDENT_RECORD;
+    if (dbio_unlock_records(fd, id, 1) != NO_ERROR && result == NO_ERROR)
+        result = ERR_DB_FILE;
+    wal_end(fd);
+    return result;
+}
 
-    // Write an empty student record to original record and check for errors
-    if (write(fd, &empty_student, STUDENT_RECORD_SIZE) == -1)
+/*
+ *  update_student
+ *      fd:      linux file descriptor
+ *      id:      student to change
+ *      *field:  "fname=value", "lname=value" or "gpa=value" (gpa as a 3
+ *               digit int)
+ *
+ *  Changes one field of a student in place instead of a delete and an add,
+ *  see db_update().  Names that do not fit the field are refused, see
+ *  validate_names().
+ *
+ *  returns:  NO_ERROR       field changed
+ *            ERR_DB_ARGS    unknown field, name too long or gpa out of range
+ *            ERR_DB_FILE    database file I/O issue
+ *            ERR_DB_OP      student not in database
+ *
+ *  console:  M_STD_UPDATED      on success
+ *            M_ERR_UPD_FIELD    unknown field or gpa out of range
+ *            M_ERR_STD_NAME     name too long
+ *            M_STD_NOT_FND_MSG  student not in database
+ *            M_ERR_DB_WRITE     error writing to db file
+ *
+ */
+int update_student(int fd, long long id, char *field)
+{
+    student_t s = EMPTY_STUDENT_RECORD;
+    char *value = strchr(field, '=');
+    size_t off, len;
+
+    s.id = id;
+    if (value == NULL)
+    {
+        printf(M_ERR_UPD_FIELD);
+        return ERR_DB_ARGS;
+    }
+    *value++ = '\0';
+
+    if ((strcmp(field, "fname") == 0 && validate_names(value, NULL) != NO_ERROR) ||
+        (strcmp(field, "lname") == 0 && validate_names(NULL, value) != NO_ERROR))
+    {
+        printf(M_ERR_STD_NAME, STD_FNAME_MAX, STD_LNAME_MAX);
+        return ERR_DB_ARGS;
+    }
+    if (strcmp(field, "fname") == 0 && *value != '\0')
+    {
+        strncpy(s.fname, value, sizeof(s.fname) - 1);
+        off = offsetof(student_t, fname);
+        len = sizeof(s.fname);
+    }
+    else if (strcmp(field, "lname") == 0 && *value != '\0')
+    {
+        strncpy(s.lname, value, sizeof(s.lname) - 1);
+        off = offsetof(student_t, lname);
+        len = sizeof(s.lname);
+    }
+    else if (strcmp(field, "gpa") == 0)
+    {
+        char *end;
+        long gpa = strtol(value, &end, 10);
+
+        if (*value == '\0' || *end != '\0' || gpa < MIN_STD_GPA || gpa > MAX_STD_GPA)
+        {
+            printf(M_ERR_UPD_FIELD);
+            return ERR_DB_ARGS;
+        }
+        s.gpa = gpa;
+        off = offsetof(student_t, gpa);
+        len = sizeof(s.gpa);
+    }
+    else
+    {
+        printf(M_ERR_UPD_FIELD);
+        return ERR_DB_ARGS;
+    }
+
+    int rc = db_update(fd, &s, off, len);
+
+    if (rc == SRCH_NOT_FOUND)
+    {
+        printf(M_STD_NOT_FND_MSG, id);
+        return ERR_DB_OP;
+    }
+    else if (rc != NO_ERROR)
     {
         printf(M_ERR_DB_WRITE);
         return ERR_DB_FILE;
     }
 
-    // Success message
-    printf(M_STD_DEL_MSG, id);
+    printf(M_STD_UPDATED, id);
     return NO_ERROR;
 }
 
+/*
+ *  db_update
+ *      fd:   linux file descriptor
+ *      *s:   s->id selects the student, the field holds its new value
+ *      off:  offset of the field in student_t
+ *      len:  size of the field
+ *
+ *  The console free core of update_student().  Under the record lock of
+ *  the slot the record is checked to be live and read, the new record is
+ *  logged (the log replays it like an add) and only the field is written
+ *  back, with one pwrite() at its offset in the slot (see
+ *  dbio_write_field()).  Readers never find the student missing, as they
+ *  could between a delete and an add, but the unlocked readers can see a
+ *  name half written while it changes.  The secondary indexes move the
+ *  student from the old values to the new ones.  Ids above MAX_STD_ID are
+ *  changed through the id map.
+ *
+ *  returns:  NO_ERROR       field written
+ *            ERR_DB_FILE    database file I/O issue
+ *            SRCH_NOT_FOUND student not in database
+ *
+ *  console:  Does not produce any console I/O
+ */
+int db_update(int fd, const student_t *s, size_t off, size_t len)
+{
+    student_t old, rec;
+    int rc;
+
+    if (s->id < MIN_STD_ID || !dbmap_may_exist(fd, s->id))
+        return SRCH_NOT_FOUND;
+    if ((rc = wal_begin(fd)) != NO_ERROR)
+        return rc;
+    if (s->id > MAX_STD_ID)
+    {
+        if ((rc = dbmap_update(fd, s, off, len, &old)) == NO_ERROR)
+        {
+            rec = old;
+            memcpy((char *)&rec + off, (const char *)s + off, len);
+            if ((rc = db_indexes_remove(fd, &old)) == NO_ERROR)
+                rc = db_indexes_insert(fd, &rec);
+        }
+        wal_end(fd);
+        return rc;
+    }
+
+    int id = (int)s->id;
+    if ((rc = dbio_lock_records(fd, id, 1)) != NO_ERROR)
+    {
+        wal_end(fd);
+        return rc;
+    }
+
+    if (!dbio_live(fd, id))
+        rc = SRCH_NOT_FOUND;
+    else if (dbio_read_range(fd, id, 1, &old) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    else
+    {
+        rec = old;
+        memcpy((char *)&rec + off, (const char *)s + off, len);
+        if ((rc = wal_log(fd, WAL_OP_ADD, id, &rec)) == NO_ERROR &&
+            (rc = dbio_write_field(fd, id, &rec, off, len)) == NO_ERROR &&
+            (rc = db_indexes_remove(fd, &old)) == NO_ERROR)
+            rc = db_indexes_insert(fd, &rec);
+    }
+
+    if (dbio_unlock_records(fd, id, 1) != NO_ERROR && rc == NO_ERROR)
+        rc = ERR_DB_FILE;
+    wal_end(fd);
+    return rc;
+}
+
 /*
  *  count_db_records
  *      fd:     linux file descriptor
  *
- *  Counts the number of records in the database.  Start by reading the
- *  database at the beginning, and continue reading individual records
- *  until you it EOF.  EOF is when the read() syscall returns 0. Check
- *  if a slot is empty or previously deleted by investigating if all of
- *  the bytes in the record read are zeros - I would suggest using memory
- *  compare memcmp() for this. Create a counter variable and initialize it
- *  to zero, every time a non-zero record is read increment the counter.
+ *  Counts the number of records in the database.  The file header keeps
+ *  a live record counter that every add and delete updates, so the count
+ *  is read straight from there instead of scanning the records.
  *
  *  returns:  <number>       returns the number of records in db on success
  *            ERR_DB_FILE    database file I/O issue
@@ -250,238 +604,945 @@ int del_student(int fd, int id)
  */
 int count_db_records(int fd)
 {
-    if (lseek(fd, 0, SEEK_SET) == -1)
+    int record_count = dbio_count(fd);
+
+    if (record_count < 0)
     {
         printf(M_ERR_DB_READ);
         return ERR_DB_FILE;
     }
 
-    int record_count = 0;
-    student_t temp;
-    ssize_t bytesReturned;
+    if (record_count == 0)
+    {
+        printf(M_DB_EMPTY);
+    }
+    else
+    {
+        printf(M_DB_RECORD_CNT, record_count);
+    }
 
-    while ((bytesReturned = read(fd, &temp, STUDENT_RECORD_SIZE)) > 0)
+    return record_count;
+}
+
+/*
+ *  print_db
+ *      fd:     linux file descriptor
+ *      mode:   FMT_TABLE for the table below, FMT_CSV, FMT_JSONL or
+ *              FMT_RAW for the formats of dbfmt.h
+ *
+ *  Prints all records in the database in id order.  The file is scanned by
+ *  the parallel scan driver of dbpscan.h, which skips the holes and empty
+ *  slots.  Every worker renders its range into a memory formatter (see
+ *  dbfmt.h), the ranges are then appended to stdout in file order, so the
+ *  output does not depend on the number of threads.  In table mode the
+ *  header is printed before the first row:
+ *
+ *     STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA"
+ *
+ *  and each record as STUDENT_PRINT_FMT_STRING with the gpa divided by
+ *  100.0.  M_DB_EMPTY is only printed in table mode, the other modes print
+ *  nothing but the records.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *
+ *  console:  <see above>      on success, print table or database empty
+ *            M_ERR_DB_READ    error reading or seeking the database file
+ *
+ */
+typedef struct print_state
+{
+    dbfmt_t out;
+    int record_found;
+} print_state_t;
+
+// the rows of one range of the file
+typedef struct print_part
+{
+    dbfmt_t rows;
+    int record_found;
+} print_part_t;
+
+static int print_record(const student_t *student, void *arg)
+{
+    print_part_t *part = arg;
+
+    part->record_found = 1;
+    dbfmt_row(&part->rows, student);
+    return 0;
+}
+
+static void print_reset(void *p, void *arg)
+{
+    print_part_t *part = p;
+    print_state_t *ps = arg;
+
+    if (part->rows.buf == NULL && dbfmt_open(&part->rows, ps->out.mode, -1) != NO_ERROR)
+        part->rows.err = 1;
+    part->rows.len = 0;
+    part->record_found = 0;
+}
+
+static int print_merge(void *p, void *arg)
+{
+    print_part_t *part = p;
+    print_state_t *ps = arg;
+
+    if (part->rows.err)
+        return ERR_DB_FILE;
+    if (!part->record_found)
+        return NO_ERROR;
+    if (!ps->record_found && ps->out.mode == FMT_TABLE)
+        dbfmt_header(&ps->out);
+    ps->record_found = 1;
+    dbfmt_append(&ps->out, &part->rows);
+    return NO_ERROR;
+}
+
+static void print_release(void *p)
+{
+    print_part_t *part = p;
+
+    free(part->rows.buf);
+}
+
+int print_db(int fd, int mode)
+{
+    print_state_t ps = {0};
+    dbpscan_job_t job = {
+        .row = print_record,
+        .merge = print_merge,
+        .reset = print_reset,
+        .release = print_release,
+        .part_size = sizeof(print_part_t),
+        .arg = &ps,
+    };
+    int rc;
+
+    if (dbfmt_open(&ps.out, mode, STDOUT_FILENO) != NO_ERROR)
     {
-        if (memcmp(&temp, &EMPTY_STUDENT_RECORD, STUDENT_RECORD_SIZE) == 0)
-        {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    if (mode == FMT_CSV)
+        dbfmt_header(&ps.out);
+
+    rc = dbpscan_run(fd, &job);
+    if (dbfmt_close(&ps.out) != NO_ERROR && rc == NO_ERROR)
+        rc = ERR_DB_FILE;
+    if (rc != NO_ERROR)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    if (!ps.record_found && mode == FMT_TABLE)
+    {
+        printf(M_DB_EMPTY);
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  print_matches
+ *      fd:     linux file descriptor
+ *      *ids:   candidate ids from an index, sorted
+ *      count:  number of candidates
+ *      min:    lowest gpa to print
+ *      max:    highest gpa to print
+ *      lname:  last name the students must have, NULL for any
+ *
+ *  Fetches all candidates with a single get_students() call and prints the
+ *  ones that still exist, are inside the gpa range and have the last name,
+ *  in the table format of print_db().  The last name check drops the hash
+ *  collisions of the name index.  The table header is only printed if
+ *  there is a row.
+ *
+ *  returns:  <number>       number of students printed
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  <table>        the matching students
+ *            M_ERR_DB_READ  error reading the database
+ */
+static int print_matches(int fd, const long long *ids, int count, int min, int max,
+                         const char *lname)
+{
+    student_t *students = malloc(sizeof(student_t) * (count ? count : 1));
+    int *rcs = malloc(sizeof(int) * (count ? count : 1));
+    int found = 0;
+
+    if (students == NULL || rcs == NULL ||
+        get_students(fd, count, ids, students, rcs) != NO_ERROR)
+    {
+        free(students);
+        free(rcs);
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        student_t *student = &students[i];
+        if (rcs[i] != NO_ERROR || student->gpa < min || student->gpa > max)
+            continue;
+        if (lname != NULL && strncmp(student->lname, lname, sizeof(student->lname)) != 0)
             continue;
+        if (found++ == 0)
+            printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+
+        float calculated_gpa = student->gpa / 100.0;
+        printf(STUDENT_PRINT_FMT_STRING, student->id, student->fname, student->lname, calculated_gpa);
+    }
+
+    free(students);
+    free(rcs);
+    return found;
+}
+
+/*
+ *  find_students
+ *      fd:     linux file descriptor
+ *      count:  number of ids
+ *      *ids[]: the student ids as given on the command line
+ *
+ *  The -f option with more than one id.  All students are fetched with one
+ *  get_students() call and the ones that exist are printed in a single
+ *  table, in the order they were asked for.
+ *
+ *  returns:  NO_ERROR       every student was found
+ *            SRCH_NOT_FOUND at least one student was not found
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  <table>            the students that were found
+ *            M_STD_NOT_FND_MSG  once for every student that was not found
+ *            M_ERR_DB_READ      error reading the database
+ */
+int find_students(int fd, int count, char *ids[])
+{
+    long long *id = calloc(count, sizeof(long long));
+    student_t *students = malloc(sizeof(student_t) * count);
+    int *rcs = malloc(sizeof(int) * count);
+    int rc = NO_ERROR;
+
+    if (id == NULL || students == NULL || rcs == NULL)
+        rc = ERR_DB_FILE;
+    for (int i = 0; rc == NO_ERROR && i < count; i++)
+        id[i] = atoll(ids[i]);
+    if (rc == NO_ERROR && get_students(fd, count, id, students, rcs) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    for (int i = 0; rc == NO_ERROR && i < count; i++)
+        if (rcs[i] != NO_ERROR && rcs[i] != SRCH_NOT_FOUND)
+            rc = ERR_DB_FILE;
+
+    if (rc == NO_ERROR)
+    {
+        bool header = false;
+        for (int i = 0; i < count; i++)
+        {
+            if (rcs[i] != NO_ERROR)
+                continue;
+            if (!header)
+                printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+            header = true;
+
+            float calculated_gpa = students[i].gpa / 100.0;
+            printf(STUDENT_PRINT_FMT_STRING, students[i].id, students[i].fname,
+                   students[i].lname, calculated_gpa);
         }
-        record_count++;
+        for (int i = 0; i < count; i++)
+            if (rcs[i] == SRCH_NOT_FOUND)
+            {
+                printf(M_STD_NOT_FND_MSG, id[i]);
+                rc = SRCH_NOT_FOUND;
+            }
     }
+    else
+        printf(M_ERR_DB_READ);
+
+    free(id);
+    free(students);
+    free(rcs);
+    return rc;
+}
 
-    if (bytesReturned == -1)
+/*
+ *  search_db_lname
+ *      fd:     linux file descriptor
+ *      lname:  last name to look for, must match exactly
+ *
+ *  Prints all students with the given last name, in id order, using the
+ *  same table format as print_db().  The candidates come from the last
+ *  name index (see nameidx.h) and are read in one batch, the few that only
+ *  share the hash of lname are dropped then.
+ *
+ *  returns:  <number>       number of students found
+ *            ERR_DB_FILE    database or index file I/O issue
+ *
+ *  console:  <table>            on success, the matching students
+ *            M_STD_NAME_NOT_FND if nobody has that last name
+ *            M_ERR_DB_READ      error reading the database or the index
+ *
+ */
+int search_db_lname(int fd, char *lname)
+{
+    long long *ids;
+    int n = nameidx_lookup(fd, lname, &ids);
+
+    if (n < 0)
     {
         printf(M_ERR_DB_READ);
         return ERR_DB_FILE;
     }
 
-    if (record_count == 0)
+    int found = print_matches(fd, ids, n, MIN_STD_GPA, MAX_STD_GPA, lname);
+    free(ids);
+    if (found < 0)
+        return found;
+
+    if (found == 0)
+        printf(M_STD_NAME_NOT_FND, lname);
+    return found;
+}
+
+/*
+ *  search_db_prefix
+ *      fd:       linux file descriptor
+ *      pattern:  start of a first or last name, a trailing '*' is ignored;
+ *                with dist >= 0 a whole name instead
+ *      dist:     -1 for a prefix search, otherwise the largest edit
+ *                distance between pattern and a matching name
+ *
+ *  Prints all students whose first or last name starts with pattern (or
+ *  is within dist edits of it), in id order, using the same table format
+ *  as print_db().  Case is ignored.  The candidates come from the trie
+ *  index (see trieidx.h), so only the records of matching students are
+ *  read.
+ *
+ *  returns:  <number>       number of students found
+ *            ERR_DB_FILE    database or index file I/O issue
+ *
+ *  console:  <table>               on success, the matching students
+ *            M_STD_PREFIX_NOT_FND  if no name matches
+ *            M_ERR_DB_READ         error reading the database or the index
+ *
+ */
+int search_db_prefix(int fd, char *pattern, int dist)
+{
+    char prefix[64];
+    long long *ids;
+    int n;
+
+    snprintf(prefix, sizeof(prefix), "%s", pattern);
+    if (dist < 0)
     {
-        printf(M_DB_EMPTY);
+        size_t len = strlen(prefix);
+        if (len > 0 && prefix[len - 1] == '*')
+            prefix[len - 1] = '\0';
+        n = trieidx_prefix(fd, prefix, &ids);
     }
     else
+        n = trieidx_fuzzy(fd, prefix, dist, &ids);
+
+    if (n < 0)
     {
-        printf(M_DB_RECORD_CNT, record_count);
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
     }
 
-    return record_count;
+    int found = print_matches(fd, ids, n, MIN_STD_GPA, MAX_STD_GPA, NULL);
+    free(ids);
+    if (found < 0)
+        return found;
+
+    if (found == 0)
+        printf(M_STD_PREFIX_NOT_FND, pattern);
+    return found;
 }
 
 /*
- *  print_db
- *      fd:     linux file descriptor
+ *  search_db_gpa
+ *      fd:   linux file descriptor
+ *      min:  lowest gpa to list (as 3 digit int)
+ *      max:  highest gpa to list (as 3 digit int)
+ *
+ *  Prints all students with min <= gpa <= max, in id order, using the same
+ *  table format as print_db().  The ids come from the gpa index (see
+ *  gpaidx.h), so only the records of matching students are read.
+ *
+ *  returns:  <number>       number of students found
+ *            ERR_DB_FILE    database or index file I/O issue
+ *
+ *  console:  <table>            on success, the matching students
+ *            M_STD_GPA_NOT_FND  if nobody is in the range
+ *            M_ERR_DB_READ      error reading the database or the index
+ *
+ */
+int search_db_gpa(int fd, int min, int max)
+{
+    long long *ids;
+    int n = gpaidx_range(fd, min, max, &ids);
+
+    if (n < 0)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    int found = print_matches(fd, ids, n, min, max, NULL);
+    free(ids);
+    if (found < 0)
+        return found;
+
+    if (found == 0)
+        printf(M_STD_GPA_NOT_FND, min / 100.0, max / 100.0);
+    return found;
+}
+
+/*
+ *  print_gpa_stats
+ *      fd:  linux file descriptor
  *
- *  Prints all records in the database.  Start by reading the
- *  database at the beginning, and continue reading individual records
- *  until you it EOF.  EOF is when the read() syscall returns 0. Check
- *  if a slot is empty or previously deleted by investigating if all of
- *  the bytes in the record read are zeros - I would suggest using memory
- *  compare memcmp() for this. Be careful as the database might be empty.
- *  on the first real row encountered print the header for the required output:
+ *  Prints the number of students, the lowest, highest and average gpa and
+ *  a histogram with one row per GPAIDX_HIST_BAND wide band of gpa values.
+ *  Everything is computed from the per value counts in the header of the
+ *  gpa index, no record is read.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    index file I/O issue
+ *
+ *  console:  M_GPA_STATS and the histogram on success
+ *            M_DB_EMPTY     if there are no students
+ *            M_ERR_DB_READ  error reading the index
+ *
+ */
+int print_gpa_stats(int fd)
+{
+    uint32_t counts[GPAIDX_VALUES];
+    int min = -1, max = -1;
+    long long sum = 0;
+    int n = gpaidx_counts(fd, counts);
+
+    if (n < 0)
+    {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    if (n == 0)
+    {
+        printf(M_DB_EMPTY);
+        return NO_ERROR;
+    }
+
+    for (int key = 0; key < GPAIDX_VALUES; key++)
+    {
+        if (counts[key] == 0)
+            continue;
+        if (min < 0)
+            min = key + MIN_STD_GPA;
+        max = key + MIN_STD_GPA;
+        sum += (long long)counts[key] * (key + MIN_STD_GPA);
+    }
+    printf(M_GPA_STATS, n, min / 100.0, max / 100.0, sum / 100.0 / n);
+
+    // the top value (5.00) goes into the last band
+    printf(GPA_HIST_HDR_STRING, "GPA", "STUDENTS");
+    for (int lo = MIN_STD_GPA; lo + GPAIDX_HIST_BAND <= MAX_STD_GPA; lo += GPAIDX_HIST_BAND)
+    {
+        int hi = lo + GPAIDX_HIST_BAND - 1;
+        int band = 0;
+
+        if (hi + GPAIDX_HIST_BAND > MAX_STD_GPA)
+            hi = MAX_STD_GPA;
+        for (int gpa = lo; gpa <= hi; gpa++)
+            band += counts[gpa - MIN_STD_GPA];
+        printf(GPA_HIST_FMT_STRING, lo / 100.0, hi / 100.0, band);
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  print_student
+ *      *s:   a pointer to a student_t structure that should
+ *            contain a valid student to be printed
+ *
+ *  Start by ensuring that provided student pointer is valid.  To do this
+ *  make sure it is not NULL and that s->id is not zero.  After ensuring
+ *  that the student is valid, print it the exact way that is described
+ *  in the print_db() function by first printing the header then the
+ *  student data:
  *
  *     printf(STUDENT_PRINT_HDR_STRING, "ID",
  *                  "FIRST NAME", "LAST_NAME", "GPA");
  *
- *  then for each valid record encountered print the required output:
+ *     printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname,
+ *                    student.lname, calculated_gpa_from_s);
+ *
+ *  Dont forget that  the GPA in the student structure is an int, to convert
+ *  it into a real gpa divide by 100.0 and store in a float variable.
  *
- *     printf(STUDENT_PRINT_FMT_STRING, student.id, student.fname,
- *                    student.lname, calculated_gpa_from_student);
+ *  returns:  nothing, this is a void function
  *
- *  The code above assumes you are reading student records into a local
- *  variable named student that is of type student_t. Also dont forget that
- *  the GPA in the student structure is an int, to convert it into a real
- *  gpa divide by 100.0 and store in a float variable.
  *
- *  returns:  NO_ERROR       on success
+ *  console:  <see above>      on success, print table or database empty
+ *            M_ERR_STD_PRINT  if the function argument s is NULL or if
+ *                             s->id is zero
+ *
+ */
+void print_student(student_t *s)
+{
+    if (s == NULL || s->id == 0)
+    {
+        printf(M_ERR_STD_PRINT);
+        return;
+    }
+    printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+    float calculated_gpa = s->gpa / 100.0;
+    printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname, s->lname, calculated_gpa);
+}
+
+/*
+ *  NOTE IMPLEMENTING THIS FUNCTION IS EXTRA CREDIT
+ *
+ *  compress_db
+ *      fd:     linux file descriptor
+ *
+ *  This assignment takes advantage of the way Linux handles sparse files
+ *  on disk. Thus if there is a large hole between student records, Linux
+ *  will not use any physical storage.  However, when a database record is
+ *  deleted storage is used to write a blank - see EMPTY_STUDENT_RECORD from
+ *  db.h - record.
+ *
+ *  The original design rewrote every valid record into TMP_DB_FILE and
+ *  renamed it over DB_FILE, which costs I/O proportional to the whole
+ *  database.  Because every record lives at id * STUDENT_RECORD_SIZE, no
+ *  record ever has to move.  Linux does provide a way to delete data in the
+ *  middle of a file: fallocate(FALLOC_FL_PUNCH_HOLE).  So the database is
+ *  compressed in place by turning every 4K page that only contains deleted
+ *  records back into a hole, see dbio_punch_empty_pages().  Only allocated
+ *  pages are examined and the file size does not change.
+ *
+ *  Since nothing is renamed the fd passed in stays valid and is returned
+ *  to the caller, which keeps the contract of the rewrite based design.
+ *
+ *  returns:  <number>       returns the fd of the compressed database file
  *            ERR_DB_FILE    database file I/O issue
  *
  *
- *  console:  <see above>      on success, print table or database empty
- *            M_ERR_DB_READ    error reading or seeking the database file
+ *  console:  M_DB_COMPRESSED_OK  on success, the db was successfully compressed.
+ *            M_DB_RECLAIMED      on success, how much storage was given back
+ *            M_ERR_DB_WRITE      error reading the db or punching holes in it
+ *
+ */
+int compress_db(int fd)
+{
+    off_t reclaimed;
+
+    if (dbio_punch_empty_pages(fd, &reclaimed) != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    printf(M_DB_COMPRESSED_OK);
+    printf(M_DB_RECLAIMED, (long long)reclaimed);
+    return fd;
+}
+
+/*
+ *  snapshot_db
+ *      fd:     linux file descriptor
+ *      *dest:  path of the snapshot, overwritten if it exists
+ *
+ *  Writes a point in time copy of the database to dest while other
+ *  processes keep using it.  Adds and deletes are held off for as long as
+ *  the copy takes (see dbsnap.h), which is a reflink clone where the file
+ *  system supports it and a copy of the live extents elsewhere.  The id
+ *  map directory is copied along under the same locks.  An old log or old
+ *  indexes next to dest would not match the snapshot, they are removed and
+ *  rebuilt the first time the snapshot is opened.
+ *
+ *  returns:  NO_ERROR       snapshot written
+ *            ERR_DB_ARGS    dest is the database itself
+ *            ERR_DB_FILE    database or snapshot file I/O issue
+ *
+ *  console:  M_DB_SNAP_OK       on success, the number of students copied
+ *            M_DB_SNAP_CLONED   on success, the file system cloned the file
+ *            M_DB_SNAP_COPIED   on success, how much data had to be copied
+ *            M_ERR_SNAP_SELF    dest is the database file
+ *            M_ERR_SNAP_WRITE   error creating or writing the snapshot
+ */
+int snapshot_db(int fd, char *dest)
+{
+    char path[4096];
+    struct stat st, dst_st;
+    off_t copied, dir_copied;
+    int count = 0, method;
+
+    int dst = open(dest, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (dst == -1)
+    {
+        printf(M_ERR_SNAP_WRITE);
+        return ERR_DB_FILE;
+    }
+    if (fstat(fd, &st) == -1 || fstat(dst, &dst_st) == -1)
+    {
+        close(dst);
+        printf(M_ERR_SNAP_WRITE);
+        return ERR_DB_FILE;
+    }
+    if (st.st_dev == dst_st.st_dev && st.st_ino == dst_st.st_ino)
+    {
+        close(dst);
+        printf(M_ERR_SNAP_SELF);
+        return ERR_DB_ARGS;
+    }
+
+    snprintf(path, sizeof(path), "%s%s", dest, DBMAP_SUFFIX);
+    int dir_dst = open(path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (dir_dst == -1 || ftruncate(dst, 0) == -1)
+    {
+        if (dir_dst != -1)
+            close(dir_dst);
+        close(dst);
+        printf(M_ERR_SNAP_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    // hold off the writers, the slots first and then the id map, ext id
+    // writers never wait for a slot lock while they hold the directory
+    method = dbio_freeze(fd);
+    if (method == NO_ERROR)
+    {
+        int xfd = dbmap_freeze(fd);
+        count = dbio_count(fd);
+        method = dbsnap_copy(fd, dst, &copied);
+        if (method > 0 && (xfd < 0 || dbsnap_copy(xfd, dir_dst, &dir_copied) < 0))
+            method = ERR_DB_FILE;
+        dbmap_thaw(fd);
+        dbio_thaw(fd);
+    }
+    close(dir_dst);
+    close(dst);
+
+    snprintf(path, sizeof(path), "%s%s", dest, WAL_SUFFIX);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s%s", dest, NAMEIDX_SUFFIX);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s%s", dest, GPAIDX_SUFFIX);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s%s", dest, TRIEIDX_SUFFIX);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s%s", dest, DBBLOOM_SUFFIX);
+    unlink(path);
+
+    if (method < 0)
+    {
+        printf(M_ERR_SNAP_WRITE);
+        return ERR_DB_FILE;
+    }
+    printf(M_DB_SNAP_OK, count, dest);
+    if (method == DBSNAP_CLONE)
+        printf(M_DB_SNAP_CLONED);
+    else
+        printf(M_DB_SNAP_COPIED, (long long)copied);
+    return NO_ERROR;
+}
+
+/*
+ *  validate_range
+ *      id:  proposed student id
+ *      gpa: proposed gpa
+ *
+ *  This function validates that the id and gpa are in the allowable ranges
+ *  as per the specifications.  It checks if the values are within the
+ *  inclusive range using constents in db.h
+ *
+ *  returns:    NO_ERROR       on success, both ID and GPA are in range
+ *              EXIT_FAIL_ARGS if either ID or GPA is out of range
+ *
+ *  console:  This function does not produce any output
+ *
+ */
+int validate_range(long long id, int gpa)
+{
+
+    if ((id < MIN_STD_ID) || (id > MAX_STD_ID_64))
+        return EXIT_FAIL_ARGS;
+
+    if ((gpa < MIN_STD_GPA) || (gpa > MAX_STD_GPA))
+        return EXIT_FAIL_ARGS;
+
+    return NO_ERROR;
+}
+
+/*
+ *  validate_names
+ *      fname:  proposed first name, NULL to leave it unchecked
+ *      lname:  proposed last name, NULL to leave it unchecked
+ *
+ *  Checks that the names fit the record with their terminating zero.  A
+ *  name that does not fit is refused rather than cut, so every way in
+ *  (-a, -u, -b, -T and -C) stores exactly what it was given or nothing.
+ *
+ *  returns:    NO_ERROR       both names fit
+ *              EXIT_FAIL_ARGS if either is too long
+ *
+ *  console:  This function does not produce any output
+ */
+int validate_names(const char *fname, const char *lname)
+{
+    if (fname != NULL && strlen(fname) > STD_FNAME_MAX)
+        return EXIT_FAIL_ARGS;
+    if (lname != NULL && strlen(lname) > STD_LNAME_MAX)
+        return EXIT_FAIL_ARGS;
+    return NO_ERROR;
+}
+
+/*
+ *  pack_db
+ *      fd:     linux file descriptor
+ *      *dest:  path of the packed file, overwritten if it exists
+ *
+ *  Writes the students to dest in the compact format of dbpack.h.  Adds
+ *  and deletes are held off while the table is read, like for
+ *  snapshot_db().
+ *
+ *  returns:  NO_ERROR       packed file written
+ *            ERR_DB_ARGS    dest is the database itself
+ *            ERR_DB_FILE    database or packed file I/O issue
  *
+ *  console:  M_DB_PACK_OK       on success, the size of the packed file
+ *            M_ERR_SNAP_SELF    dest is the database file
+ *            M_ERR_PACK_WRITE   error creating or writing the packed file
  */
-int print_db(int fd)
+int pack_db(int fd, char *dest)
 {
-    if (lseek(fd, 0, SEEK_SET) == -1)
+    struct stat st, dst_st;
+    dbpack_hdr_t hdr;
+    int rc;
+
+    int out = open(dest, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (out == -1 || fstat(fd, &st) == -1 || fstat(out, &dst_st) == -1)
     {
-        printf(M_ERR_DB_READ);
+        if (out != -1)
+            close(out);
+        printf(M_ERR_PACK_WRITE);
         return ERR_DB_FILE;
     }
-
-    student_t student;
-    ssize_t bytesReturned;
-    int record_found = 0;
-
-    while ((bytesReturned = read(fd, &student, sizeof(student_t))) > 0)
+    if (st.st_dev == dst_st.st_dev && st.st_ino == dst_st.st_ino)
     {
-        if (student.id == 0)
-        {
-            continue;
-        }
-
-        if (!record_found)
-        {
-            printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
-            record_found = 1;
-        }
+        close(out);
+        printf(M_ERR_SNAP_SELF);
+        return ERR_DB_ARGS;
+    }
 
-        float calculated_gpa = student.gpa / 100.0;
-        printf(STUDENT_PRINT_FMT_STRING, student.id, student.fname, student.lname, calculated_gpa);
+    rc = ftruncate(out, 0) == -1 ? ERR_DB_FILE : dbio_freeze(fd);
+    if (rc == NO_ERROR)
+    {
+        rc = dbmap_freeze(fd) < 0 ? ERR_DB_FILE : dbpack_write(fd, out, &hdr);
+        dbmap_thaw(fd);
+        dbio_thaw(fd);
     }
+    if (rc == NO_ERROR && fstat(out, &dst_st) == -1)
+        rc = ERR_DB_FILE;
+    close(out);
 
-    if (bytesReturned == -1)
+    if (rc != NO_ERROR)
     {
-        printf(M_ERR_DB_READ);
+        printf(M_ERR_PACK_WRITE);
         return ERR_DB_FILE;
     }
-    if (!record_found)
+    printf(M_DB_PACK_OK, (unsigned long long)hdr.records, (unsigned long long)dst_st.st_size,
+           (unsigned long long)hdr.records * STUDENT_RECORD_SIZE);
+    return NO_ERROR;
+}
+
+// dbpack_scan() callback of unpack_db()
+typedef struct unpack_state
+{
+    int fd;
+    int added;
+    int existed;
+    bool db_failed; // the scan stopped because db_insert() failed
+} unpack_state_t;
+
+static int unpack_record(const student_t *s, void *arg)
+{
+    unpack_state_t *us = arg;
+    int rc = db_insert(us->fd, s);
+
+    if (rc == ERR_DB_OP)
+        us->existed++;
+    else if (rc == NO_ERROR)
+        us->added++;
+    else
     {
-        printf(M_DB_EMPTY);
+        us->db_failed = true;
+        return rc;
     }
-
-    return NO_ERROR;
+    return 0;
 }
 
 /*
- *  print_student
- *      *s:   a pointer to a student_t structure that should
- *            contain a valid student to be printed
- *
- *  Start by ensuring that provided student pointer is valid.  To do this
- *  make sure it is not NULL and that s->id is not zero.  After ensuring
- *  that the student is valid, print it the exact way that is described
- *  in the print_db() function by first printing the header then the
- *  student data:
- *
- *     printf(STUDENT_PRINT_HDR_STRING, "ID",
- *                  "FIRST NAME", "LAST_NAME", "GPA");
- *
- *     printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname,
- *                    student.lname, calculated_gpa_from_s);
- *
- *  Dont forget that  the GPA in the student structure is an int, to convert
- *  it into a real gpa divide by 100.0 and store in a float variable.
- *
- *  returns:  nothing, this is a void function
+ *  unpack_db
+ *      fd:    linux file descriptor
+ *      *src:  path of a packed file
  *
+ *  Adds every student of the packed file to the database, in the fixed
+ *  format.  Students whose id is already taken are left as they are.
  *
- *  console:  <see above>      on success, print table or database empty
- *            M_ERR_STD_PRINT  if the function argument s is NULL or if
- *                             s->id is zero
+ *  returns:  NO_ERROR       every student was added or already there
+ *            ERR_DB_FILE    database or packed file I/O issue
  *
+ *  console:  M_DB_UNPACK_OK     on success, how many students were added
+ *            M_ERR_PACK_READ    src is not a readable packed file
+ *            M_ERR_DB_WRITE     error writing the database
  */
-void print_student(student_t *s)
+int unpack_db(int fd, char *src)
 {
-    if (s == NULL || s->id == 0)
+    unpack_state_t us = {.fd = fd};
+    dbpack_t *p = dbpack_open(src);
+    int rc;
+
+    if (p == NULL)
     {
-        printf(M_ERR_STD_PRINT);
-        return;
+        printf(M_ERR_PACK_READ);
+        return ERR_DB_FILE;
     }
-    printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
-    float calculated_gpa = s->gpa / 100.0;
-    printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname, s->lname, calculated_gpa);
+    rc = dbpack_scan(p, unpack_record, &us);
+    dbpack_close(p);
+
+    if (rc != NO_ERROR)
+    {
+        printf(us.db_failed ? M_ERR_DB_WRITE : M_ERR_PACK_READ);
+        return ERR_DB_FILE;
+    }
+    printf(M_DB_UNPACK_OK, us.added, us.existed);
+    return NO_ERROR;
+}
+
+// dbpack_scan() callback of query_packed(), the rows of -p
+static int packed_row(const student_t *s, void *arg)
+{
+    print_state_t *ps = arg;
+
+    if (!ps->record_found && ps->out.mode == FMT_TABLE)
+        dbfmt_header(&ps->out);
+    ps->record_found = 1;
+    dbfmt_row(&ps->out, s);
+    return 0;
 }
 
 /*
- *  NOTE IMPLEMENTING THIS FUNCTION IS EXTRA CREDIT
- *
- *  compress_db
- *      fd:     linux file descriptor
- *
- *  This assignment takes advantage of the way Linux handles sparse files
- *  on disk. Thus if there is a large hole between student records, Linux
- *  will not use any physical storage.  However, when a database record is
- *  deleted storage is used to write a blank - see EMPTY_STUDENT_RECORD from
- *  db.h - record.
- *
- *  Since Linux provides no way to delete data in the middle of a file, and
- *  deleted records take up physical storage, this function will compress the
- *  database by rewriting a new database file that only includes valid student
- *  records. There are a number of ways to do this, but since this is extra credit
- *  you need to figure this out on your own.
- *
- *  At a high level create a temporary database file then copy all valid students from
- *  the active database (passed in via fd) to the temporary file. When this is done
- *  rename the temporary database file to the name of the real database file. See
- *  the constants in db.h for required file names:
- *
- *         #define DB_FILE     "student.db"        //name of database file
- *         #define TMP_DB_FILE ".tmp_student.db"   //for extra credit
+ *  query_packed
+ *      argc:    number of arguments behind -packed
+ *      *argv[]: the packed file, then -f id [id ...] or -p [format]
  *
- *  Note that you are passed in the fd of the database file to be compressed,
- *  it is very likely you will need to close it to overwrite it with the
- *  compressed version of the file.  To ensure the caller can work with the
- *  compressed file after you create it, it is a good design to return the fd
- *  of the new compressed file from this function
+ *  Answers -f and -p straight from a packed file, the database is not
+ *  opened at all.  The output is the same as for the database the file
+ *  was packed from.
  *
- *  returns:  <number>       returns the fd of the compressed database file
- *            ERR_DB_FILE    database file I/O issue
- *
- *
- *  console:  M_DB_COMPRESSED_OK  on success, the db was successfully compressed.
- *            M_ERR_DB_OPEN    error when opening/creating temporary database file.
- *                             this error should also be returned after you
- *                             compressed the database file and if you are unable
- *                             to open it to pass the fd back to the caller
- *            M_ERR_DB_CREATE  error creating the db file. For instance the
- *                             inability to copy the temporary file back as
- *                             the primary database file.
- *            M_ERR_DB_READ    error reading or seeking the the db or tempdb file
- *            M_ERR_DB_WRITE   error writing to db or tempdb file (adding student)
+ *  returns:  EXIT_OK, EXIT_FAIL_DB (a student was not found, or the file
+ *            can not be read) or EXIT_FAIL_ARGS
  *
+ *  console:  <see -f and -p>
+ *            M_ERR_PACK_READ    src is not a readable packed file
  */
-int compress_db(int fd)
+int query_packed(int argc, char *argv[])
 {
-    // TODO
-    printf(M_NOT_IMPL);
-    return fd;
+    bool find = argc >= 3 && strcmp(argv[1], "-f") == 0;
+    int mode = argc >= 2 && argc <= 3 && strcmp(argv[1], "-p") == 0 ? dbfmt_mode(argc == 3 ? argv[2] : NULL) : -1;
+    int exit_code = EXIT_OK;
+    dbpack_t *p;
+
+    if (!find && mode < 0)
+        return EXIT_FAIL_ARGS;
+    if ((p = dbpack_open(argv[0])) == NULL)
+    {
+        printf(M_ERR_PACK_READ);
+        return EXIT_FAIL_DB;
+    }
+
+    if (find)
+    {
+        bool header = false;
+        student_t s;
+
+        for (int i = 2; i < argc; i++)
+        {
+            long long id = atoll(argv[i]);
+            int rc = dbpack_get(p, id, &s);
+
+            if (rc == SRCH_NOT_FOUND)
+            {
+                printf(M_STD_NOT_FND_MSG, id);
+                exit_code = EXIT_FAIL_DB;
+                continue;
+            }
+            if (rc != NO_ERROR)
+            {
+                printf(M_ERR_PACK_READ);
+                exit_code = EXIT_FAIL_DB;
+                break;
+            }
+            if (!header)
+                printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
+            header = true;
+
+            float calculated_gpa = s.gpa / 100.0;
+            printf(STUDENT_PRINT_FMT_STRING, s.id, s.fname, s.lname, calculated_gpa);
+        }
+    }
+    else
+    {
+        print_state_t ps = {0};
+        int rc;
+
+        fflush(stdout);
+        if (dbfmt_open(&ps.out, mode, STDOUT_FILENO) != NO_ERROR)
+            rc = ERR_DB_FILE;
+        else
+        {
+            if (mode == FMT_CSV)
+                dbfmt_header(&ps.out);
+            rc = dbpack_scan(p, packed_row, &ps);
+            if (dbfmt_close(&ps.out) != NO_ERROR && rc == NO_ERROR)
+                rc = ERR_DB_FILE;
+        }
+        if (rc != NO_ERROR)
+        {
+            printf(M_ERR_PACK_READ);
+            exit_code = EXIT_FAIL_DB;
+        }
+        else if (!ps.record_found && mode == FMT_TABLE)
+            printf(M_DB_EMPTY);
+    }
+
+    dbpack_close(p);
+    return exit_code;
 }
 
 /*
- *  validate_range
- *      id:  proposed student id
- *      gpa: proposed gpa
- *
- *  This function validates that the id and gpa are in the allowable ranges
- *  as per the specifications.  It checks if the values are within the
- *  inclusive range using constents in db.h
+ *  print_pool_stats
+ *      fd:  linux file descriptor
  *
- *  returns:    NO_ERROR       on success, both ID and GPA are in range
- *              EXIT_FAIL_ARGS if either ID or GPA is out of range
+ *  Prints the counters of the buffer pool of fd, see dbpool.h
  *
- *  console:  This function does not produce any output
+ *  returns:  nothing, this is a void function
  *
+ *  console:  M_POOL_STATS if fd has a buffer pool, nothing otherwise
  */
-int validate_range(int id, int gpa)
+void print_pool_stats(int fd)
 {
+    dbpool_stats_t st;
 
-    if ((id < MIN_STD_ID) || (id > MAX_STD_ID))
-        return EXIT_FAIL_ARGS;
-
-    if ((gpa < MIN_STD_GPA) || (gpa > MAX_STD_GPA))
-        return EXIT_FAIL_ARGS;
-
-    return NO_ERROR;
+    if (!dbpool_stats(fd, &st))
+        return;
+    printf(M_POOL_STATS, (unsigned long long)st.hits, (unsigned long long)st.misses,
+           (unsigned long long)st.evictions, (unsigned long long)st.invalidations,
+           (unsigned long long)st.pages_written, (unsigned long long)st.writes);
 }
 
 /*
@@ -497,25 +1558,59 @@ int validate_range(int id, int gpa)
  */
 void usage(char *exename)
 {
-    printf("usage: %s -[h|a|c|d|f|p|z] options.  Where:\n", exename);
+    printf("usage: %s [-V] -[h|a|A|b|c|C|d|f|g|p|P|pack|packed|s|S|snap|T|u|unpack|x|z] options.  Where:\n", exename);
+    printf("\t-V:  prints what every operation cost to stderr as JSON (see dbstat.h)\n");
     printf("\t-h:  prints help\n");
+    printf("\t-A:  prints the student count, min/max/avg gpa and a gpa histogram\n");
     printf("\t-a id first_name last_name gpa(as 3 digit int):  adds a student\n");
+    printf("\t-b [file]:  bulk mode, runs one -a/-d/-f operation per line of file (or stdin)\n");
     printf("\t-c:  counts the records in the database\n");
+    printf("\t-C sock -[a|c|d|f|p|V] ...:  runs the operation on the server listening on sock,\n");
+    printf("\t     -V prints what its operations cost so far\n");
     printf("\t-d id:  deletes a student\n");
-    printf("\t-f id:  finds and prints a student in the database\n");
-    printf("\t-p:  prints all records in the student database\n");
+    printf("\t-f id [id ...]:  finds and prints students in the database\n");
+    printf("\t-g min max:  finds and prints all students with min <= gpa <= max (as 3 digit ints)\n");
+    printf("\t-P prefix[*] [dist]:  finds and prints all students with a first or last name\n");
+    printf("\t     starting with prefix, or given dist a name within dist edits (0-%d) of it\n", TRIEIDX_MAX_DIST);
+    printf("\t-p [--csv|--jsonl|--raw]:  prints all records in the student database, as a table\n");
+    printf("\t     or as CSV, JSON lines or the raw 64 byte records\n");
+    printf("\t-pack dest:  writes a compact copy of the database to dest (see dbpack.h)\n");
+    printf("\t-packed src -f id [id ...] | -p [format]:  runs -f or -p on the compact copy src\n");
+    printf("\t-s lname:  finds and prints all students with that last name\n");
+    printf("\t-S sock:  serves the database on the unix domain socket sock\n");
+    printf("\t-snap dest:  writes a consistent copy of the database to dest, writers may go on\n");
+    printf("\t-T script:  runs the -a/-d/-f lines of script (- for stdin) as one transaction,\n");
+    printf("\t     either all of its adds and deletes happen or none does\n");
+    printf("\t-u id fname=x|lname=x|gpa=n:  changes one field of a student in place\n");
+    printf("\t-unpack src:  adds the students of the compact copy src to the database\n");
     printf("\t-x:  compress the database file [EXTRA CREDIT]\n");
     printf("\t-z:  zero db file (remove all records)\n");
+    printf("environment:\n");
+    printf("\t%s=mmap:  use the memory mapped storage backend\n", DB_BACKEND_ENV);
+    printf("\t%s=uring:  do record I/O through io_uring (falls back to pread)\n", DB_BACKEND_ENV);
+    printf("\t%s=n:  io_uring queue depth\n", DBURING_DEPTH_ENV);
+    printf("\t%s=n:  threads for full table scans (default: one per CPU)\n", DBPSCAN_THREADS_ENV);
+    printf("\t%s=direct|nocache:  keep full scans out of the page cache (see dbio.h)\n", DBIO_SCAN_IO_ENV);
+    printf("\t%s=n:  KiB of buffer pool for -b and -S (default: %d, 0 for none)\n", DBPOOL_ENV, DBPOOL_DEFAULT_KB);
+    printf("\t%s=1:  same as -V\n", DBSTAT_ENV);
+    printf("\t%s=1:  log changes to a write-ahead log with group commit\n", WAL_ENV);
+    printf("\t%s=n, %s=usec:  group commit batch size and latency budget\n", WAL_BATCH_ENV, WAL_DELAY_ENV);
+    printf("\t%s=1:  migrate an old database even if names must be cut or records dropped\n", DBHDR_MIGRATE_ENV);
 }
 
+// The benchmark driver (bench/sdbbench.c) links everything above with
+// its own main(), see the bench target of the makefile
+#ifndef SDBSC_NO_MAIN
+
 // Welcome to main()
 int main(int argc, char *argv[])
 {
     char opt;      // user selected option
     int fd;        // file descriptor of database files
+    dbstat_mark_t mark; // start of the operation being measured, see dbstat.h
     int rc;        // return code from various operations
     int exit_code; // exit code to shell
-    int id;        // userid from argv[2]
+    long long id;  // userid from argv[2]
     int gpa;       // gpa from argv[5]
 
     // space for a student structure which we will get back from
@@ -523,6 +1618,19 @@ int main(int argc, char *argv[])
     // and print_student().
     student_t student = {0};
 
+    // -V in front of any option turns the instrumentation on, so does
+    // DBSTAT_ENV
+    if (argc >= 2 && strcmp(argv[1], "-V") == 0)
+    {
+        dbstat_enable();
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+    char *stats_env = getenv(DBSTAT_ENV);
+    if (stats_env != NULL && strcmp(stats_env, "1") == 0)
+        dbstat_enable();
+
     // This function must have at least one arg, and the arg must start
     // with a dash
     if ((argc < 2) || (*argv[1] != '-'))
@@ -542,10 +1650,46 @@ int main(int argc, char *argv[])
         exit(EXIT_OK);
     }
 
+    // the thin client talks to a running daemon, it never opens the
+    // database file itself
+    if (opt == 'C')
+    {
+        //    arv[0] arv[1] arv[2] arv[3] ...
+        // prog_name     -C   sock     -f  id
+        //-----------------------------------
+        // example:  prog_name -C /tmp/sdb.sock -f 100
+        if (argc < 4)
+        {
+            usage(argv[0]);
+            exit(EXIT_FAIL_ARGS);
+        }
+        exit_code = client_main(argv[2], argc - 3, argv + 3);
+        if (exit_code == EXIT_FAIL_ARGS)
+            usage(argv[0]);
+        exit(exit_code);
+    }
+
+    // a packed copy is read on its own, without the database
+    if (strcmp(argv[1], "-packed") == 0)
+    {
+        //    arv[0]  arv[1] arv[2] arv[3] ...
+        // prog_name -packed    src     -f  id
+        //------------------------------------
+        // example:  prog_name -packed students.pack -f 100
+        //           prog_name -packed students.pack -p --csv
+        exit_code = argc < 3 ? EXIT_FAIL_ARGS : query_packed(argc - 2, argv + 2);
+        if (exit_code == EXIT_FAIL_ARGS)
+            usage(argv[0]);
+        exit(exit_code);
+    }
+
     // now lets open the file and continue if there is no error
     // note we are not truncating the file using the second
-    // parameter
-    fd = open_db(DB_FILE, false);
+    // parameter.  A script always goes through the write-ahead log, that
+    // is what makes it atomic across crashes
+    dbstat_begin(&mark);
+    fd = open_db(DB_FILE, false, db_open_flags() | (opt == 'T' ? DB_OPEN_WAL : 0));
+    dbstat_end(DBSTAT_OPEN, &mark);
     if (fd < 0)
     {
         exit(EXIT_FAIL_DB);
@@ -572,7 +1716,7 @@ int main(int argc, char *argv[])
 
         // convert id and gpa to ints from argv.  For this assignment assume
         // they are valid numbers
-        id = atoi(argv[2]);
+        id = atoll(argv[2]);
         gpa = atoi(argv[5]);
 
         exit_code = validate_range(id, gpa);
@@ -581,19 +1725,98 @@ int main(int argc, char *argv[])
             printf(M_ERR_STD_RNG);
             break;
         }
+        exit_code = validate_names(argv[3], argv[4]);
+        if (exit_code == EXIT_FAIL_ARGS)
+        {
+            printf(M_ERR_STD_NAME, STD_FNAME_MAX, STD_LNAME_MAX);
+            break;
+        }
 
+        dbstat_begin(&mark);
         rc = add_student(fd, id, argv[3], argv[4], gpa);
+        dbstat_end(DBSTAT_ADD, &mark);
         if (rc < 0)
             exit_code = EXIT_FAIL_DB;
 
         break;
 
+    case 'b':
+        //    arv[0] arv[1] [arv[2]]
+        // prog_name     -b   [file]
+        //---------------------------
+        // example:  prog_name -b ops.txt
+        //           generate_ops | prog_name -b
+        if (argc > 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        else
+        {
+            FILE *in = stdin;
+            if (argc == 3 && strcmp(argv[2], "-") != 0)
+                in = fopen(argv[2], "r");
+            if (in == NULL)
+            {
+                printf(M_ERR_BULK_OPEN);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+
+            dbio_attach_pool(fd, dbpool_budget());
+            rc = bulk_load(fd, in);
+            print_pool_stats(fd);
+            if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            if (in != stdin)
+                fclose(in);
+        }
+        break;
+
+    case 'T':
+        //    arv[0] arv[1]   arv[2]
+        // prog_name     -T   script
+        //---------------------------
+        // example:  prog_name -T etl.txt
+        //           generate_ops | prog_name -T -
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        else
+        {
+            FILE *in = strcmp(argv[2], "-") == 0 ? stdin : fopen(argv[2], "r");
+            if (in == NULL)
+            {
+                printf(M_ERR_BULK_OPEN);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+
+            rc = bulk_script(fd, in);
+            if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            if (in != stdin)
+                fclose(in);
+
+            // the log was only turned on for the script, leave none behind
+            // for writers that do not use it
+            if (rc != ERR_DB_FILE && !(db_open_flags() & DB_OPEN_WAL) && wal_checkpoint(fd) != NO_ERROR)
+                exit_code = EXIT_FAIL_DB;
+        }
+        break;
+
     case 'c':
         //    arv[0] arv[1]
         // prog_name     -c
         //-----------------
         // example:  prog_name -c
+        dbstat_begin(&mark);
         rc = count_db_records(fd);
+        dbstat_end(DBSTAT_COUNT, &mark);
         if (rc < 0)
             exit_code = EXIT_FAIL_DB;
         break;
@@ -609,8 +1832,10 @@ int main(int argc, char *argv[])
             exit_code = EXIT_FAIL_ARGS;
             break;
         }
-        id = atoi(argv[2]);
+        id = atoll(argv[2]);
+        dbstat_begin(&mark);
         rc = del_student(fd, id);
+        dbstat_end(DBSTAT_DEL, &mark);
         if (rc < 0)
             exit_code = EXIT_FAIL_DB;
 
@@ -621,14 +1846,26 @@ int main(int argc, char *argv[])
         // prog_name     -f      id
         //-------------------------
         // example:  prog_name -f 100
-        if (argc != 3)
+        //           prog_name -f 100 200 300   (one table for all ids)
+        if (argc < 3)
         {
             usage(argv[0]);
             exit_code = EXIT_FAIL_ARGS;
             break;
         }
-        id = atoi(argv[2]);
+        if (argc > 3)
+        {
+            dbstat_begin(&mark);
+            rc = find_students(fd, argc - 2, argv + 2);
+            dbstat_end(DBSTAT_GET, &mark);
+            if (rc != NO_ERROR)
+                exit_code = EXIT_FAIL_DB;
+            break;
+        }
+        id = atoll(argv[2]);
+        dbstat_begin(&mark);
         rc = get_student(fd, id, &student);
+        dbstat_end(DBSTAT_GET, &mark);
 
         switch (rc)
         {
@@ -647,11 +1884,199 @@ int main(int argc, char *argv[])
         break;
 
     case 'p':
-        //    arv[0] arv[1]
-        // prog_name     -p
-        //-----------------
+        //    arv[0] arv[1] arv[2]
+        // prog_name  -pack   dest
+        //-------------------------
+        // example:  prog_name -pack students.pack
+        if (strcmp(argv[1], "-pack") == 0)
+        {
+            if (argc != 3)
+            {
+                usage(argv[0]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = pack_db(fd, argv[2]);
+            if (rc == ERR_DB_ARGS)
+                exit_code = EXIT_FAIL_ARGS;
+            else if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+        }
+
+        //    arv[0] arv[1]  [arv[2]]
+        // prog_name     -p  [format]
+        //---------------------------
         // example:  prog_name -p
-        rc = print_db(fd);
+        //           prog_name -p --csv
+        rc = dbfmt_mode(argc == 3 ? argv[2] : NULL);
+        if (argc > 3 || rc < 0)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        dbstat_begin(&mark);
+        rc = print_db(fd, rc);
+        dbstat_end(DBSTAT_PRINT, &mark);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 's':
+        //    arv[0] arv[1] arv[2]
+        // prog_name  -snap   dest
+        //-------------------------
+        // example:  prog_name -snap backup.db
+        if (strcmp(argv[1], "-snap") == 0)
+        {
+            if (argc != 3)
+            {
+                usage(argv[0]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = snapshot_db(fd, argv[2]);
+            if (rc == ERR_DB_ARGS)
+                exit_code = EXIT_FAIL_ARGS;
+            else if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+        }
+
+        //    arv[0] arv[1] arv[2]
+        // prog_name     -s  lname
+        //-------------------------
+        // example:  prog_name -s doe
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = search_db_lname(fd, argv[2]);
+        if (rc <= 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'P':
+        //    arv[0] arv[1] arv[2]  arv[3]
+        // prog_name     -P prefix  [dist]
+        //--------------------------------
+        // example:  prog_name -P sm*
+        //           prog_name -P smyth 1
+        if (argc != 3 && argc != 4)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        {
+            int dist = -1;
+
+            if (argc == 4)
+            {
+                char *end;
+                dist = (int)strtol(argv[3], &end, 10);
+                if (*argv[3] == '\0' || *end != '\0' || dist < 0 || dist > TRIEIDX_MAX_DIST)
+                {
+                    printf(M_ERR_PREFIX_DIST, TRIEIDX_MAX_DIST);
+                    exit_code = EXIT_FAIL_ARGS;
+                    break;
+                }
+            }
+            rc = search_db_prefix(fd, argv[2], dist);
+            if (rc <= 0)
+                exit_code = EXIT_FAIL_DB;
+        }
+        break;
+
+    case 'g':
+        //    arv[0] arv[1] arv[2] arv[3]
+        // prog_name     -g  min    max
+        //---------------------------------
+        // example:  prog_name -g 350 400
+        if (argc != 4)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        {
+            int min = atoi(argv[2]);
+            int max = atoi(argv[3]);
+
+            if (min < MIN_STD_GPA || max > MAX_STD_GPA || min > max)
+            {
+                printf(M_ERR_GPA_RNG);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = search_db_gpa(fd, min, max);
+            if (rc <= 0)
+                exit_code = EXIT_FAIL_DB;
+        }
+        break;
+
+    case 'u':
+        //    arv[0] arv[1] arv[2]       arv[3]
+        // prog_name     -u     id  field=value
+        //--------------------------------------
+        // example:  prog_name -u 100 gpa=355
+        if (strcmp(argv[1], "-u") == 0)
+        {
+            if (argc != 4)
+            {
+                usage(argv[0]);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            id = atoll(argv[2]);
+            dbstat_begin(&mark);
+            rc = update_student(fd, id, argv[3]);
+            dbstat_end(DBSTAT_UPDATE, &mark);
+            if (rc == ERR_DB_ARGS)
+                exit_code = EXIT_FAIL_ARGS;
+            else if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+        }
+
+        //    arv[0]  arv[1] arv[2]
+        // prog_name -unpack    src
+        //-------------------------
+        // example:  prog_name -unpack students.pack
+        if (strcmp(argv[1], "-unpack") != 0 || argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = unpack_db(fd, argv[2]);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'A':
+        rc = print_gpa_stats(fd);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'S':
+        //    arv[0] arv[1] arv[2]
+        // prog_name     -S   sock
+        //-------------------------
+        // example:  prog_name -S /tmp/sdb.sock
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        dbio_attach_pool(fd, dbpool_budget());
+        rc = serve_db(fd, argv[2]);
+        print_pool_stats(fd);
         if (rc < 0)
             exit_code = EXIT_FAIL_DB;
         break;
@@ -664,7 +2089,9 @@ int main(int argc, char *argv[])
 
         // remember compress_db returns a fd of the compressed database.
         // we close it after this switch statement
+        dbstat_begin(&mark);
         fd = compress_db(fd);
+        dbstat_end(DBSTAT_COMPRESS, &mark);
         if (fd < 0)
             exit_code = EXIT_FAIL_DB;
         break;
@@ -676,8 +2103,8 @@ int main(int argc, char *argv[])
         // example:  prog_name -x
         // HINT:  close the db file, we already have fd
         //       and reopen db indicating truncate=true
-        close(fd);
-        fd = open_db(DB_FILE, true);
+        close_db(fd);
+        fd = open_db(DB_FILE, true, db_open_flags());
         if (fd < 0)
         {
             exit_code = EXIT_FAIL_DB;
@@ -693,6 +2120,8 @@ int main(int argc, char *argv[])
 
     // dont forget to close the file before exiting, and setting the
     // proper exit code - see the header file for expected values
-    close(fd);
+    close_db(fd);
     exit(exit_code);
-}
\ No newline at end of file
+}
+
+#endif // SDBSC_NO_MAIN
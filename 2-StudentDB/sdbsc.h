@@ -3,15 +3,33 @@
 #include "db.h" //get student record type
 
 // prototypes for functions go below for this assignment
-int open_db(char *dbFile, bool should_truncate);
-int add_student(int fd, int id, char *fname, char *lname, int gpa);
-int get_student(int fd, int id, student_t *s);
-int del_student(int fd, int id);
+int open_db(char *dbFile, bool should_truncate, int flags);
+void close_db(int fd);
+int db_open_flags(void);
+int add_student(int fd, long long id, char *fname, char *lname, int gpa);
+int get_student(int fd, long long id, student_t *s);
+int get_students(int fd, int count, const long long *ids, student_t *out, int *rcs);
+int find_students(int fd, int count, char *ids[]);
+int del_student(int fd, long long id);
+int db_insert(int fd, const student_t *s);
+int db_remove(int fd, long long id);
+int update_student(int fd, long long id, char *field);
+int db_update(int fd, const student_t *s, size_t off, size_t len);
 int compress_db(int fd);
+int snapshot_db(int fd, char *dest);
+int pack_db(int fd, char *dest);
+int unpack_db(int fd, char *src);
+int query_packed(int argc, char *argv[]);
 void print_student(student_t *s);
-int validate_range(int id, int gpa);
+int validate_range(long long id, int gpa);
+int validate_names(const char *fname, const char *lname);
 int count_db_records(int fd);
-int print_db(int fd);
+int print_db(int fd, int mode);
+int search_db_lname(int fd, char *lname);
+int search_db_prefix(int fd, char *pattern, int dist);
+int search_db_gpa(int fd, int min, int max);
+int print_gpa_stats(int fd);
+void print_pool_stats(int fd);
 void usage(char *);
 
 // error codes to be returned from individual functions
@@ -19,10 +37,12 @@ void usage(char *);
 //  ERR_DB_FILE is returned if there is are any issues with the database file itself
 //  ERR_DB_OP is returned if an operation did not work aka add or delete a student
 //  SRCH_NOT_FOUND is returned if the student is not found (get_student, and del_student)
+//  ERR_DB_ARGS is returned by the daemon when a request is out of range
 #define NO_ERROR 0
 #define ERR_DB_FILE -1
 #define ERR_DB_OP -2
 #define SRCH_NOT_FOUND -3
+#define ERR_DB_ARGS -4
 #define NOT_IMPLEMENTED_YET 0
 
 // error codes to be returned to the shell
@@ -37,27 +57,69 @@ void usage(char *);
 
 // Output messages
 #define M_ERR_STD_RNG "Cant add student, either ID or GPA out of allowable range!\n"
+#define M_ERR_STD_NAME "Cant store a first name over %d or a last name over %d characters!\n"
 #define M_ERR_DB_CREATE "Error creating DB file, exiting!\n"
 #define M_ERR_DB_OPEN "Error opening DB file, exiting!\n"
 #define M_ERR_DB_READ "Error reading DB file, exiting!\n"
 #define M_ERR_DB_WRITE "Error writing DB file, exiting!\n"
-#define M_ERR_DB_ADD_DUP "Cant add student with ID=%d, already exists in db.\n"
+#define M_ERR_DB_ADD_DUP "Cant add student with ID=%lld, already exists in db.\n"
 #define M_ERR_STD_PRINT "Cant print student. Student is NULL or ID is zero\n"
 
-#define M_STD_ADDED "Student %d added to database.\n"
-#define M_STD_DEL_MSG "Student %d was deleted from database.\n"
-#define M_STD_NOT_FND_MSG "Student %d was not found in database.\n"
+#define M_STD_ADDED "Student %lld added to database.\n"
+#define M_STD_DEL_MSG "Student %lld was deleted from database.\n"
+#define M_STD_UPDATED "Student %lld was updated in database.\n"
+#define M_STD_NOT_FND_MSG "Student %lld was not found in database.\n"
+#define M_STD_NAME_NOT_FND "No student with last name %s was found in database.\n"
+#define M_STD_PREFIX_NOT_FND "No student with a name matching %s was found in database.\n"
+#define M_STD_GPA_NOT_FND "No student with a GPA between %.2f and %.2f was found in database.\n"
+#define M_ERR_GPA_RNG "Invalid GPA range, expecting 0 <= min <= max <= 500!\n"
+#define M_ERR_UPD_FIELD "Invalid field, expecting fname=name, lname=name or gpa=0..500!\n"
+#define M_ERR_MIGRATE_FNAME "Cant migrate student %d, first name is longer than %d characters.\n"
+#define M_ERR_MIGRATE_ID "Cant migrate the record in slot %lld, id out of range.\n"
+#define M_ERR_MIGRATE_LOSSY "Database not migrated, set %s=1 to cut or drop the records above.\n"
+#define M_MIGRATE_FNAME_CUT "Student %d: first name cut to %d characters while migrating.\n"
+#define M_MIGRATE_ID_DROP "Dropped the record in slot %lld while migrating, id out of range.\n"
+#define M_ERR_PREFIX_DIST "Invalid edit distance, expecting 0 <= dist <= %d!\n"
+#define M_GPA_STATS "Students: %d  min GPA: %.2f  max GPA: %.2f  avg GPA: %.2f\n"
 #define M_DB_COMPRESSED_OK "Database successfully compressed!\n"
+#define M_DB_RECLAIMED "Reclaimed %lld bytes of storage.\n"
+#define M_DB_SNAP_OK "Snapshot of %d student record(s) written to %s.\n"
+#define M_DB_SNAP_CLONED "The snapshot shares its storage with the database.\n"
+#define M_DB_SNAP_COPIED "Copied %lld bytes of live data.\n"
+#define M_ERR_SNAP_SELF "Cant write the snapshot over the database itself!\n"
+#define M_ERR_SNAP_WRITE "Error writing snapshot file, exiting!\n"
+#define M_DB_PACK_OK "Packed %llu student record(s) into %llu bytes (%llu as fixed records).\n"
+#define M_DB_UNPACK_OK "Unpacked %d student record(s), %d already in the database.\n"
+#define M_ERR_PACK_WRITE "Error writing packed file, exiting!\n"
+#define M_ERR_PACK_READ "Error reading packed file, exiting!\n"
 #define M_DB_ZERO_OK "All database records removed!\n"
 #define M_DB_EMPTY "Database contains no student records.\n"
 #define M_DB_RECORD_CNT "Database contains %d student record(s).\n"
 #define M_NOT_IMPL "The requested operation is not implemented yet!\n"
+#define M_ERR_BULK_OPEN "Error opening bulk input file, exiting!\n"
+#define M_ERR_BULK_LINE "Skipping malformed bulk input on line %d.\n"
+#define M_ERR_SRV_SOCK "Error setting up the server socket, exiting!\n"
+#define M_ERR_SRV_CONNECT "Error talking to the sdbsc server, exiting!\n"
+#define M_STATS_OFF "The server runs without instrumentation, start it with -V or %s=1.\n"
+#define M_SRV_LISTEN "Serving student database on %s\n"
+#define M_BULK_DONE "Bulk load: %d operation(s), %d added, %d deleted, %d found, %d failed in %.3f sec (%.0f records/sec).\n"
+#define M_ERR_TXN_LINE "Malformed script input on line %d.\n"
+#define M_ERR_TXN_MAPPED "Cant change student %lld from a script, only ids up to %d can be added or deleted.\n"
+#define M_TXN_ABORTED "Script aborted on line %d, no changes were made.\n"
+#define M_TXN_DONE "Script committed: %d operation(s), %d added, %d deleted, %d found, %d not found.\n"
+#define M_POOL_STATS "Buffer pool: %llu hit(s), %llu miss(es), %llu eviction(s), %llu invalidation(s), %llu page(s) written in %llu write(s).\n"
 
 // useful format strings for print students
 // For example to print the header in the required output:
 //   printf(STUDENT_PRINT_HDR_STRING, "ID","FIRST NAME",
 //                                    "LAST_NAME", "GPA");
+// The name columns stay 24 and 32 wide, the precisions are the longest
+// names a record holds (see db.h).
 #define STUDENT_PRINT_HDR_STRING "%-6s %-24s %-32s %-3s\n"
-#define STUDENT_PRINT_FMT_STRING "%-6d %-24.24s %-32.32s %-3.2f\n"
+#define STUDENT_PRINT_FMT_STRING "%-6lld %-24.21s %-32.31s %-3.2f\n"
+
+// format strings for the gpa histogram printed by -A, one row per band
+#define GPA_HIST_HDR_STRING "%-11s %s\n"
+#define GPA_HIST_FMT_STRING "%.2f-%.2f   %d\n"
 
 #endif
\ No newline at end of file
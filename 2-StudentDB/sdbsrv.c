@@ -0,0 +1,594 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbio.h"
+#include "sdbsrv.h"
+#include "wal.h"
+#include "dbstat.h"
+
+// State of one client connection.  Requests are accumulated in rx until a
+// whole request is available, responses are queued in tx until the socket
+// accepts them.  In WAL mode responses are also held back until the group
+// commit that covers the changes they report (commit_wait).  A client that
+// shuts down its sending side still gets every response (rd_eof), the
+// connection is closed once they are all sent.
+typedef struct conn
+{
+    int sock;
+    char rx[SRV_RX_BUF];
+    size_t rx_len;
+    char *tx;
+    size_t tx_len;
+    size_t tx_off;
+    size_t tx_cap;
+    bool want_out; // EPOLLOUT is armed because tx could not be drained
+    bool commit_wait;
+    bool rd_eof;   // the client sends nothing more, close when tx is sent
+    struct conn *next_wait;
+} conn_t;
+
+static volatile sig_atomic_t srv_stop = 0;
+
+// connections with commit_wait set
+static conn_t *commit_waiters = NULL;
+
+static void srv_on_signal(int sig)
+{
+    (void)sig;
+    srv_stop = 1;
+}
+
+static int set_nonblock(int sock)
+{
+    int fl = fcntl(sock, F_GETFL, 0);
+    if (fl == -1)
+        return -1;
+    return fcntl(sock, F_SETFL, fl | O_NONBLOCK);
+}
+
+static int tx_append(conn_t *c, const void *data, size_t len)
+{
+    if (c->tx_len + len > c->tx_cap)
+    {
+        size_t cap = c->tx_cap ? c->tx_cap : SRV_RX_BUF;
+        while (cap < c->tx_len + len)
+            cap *= 2;
+        char *tx = realloc(c->tx, cap);
+        if (tx == NULL)
+            return -1;
+        c->tx = tx;
+        c->tx_cap = cap;
+    }
+    memcpy(c->tx + c->tx_len, data, len);
+    c->tx_len += len;
+    return 0;
+}
+
+static int tx_resp(conn_t *c, int32_t status, uint32_t count)
+{
+    sdb_resp_t resp = {status, count};
+    return tx_append(c, &resp, sizeof(resp));
+}
+
+// dbio_scan() callback used by SDB_OP_PRINT.  Records are appended behind
+// a response header that is patched once the scan is done.
+typedef struct scan_out
+{
+    conn_t *c;
+    uint32_t count;
+} scan_out_t;
+
+static int scan_collect(const student_t *s, void *arg)
+{
+    scan_out_t *out = arg;
+
+    out->count++;
+    if (tx_append(out->c, s, sizeof(*s)) != 0)
+        return ERR_DB_FILE;
+    return 0;
+}
+
+/*
+ *  run_request
+ *      fd:    database file descriptor
+ *      *c:    connection the request arrived on
+ *      *req:  request header
+ *      *rec:  student record for SDB_OP_ADD, NULL otherwise
+ *
+ *  Runs one request against the database and queues the response.  All of
+ *  the work is done by the same console free functions the command line
+ *  uses, so the daemon and the CLI can never disagree on semantics.
+ *
+ *  returns:  0 on success, -1 if the connection should be dropped
+ */
+static int run_request(int fd, conn_t *c, const sdb_req_t *req, const student_t *rec)
+{
+    char line[4096];
+    student_t s;
+    int rc;
+
+    switch (req->op)
+    {
+    case SDB_OP_ADD:
+        if (validate_range(rec->id, rec->gpa) != NO_ERROR)
+            return tx_resp(c, ERR_DB_ARGS, 0);
+        return tx_resp(c, db_insert(fd, rec), 0);
+
+    case SDB_OP_GET:
+        rc = get_student(fd, req->id, &s);
+        if (rc != NO_ERROR)
+            return tx_resp(c, rc, 0);
+        if (tx_resp(c, NO_ERROR, 1) != 0)
+            return -1;
+        return tx_append(c, &s, sizeof(s));
+
+    case SDB_OP_DEL:
+        return tx_resp(c, db_remove(fd, req->id), 0);
+
+    case SDB_OP_COUNT:
+        rc = dbio_count(fd);
+        if (rc < 0)
+            return tx_resp(c, ERR_DB_FILE, 0);
+        return tx_resp(c, NO_ERROR, rc);
+
+    case SDB_OP_PRINT:
+    {
+        size_t hdr_at = c->tx_len;
+        scan_out_t out = {c, 0};
+
+        if (tx_resp(c, NO_ERROR, 0) != 0)
+            return -1;
+        rc = dbio_scan(fd, scan_collect, &out);
+        if (rc != NO_ERROR)
+        {
+            c->tx_len = hdr_at;
+            return tx_resp(c, ERR_DB_FILE, 0);
+        }
+        sdb_resp_t resp = {NO_ERROR, out.count};
+        memcpy(c->tx + hdr_at, &resp, sizeof(resp));
+        return 0;
+    }
+
+    case SDB_OP_STATS:
+        if (!dbstat_enabled() || (rc = dbstat_json(line, sizeof(line))) < 0)
+            return tx_resp(c, ERR_DB_OP, 0);
+        if (tx_resp(c, NO_ERROR, rc) != 0)
+            return -1;
+        return tx_append(c, line, rc);
+
+    default:
+        return -1;
+    }
+}
+
+/*
+ *  handle_request
+ *      fd:    database file descriptor
+ *      *c:    connection the request arrived on
+ *      *req:  request header
+ *      *rec:  student record for SDB_OP_ADD, NULL otherwise
+ *
+ *  run_request() with the instrumentation of dbstat.h, every request adds
+ *  to the totals of the function the command line would have called for
+ *  it.  Sending the response is not part of what is measured.
+ *
+ *  returns:  0 on success, -1 if the connection should be dropped
+ */
+static int handle_request(int fd, conn_t *c, const sdb_req_t *req, const student_t *rec)
+{
+    dbstat_mark_t mark;
+    int op;
+
+    switch (req->op)
+    {
+    case SDB_OP_ADD:
+        op = DBSTAT_ADD;
+        break;
+    case SDB_OP_GET:
+        op = DBSTAT_GET;
+        break;
+    case SDB_OP_DEL:
+        op = DBSTAT_DEL;
+        break;
+    case SDB_OP_COUNT:
+        op = DBSTAT_COUNT;
+        break;
+    case SDB_OP_PRINT:
+        op = DBSTAT_PRINT;
+        break;
+    default:
+        return run_request(fd, c, req, rec);
+    }
+
+    dbstat_begin(&mark);
+    int rc = run_request(fd, c, req, rec);
+    dbstat_end(op, &mark);
+    return rc;
+}
+
+/*
+ *  conn_flush
+ *      *c:  connection with queued responses
+ *
+ *  Writes as much of the queued output as the socket takes.
+ *
+ *  returns:  1 everything was sent, 0 output still pending, -1 error
+ */
+static int conn_flush(conn_t *c)
+{
+    while (c->tx_off < c->tx_len)
+    {
+        ssize_t n = send(c->sock, c->tx + c->tx_off, c->tx_len - c->tx_off, MSG_NOSIGNAL);
+        if (n == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        c->tx_off += n;
+    }
+    c->tx_off = c->tx_len = 0;
+    return 1;
+}
+
+/*
+ *  conn_process
+ *      fd:  database file descriptor
+ *      *c:  connection with received data
+ *
+ *  Runs every complete request in the receive buffer and tries to send the
+ *  responses.  Whatever the socket does not take right away stays queued
+ *  and want_out is set.  While this process has unsynced log records the
+ *  responses wait for commit_group() instead.
+ *
+ *  returns:  0 keep the connection, -1 close it
+ */
+static int conn_process(int fd, conn_t *c)
+{
+    size_t off = 0;
+
+    while (c->rx_len - off >= sizeof(sdb_req_t))
+    {
+        sdb_req_t req;
+        student_t add;
+        const student_t *rec = NULL;
+        size_t need = sizeof(req);
+
+        memcpy(&req, c->rx + off, sizeof(req));
+        if (req.op == SDB_OP_ADD)
+        {
+            need += sizeof(student_t);
+            if (c->rx_len - off < need)
+                break;
+            memcpy(&add, c->rx + off + sizeof(req), sizeof(add));
+            add.fname[sizeof(add.fname) - 1] = '\0';
+            add.lname[sizeof(add.lname) - 1] = '\0';
+            rec = &add;
+        }
+
+        if (handle_request(fd, c, &req, rec) != 0)
+            return -1;
+        off += need;
+    }
+    memmove(c->rx, c->rx + off, c->rx_len - off);
+    c->rx_len -= off;
+
+    // nothing may be acknowledged before the log is on disk
+    if (wal_pending(fd))
+    {
+        if (!c->commit_wait)
+        {
+            c->commit_wait = true;
+            c->next_wait = commit_waiters;
+            commit_waiters = c;
+        }
+        return 0;
+    }
+
+    int sent = conn_flush(c);
+    if (sent < 0)
+        return -1;
+    c->want_out = (sent == 0);
+    return 0;
+}
+
+/*
+ *  conn_read
+ *      fd:  database file descriptor
+ *      *c:  readable connection
+ *
+ *  Drains the socket and runs the requests it delivered.  Reading stops
+ *  while responses are backed up so a client that does not read its
+ *  answers cannot make the daemon buffer without limit.  End of file only
+ *  sets rd_eof, the responses still queued or waiting for the group commit
+ *  are sent before the connection is closed (see conn_done()).
+ *
+ *  returns:  0 keep the connection, -1 close it
+ */
+static int conn_read(int fd, conn_t *c)
+{
+    while (!c->want_out && !c->rd_eof)
+    {
+        ssize_t n = recv(c->sock, c->rx + c->rx_len, sizeof(c->rx) - c->rx_len, 0);
+        if (n == 0)
+        {
+            c->rd_eof = true;
+            break;
+        }
+        if (n == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        c->rx_len += n;
+
+        if (conn_process(fd, c) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+// true once a client that shut down its sending side has every response
+static bool conn_done(const conn_t *c)
+{
+    return c->rd_eof && !c->want_out && !c->commit_wait;
+}
+
+// events to wait for: the socket taking output, more requests, or only
+// errors while a finished client waits for the group commit
+static uint32_t conn_events(const conn_t *c)
+{
+    if (c->want_out)
+        return EPOLLOUT;
+    return c->rd_eof ? 0 : EPOLLIN | EPOLLRDHUP;
+}
+
+static void conn_close(int ep, conn_t *c)
+{
+    for (conn_t **p = &commit_waiters; c->commit_wait && *p != NULL; p = &(*p)->next_wait)
+        if (*p == c)
+        {
+            *p = c->next_wait;
+            break;
+        }
+    epoll_ctl(ep, EPOLL_CTL_DEL, c->sock, NULL);
+    close(c->sock);
+    free(c->tx);
+    free(c);
+}
+
+/*
+ *  commit_group
+ *      fd:  database file descriptor
+ *      ep:  epoll instance
+ *
+ *  Syncs the write-ahead log once for every change made since the last
+ *  commit and releases the responses that waited for it.  If the log could
+ *  not be synced the waiting clients are disconnected, their changes are
+ *  not acknowledged.
+ */
+static void commit_group(int fd, int ep)
+{
+    struct epoll_event ev;
+    int rc = wal_sync(fd);
+
+    while (commit_waiters != NULL)
+    {
+        conn_t *c = commit_waiters;
+
+        commit_waiters = c->next_wait;
+        c->commit_wait = false;
+
+        int sent = rc == NO_ERROR ? conn_flush(c) : -1;
+        if (sent < 0 || (sent == 1 && conn_done(c)))
+        {
+            conn_close(ep, c);
+            continue;
+        }
+        if (sent == 0 && !c->want_out)
+        {
+            c->want_out = true;
+            ev.events = EPOLLOUT;
+            ev.data.ptr = c;
+            epoll_ctl(ep, EPOLL_CTL_MOD, c->sock, &ev);
+        }
+    }
+
+    // keep the log short under steady load, idle time is not guaranteed
+    if (wal_log_bytes(fd) >= WAL_CHECKPOINT_BYTES)
+        wal_checkpoint(fd);
+}
+
+/*
+ *  serve_db
+ *      fd:          database file descriptor, stays open for the lifetime
+ *                   of the daemon
+ *      sock_path:   path of the unix domain socket to listen on
+ *
+ *  Runs the sdbsc daemon.  A single epoll event loop multiplexes the
+ *  listening socket and every client connection, all sockets are non
+ *  blocking.  Requests are served straight from the already open (and
+ *  typically already cached or mapped) database, so a lookup costs a
+ *  round trip on the socket instead of a process start and an open().
+ *  SIGINT or SIGTERM stop the daemon and remove the socket.
+ *
+ *  In WAL mode the changes of all connections are committed together: a
+ *  group is synced once the batch is full or the latency budget of its
+ *  oldest change is used up (see wal_commit_due()), and the log is
+ *  checkpointed whenever the daemon has been idle for a while.
+ *
+ *  returns:  NO_ERROR on a clean shutdown, ERR_DB_FILE if the socket could
+ *            not be set up
+ *
+ *  console:  M_SRV_LISTEN once the socket is ready, M_ERR_SRV_SOCK on error
+ */
+int serve_db(int fd, char *sock_path)
+{
+    struct sockaddr_un addr = {0};
+    struct epoll_event ev, events[SRV_MAX_EVENTS];
+    struct sigaction sa = {0};
+    int lsock, ep;
+
+    if (strlen(sock_path) >= sizeof(addr.sun_path))
+    {
+        printf(M_ERR_SRV_SOCK);
+        return ERR_DB_FILE;
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sock_path);
+
+    lsock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lsock == -1)
+    {
+        printf(M_ERR_SRV_SOCK);
+        return ERR_DB_FILE;
+    }
+    unlink(sock_path);
+    if (bind(lsock, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(lsock, SRV_LISTEN_BACKLOG) == -1 || set_nonblock(lsock) == -1)
+    {
+        printf(M_ERR_SRV_SOCK);
+        close(lsock);
+        return ERR_DB_FILE;
+    }
+
+    ep = epoll_create1(0);
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; // NULL marks the listening socket
+    if (ep == -1 || epoll_ctl(ep, EPOLL_CTL_ADD, lsock, &ev) == -1)
+    {
+        printf(M_ERR_SRV_SOCK);
+        close(lsock);
+        unlink(sock_path);
+        return ERR_DB_FILE;
+    }
+
+    sa.sa_handler = srv_on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf(M_SRV_LISTEN, sock_path);
+    fflush(stdout);
+    wal_defer(fd, true);
+
+    while (!srv_stop)
+    {
+        int timeout = -1;
+
+        if (commit_waiters != NULL)
+        {
+            long due = wal_commit_due(fd);
+            timeout = due <= 0 ? 0 : (int)((due + 999) / 1000);
+        }
+        else if (wal_log_bytes(fd) > 0)
+            timeout = SRV_CHECKPOINT_IDLE_MS;
+
+        int n = epoll_wait(ep, events, SRV_MAX_EVENTS, timeout);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (n == 0 && commit_waiters == NULL && wal_log_bytes(fd) > 0)
+            wal_checkpoint(fd);
+
+        for (int i = 0; i < n; i++)
+        {
+            conn_t *c = events[i].data.ptr;
+
+            if (c == NULL)
+            {
+                int sock;
+                while ((sock = accept(lsock, NULL, NULL)) != -1)
+                {
+                    c = calloc(1, sizeof(conn_t));
+                    if (c == NULL || set_nonblock(sock) == -1)
+                    {
+                        free(c);
+                        close(sock);
+                        continue;
+                    }
+                    c->sock = sock;
+                    ev.events = EPOLLIN | EPOLLRDHUP;
+                    ev.data.ptr = c;
+                    if (epoll_ctl(ep, EPOLL_CTL_ADD, sock, &ev) == -1)
+                    {
+                        close(sock);
+                        free(c);
+                    }
+                }
+                continue;
+            }
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                conn_close(ep, c);
+                continue;
+            }
+
+            if ((events[i].events & EPOLLOUT) && c->want_out)
+            {
+                int sent = conn_flush(c);
+                if (sent < 0)
+                {
+                    conn_close(ep, c);
+                    continue;
+                }
+                // requests that were parked behind the backlog run now
+                if ((sent == 1 && conn_process(fd, c) != 0) || conn_done(c))
+                {
+                    conn_close(ep, c);
+                    continue;
+                }
+                if (!c->want_out)
+                {
+                    ev.events = conn_events(c);
+                    ev.data.ptr = c;
+                    epoll_ctl(ep, EPOLL_CTL_MOD, c->sock, &ev);
+                }
+            }
+
+            if (!c->want_out && !c->rd_eof && (events[i].events & (EPOLLIN | EPOLLRDHUP)))
+            {
+                if (conn_read(fd, c) != 0 || conn_done(c))
+                {
+                    conn_close(ep, c);
+                    continue;
+                }
+                if (c->want_out || c->rd_eof)
+                {
+                    ev.events = conn_events(c);
+                    ev.data.ptr = c;
+                    epoll_ctl(ep, EPOLL_CTL_MOD, c->sock, &ev);
+                }
+            }
+        }
+
+        if (commit_waiters != NULL && wal_commit_due(fd) <= 0)
+            commit_group(fd, ep);
+    }
+
+    close(ep);
+    close(lsock);
+    unlink(sock_path);
+    return NO_ERROR;
+}
@@ -0,0 +1,60 @@
+#ifndef __SDBSRV_H__
+#define __SDBSRV_H__
+
+#include <stdint.h>
+
+#include "db.h" //get student record type
+
+// Wire protocol between the sdbsc daemon (-S) and the thin client (-C).
+//
+// Every request starts with a fixed 16 byte header.  SDB_OP_ADD is followed
+// by the 64 byte student record to store, all other requests are just the
+// header.  Requests may be pipelined on one connection, responses come back
+// in request order.
+//
+// Every response starts with a fixed 8 byte header.  status carries the
+// same codes the local functions return (NO_ERROR, ERR_DB_OP, ...).  For
+// SDB_OP_COUNT count is the number of records in the database, for
+// SDB_OP_GET and SDB_OP_PRINT count is the number of 64 byte student
+// records that follow the header.  For SDB_OP_STATS count is the length of
+// the JSON line that follows (see dbstat.h, no newline), the status is
+// ERR_DB_OP if the daemon runs without instrumentation.
+//
+// All integers are in host byte order, the socket is local only.
+#define SDB_OP_ADD 'a'
+#define SDB_OP_COUNT 'c'
+#define SDB_OP_DEL 'd'
+#define SDB_OP_GET 'f'
+#define SDB_OP_PRINT 'p'
+#define SDB_OP_STATS 'V'
+
+typedef struct sdb_req
+{
+    uint8_t op;          // SDB_OP_*
+    uint8_t reserved[7]; // must be zero
+    int64_t id;          // student id for add, get and del
+} sdb_req_t;
+
+typedef struct sdb_resp
+{
+    int32_t status; // NO_ERROR or one of the error codes from sdbsc.h
+    uint32_t count; // record count, see above
+} sdb_resp_t;
+
+// Size of the per connection receive buffer, holds many pipelined requests
+#define SRV_RX_BUF 4096
+
+// Max events handled per epoll_wait() call
+#define SRV_MAX_EVENTS 64
+
+// Backlog of pending connections on the listening socket
+#define SRV_LISTEN_BACKLOG 128
+
+// With the write-ahead log on, the daemon checkpoints it after this many
+// milliseconds without requests
+#define SRV_CHECKPOINT_IDLE_MS 1000
+
+int serve_db(int fd, char *sock_path);
+int client_main(char *sock_path, int argc, char *argv[]);
+
+#endif
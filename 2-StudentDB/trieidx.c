@@ -0,0 +1,621 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbio.h"
+#include "trieidx.h"
+
+// longest name of either field
+#define NAME_MAX_LEN sizeof(((student_t *)0)->lname)
+
+typedef union trie_cell
+{
+    trieidx_node_t node;
+    trieidx_post_t post;
+} trie_cell_t;
+
+// the index of one database fd
+typedef struct trie
+{
+    int xfd;
+    trieidx_hdr_t *hdr;  // shared mapping of the index file
+    trie_cell_t *cells;  // the cells, behind the header
+    uint32_t mapped;     // cells the mapping covers
+} trie_t;
+
+// matching ids handed back by a search
+typedef struct id_list
+{
+    long long *ids;
+    int n;
+    int cap;
+} id_list_t;
+
+static trie_t *trieidx_table[DBIO_MAX_FD];
+
+static trie_t *trie_of(int fd)
+{
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return NULL;
+    return trieidx_table[fd];
+}
+
+#define NODE(t, i) ((t)->cells[i].node)
+#define POST(t, i) ((t)->cells[i].post)
+
+static size_t file_len(uint32_t cap)
+{
+    return TRIEIDX_CELLS_OFFSET + (size_t)cap * sizeof(trie_cell_t);
+}
+
+// lower case copy of a name field that is not necessarily terminated
+static size_t fold(const char *name, size_t len, char *out)
+{
+    size_t n = 0;
+
+    while (n < len && n < NAME_MAX_LEN && name[n] != '\0')
+    {
+        out[n] = tolower((unsigned char)name[n]);
+        n++;
+    }
+    return n;
+}
+
+static void unmap(trie_t *t)
+{
+    if (t->hdr != NULL)
+        munmap(t->hdr, file_len(t->mapped));
+    t->hdr = NULL;
+    t->cells = NULL;
+    t->mapped = 0;
+}
+
+static int map_cells(trie_t *t, uint32_t cap)
+{
+    unmap(t);
+    void *map = mmap(NULL, file_len(cap), PROT_READ | PROT_WRITE, MAP_SHARED, t->xfd, 0);
+    if (map == MAP_FAILED)
+        return ERR_DB_FILE;
+    t->hdr = map;
+    t->cells = (trie_cell_t *)((char *)map + TRIEIDX_CELLS_OFFSET);
+    t->mapped = cap;
+    return NO_ERROR;
+}
+
+// maps the file again if another process grew it, the caller holds the
+// flock()
+static int refresh(trie_t *t)
+{
+    uint32_t cap = __atomic_load_n(&t->hdr->cap, __ATOMIC_ACQUIRE);
+
+    if (cap == t->mapped)
+        return NO_ERROR;
+    return map_cells(t, cap);
+}
+
+/*
+ *  alloc_cell
+ *      *t:    the index, flock()ed exclusively
+ *      post:  the cell is a posting block, those are recycled
+ *
+ *  Hands out a zeroed cell, doubling the file when it is full.  The
+ *  mapping may move, so cells are only ever referred to by number.
+ *
+ *  returns:  the cell, 0 if the file could not grow
+ */
+static uint32_t alloc_cell(trie_t *t, bool post)
+{
+    trieidx_hdr_t *hdr = t->hdr;
+    uint32_t i;
+
+    if (post && hdr->free != 0)
+    {
+        i = hdr->free;
+        hdr->free = POST(t, i).next;
+    }
+    else
+    {
+        if (hdr->used == hdr->cap)
+        {
+            uint32_t cap = hdr->cap * 2;
+            if (ftruncate(t->xfd, file_len(cap)) == -1)
+                return 0;
+            __atomic_store_n(&hdr->cap, cap, __ATOMIC_RELEASE);
+            if (map_cells(t, cap) != NO_ERROR)
+                return 0;
+            hdr = t->hdr;
+        }
+        i = hdr->used++;
+    }
+    memset(&t->cells[i], 0, sizeof(trie_cell_t));
+    return i;
+}
+
+// the child of node for character c, 0 if there is none.  *prev is set to
+// the sibling it would follow
+static uint32_t find_child(trie_t *t, uint32_t node, char c, uint32_t *prev)
+{
+    uint32_t cur = NODE(t, node).child;
+
+    *prev = 0;
+    while (cur != 0 && NODE(t, cur).ch < (uint8_t)c)
+    {
+        *prev = cur;
+        cur = NODE(t, cur).sibling;
+    }
+    return (cur != 0 && NODE(t, cur).ch == (uint8_t)c) ? cur : 0;
+}
+
+/*
+ *  add_name
+ *      *t:     the index, flock()ed exclusively
+ *      field:  TRIEIDX_LNAME or TRIEIDX_FNAME
+ *      name:   the name field of the student
+ *      len:    size of the field
+ *      id:     the student
+ *
+ *  Walks down the name, adding the nodes that are missing, and puts id on
+ *  the postings of the last one.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int add_name(trie_t *t, int field, const char *name, size_t len, long long id)
+{
+    char key[NAME_MAX_LEN];
+    size_t n = fold(name, len, key);
+    uint32_t node = t->hdr->root[field];
+
+    for (size_t k = 0; k < n; k++)
+    {
+        uint32_t prev;
+        uint32_t next = find_child(t, node, key[k], &prev);
+
+        if (next == 0)
+        {
+            if ((next = alloc_cell(t, false)) == 0)
+                return ERR_DB_FILE;
+            NODE(t, next).ch = (uint8_t)key[k];
+            if (prev != 0)
+            {
+                NODE(t, next).sibling = NODE(t, prev).sibling;
+                NODE(t, prev).sibling = next;
+            }
+            else
+            {
+                NODE(t, next).sibling = NODE(t, node).child;
+                NODE(t, node).child = next;
+            }
+        }
+        node = next;
+    }
+
+    uint32_t head = NODE(t, node).post;
+    if (head == 0 || POST(t, head).count == TRIEIDX_POST_IDS)
+    {
+        uint32_t block = alloc_cell(t, true);
+        if (block == 0)
+            return ERR_DB_FILE;
+        POST(t, block).next = head;
+        NODE(t, node).post = head = block;
+    }
+    POST(t, head).ids[POST(t, head).count++] = id;
+    return NO_ERROR;
+}
+
+/*
+ *  drop_name
+ *      *t:     the index, flock()ed exclusively
+ *      field:  TRIEIDX_LNAME or TRIEIDX_FNAME
+ *      name:   the name field of the student
+ *      len:    size of the field
+ *      id:     the student
+ *
+ *  Takes id off the postings of the name.  The last id of the first block
+ *  fills the hole, a first block that runs empty goes to the free list.
+ */
+static void drop_name(trie_t *t, int field, const char *name, size_t len, long long id)
+{
+    char key[NAME_MAX_LEN];
+    size_t n = fold(name, len, key);
+    uint32_t node = t->hdr->root[field];
+    uint32_t prev;
+
+    for (size_t k = 0; k < n && node != 0; k++)
+        node = find_child(t, node, key[k], &prev);
+    if (node == 0)
+        return;
+
+    uint32_t head = NODE(t, node).post;
+    for (uint32_t b = head; b != 0; b = POST(t, b).next)
+        for (uint32_t i = 0; i < POST(t, b).count; i++)
+        {
+            if (POST(t, b).ids[i] != id)
+                continue;
+            POST(t, b).ids[i] = POST(t, head).ids[--POST(t, head).count];
+            if (POST(t, head).count == 0)
+            {
+                NODE(t, node).post = POST(t, head).next;
+                POST(t, head).next = t->hdr->free;
+                t->hdr->free = head;
+            }
+            return;
+        }
+}
+
+static int add_id(id_list_t *out, long long id)
+{
+    if (out->n == out->cap)
+    {
+        int cap = out->cap ? out->cap * 2 : 16;
+        long long *ids = realloc(out->ids, cap * sizeof(long long));
+        if (ids == NULL)
+            return ERR_DB_FILE;
+        out->ids = ids;
+        out->cap = cap;
+    }
+    out->ids[out->n++] = id;
+    return NO_ERROR;
+}
+
+// adds the postings of one node
+static int collect_node(trie_t *t, uint32_t node, id_list_t *out)
+{
+    for (uint32_t b = NODE(t, node).post; b != 0; b = POST(t, b).next)
+        for (uint32_t i = 0; i < POST(t, b).count; i++)
+            if (add_id(out, POST(t, b).ids[i]) != NO_ERROR)
+                return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+// adds the postings of node and of everything below it
+static int collect_below(trie_t *t, uint32_t node, id_list_t *out)
+{
+    if (collect_node(t, node, out) != NO_ERROR)
+        return ERR_DB_FILE;
+    for (uint32_t c = NODE(t, node).child; c != 0; c = NODE(t, c).sibling)
+        if (collect_below(t, c, out) != NO_ERROR)
+            return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+/*
+ *  fuzzy_walk
+ *      *t:    the index, flock()ed
+ *      node:  node whose children are visited
+ *      pat:   the name searched for, folded
+ *      plen:  its length
+ *      prev:  row of the Levenshtein table for the path down to node
+ *      dist:  largest edit distance that matches
+ *      *out:  receives the ids of matching names
+ *
+ *  Computes the row of every child from the row of its parent.  Names
+ *  ending at a child match if the last entry is within dist, the walk goes
+ *  on below the child as long as any entry is.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int fuzzy_walk(trie_t *t, uint32_t node, const char *pat, int plen, const int *prev,
+                      int dist, id_list_t *out)
+{
+    int row[NAME_MAX_LEN + 1];
+
+    for (uint32_t c = NODE(t, node).child; c != 0; c = NODE(t, c).sibling)
+    {
+        int best = row[0] = prev[0] + 1;
+
+        for (int j = 1; j <= plen; j++)
+        {
+            int cost = prev[j - 1] + (pat[j - 1] != (char)NODE(t, c).ch);
+            int v = prev[j] + 1 < row[j - 1] + 1 ? prev[j] + 1 : row[j - 1] + 1;
+            row[j] = cost < v ? cost : v;
+            if (row[j] < best)
+                best = row[j];
+        }
+        if (row[plen] <= dist && collect_node(t, c, out) != NO_ERROR)
+            return ERR_DB_FILE;
+        if (best <= dist && fuzzy_walk(t, c, pat, plen, row, dist, out) != NO_ERROR)
+            return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+static int cmp_id(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// sorts the ids and drops the students that matched with both names
+static int finish(id_list_t *out, long long **ids)
+{
+    int uniq = 0;
+
+    qsort(out->ids, out->n, sizeof(long long), cmp_id);
+    for (int i = 0; i < out->n; i++)
+        if (uniq == 0 || out->ids[uniq - 1] != out->ids[i])
+            out->ids[uniq++] = out->ids[i];
+    *ids = out->ids;
+    return uniq;
+}
+
+// dbio_scan() callback of rebuild()
+static int index_student(const student_t *s, void *arg)
+{
+    trie_t *t = arg;
+
+    if (add_name(t, TRIEIDX_LNAME, s->lname, sizeof(s->lname), s->id) != NO_ERROR ||
+        add_name(t, TRIEIDX_FNAME, s->fname, sizeof(s->fname), s->id) != NO_ERROR)
+        return ERR_DB_FILE;
+    t->hdr->entries++;
+    return 0;
+}
+
+/*
+ *  rebuild
+ *      fd:  database file descriptor
+ *      *t:  the index, its file flock()ed exclusively by the caller
+ *
+ *  Formats an empty trie with its two roots and indexes every student with
+ *  one scan of the database.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int rebuild(int fd, trie_t *t)
+{
+    trieidx_hdr_t hdr = {0};
+
+    unmap(t);
+    memcpy(hdr.magic, TRIEIDX_MAGIC, sizeof(hdr.magic));
+    hdr.version = TRIEIDX_VERSION;
+    hdr.cap = TRIEIDX_MIN_CELLS;
+    hdr.used = 3;
+    hdr.root[TRIEIDX_LNAME] = 1;
+    hdr.root[TRIEIDX_FNAME] = 2;
+    hdr.entries = 0;
+
+    if (ftruncate(t->xfd, 0) == -1 || ftruncate(t->xfd, file_len(hdr.cap)) == -1 ||
+        pwrite(t->xfd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || map_cells(t, hdr.cap) != NO_ERROR)
+        return ERR_DB_FILE;
+    if (dbio_scan(fd, index_student, t) != NO_ERROR)
+    {
+        // leave a count that can not match, the next open tries again
+        t->hdr->entries = -1;
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  trieidx_open
+ *      fd:               database file descriptor
+ *      dbFile:           path of the database, the index is dbFile followed
+ *                        by TRIEIDX_SUFFIX
+ *      should_truncate:  the database was just emptied
+ *
+ *  Maps the index of the database.  If the index is missing, was written
+ *  by another version, or does not count as many students as the database
+ *  header (for example after a crash between the two writes) it is rebuilt
+ *  from the records.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int trieidx_open(int fd, char *dbFile, bool should_truncate)
+{
+    char path[4096];
+    trieidx_hdr_t hdr;
+    struct stat st;
+    int rc = NO_ERROR;
+
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return ERR_DB_FILE;
+
+    trieidx_close(fd);
+    trie_t *t = calloc(1, sizeof(trie_t));
+    if (t == NULL)
+        return ERR_DB_FILE;
+
+    snprintf(path, sizeof(path), "%s%s", dbFile, TRIEIDX_SUFFIX);
+    t->xfd = open(path, O_RDWR | O_CREAT | (should_truncate ? O_TRUNC : 0),
+                  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (t->xfd == -1)
+    {
+        free(t);
+        return ERR_DB_FILE;
+    }
+
+    if (flock(t->xfd, LOCK_EX) == -1)
+        rc = ERR_DB_FILE;
+    else if (pread(t->xfd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || fstat(t->xfd, &st) == -1 ||
+             memcmp(hdr.magic, TRIEIDX_MAGIC, sizeof(hdr.magic)) != 0 ||
+             hdr.version != TRIEIDX_VERSION || hdr.cap < TRIEIDX_MIN_CELLS ||
+             hdr.used > hdr.cap || (size_t)st.st_size < file_len(hdr.cap) ||
+             hdr.entries != dbio_count(fd))
+        rc = rebuild(fd, t);
+    else
+        rc = map_cells(t, hdr.cap);
+    flock(t->xfd, LOCK_UN);
+
+    if (rc != NO_ERROR)
+    {
+        unmap(t);
+        close(t->xfd);
+        free(t);
+        return rc;
+    }
+    trieidx_table[fd] = t;
+    return NO_ERROR;
+}
+
+void trieidx_close(int fd)
+{
+    trie_t *t = trie_of(fd);
+
+    if (t == NULL)
+        return;
+    unmap(t);
+    close(t->xfd);
+    free(t);
+    trieidx_table[fd] = NULL;
+}
+
+/*
+ *  trieidx_insert
+ *      fd:  database file descriptor
+ *      *s:  student that was just added
+ *
+ *  Indexes both names under an exclusive flock() of the index file.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int trieidx_insert(int fd, const student_t *s)
+{
+    trie_t *t = trie_of(fd);
+    int rc;
+
+    if (t == NULL)
+        return NO_ERROR;
+    if (flock(t->xfd, LOCK_EX) == -1)
+        return ERR_DB_FILE;
+
+    if ((rc = refresh(t)) == NO_ERROR &&
+        (rc = add_name(t, TRIEIDX_LNAME, s->lname, sizeof(s->lname), s->id)) == NO_ERROR &&
+        (rc = add_name(t, TRIEIDX_FNAME, s->fname, sizeof(s->fname), s->id)) == NO_ERROR)
+        t->hdr->entries++;
+    flock(t->xfd, LOCK_UN);
+    return rc;
+}
+
+/*
+ *  trieidx_remove
+ *      fd:  database file descriptor
+ *      *s:  record of the student that was just deleted
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int trieidx_remove(int fd, const student_t *s)
+{
+    trie_t *t = trie_of(fd);
+    int rc;
+
+    if (t == NULL)
+        return NO_ERROR;
+    if (flock(t->xfd, LOCK_EX) == -1)
+        return ERR_DB_FILE;
+
+    if ((rc = refresh(t)) == NO_ERROR)
+    {
+        drop_name(t, TRIEIDX_LNAME, s->lname, sizeof(s->lname), s->id);
+        drop_name(t, TRIEIDX_FNAME, s->fname, sizeof(s->fname), s->id);
+        t->hdr->entries--;
+    }
+    flock(t->xfd, LOCK_UN);
+    return rc;
+}
+
+/*
+ *  trieidx_prefix
+ *      fd:      database file descriptor
+ *      prefix:  start of a first or last name, case is ignored
+ *      **ids:   set to a malloc()ed array of matching ids, the caller frees
+ *               it
+ *
+ *  Walks down the prefix under both roots and collects every posting
+ *  below, the work is proportional to the length of the prefix and the
+ *  names that match.
+ *
+ *  returns:  number of matching students (ids in ascending order), or
+ *            ERR_DB_FILE
+ */
+int trieidx_prefix(int fd, const char *prefix, long long **ids)
+{
+    trie_t *t = trie_of(fd);
+    id_list_t out = {0};
+    char key[NAME_MAX_LEN];
+    size_t len = strlen(prefix);
+    int rc = NO_ERROR;
+
+    *ids = NULL;
+    if (t == NULL || flock(t->xfd, LOCK_SH) == -1)
+        return ERR_DB_FILE;
+
+    // a prefix longer than any name can not match
+    size_t n = fold(prefix, len, key);
+    if (len <= NAME_MAX_LEN && (rc = refresh(t)) == NO_ERROR)
+        for (int field = TRIEIDX_LNAME; field <= TRIEIDX_FNAME && rc == NO_ERROR; field++)
+        {
+            uint32_t node = t->hdr->root[field];
+            uint32_t prev;
+
+            for (size_t k = 0; k < n && node != 0; k++)
+                node = find_child(t, node, key[k], &prev);
+            if (node != 0)
+                rc = collect_below(t, node, &out);
+        }
+    flock(t->xfd, LOCK_UN);
+
+    if (rc != NO_ERROR)
+    {
+        free(out.ids);
+        return rc;
+    }
+    return finish(&out, ids);
+}
+
+/*
+ *  trieidx_fuzzy
+ *      fd:     database file descriptor
+ *      name:   first or last name to look for, case is ignored
+ *      dist:   largest edit distance (insertions, deletions and
+ *              substitutions) that still matches, at most TRIEIDX_MAX_DIST
+ *      **ids:  set to a malloc()ed array of matching ids, the caller frees
+ *              it
+ *
+ *  returns:  number of matching students (ids in ascending order), or
+ *            ERR_DB_FILE
+ */
+int trieidx_fuzzy(int fd, const char *name, int dist, long long **ids)
+{
+    trie_t *t = trie_of(fd);
+    id_list_t out = {0};
+    char key[NAME_MAX_LEN];
+    int row[NAME_MAX_LEN + 1];
+    size_t len = strlen(name);
+    int rc = NO_ERROR;
+
+    *ids = NULL;
+    if (t == NULL || dist < 0 || dist > TRIEIDX_MAX_DIST || flock(t->xfd, LOCK_SH) == -1)
+        return ERR_DB_FILE;
+
+    // a name too long for the fields is too far from any of them
+    int plen = fold(name, len, key);
+    for (int j = 0; j <= plen; j++)
+        row[j] = j;
+    if (len <= NAME_MAX_LEN && (rc = refresh(t)) == NO_ERROR)
+        for (int field = TRIEIDX_LNAME; field <= TRIEIDX_FNAME && rc == NO_ERROR; field++)
+        {
+            uint32_t root = t->hdr->root[field];
+
+            if (plen <= dist)
+                rc = collect_node(t, root, &out);
+            if (rc == NO_ERROR)
+                rc = fuzzy_walk(t, root, key, plen, row, dist, &out);
+        }
+    flock(t->xfd, LOCK_UN);
+
+    if (rc != NO_ERROR)
+    {
+        free(out.ids);
+        return rc;
+    }
+    return finish(&out, ids);
+}
@@ -0,0 +1,81 @@
+#ifndef __TRIEIDX_H__
+#define __TRIEIDX_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "db.h" //get student record type
+
+// Persistent prefix index on the first and the last name of a student,
+// kept next to the database (DB_FILE followed by TRIEIDX_SUFFIX).  It
+// answers -P: names starting with a prefix, or names within a small edit
+// distance of a given name.  Names are indexed in lower case, so searches
+// ignore case.
+//
+// The file is a trie.  The first TRIEIDX_CELLS_OFFSET bytes are the
+// trieidx_hdr_t, then an array of 32 byte cells that every process maps
+// shared.  A cell is either a node or a block of postings, cell 0 is never
+// used so 0 can mean "none":
+//  - a node has one character, its first child and its next sibling
+//    (siblings are kept sorted by character) and the postings of the
+//    students whose name ends at this node
+//  - a posting block holds up to TRIEIDX_POST_IDS ids and links to the
+//    next block of the same node
+// The two names have separate roots.  A prefix search walks down the
+// prefix and then collects the postings below it, so it visits only nodes
+// that lead to a match.  An edit distance search walks the trie with one
+// row of the Levenshtein table per node and leaves a branch as soon as
+// every entry of the row is above the limit.
+//
+// Nodes are never removed, emptied posting blocks go to a free list.  The
+// file grows by doubling; a process that finds the header asking for more
+// cells than it mapped maps the file again.
+#define TRIEIDX_SUFFIX ".name.trie"
+#define TRIEIDX_MAGIC "SDBTRI\0"
+#define TRIEIDX_VERSION 1
+#define TRIEIDX_CELLS_OFFSET 4096
+#define TRIEIDX_MIN_CELLS 4096
+#define TRIEIDX_POST_IDS 3
+
+// largest edit distance -P accepts
+#define TRIEIDX_MAX_DIST 3
+
+// roots of the two names
+#define TRIEIDX_LNAME 0
+#define TRIEIDX_FNAME 1
+
+typedef struct trieidx_hdr
+{
+    char magic[8];     // TRIEIDX_MAGIC
+    uint32_t version;  // TRIEIDX_VERSION
+    uint32_t cap;      // cells the file has room for
+    uint32_t used;     // cells handed out, the next one is at used
+    uint32_t free;     // first posting block on the free list
+    uint32_t root[2];  // root nodes, see TRIEIDX_LNAME and TRIEIDX_FNAME
+    int32_t entries;   // number of indexed students
+} trieidx_hdr_t;
+
+typedef struct trieidx_node
+{
+    uint32_t child;    // first child, 0 for none
+    uint32_t sibling;  // next sibling with a higher character
+    uint32_t post;     // first posting block, 0 for none
+    uint8_t ch;        // character of the edge into this node
+    uint8_t pad[19];
+} trieidx_node_t;
+
+typedef struct trieidx_post
+{
+    uint32_t next;     // next block of the same node, or of the free list
+    uint32_t count;    // ids in use
+    int64_t ids[TRIEIDX_POST_IDS];
+} trieidx_post_t;
+
+int trieidx_open(int fd, char *dbFile, bool should_truncate);
+void trieidx_close(int fd);
+int trieidx_insert(int fd, const student_t *s);
+int trieidx_remove(int fd, const student_t *s);
+int trieidx_prefix(int fd, const char *prefix, long long **ids);
+int trieidx_fuzzy(int fd, const char *name, int dist, long long **ids);
+
+#endif
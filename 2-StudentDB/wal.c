@@ -0,0 +1,752 @@
+#define _GNU_SOURCE // F_OFD_SETLK and F_OFD_SETLKW
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+#include "dbio.h"
+#include "dbmap.h"
+#include "wal.h"
+
+// Bytes of the log file used as OFD locks (the locks do not touch the data)
+//  WAL_LOCK_APPEND  exclusive while a record is appended
+//  WAL_LOCK_SYNC    held by the group commit leader during fdatasync()
+//  WAL_LOCK_APPLY   shared by writers from logging a change until the page
+//                   is written, exclusive for checkpoints
+//  WAL_LOCK_USERS   shared by every process that has the log open, whoever
+//                   gets it exclusively is alone and may recover the log
+#define WAL_LOCK_APPEND 0
+#define WAL_LOCK_SYNC 1
+#define WAL_LOCK_APPLY 2
+#define WAL_LOCK_USERS 3
+
+// Log state of one database descriptor, hdr is NULL while the log is off
+typedef struct wal_ctx
+{
+    int xfd;
+    wal_hdr_t *hdr;
+    int batch;         // WAL_BATCH_ENV
+    long delay_us;     // WAL_DELAY_ENV
+    bool defer;        // wal_log() leaves the sync to the caller
+    bool inside;       // between wal_begin() and wal_end()
+    uint32_t txn;      // transaction records are logged under, 0 for none
+    uint64_t my_end;   // end of the last record this process appended
+    uint32_t my_epoch; // epoch of that record
+    struct timespec first_pending; // when the oldest unsynced record was logged
+} wal_ctx_t;
+
+static wal_ctx_t wal_table[DBIO_MAX_FD];
+
+static wal_ctx_t *wal_ctx(int fd)
+{
+    if (fd < 0 || fd >= DBIO_MAX_FD || wal_table[fd].hdr == NULL)
+        return NULL;
+    return &wal_table[fd];
+}
+
+static int lock_byte(int xfd, off_t byte, short type, bool wait)
+{
+    struct flock fl = {0};
+
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = byte;
+    fl.l_len = 1;
+    while (fcntl(xfd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &fl) == -1)
+        if (errno != EINTR || !wait)
+            return -1;
+    return 0;
+}
+
+static void unlock_byte(int xfd, off_t byte)
+{
+    lock_byte(xfd, byte, F_UNLCK, false);
+}
+
+static long env_long(const char *name, long dflt, long min)
+{
+    char *v = getenv(name);
+
+    if (v == NULL || *v == '\0')
+        return dflt;
+    long n = atol(v);
+    return n >= min ? n : dflt;
+}
+
+static long elapsed_us(const struct timespec *since)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000000L + (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+// FNV-1a over the record up to the checksum itself
+static uint32_t rec_check(const wal_rec_t *r)
+{
+    const uint8_t *p = (const uint8_t *)r;
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < offsetof(wal_rec_t, check); i++)
+    {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+ *  hdr_init
+ *      xfd:  log file, the caller is alone (WAL_LOCK_USERS exclusive)
+ *
+ *  Formats a new or unusable log as an empty log.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int hdr_init(int xfd)
+{
+    wal_hdr_t hdr = {0};
+
+    memcpy(hdr.magic, WAL_MAGIC, sizeof(hdr.magic));
+    hdr.version = WAL_VERSION;
+    hdr.epoch = 1;
+    hdr.tail = hdr.synced = WAL_HDR_SIZE;
+
+    if (ftruncate(xfd, 0) == -1 || ftruncate(xfd, WAL_HDR_SIZE) == -1 ||
+        pwrite(xfd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || fdatasync(xfd) == -1)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+/*
+ *  reset_log
+ *      ctx:  log state, the caller holds every lock exclusively or is alone
+ *
+ *  Empties the log.  The new epoch reaches the disk before the log is cut
+ *  back, so records that survive a lost truncate can never be replayed.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int reset_log(wal_ctx_t *ctx)
+{
+    wal_hdr_t *hdr = ctx->hdr;
+
+    hdr->epoch++;
+    __atomic_store_n(&hdr->tail, WAL_HDR_SIZE, __ATOMIC_RELEASE);
+    __atomic_store_n(&hdr->synced, WAL_HDR_SIZE, __ATOMIC_RELEASE);
+    __atomic_store_n(&hdr->appended, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&hdr->synced_recs, 0, __ATOMIC_RELEASE);
+
+    if (msync(hdr, WAL_HDR_SIZE, MS_SYNC) == -1 || ftruncate(ctx->xfd, WAL_HDR_SIZE) == -1)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+// true if the record at off is a good record of the current epoch
+static bool rec_valid(const wal_hdr_t *hdr, const wal_rec_t *r, off_t off)
+{
+    if (r->lsn != (uint64_t)off || r->epoch != hdr->epoch || r->check != rec_check(r))
+        return false;
+    if (r->op == WAL_OP_COMMIT)
+        return r->txn != 0;
+    return r->slot >= MIN_STD_ID && (r->slot <= MAX_STD_ID || r->slot >= DBMAP_FIRST_SLOT);
+}
+
+static int cmp_txn(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ *  committed_txns
+ *      ctx:    log state, the caller is alone
+ *      *end:   set to the end of the last good record
+ *      *ntxns: set to the number of committed transactions
+ *
+ *  First pass of replay(): finds where the good records end and which
+ *  transactions got their commit record in before that.
+ *
+ *  returns:  the committed transaction ids sorted (NULL for none), or NULL
+ *            with *ntxns set to -1 if out of memory
+ */
+static uint32_t *committed_txns(wal_ctx_t *ctx, off_t *end, int *ntxns)
+{
+    uint32_t *txns = NULL;
+    int cap = 0;
+    off_t off = WAL_HDR_SIZE;
+    wal_rec_t r;
+
+    *ntxns = 0;
+    while (pread(ctx->xfd, &r, sizeof(r), off) == sizeof(r) && rec_valid(ctx->hdr, &r, off))
+    {
+        if (r.op == WAL_OP_COMMIT)
+        {
+            if (*ntxns == cap)
+            {
+                cap = cap ? cap * 2 : 16;
+                uint32_t *more = realloc(txns, sizeof(uint32_t) * cap);
+                if (more == NULL)
+                {
+                    free(txns);
+                    *ntxns = -1;
+                    return NULL;
+                }
+                txns = more;
+            }
+            txns[(*ntxns)++] = r.txn;
+        }
+        off += sizeof(r);
+    }
+    if (*ntxns > 0)
+        qsort(txns, *ntxns, sizeof(uint32_t), cmp_txn);
+    *end = off;
+    return txns;
+}
+
+/*
+ *  replay
+ *      fd:   database file descriptor
+ *      ctx:  log state, the caller is alone
+ *
+ *  Re-applies every good record of the current epoch to the database, in
+ *  log order, except the records of transactions that never committed
+ *  (their pages were never written either).  Slots that already hold the
+ *  logged image are left alone, so replaying a log whose changes all made
+ *  it to the database writes nothing.  The log is cut back behind the last
+ *  good record.
+ *
+ *  returns:  number of slots that had to be repaired, or ERR_DB_FILE
+ */
+static int replay(int fd, wal_ctx_t *ctx)
+{
+    wal_hdr_t *hdr = ctx->hdr;
+    off_t off = WAL_HDR_SIZE;
+    off_t end;
+    student_t cur;
+    wal_rec_t r;
+    int changed = 0;
+    int ntxns;
+    bool recount = false;
+
+    uint32_t *txns = committed_txns(ctx, &end, &ntxns);
+    if (ntxns < 0)
+        return ERR_DB_FILE;
+
+    for (; off < end; off += sizeof(r))
+    {
+        if (pread(ctx->xfd, &r, sizeof(r), off) != sizeof(r))
+        {
+            free(txns);
+            return ERR_DB_FILE;
+        }
+        if (r.op == WAL_OP_COMMIT ||
+            (r.txn != 0 && bsearch(&r.txn, txns, ntxns, sizeof(uint32_t), cmp_txn) == NULL))
+            continue;
+
+        int slot = r.slot;
+        bool add = (r.op == WAL_OP_ADD);
+        bool mapped = slot > MAX_STD_ID;
+        const student_t *img = add ? &r.rec : &EMPTY_STUDENT_RECORD;
+        bool live = mapped ? add : dbio_live(fd, slot);
+
+        if (dbio_read_range(fd, slot, 1, &cur) != NO_ERROR)
+        {
+            free(txns);
+            return ERR_DB_FILE;
+        }
+        if (live != add || memcmp(&cur, img, STUDENT_RECORD_SIZE) != 0)
+        {
+            if (dbio_write(fd, slot, img) != NO_ERROR)
+            {
+                free(txns);
+                return ERR_DB_FILE;
+            }
+            if (mapped)
+                recount = true;
+            else if (add && !live)
+                dbio_claim(fd, slot);
+            else if (!add && live)
+                dbio_release(fd, slot);
+            changed++;
+        }
+    }
+    free(txns);
+
+    // the id map has no bitmap to tell how many of its records were live
+    if (recount && dbio_recount(fd) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    // anything behind the last good record is a torn write
+    hdr->tail = hdr->synced = off;
+    hdr->appended = hdr->synced_recs = (off - WAL_HDR_SIZE) / sizeof(r);
+    hdr->writers = 0;
+    if (ftruncate(ctx->xfd, off) == -1)
+        return ERR_DB_FILE;
+    return changed;
+}
+
+// syncs the database and empties the log, every lock is held or we are alone
+static int checkpoint_locked(int fd, wal_ctx_t *ctx)
+{
+    if (dbio_sync(fd) != NO_ERROR)
+        return ERR_DB_FILE;
+    return reset_log(ctx);
+}
+
+/*
+ *  wal_open
+ *      fd:               database file descriptor, already attached
+ *      dbFile:           path of the database, the log is dbFile followed
+ *                        by WAL_SUFFIX
+ *      should_truncate:  the database was just emptied, so is the log
+ *      flags:            DB_OPEN_* flags, DB_OPEN_WAL turns the log on
+ *
+ *  The first process to open the log (nobody else holds WAL_LOCK_USERS)
+ *  replays it, this repairs whatever a crashed process did not get to
+ *  write.  A log left behind is also replayed when the database is opened
+ *  without DB_OPEN_WAL, then the log is checkpointed and removed.  While
+ *  other processes use the log, a process opened without DB_OPEN_WAL joins
+ *  it as well: a change it wrote straight to the file could otherwise be
+ *  overwritten by an older logged image when the log is replayed.
+ *
+ *  returns:  number of slots repaired by the replay (0 normally), or
+ *            ERR_DB_FILE
+ */
+int wal_open(int fd, char *dbFile, bool should_truncate, int flags)
+{
+    bool enabled = flags & DB_OPEN_WAL;
+    char path[4096];
+    wal_hdr_t hdr;
+    int changed = 0;
+
+    if (fd < 0 || fd >= DBIO_MAX_FD)
+        return ERR_DB_FILE;
+
+    snprintf(path, sizeof(path), "%s%s", dbFile, WAL_SUFFIX);
+    int xfd = open(path, O_RDWR | (enabled ? O_CREAT : 0), S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (xfd == -1)
+        return (!enabled && errno == ENOENT) ? NO_ERROR : ERR_DB_FILE;
+
+    bool alone = lock_byte(xfd, WAL_LOCK_USERS, F_WRLCK, false) == 0;
+    if (!alone)
+        enabled = true;
+    if (!alone && lock_byte(xfd, WAL_LOCK_USERS, F_RDLCK, true) == -1)
+    {
+        close(xfd);
+        return ERR_DB_FILE;
+    }
+
+    if (alone && (pread(xfd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+                  memcmp(hdr.magic, WAL_MAGIC, sizeof(hdr.magic)) != 0 ||
+                  hdr.version != WAL_VERSION) &&
+        hdr_init(xfd) != NO_ERROR)
+    {
+        close(xfd);
+        return ERR_DB_FILE;
+    }
+
+    void *map = mmap(NULL, WAL_HDR_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, xfd, 0);
+    if (map == MAP_FAILED)
+    {
+        close(xfd);
+        return ERR_DB_FILE;
+    }
+
+    wal_ctx_t *ctx = &wal_table[fd];
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->xfd = xfd;
+    ctx->hdr = map;
+    ctx->batch = env_long(WAL_BATCH_ENV, WAL_DEFAULT_BATCH, 1);
+    ctx->delay_us = env_long(WAL_DELAY_ENV, WAL_DEFAULT_DELAY_US, 0);
+
+    int rc = NO_ERROR;
+    if (alone)
+    {
+        if (should_truncate)
+            rc = reset_log(ctx);
+        else if ((changed = replay(fd, ctx)) < 0)
+            rc = ERR_DB_FILE;
+
+        if (rc == NO_ERROR && !enabled)
+        {
+            rc = checkpoint_locked(fd, ctx);
+            if (rc == NO_ERROR)
+                unlink(path);
+            wal_close(fd);
+            return rc == NO_ERROR ? changed : rc;
+        }
+        if (rc == NO_ERROR)
+            lock_byte(xfd, WAL_LOCK_USERS, F_RDLCK, false);
+    }
+    else if (should_truncate)
+    {
+        lock_byte(xfd, WAL_LOCK_APPLY, F_WRLCK, true);
+        lock_byte(xfd, WAL_LOCK_SYNC, F_WRLCK, true);
+        lock_byte(xfd, WAL_LOCK_APPEND, F_WRLCK, true);
+        rc = reset_log(ctx);
+        unlock_byte(xfd, WAL_LOCK_APPEND);
+        unlock_byte(xfd, WAL_LOCK_SYNC);
+        unlock_byte(xfd, WAL_LOCK_APPLY);
+    }
+
+    if (rc != NO_ERROR)
+    {
+        wal_close(fd);
+        return rc;
+    }
+    return changed;
+}
+
+/*
+ *  wal_close
+ *      fd:  database file descriptor
+ *
+ *  The last process to close the log checkpoints it once it has grown past
+ *  WAL_CHECKPOINT_BYTES, smaller logs are left for the next replay.
+ */
+void wal_close(int fd)
+{
+    wal_ctx_t *ctx = wal_ctx(fd);
+
+    if (ctx == NULL)
+        return;
+
+    wal_end(fd);
+    if (lock_byte(ctx->xfd, WAL_LOCK_USERS, F_WRLCK, false) == 0 &&
+        ctx->hdr->tail - WAL_HDR_SIZE >= WAL_CHECKPOINT_BYTES)
+        checkpoint_locked(fd, ctx);
+
+    munmap(ctx->hdr, WAL_HDR_SIZE);
+    close(ctx->xfd);
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+bool wal_enabled(int fd)
+{
+    return wal_ctx(fd) != NULL;
+}
+
+/*
+ *  wal_defer
+ *      fd:     database file descriptor
+ *      defer:  true if the caller batches its own syncs
+ *
+ *  With defer set wal_log() only appends, the caller commits a whole group
+ *  of changes with one wal_sync() (bulk loads and the daemon do this).
+ */
+void wal_defer(int fd, bool defer)
+{
+    wal_ctx_t *ctx = wal_ctx(fd);
+
+    if (ctx != NULL)
+        ctx->defer = defer;
+}
+
+/*
+ *  wal_begin
+ *      fd:  database file descriptor
+ *
+ *  Starts a change: from logging it until its page is written a change must
+ *  not be cut off by a checkpoint.  Does nothing while the log is off.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int wal_begin(int fd)
+{
+    wal_ctx_t *ctx = wal_ctx(fd);
+
+    if (ctx == NULL || ctx->inside)
+        return NO_ERROR;
+    if (lock_byte(ctx->xfd, WAL_LOCK_APPLY, F_RDLCK, true) == -1)
+        return ERR_DB_FILE;
+    __atomic_add_fetch(&ctx->hdr->writers, 1, __ATOMIC_ACQ_REL);
+    ctx->inside = true;
+    return NO_ERROR;
+}
+
+void wal_end(int fd)
+{
+    wal_ctx_t *ctx = wal_ctx(fd);
+
+    if (ctx == NULL || !ctx->inside)
+        return;
+    __atomic_sub_fetch(&ctx->hdr->writers, 1, __ATOMIC_ACQ_REL);
+    unlock_byte(ctx->xfd, WAL_LOCK_APPLY);
+    ctx->inside = false;
+}
+
+// appends r behind the last record, fills in its lsn, epoch and checksum
+static int append(int fd, wal_rec_t *r)
+{
+    wal_ctx_t *ctx = wal_ctx(fd);
+    int rc = NO_ERROR;
+
+    if (lock_byte(ctx->xfd, WAL_LOCK_APPEND, F_WRLCK, true) == -1)
+        return ERR_DB_FILE;
+
+    bool was_pending = wal_pending(fd);
+    uint64_t off = __atomic_load_n(&ctx->hdr->tail, __ATOMIC_ACQUIRE);
+    r->lsn = off;
+    r->epoch = ctx->hdr->epoch;
+    r->check = rec_check(r);
+
+    if (pwrite(ctx->xfd, r, sizeof(*r), off) != sizeof(*r))
+        rc = ERR_DB_FILE;
+    else
+    {
+        __atomic_store_n(&ctx->hdr->tail, off + sizeof(*r), __ATOMIC_RELEASE);
+        __atomic_add_fetch(&ctx->hdr->appended, 1, __ATOMIC_ACQ_REL);
+        ctx->my_end = off + sizeof(*r);
+        ctx->my_epoch = r->epoch;
+        if (!was_pending)
+            clock_gettime(CLOCK_MONOTONIC, &ctx->first_pending);
+    }
+    unlock_byte(ctx->xfd, WAL_LOCK_APPEND);
+    return rc;
+}
+
+/*
+ *  wal_log
+ *      fd:    database file descriptor
+ *      op:    WAL_OP_ADD or WAL_OP_DEL
+ *      slot:  slot the change goes to, see wal_rec_t
+ *      *rec:  the new record for an add, only rec->id is used for a delete
+ *
+ *  Appends one record to the log and, unless syncing is deferred or a
+ *  transaction is open, waits for the group commit that covers it.  Does
+ *  nothing while the log is off.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int wal_log(int fd, int op, int slot, const student_t *rec)
+{
+    wal_ctx_t *ctx = wal_ctx(fd);
+    wal_rec_t r = {0};
+
+    if (ctx == NULL)
+        return NO_ERROR;
+
+    r.op = op;
+    r.slot = slot;
+    r.txn = ctx->txn;
+    if (op == WAL_OP_ADD)
+        r.rec = *rec;
+    else
+        r.rec.id = rec->id;
+
+    int rc = append(fd, &r);
+    if (rc != NO_ERROR || ctx->defer || ctx->txn != 0)
+        return rc;
+    return wal_sync(fd);
+}
+
+/*
+ *  wal_txn_begin
+ *      fd:  database file descriptor, between wal_begin() and wal_end()
+ *
+ *  Hands out a new transaction id, every record logged until
+ *  wal_txn_commit() or wal_txn_abort() belongs to it and is only replayed
+ *  if the transaction committed.  The pages of those records must not be
+ *  written before the commit.  Does nothing while the log is off.
+ *
+ *  returns:  NO_ERROR
+ */
+int wal_txn_begin(int fd)
+{
+    wal_ctx_t *ctx = wal_ctx(fd);
+
+    if (ctx == NULL)
+        return NO_ERROR;
+    do
+        ctx->txn = __atomic_add_fetch(&ctx->hdr->txns, 1, __ATOMIC_ACQ_REL);
+    while (ctx->txn == 0);
+    return NO_ERROR;
+}
+
+/*
+ *  wal_txn_commit
+ *      fd:  database file descriptor
+ *
+ *  Appends the commit record of the open transaction and waits until it
+ *  is on disk (deferred syncing does not apply), from then on the
+ *  transaction survives a crash.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int wal_txn_commit(int fd)
+{
+    wal_ctx_t *ctx = wal_ctx(fd);
+    wal_rec_t r = {0};
+
+    if (ctx == NULL || ctx->txn == 0)
+        return NO_ERROR;
+
+    r.op = WAL_OP_COMMIT;
+    r.txn = ctx->txn;
+    ctx->txn = 0;
+    if (append(fd, &r) != NO_ERROR)
+        return ERR_DB_FILE;
+    return wal_sync(fd);
+}
+
+// drops the open transaction, its records stay in the log but are never
+// replayed
+void wal_txn_abort(int fd)
+{
+    wal_ctx_t *ctx = wal_ctx(fd);
+
+    if (ctx != NULL)
+        ctx->txn = 0;
+}
+
+/*
+ *  wal_pending
+ *      fd:  database file descriptor
+ *
+ *  returns:  true if this process logged records that are not on disk yet
+ */
+bool wal_pending(int fd)
+{
+    wal_ctx_t *ctx = wal_ctx(fd);
+
+    if (ctx == NULL || ctx->my_epoch != __atomic_load_n(&ctx->hdr->epoch, __ATOMIC_ACQUIRE))
+        return false;
+    return ctx->my_end > __atomic_load_n(&ctx->hdr->synced, __ATOMIC_ACQUIRE);
+}
+
+/*
+ *  wal_commit_due
+ *      fd:  database file descriptor
+ *
+ *  Tells a caller that defers its syncs when to commit the group: when the
+ *  batch is full or the latency budget of its oldest pending record is
+ *  used up.
+ *
+ *  returns:  -1 nothing pending, 0 commit now, otherwise the microseconds
+ *            left in the latency budget
+ */
+long wal_commit_due(int fd)
+{
+    wal_ctx_t *ctx = wal_ctx(fd);
+
+    if (!wal_pending(fd))
+        return -1;
+
+    uint64_t backlog = __atomic_load_n(&ctx->hdr->appended, __ATOMIC_ACQUIRE) -
+                       __atomic_load_n(&ctx->hdr->synced_recs, __ATOMIC_ACQUIRE);
+    long left = ctx->delay_us - elapsed_us(&ctx->first_pending);
+
+    if (backlog >= (uint64_t)ctx->batch || left <= 0)
+        return 0;
+    return left;
+}
+
+/*
+ *  wal_sync
+ *      fd:  database file descriptor
+ *
+ *  Group commit, see wal.h.  Returns as soon as every record this process
+ *  appended is on disk.  The leader keeps the sync open for up to the
+ *  latency budget while other processes are in the middle of a change and
+ *  the batch is not full yet.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int wal_sync(int fd)
+{
+    wal_ctx_t *ctx = wal_ctx(fd);
+    int rc = NO_ERROR;
+
+    if (!wal_pending(fd))
+        return NO_ERROR;
+    if (lock_byte(ctx->xfd, WAL_LOCK_SYNC, F_WRLCK, true) == -1)
+        return ERR_DB_FILE;
+
+    // the previous leader may have covered our records while we waited
+    if (wal_pending(fd))
+    {
+        wal_hdr_t *hdr = ctx->hdr;
+        struct timespec start;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (;;)
+        {
+            int others = __atomic_load_n(&hdr->writers, __ATOMIC_ACQUIRE) - (ctx->inside ? 1 : 0);
+            uint64_t backlog = __atomic_load_n(&hdr->appended, __ATOMIC_ACQUIRE) -
+                               __atomic_load_n(&hdr->synced_recs, __ATOMIC_ACQUIRE);
+
+            if (others <= 0 || backlog >= (uint64_t)ctx->batch ||
+                elapsed_us(&start) >= ctx->delay_us)
+                break;
+            usleep(50);
+        }
+
+        uint64_t end = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+        uint64_t recs = __atomic_load_n(&hdr->appended, __ATOMIC_ACQUIRE);
+
+        if (fdatasync(ctx->xfd) == -1)
+            rc = ERR_DB_FILE;
+        else
+        {
+            __atomic_store_n(&hdr->synced_recs, recs, __ATOMIC_RELEASE);
+            __atomic_store_n(&hdr->synced, end, __ATOMIC_RELEASE);
+        }
+    }
+    unlock_byte(ctx->xfd, WAL_LOCK_SYNC);
+    return rc;
+}
+
+/*
+ *  wal_log_bytes
+ *      fd:  database file descriptor
+ *
+ *  returns:  bytes of records in the log, the amount a checkpoint removes
+ */
+uint64_t wal_log_bytes(int fd)
+{
+    wal_ctx_t *ctx = wal_ctx(fd);
+
+    if (ctx == NULL)
+        return 0;
+    return __atomic_load_n(&ctx->hdr->tail, __ATOMIC_ACQUIRE) - WAL_HDR_SIZE;
+}
+
+/*
+ *  wal_checkpoint
+ *      fd:  database file descriptor, not between wal_begin() and wal_end()
+ *
+ *  Waits for changes in flight, syncs the database and empties the log.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int wal_checkpoint(int fd)
+{
+    wal_ctx_t *ctx = wal_ctx(fd);
+    int rc;
+
+    if (ctx == NULL || ctx->inside)
+        return NO_ERROR;
+
+    if (lock_byte(ctx->xfd, WAL_LOCK_APPLY, F_WRLCK, true) == -1)
+        return ERR_DB_FILE;
+    lock_byte(ctx->xfd, WAL_LOCK_SYNC, F_WRLCK, true);
+    lock_byte(ctx->xfd, WAL_LOCK_APPEND, F_WRLCK, true);
+
+    rc = checkpoint_locked(fd, ctx);
+
+    unlock_byte(ctx->xfd, WAL_LOCK_APPEND);
+    unlock_byte(ctx->xfd, WAL_LOCK_SYNC);
+    unlock_byte(ctx->xfd, WAL_LOCK_APPLY);
+    return rc;
+}
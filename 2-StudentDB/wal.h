@@ -0,0 +1,109 @@
+#ifndef __WAL_H__
+#define __WAL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "db.h" //get student record type
+
+// Optional write-ahead log (DB_OPEN_WAL), kept next to the database (DB_FILE
+// followed by WAL_SUFFIX).
+//
+// Every add and delete appends a record with the full new image of the
+// slot to the log and waits until the log is on disk before the change is
+// acknowledged.  The database pages themselves are written without any
+// sync, a crash is repaired by replaying the log (redo only, replaying a
+// record twice is harmless).
+//
+// Group commit: appending is cheap, the expensive part is fdatasync().  The
+// first writer that needs its record synced becomes the leader, waits up to
+// the latency budget (WAL_DELAY_ENV) for other writers to join as long as
+// fewer than WAL_BATCH_ENV records are pending, and then syncs everything
+// appended so far with a single fdatasync().  Writers whose records were
+// covered return without syncing.  This works across processes, the state
+// lives in the shared mapping of the log header and the roles are handed
+// out with OFD byte range locks on the log file.
+//
+// Transactions: a script run with -T (see bulk.h) logs all its changes
+// under one transaction id and then appends a WAL_OP_COMMIT record for
+// that id.  Its pages are only written after the commit is on disk, and
+// replay skips every record of a transaction without a commit record, so
+// after a crash either all changes of the script are there or none.
+// Records of plain adds and deletes carry transaction 0 and are always
+// replayed.
+//
+// Checkpoint: the database is synced and the log is emptied.  The last
+// process to close the database does it once the log grows past
+// WAL_CHECKPOINT_BYTES, the daemon also does it whenever it is idle.
+//
+//     offset 0             wal_hdr_t (shared mapping, WAL_HDR_SIZE bytes)
+//     offset WAL_HDR_SIZE  wal_rec_t, wal_rec_t, ...
+#define WAL_SUFFIX ".wal"
+#define WAL_MAGIC "SDBWAL\0"
+#define WAL_VERSION 3
+#define WAL_HDR_SIZE 4096
+
+// Environment variables read by db_open_flags() and wal_open(), for example:
+//   SDB_WAL=1 SDB_WAL_BATCH=64 SDB_WAL_DELAY_US=1000 ./sdbsc -a 1 john doe 345
+#define WAL_ENV "SDB_WAL"
+#define WAL_BATCH_ENV "SDB_WAL_BATCH"
+#define WAL_DELAY_ENV "SDB_WAL_DELAY_US"
+#define WAL_DEFAULT_BATCH 32
+#define WAL_DEFAULT_DELAY_US 2000
+
+#define WAL_CHECKPOINT_BYTES (256 * 1024)
+
+// Record types
+#define WAL_OP_ADD 'a'
+#define WAL_OP_DEL 'd'
+#define WAL_OP_COMMIT 'c'
+
+typedef struct wal_hdr
+{
+    char magic[8];        // WAL_MAGIC
+    uint32_t version;     // WAL_VERSION
+    uint32_t epoch;       // bumped by every checkpoint, see wal_rec_t
+    uint64_t tail;        // end of the last complete record
+    uint64_t synced;      // every record before this offset is on disk
+    uint64_t appended;    // records appended since the last checkpoint
+    uint64_t synced_recs; // records covered by the last fdatasync()
+    int32_t writers;      // processes between wal_begin() and wal_end()
+    uint32_t txns;        // last transaction id handed out
+} wal_hdr_t;
+
+// One log record.  A record is only replayed when its lsn matches its file
+// offset, its epoch matches the header and the checksum is good, which
+// rejects torn writes as well as leftovers from before a checkpoint.
+//
+// slot is the slot the change went to, the id itself for ids up to
+// MAX_STD_ID.  Slots of the id map (see dbmap.h) are replayed as plain
+// images, this also covers the bucket headers and the records a bucket
+// split moved.  A commit record only carries its txn.
+typedef struct wal_rec
+{
+    uint64_t lsn;   // file offset of this record
+    uint32_t epoch; // wal_hdr_t.epoch when the record was appended
+    uint32_t op;    // WAL_OP_ADD or WAL_OP_DEL
+    student_t rec;  // new contents of the slot for an add
+    uint32_t slot;  // slot the change went to
+    uint32_t txn;   // transaction of the change, 0 for none
+    uint32_t check; // FNV-1a of everything above
+} wal_rec_t;
+
+int wal_open(int fd, char *dbFile, bool should_truncate, int flags);
+void wal_close(int fd);
+bool wal_enabled(int fd);
+void wal_defer(int fd, bool defer);
+int wal_begin(int fd);
+void wal_end(int fd);
+int wal_log(int fd, int op, int slot, const student_t *rec);
+int wal_sync(int fd);
+int wal_txn_begin(int fd);
+int wal_txn_commit(int fd);
+void wal_txn_abort(int fd);
+bool wal_pending(int fd);
+long wal_commit_due(int fd);
+uint64_t wal_log_bytes(int fd);
+int wal_checkpoint(int fd);
+
+#endif